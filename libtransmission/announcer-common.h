@@ -9,8 +9,13 @@
 #error only the libtransmission announcer module should #include this header.
 #endif
 
+#include <algorithm>
 #include <array>
 #include <cstddef> // size_t
+#include <ctime> // time_t
+#include <functional> // std::greater
+#include <iterator>
+#include <queue>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -232,6 +237,109 @@ void tr_tracker_udp_announce(
 
 void tr_tracker_udp_start_shutdown(tr_session* session);
 
+/***
+****  SCHEDULING
+***/
+
+/**
+ * A min-heap of tracker tiers' announce or scrape times, so that upkeep
+ * only has to look at the tiers that are due. Changing a tier's time
+ * pushes a new entry instead of moving the old one, so entries can be
+ * stale and are checked against the tier when they come due.
+ * Due tiers wait in `ready` until they're served or have nothing to do.
+ */
+struct tr_tier_queue
+{
+    // Identifies a tier without pointing to it, since the
+    // tier may be gone by the time its deadline comes up.
+    struct Key
+    {
+        int tor_id;
+        int tier_id;
+
+        [[nodiscard]] bool operator<(Key const& that) const
+        {
+            return tor_id != that.tor_id ? tor_id < that.tor_id : tier_id < that.tier_id;
+        }
+
+        [[nodiscard]] bool operator==(Key const& that) const
+        {
+            return tor_id == that.tor_id && tier_id == that.tier_id;
+        }
+    };
+
+    struct Deadline
+    {
+        time_t at;
+        Key key;
+
+        [[nodiscard]] bool operator>(Deadline const& that) const
+        {
+            return at > that.at;
+        }
+    };
+
+    void schedule(time_t at, Key key)
+    {
+        deadlines.push({ at, key });
+    }
+
+    // Collect the tiers that `needs` to run now, and forget the ones
+    // that `find` can't find or that `is_due` says have nothing due.
+    // Tiers that are due but busy, or that don't get a slot this time,
+    // stay in the queue for next time.
+    template<typename Find, typename IsDue, typename Needs>
+    auto takeReady(time_t now, Find find, IsDue is_due, Needs needs)
+    {
+        popDue(now);
+
+        auto ret = std::vector<decltype(find(Key{}))>{};
+        auto const end = std::remove_if(
+            std::begin(ready),
+            std::end(ready),
+            [&](auto const& key)
+            {
+                auto* const tier = find(key);
+                if (tier == nullptr || !is_due(tier))
+                {
+                    return true;
+                }
+
+                if (needs(tier))
+                {
+                    ret.push_back(tier);
+                }
+
+                return false;
+            });
+        ready.erase(end, std::end(ready));
+
+        return ret;
+    }
+
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> deadlines;
+    std::vector<Key> ready;
+
+private:
+    // move the tiers that are due into `ready`
+    void popDue(time_t now)
+    {
+        auto const old_size = std::size(ready);
+
+        while (!std::empty(deadlines) && deadlines.top().at <= now)
+        {
+            ready.push_back(deadlines.top().key);
+            deadlines.pop();
+        }
+
+        if (std::size(ready) != old_size)
+        {
+            std::sort(std::begin(ready), std::end(ready));
+            ready.erase(std::unique(std::begin(ready), std::end(ready)), std::end(ready));
+        }
+    }
+};
+
 void tr_announcerParseHttpAnnounceResponse(tr_announce_response& response, std::string_view msg);
 
 void tr_announcerParseHttpScrapeResponse(tr_scrape_response& response, std::string_view msg);
@@ -182,9 +182,25 @@ struct tr_announcer
         tr_timerAddMsec(this->upkeep_timer, UpkeepIntervalMsec);
     }
 
+    // a tier's announce or scrape went out; note how late it was
+    void recordLag(time_t deadline)
+    {
+        auto const now_msec = tr_time_msec();
+        auto const deadline_msec = uint64_t(deadline) * 1000U;
+        auto const lag_msec = now_msec > deadline_msec ? now_msec - deadline_msec : 0;
+
+        ++stats.tiers_served;
+        stats.total_lag_msec += lag_msec;
+        stats.max_lag_msec = std::max(stats.max_lag_msec, lag_msec);
+    }
+
     std::set<tr_announce_request*, StopsCompare> stops;
     std::map<tr_interned_string, tr_scrape_info> scrape_info;
 
+    tr_tier_queue announces;
+    tr_tier_queue scrapes;
+    tr_announcer_stats stats;
+
     tr_session* const session;
     event* const upkeep_timer;
     int const key = tr_rand_int(INT_MAX);
@@ -301,14 +317,15 @@ tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed)
 /** @brief A group of trackers in a single tier, as per the multitracker spec */
 struct tr_tier
 {
-    tr_tier(tr_announcer* announcer, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
-        : tor{ tor_in }
+    tr_tier(tr_announcer* announcer_in, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
+        : announcer{ announcer_in }
+        , tor{ tor_in }
         , id{ next_key++ }
     {
         trackers.reserve(std::size(infos));
         for (auto const* info : infos)
         {
-            trackers.emplace_back(announcer, *info);
+            trackers.emplace_back(announcer_in, *info);
         }
         useNextTracker();
         scrapeSoon();
@@ -336,16 +353,51 @@ struct tr_tier
         return &trackers[*current_tracker_index_];
     }
 
+    [[nodiscard]] bool isAnnounceDue(time_t now) const
+    {
+        return announceAt != 0 && announceAt <= now && !std::empty(announce_events);
+    }
+
+    [[nodiscard]] bool isScrapeDue(time_t now) const
+    {
+        auto const* const tracker = currentTracker();
+
+        return scrapeAt != 0 && scrapeAt <= now && tracker != nullptr && tracker->scrape_info != nullptr;
+    }
+
     [[nodiscard]] bool needsToAnnounce(time_t now) const
     {
-        return !isAnnouncing && !isScraping && announceAt != 0 && announceAt <= now && !std::empty(announce_events);
+        return !isAnnouncing && !isScraping && isAnnounceDue(now);
     }
 
     [[nodiscard]] bool needsToScrape(time_t now) const
     {
-        auto const* const tracker = currentTracker();
+        return !isScraping && isScrapeDue(now);
+    }
+
+    [[nodiscard]] tr_tier_queue::Key key() const
+    {
+        return { tor->uniqueId, id };
+    }
+
+    void setAnnounceAt(time_t at)
+    {
+        announceAt = at;
+
+        if (at != 0)
+        {
+            announcer->announces.schedule(at, key());
+        }
+    }
+
+    void setScrapeAt(time_t at)
+    {
+        scrapeAt = at;
 
-        return !isScraping && scrapeAt != 0 && scrapeAt <= now && tracker != nullptr && tracker->scrape_info != nullptr;
+        if (at != 0)
+        {
+            announcer->scrapes.schedule(at, key());
+        }
     }
 
     [[nodiscard]] auto countDownloaders() const
@@ -380,6 +432,9 @@ struct tr_tier
         lastAnnounceStartTime = 0;
         lastScrapeStartTime = 0;
 
+        // the new tracker may be able to scrape when the old one couldn't
+        setScrapeAt(scrapeAt);
+
         return currentTracker();
     }
 
@@ -421,9 +476,10 @@ struct tr_tier
 
     void scheduleNextScrape(int interval)
     {
-        this->scrapeAt = getNextScrapeTime(tor->session, this, interval);
+        setScrapeAt(getNextScrapeTime(tor->session, this, interval));
     }
 
+    tr_announcer* const announcer;
     tr_torrent* const tor;
 
     /* number of up/down/corrupt bytes since the last time we sent an
@@ -780,7 +836,7 @@ static void tier_announce_event_push(tr_tier* tier, tr_announce_event e, time_t
 
     /* add it */
     events.push_back(e);
-    tier->announceAt = announceAt;
+    tier->setAnnounceAt(announceAt);
     tier_update_announce_priority(tier);
 
     dbgmsg_tier_announce_queue(tier);
@@ -981,6 +1037,9 @@ static void on_announce_done(tr_announce_response const* response, void* vdata)
         tier->isAnnouncing = false;
         tier->manualAnnounceAllowedAt = now + tier->announceMinIntervalSec;
 
+        // trackerStats changed, so torrent-get's "since" should see it
+        tier->tor->markStatsChanged();
+
         if (!response->did_connect)
         {
             on_announce_error(tier, _("Could not connect to tracker"), event);
@@ -1168,6 +1227,7 @@ static void tierAnnounce(tr_announcer* announcer, tr_tier* tier)
 
     auto* const data = new announce_data{ tier->id, now, announce_event, announcer->session, tor->isRunning };
 
+    announcer->recordLag(tier->announceAt);
     tier->isAnnouncing = true;
     tier->lastAnnounceStartTime = now;
 
@@ -1304,6 +1364,7 @@ static void on_scrape_done(tr_scrape_response const* response, void* vsession)
             tier->lastScrapeTime = now;
             tier->lastScrapeSucceeded = false;
             tier->lastScrapeTimedOut = response->did_timeout;
+            tor->markStatsChanged();
 
             if (!response->did_connect)
             {
@@ -1411,6 +1472,7 @@ static void multiscrape(tr_announcer* announcer, std::vector<tr_tier*> const& ti
 
             req->info_hash[req->info_hash_count] = tier->tor->infoHash();
             ++req->info_hash_count;
+            announcer->recordLag(tier->scrapeAt);
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
             found = true;
@@ -1425,6 +1487,7 @@ static void multiscrape(tr_announcer* announcer, std::vector<tr_tier*> const& ti
 
             req->info_hash[req->info_hash_count] = tier->tor->infoHash();
             ++req->info_hash_count;
+            announcer->recordLag(tier->scrapeAt);
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
 
@@ -1488,28 +1551,36 @@ static int compareAnnounceTiers(tr_tier const* a, tr_tier const* b)
     return a < b ? -1 : 1;
 }
 
+static tr_tier* findTier(tr_announcer* announcer, tr_tier_queue::Key key)
+{
+    auto* const tor = tr_torrentFindFromId(announcer->session, key.tor_id);
+    if (tor == nullptr || tor->torrent_announcer == nullptr)
+    {
+        return nullptr;
+    }
+
+    return tor->torrent_announcer->getTier(key.tier_id);
+}
+
 static void scrapeAndAnnounceMore(tr_announcer* announcer)
 {
     time_t const now = tr_time();
 
     /* build a list of tiers that need to be announced */
-    auto announce_me = std::vector<tr_tier*>{};
-    auto scrape_me = std::vector<tr_tier*>{};
-    for (auto* tor : announcer->session->torrents)
+    auto const find = [announcer](auto const& key)
     {
-        for (auto& tier : tor->torrent_announcer->tiers)
-        {
-            if (tier.needsToAnnounce(now))
-            {
-                announce_me.push_back(&tier);
-            }
-
-            if (tier.needsToScrape(now))
-            {
-                scrape_me.push_back(&tier);
-            }
-        }
-    }
+        return findTier(announcer, key);
+    };
+    auto announce_me = announcer->announces.takeReady(
+        now,
+        find,
+        [now](auto const* tier) { return tier->isAnnounceDue(now); },
+        [now](auto const* tier) { return tier->needsToAnnounce(now); });
+    auto scrape_me = announcer->scrapes.takeReady(
+        now,
+        find,
+        [now](auto const* tier) { return tier->isScrapeDue(now); },
+        [now](auto const* tier) { return tier->needsToScrape(now); });
 
     /* First, scrape what we can. We handle scrapes first because
      * we can work through that queue much faster than announces
@@ -1565,6 +1636,11 @@ static void onUpkeepTimer(evutil_socket_t /*fd*/, short /*what*/, void* vannounc
     announcer->scheduleNextUpdate();
 }
 
+tr_announcer_stats tr_announcerGetStats(tr_announcer const* announcer)
+{
+    return announcer->stats;
+}
+
 /***
 ****
 ***/
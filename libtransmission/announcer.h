@@ -10,6 +10,7 @@
 #endif
 
 #include <cstddef> // size_t
+#include <cstdint>
 #include <ctime>
 #include <string_view>
 #include <vector>
@@ -99,6 +100,19 @@ tr_tracker_view tr_announcerTracker(tr_torrent const* torrent, size_t i);
 
 size_t tr_announcerTrackerCount(tr_torrent const* tor);
 
+/**
+ * How far behind their scheduled time the announcer has been
+ * sending tiers' announces and scrapes since the session started.
+ */
+struct tr_announcer_stats
+{
+    uint64_t tiers_served = 0;
+    uint64_t total_lag_msec = 0;
+    uint64_t max_lag_msec = 0;
+};
+
+tr_announcer_stats tr_announcerGetStats(tr_announcer const*);
+
 /***
 ****
 ***/
@@ -4,11 +4,12 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <limits>
+#include <unordered_map>
 #include <vector>
 
 #include "transmission.h"
 #include "bandwidth.h"
-#include "crypto-utils.h" /* tr_rand_int_weak() */
 #include "log.h"
 #include "peer-io.h"
 #include "tr-assert.h"
@@ -20,59 +21,44 @@
 ****
 ***/
 
-unsigned int Bandwidth::getSpeedBytesPerSecond(RateControl& r, unsigned int interval_msec, uint64_t now)
+unsigned int Bandwidth::getSpeedBytesPerSecond(RateControl& r, Horizon horizon, uint64_t now)
 {
     if (now == 0)
     {
         now = tr_time_msec();
     }
 
-    if (now != r.cache_time_)
+    auto const speed = [](uint64_t bytes, uint64_t interval_msec)
     {
-        uint64_t bytes = 0;
-        uint64_t const cutoff = now - interval_msec;
+        return unsigned(bytes * 1000U / interval_msec);
+    };
 
-        for (int i = r.newest_; r.transfers_[i].date_ > cutoff;)
-        {
-            bytes += r.transfers_[i].size_;
+    switch (horizon)
+    {
+    case Horizon::OneSecond:
+        return speed(r.recent_.shortSum(now), r.recent_.ShortMSec);
 
-            if (--i == -1)
-            {
-                i = HistorySize - 1; /* circular history */
-            }
+    case Horizon::TenSeconds:
+        return r.longer_ ? speed(r.longer_->shortSum(now), r.longer_->ShortMSec) :
+                           speed(r.recent_.longSum(now), r.recent_.LongMSec);
 
-            if (i == r.newest_)
-            {
-                break; /* we've come all the way around */
-            }
-        }
+    case Horizon::OneMinute:
+        return r.longer_ ? speed(r.longer_->longSum(now), r.longer_->LongMSec) :
+                           speed(r.recent_.longSum(now), r.recent_.LongMSec);
 
-        r.cache_val_ = unsigned(bytes * 1000U / interval_msec);
-        r.cache_time_ = now;
+    default:
+        return speed(r.recent_.longSum(now), r.recent_.LongMSec);
     }
-
-    return r.cache_val_;
 }
 
 void Bandwidth::notifyBandwidthConsumedBytes(uint64_t const now, RateControl* r, size_t size)
 {
-    if (r->transfers_[r->newest_].date_ + GranularityMSec >= now)
-    {
-        r->transfers_[r->newest_].size_ += size;
-    }
-    else
-    {
-        if (++r->newest_ == HistorySize)
-        {
-            r->newest_ = 0;
-        }
+    r->recent_.add(now, size);
 
-        r->transfers_[r->newest_].date_ = now;
-        r->transfers_[r->newest_].size_ = size;
+    if (r->longer_)
+    {
+        r->longer_->add(now, size);
     }
-
-    /* invalidate cache_val*/
-    r->cache_time_ = 0;
 }
 
 /***
@@ -83,6 +69,17 @@ Bandwidth::Bandwidth(Bandwidth* new_parent)
 {
     this->band_[TR_UP].honor_parent_limits_ = true;
     this->band_[TR_DOWN].honor_parent_limits_ = true;
+
+    // the long horizons are only reported for the session
+    if (new_parent == nullptr)
+    {
+        for (auto& band : this->band_)
+        {
+            band.raw_.longer_ = std::make_unique<RateControl::LongerWindow>();
+            band.piece_.longer_ = std::make_unique<RateControl::LongerWindow>();
+        }
+    }
+
     this->setParent(new_parent);
 }
 
@@ -135,116 +132,188 @@ void Bandwidth::allocateBandwidth(
     tr_priority_t parent_priority,
     tr_direction dir,
     unsigned int period_msec,
-    std::vector<tr_peerIo*>& peer_pool)
+    std::vector<Bandwidth*>& leaves)
 {
     tr_priority_t const priority = std::max(parent_priority, this->priority_);
 
     /* set the available bandwidth */
     if (this->band_[dir].is_limited_)
     {
-        uint64_t const next_pulse_speed = this->band_[dir].desired_speed_bps_;
-        this->band_[dir].bytes_left_ = next_pulse_speed * period_msec / 1000U;
+        auto& band = this->band_[dir];
+        uint64_t const next_pulse_speed = band.desired_speed_bps_;
+        band.bytes_left_ = next_pulse_speed * period_msec / 1000U;
+
+        auto const repaid = std::min(size_t{ band.bytes_left_ }, band.overdraft_);
+        band.bytes_left_ -= repaid;
+        band.overdraft_ -= repaid;
     }
 
-    /* add this bandwidth's peer, if any, to the peer pool */
+    /* add this bandwidth to the leaves if it has a peer */
     if (this->peer_ != nullptr)
     {
         this->peer_->priority = priority;
-        peer_pool.push_back(this->peer_);
+        leaves.push_back(this);
     }
 
     // traverse & repeat for the subtree
     for (auto* child : this->children_)
     {
-        child->allocateBandwidth(priority, dir, period_msec, peer_pool);
+        child->allocateBandwidth(priority, dir, period_msec, leaves);
     }
 }
 
-void Bandwidth::phaseOne(std::vector<tr_peerIo*>& peerArray, tr_direction dir)
+size_t Bandwidth::fairQueue(std::vector<Bandwidth*> const& leaves, tr_direction dir, FlushFunc const& flush)
 {
-    /* First phase of IO. Tries to distribute bandwidth fairly to keep faster
-     * peers from starving the others. Loop through the peers, giving each a
-     * small chunk of bandwidth. Keep looping until we run out of bandwidth
-     * and/or peers that can use it */
-    dbgmsg("%lu peers to go round-robin for %s", peerArray.size(), dir == TR_UP ? "upload" : "download");
+    static auto constexpr Unlimited = std::numeric_limits<size_t>::max();
+
+    struct Node
+    {
+        size_t n_active_children = 0;
+        size_t share = 0;
+        bool share_known = false;
+    };
+
+    auto active = leaves;
+    auto nodes = std::unordered_map<Bandwidth const*, Node>{};
+    auto n_flushes = size_t{};
 
-    size_t n = peerArray.size();
-    while (n > 0)
+    // how many bytes `b` can hand each of its active children this round
+    auto const share_of = [&nodes, dir](Bandwidth const* b, auto const& self) -> size_t
     {
-        int const i = tr_rand_int_weak(n); /* pick a peer at random */
+        auto& node = nodes[b];
+        if (!node.share_known)
+        {
+            auto const& band = b->band_[dir];
+            node.share = band.is_limited_ ? band.bytes_left_ : Unlimited;
 
-        /* value of 3000 bytes chosen so that when using uTP we'll send a full-size
-         * frame right away and leave enough buffered data for the next frame to go
-         * out in a timely manner. */
-        size_t const increment = 3000;
+            if (b->parent_ != nullptr && band.honor_parent_limits_)
+            {
+                auto const parent_share = self(b->parent_, self);
+                auto const n_siblings = std::max(size_t{ 1 }, nodes[b->parent_].n_active_children);
+                node.share = std::min(node.share, parent_share == Unlimited ? Unlimited : parent_share / n_siblings);
+            }
+
+            node.share_known = true;
+        }
 
-        int const bytes_used = tr_peerIoFlush(peerArray[i], dir, increment);
+        return node.share;
+    };
 
-        dbgmsg("peer #%d of %zu used %d bytes in this pass", i, n, bytes_used);
+    dbgmsg("%zu peers to go round-robin for %s", std::size(active), dir == TR_UP ? "upload" : "download");
+
+    while (!std::empty(active))
+    {
+        // count each bandwidth's children that are still transferring
+        nodes.clear();
+        for (Bandwidth const* b : active)
+        {
+            for (; b->parent_ != nullptr; b = b->parent_)
+            {
+                if (nodes[b->parent_].n_active_children++ > 0)
+                {
+                    break; // the rest of this path has already been counted
+                }
+            }
+        }
 
-        if (bytes_used != int(increment))
+        // compute every leaf's quantum before any of them are flushed,
+        // so that the first leaves to go can't shrink the later ones' shares
+        auto quanta = std::vector<size_t>{};
+        quanta.reserve(std::size(active));
+        for (auto const* leaf : active)
         {
-            /* peer is done writing for now; move it to the end of the list */
-            std::swap(peerArray[i], peerArray[n - 1]);
-            --n;
+            quanta.push_back(std::clamp(share_of(leaf, share_of), MinQuantum, MaxQuantum));
         }
+
+        // give each leaf its quantum, and drop the ones that don't use it all
+        auto still_active = size_t{};
+        for (size_t i = 0, n = std::size(active); i < n; ++i)
+        {
+            auto* const leaf = active[i];
+            auto const bytes_used = flush(leaf, quanta[i]);
+            ++n_flushes;
+
+            dbgmsg("peer #%zu of %zu used %zu of %zu bytes in this round", i, n, bytes_used, quanta[i]);
+
+            if (bytes_used >= quanta[i])
+            {
+                active[still_active++] = leaf;
+            }
+        }
+
+        active.resize(still_active);
     }
+
+    return n_flushes;
 }
 
 void Bandwidth::allocate(tr_direction dir, unsigned int period_msec)
 {
     TR_ASSERT(tr_isDirection(dir));
 
-    auto high = std::vector<tr_peerIo*>{};
-    auto low = std::vector<tr_peerIo*>{};
-    auto normal = std::vector<tr_peerIo*>{};
-    auto tmp = std::vector<tr_peerIo*>{};
+    auto high = std::vector<Bandwidth*>{};
+    auto low = std::vector<Bandwidth*>{};
+    auto normal = std::vector<Bandwidth*>{};
+    auto leaves = std::vector<Bandwidth*>{};
 
     /* allocateBandwidth () is a helper function with two purposes:
      * 1. allocate bandwidth to b and its subtree
-     * 2. accumulate an array of all the peerIos from b and its subtree. */
-    this->allocateBandwidth(TR_PRI_LOW, dir, period_msec, tmp);
+     * 2. accumulate an array of all the leaves with peerIos from b and its subtree. */
+    this->allocateBandwidth(TR_PRI_LOW, dir, period_msec, leaves);
 
-    for (auto* io : tmp)
+    /* take turns going first, since the last leaves in a round
+     * may find the buckets empty if their shares got rounded up */
+    if (!std::empty(leaves))
     {
+        auto const first = this->fair_queue_turn_++ % std::size(leaves);
+        std::rotate(std::begin(leaves), std::begin(leaves) + first, std::end(leaves));
+    }
+
+    for (auto* leaf : leaves)
+    {
+        auto* const io = leaf->peer_;
         tr_peerIoRef(io);
         tr_peerIoFlushOutgoingProtocolMsgs(io);
 
         switch (io->priority)
         {
         case TR_PRI_HIGH:
-            high.push_back(io);
+            high.push_back(leaf);
             [[fallthrough]];
 
         case TR_PRI_NORMAL:
-            normal.push_back(io);
+            normal.push_back(leaf);
             [[fallthrough]];
 
         default:
-            low.push_back(io);
+            low.push_back(leaf);
         }
     }
 
     /* First phase of IO. Tries to distribute bandwidth fairly to keep faster
-     * peers from starving the others. Loop through the peers, giving each a
-     * small chunk of bandwidth. Keep looping until we run out of bandwidth
-     * and/or peers that can use it */
-    phaseOne(high, dir);
-    phaseOne(normal, dir);
-    phaseOne(low, dir);
+     * peers from starving the others. Go round-robin over the peers, giving
+     * each its share of the bandwidth in one write. Keep looping until we run
+     * out of bandwidth and/or peers that can use it */
+    auto const flush = [dir](Bandwidth* leaf, size_t max_bytes)
+    {
+        return size_t(std::max(0, tr_peerIoFlush(leaf->peer_, dir, max_bytes)));
+    };
+    fairQueue(high, dir, flush);
+    fairQueue(normal, dir, flush);
+    fairQueue(low, dir, flush);
 
     /* Second phase of IO. To help us scale in high bandwidth situations,
      * enable on-demand IO for peers with bandwidth left to burn.
      * This on-demand IO is enabled until (1) the peer runs out of bandwidth,
      * or (2) the next Bandwidth::allocate () call, when we start over again. */
-    for (auto* io : tmp)
+    for (auto* leaf : leaves)
     {
-        tr_peerIoSetEnabled(io, dir, tr_peerIoHasBandwidthLeft(io, dir));
+        tr_peerIoSetEnabled(leaf->peer_, dir, tr_peerIoHasBandwidthLeft(leaf->peer_, dir));
     }
 
-    for (auto* io : tmp)
+    for (auto* leaf : leaves)
     {
-        tr_peerIoUnref(io);
+        tr_peerIoUnref(leaf->peer_);
     }
 }
 
@@ -296,7 +365,12 @@ unsigned int Bandwidth::clamp(uint64_t now, tr_direction dir, unsigned int byte_
     return byte_count;
 }
 
-void Bandwidth::notifyBandwidthConsumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now)
+void Bandwidth::notifyBandwidthConsumed(
+    tr_direction dir,
+    size_t byte_count,
+    bool is_piece_data,
+    uint64_t now,
+    bool is_file_segment)
 {
     TR_ASSERT(tr_isDirection(dir));
 
@@ -304,7 +378,15 @@ void Bandwidth::notifyBandwidthConsumed(tr_direction dir, size_t byte_count, boo
 
     if (band->is_limited_ && is_piece_data)
     {
-        band->bytes_left_ -= std::min(size_t{ band->bytes_left_ }, byte_count);
+        auto const n = std::min(size_t{ band->bytes_left_ }, byte_count);
+        band->bytes_left_ -= n;
+
+        // a sendfile() segment can't be split to fit the budget,
+        // so pay back what it went over instead of forgetting it
+        if (is_file_segment)
+        {
+            band->overdraft_ += byte_count - n;
+        }
     }
 
 #ifdef DEBUG_DIRECTION
@@ -332,6 +414,6 @@ void Bandwidth::notifyBandwidthConsumed(tr_direction dir, size_t byte_count, boo
 
     if (this->parent_ != nullptr)
     {
-        this->parent_->notifyBandwidthConsumed(dir, byte_count, is_piece_data, now);
+        this->parent_->notifyBandwidthConsumed(dir, byte_count, is_piece_data, now, is_file_segment);
     }
 }
@@ -11,6 +11,8 @@
 
 #include <array>
 #include <cstddef> // size_t
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "transmission.h"
@@ -62,6 +64,11 @@ class tr_peerIo;
  *   The peer-ios all have a pointer to their associated tr_bandwidth object,
  *   and call Bandwidth::clamp() before performing I/O to see how much
  *   bandwidth they can safely use.
+ *
+ *   Each limited bandwidth's bytes-left count is a token bucket that's
+ *   refilled by Bandwidth::allocate(). The bytes are handed out to the
+ *   peer-ios by Bandwidth::fairQueue(), which goes round-robin over the
+ *   tree so that each torrent, and each peer inside it, gets an even share.
  */
 struct Bandwidth
 {
@@ -94,8 +101,15 @@ public:
     /**
      * @brief Notify the bandwidth object that some of its allocated bandwidth has been consumed.
      * This is is usually invoked by the peer-io after a read or write.
+     * A file segment is sent whole, so it may go past the budget; that excess
+     * comes out of the next periods. Any other excess is forgotten.
      */
-    void notifyBandwidthConsumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now);
+    void notifyBandwidthConsumed(
+        tr_direction dir,
+        size_t byte_count,
+        bool is_piece_data,
+        uint64_t now,
+        bool is_file_segment = false);
 
     /**
      * @brief allocate the next period_msec's worth of bandwidth for the peer-ios to consume
@@ -122,20 +136,40 @@ public:
         return this->clamp(0, dir, byte_count);
     }
 
+    /**
+     * How far back a speed looks. `Current` is the speed shown to users,
+     * which is averaged over HistoryMSec. Only a bandwidth made without a
+     * parent, i.e. the session's, keeps the windows for `TenSeconds` and
+     * `OneMinute`; the others report their `Current` speed for those.
+     */
+    enum class Horizon
+    {
+        Current,
+        OneSecond,
+        TenSeconds,
+        OneMinute
+    };
+
     /** @brief Get the raw total of bytes read or sent by this bandwidth subtree. */
-    [[nodiscard]] unsigned int getRawSpeedBytesPerSecond(uint64_t const now, tr_direction const dir) const
+    [[nodiscard]] unsigned int getRawSpeedBytesPerSecond(
+        uint64_t const now,
+        tr_direction const dir,
+        Horizon const horizon = Horizon::Current) const
     {
         TR_ASSERT(tr_isDirection(dir));
 
-        return getSpeedBytesPerSecond(this->band_[dir].raw_, HistoryMSec, now);
+        return getSpeedBytesPerSecond(this->band_[dir].raw_, horizon, now);
     }
 
     /** @brief Get the number of piece data bytes read or sent by this bandwidth subtree. */
-    [[nodiscard]] unsigned int getPieceSpeedBytesPerSecond(uint64_t const now, tr_direction const dir) const
+    [[nodiscard]] unsigned int getPieceSpeedBytesPerSecond(
+        uint64_t const now,
+        tr_direction const dir,
+        Horizon const horizon = Horizon::Current) const
     {
         TR_ASSERT(tr_isDirection(dir));
 
-        return getSpeedBytesPerSecond(this->band_[dir].piece_, HistoryMSec, now);
+        return getSpeedBytesPerSecond(this->band_[dir].piece_, horizon, now);
     }
 
     /**
@@ -168,6 +202,12 @@ public:
         bool* value = &this->band_[dir].is_limited_;
         bool const did_change = is_limited != *value;
         *value = is_limited;
+
+        if (!is_limited)
+        {
+            this->band_[dir].overdraft_ = 0;
+        }
+
         return did_change;
     }
 
@@ -179,6 +219,23 @@ public:
         return this->band_[dir].is_limited_;
     }
 
+    /**
+     * @return true if this bandwidth or a parent whose limits it honors
+     * throttles `dir`, so that clamp() may return less than it was given
+     */
+    [[nodiscard]] bool isThrottled(tr_direction dir) const
+    {
+        for (auto const* b = this; b != nullptr; b = b->band_[dir].honor_parent_limits_ ? b->parent_ : nullptr)
+        {
+            if (b->band_[dir].is_limited_)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     /**
      * Almost all the time we do want to honor a parents' bandwidth cap, so that
      * (for example) a peer is constrained by a per-torrent cap and the global cap.
@@ -200,22 +257,107 @@ public:
         return this->band_[direction].honor_parent_limits_;
     }
 
+    using FlushFunc = std::function<size_t(Bandwidth* leaf, size_t max_bytes)>;
+
+    /**
+     * @brief Hand out bandwidth to `leaves` by round-robin over the bandwidth tree.
+     *
+     * `leaves` are bandwidths with a peer-io that may want to transfer in `dir`.
+     * In each round, each bandwidth splits what's left in its bucket evenly
+     * between its children that are still transferring, and each leaf gets
+     * its share, between MinQuantum and MaxQuantum bytes, in one call to
+     * `flush(leaf, max_bytes)`. A leaf that uses less than it was offered
+     * is done until the next call.
+     *
+     * @return the number of times `flush` was called
+     */
+    static size_t fairQueue(std::vector<Bandwidth*> const& leaves, tr_direction dir, FlushFunc const& flush);
+
+    // Sized so that a uTP peer can send a full-size frame
+    // and still have the next one buffered.
+    static constexpr size_t MinQuantum = 3000U;
+
+    // About what a TCP socket's send buffer can take in one write
+    static constexpr size_t MaxQuantum = 64U * 1024U;
+
     static constexpr size_t HistoryMSec = 2000U;
-    static constexpr size_t IntervalMSec = HistoryMSec;
-    static constexpr size_t GranularityMSec = 200;
-    static constexpr size_t HistorySize = (IntervalMSec / GranularityMSec);
 
-    struct RateControl
+    /**
+     * Counts bytes in `BinMSec`-wide bins over the last `NumBins` bins.
+     * Running totals of the newest `ShortBins` bins and of all of them are
+     * kept as bytes are added and as bins expire, so reading them is O(1).
+     */
+    template<uint64_t BinMSec, size_t NumBins, size_t ShortBins>
+    class RateWindow
     {
-        struct Transfer
+    public:
+        static_assert(ShortBins < NumBins);
+
+        static constexpr auto ShortMSec = BinMSec * ShortBins;
+        static constexpr auto LongMSec = BinMSec * NumBins;
+
+        void add(uint64_t now, uint64_t byte_count)
+        {
+            advance(now);
+            bins_[newest_ % NumBins] += byte_count;
+            short_sum_ += byte_count;
+            long_sum_ += byte_count;
+        }
+
+        [[nodiscard]] uint64_t shortSum(uint64_t now)
+        {
+            advance(now);
+            return short_sum_;
+        }
+
+        [[nodiscard]] uint64_t longSum(uint64_t now)
+        {
+            advance(now);
+            return long_sum_;
+        }
+
+    private:
+        // expire the bins that are too old as of `now`
+        void advance(uint64_t now)
         {
-            uint64_t date_;
-            uint64_t size_;
-        };
-        std::array<Transfer, HistorySize> transfers_;
-        uint64_t cache_time_;
-        unsigned int cache_val_;
-        int newest_;
+            auto const bin = now / BinMSec;
+
+            if (bin <= newest_)
+            {
+                return;
+            }
+
+            if (bin - newest_ >= NumBins)
+            {
+                bins_ = {};
+                short_sum_ = long_sum_ = 0;
+                newest_ = bin;
+                return;
+            }
+
+            while (newest_ < bin)
+            {
+                ++newest_;
+                short_sum_ -= bins_[(newest_ - ShortBins) % NumBins];
+                long_sum_ -= bins_[newest_ % NumBins];
+                bins_[newest_ % NumBins] = 0;
+            }
+        }
+
+        std::array<uint64_t, NumBins> bins_ = {};
+        uint64_t newest_ = 0;
+        uint64_t short_sum_ = 0;
+        uint64_t long_sum_ = 0;
+    };
+
+    struct RateControl
+    {
+        // 1 second and HistoryMSec
+        RateWindow<200U, HistoryMSec / 200U, 5U> recent_;
+
+        // 10 seconds and 1 minute. At ~0.5 KiB each, only the root has them
+        using LongerWindow = RateWindow<1000U, 60U, 10U>;
+        std::unique_ptr<LongerWindow> longer_;
     };
 
     struct Band
@@ -223,31 +365,34 @@ public:
         RateControl raw_;
         RateControl piece_;
         unsigned int bytes_left_;
+        // file segment bytes sent past bytes_left_, which come out of the next periods
+        size_t overdraft_;
         unsigned int desired_speed_bps_;
         bool is_limited_;
         bool honor_parent_limits_;
     };
 
 private:
-    static unsigned int getSpeedBytesPerSecond(RateControl& r, unsigned int interval_msec, uint64_t now);
+    static unsigned int getSpeedBytesPerSecond(RateControl& r, Horizon horizon, uint64_t now);
 
     static void notifyBandwidthConsumedBytes(uint64_t now, RateControl* r, size_t size);
 
     [[nodiscard]] unsigned int clamp(uint64_t now, tr_direction dir, unsigned int byte_count) const;
 
-    static void phaseOne(std::vector<tr_peerIo*>& peer_array, tr_direction dir);
-
     void allocateBandwidth(
         tr_priority_t parent_priority,
         tr_direction dir,
         unsigned int period_msec,
-        std::vector<tr_peerIo*>& peer_pool);
+        std::vector<Bandwidth*>& leaves);
 
     mutable std::array<Band, 2> band_ = {};
     Bandwidth* parent_ = nullptr;
     std::vector<Bandwidth*> children_;
     tr_peerIo* peer_ = nullptr;
     tr_priority_t priority_ = 0;
+
+    // which leaf goes first in the next allocate()
+    size_t fair_queue_turn_ = 0;
 };
 
 /* @} */
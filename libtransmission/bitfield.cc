@@ -4,13 +4,26 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <bitset>
+#include <cstdint>
 #include <vector>
 
 #include "transmission.h"
 
 #include "bitfield.h"
 #include "tr-assert.h"
-#include "utils.h" /* tr_new0() */
+
+// the popcount kernels are built twice on x86 unless the compiler can
+// already assume POPCNT, and the hardware instruction is picked at runtime
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(__POPCNT__)
+#define TR_BITFIELD_POPCNT_DISPATCH
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TR_BITFIELD_INLINE inline __attribute__((always_inline))
+#else
+#define TR_BITFIELD_INLINE inline
+#endif
 
 /****
 *****
@@ -19,112 +32,186 @@
 namespace
 {
 
+auto constexpr BitsPerWord = size_t{ 64 };
+
 constexpr size_t getBytesNeeded(size_t bit_count)
 {
     return (bit_count >> 3) + ((bit_count & 7) != 0 ? 1 : 0);
 }
 
-void setAllTrue(uint8_t* array, size_t bit_count)
+constexpr size_t getWordsNeeded(size_t bit_count)
+{
+    return (bit_count >> 6) + ((bit_count & 63) != 0 ? 1 : 0);
+}
+
+// the bit for `nth` in its word
+constexpr uint64_t bitMask(size_t nth)
 {
-    uint8_t constexpr Val = 0xFF;
-    size_t const n = getBytesNeeded(bit_count);
+    return (uint64_t{ 1 } << 63) >> (nth & 63);
+}
+
+// bits [begin, end) of a word, where begin < end <= 64
+constexpr uint64_t spanMask(size_t begin, size_t end)
+{
+    return (~uint64_t{} >> begin) & (~uint64_t{} << (BitsPerWord - end));
+}
+
+void setAllTrue(uint64_t* words, size_t bit_count)
+{
+    size_t const n = getWordsNeeded(bit_count);
 
     if (n > 0)
     {
-        std::fill_n(array, n, Val);
-        array[n - 1] = Val << (n * 8 - bit_count);
+        std::fill_n(words, n, ~uint64_t{});
+        words[n - 1] = spanMask(0, bit_count - (n - 1) * BitsPerWord);
     }
 }
 
-constexpr int8_t const trueBitCount[256] = {
-    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2,
-    3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3,
-    3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5,
-    6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4,
-    3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4,
-    5, 5, 6, 5, 6, 6, 7, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6,
-    6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
-};
+TR_BITFIELD_INLINE size_t popcount(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_popcountll(word));
+#else
+    return std::bitset<BitsPerWord>{ word }.count();
+#endif
+}
 
-} // namespace
+struct OpOnly
+{
+    constexpr uint64_t operator()(uint64_t a, uint64_t /*b*/) const
+    {
+        return a;
+    }
+};
 
-/****
-*****
-****/
+struct OpAnd
+{
+    constexpr uint64_t operator()(uint64_t a, uint64_t b) const
+    {
+        return a & b;
+    }
+};
 
-size_t tr_bitfield::countFlags() const
+// popcount(op(a[i], b[i])) summed over n words
+template<typename Op>
+TR_BITFIELD_INLINE size_t countWordsKernel(uint64_t const* a, uint64_t const* b, size_t n, Op op)
 {
-    size_t ret = 0;
+    auto ret = size_t{};
 
-    for (auto ch : flags_)
+    for (size_t i = 0; i < n; ++i)
     {
-        ret += trueBitCount[ch];
+        ret += popcount(op(a[i], b[i]));
     }
 
     return ret;
 }
 
-size_t tr_bitfield::countFlags(size_t begin, size_t end) const
+#ifdef TR_BITFIELD_POPCNT_DISPATCH
+
+template<typename Op>
+__attribute__((target("popcnt"))) size_t countWordsPopcnt(uint64_t const* a, uint64_t const* b, size_t n, Op op)
 {
-    size_t ret = 0;
-    size_t const first_byte = begin >> 3U;
-    size_t const last_byte = (end - 1) >> 3U;
+    return countWordsKernel(a, b, n, op);
+}
 
-    if (bit_count_ == 0)
-    {
-        return 0;
-    }
+bool hasPopcnt()
+{
+    static bool const has_popcnt = __builtin_cpu_supports("popcnt") != 0;
+    return has_popcnt;
+}
 
-    if (first_byte >= std::size(flags_))
+#endif
+
+template<typename Op>
+size_t countWords(uint64_t const* a, uint64_t const* b, size_t n, Op op)
+{
+#ifdef TR_BITFIELD_POPCNT_DISPATCH
+    if (hasPopcnt())
     {
-        return 0;
+        return countWordsPopcnt(a, b, n, op);
     }
+#endif
 
-    TR_ASSERT(begin < end);
-    TR_ASSERT(!std::empty(flags_));
+    return countWordsKernel(a, b, n, op);
+}
 
-    if (first_byte == last_byte)
-    {
-        uint8_t val = flags_[first_byte];
+size_t countWords(uint64_t const* words, size_t n)
+{
+    return countWords(words, words, n, OpOnly{});
+}
 
-        int i = begin - (first_byte * 8);
-        val <<= i;
-        val >>= i;
-        i = (last_byte + 1) * 8 - end;
-        val >>= i;
-        val <<= i;
+// checks several words per branch so that the loop can be vectorized
+bool anyWordsAnd(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto constexpr Stride = size_t{ 8 };
 
-        ret += trueBitCount[val];
-    }
-    else
+    size_t i = 0;
+
+    for (; i + Stride <= n; i += Stride)
     {
-        size_t const walk_end = std::min(std::size(flags_), last_byte);
+        auto acc = uint64_t{};
 
-        /* first byte */
-        size_t const first_shift = begin - (first_byte * 8);
-        uint8_t val = flags_[first_byte];
-        val <<= first_shift;
-        val >>= first_shift;
-        ret += trueBitCount[val];
+        for (size_t j = 0; j < Stride; ++j)
+        {
+            acc |= a[i + j] & b[i + j];
+        }
 
-        /* middle bytes */
-        for (size_t i = first_byte + 1; i < walk_end; ++i)
+        if (acc != 0)
         {
-            ret += trueBitCount[flags_[i]];
+            return true;
         }
+    }
 
-        /* last byte */
-        if (last_byte < std::size(flags_))
+    for (; i < n; ++i)
+    {
+        if ((a[i] & b[i]) != 0)
         {
-            size_t const last_shift = (last_byte + 1) * 8 - end;
-            val = flags_[last_byte];
-            val >>= last_shift;
-            val <<= last_shift;
-            ret += trueBitCount[val];
+            return true;
         }
     }
 
-    TR_ASSERT(ret <= (begin - end));
+    return false;
+}
+
+} // namespace
+
+/****
+*****
+****/
+
+size_t tr_bitfield::countFlags() const
+{
+    return countWords(std::data(flags_), std::size(flags_));
+}
+
+size_t tr_bitfield::countFlags(size_t begin, size_t end) const
+{
+    if (bit_count_ == 0)
+    {
+        return 0;
+    }
+
+    end = std::min(end, std::size(flags_) * BitsPerWord);
+    if (begin >= end)
+    {
+        return 0;
+    }
+
+    size_t const first_word = begin / BitsPerWord;
+    size_t const last_word = (end - 1) / BitsPerWord;
+    size_t const first_bit = begin - first_word * BitsPerWord;
+    size_t const last_bit_end = end - last_word * BitsPerWord;
+
+    if (first_word == last_word)
+    {
+        return popcount(flags_[first_word] & spanMask(first_bit, last_bit_end));
+    }
+
+    auto ret = popcount(flags_[first_word] & spanMask(first_bit, BitsPerWord));
+    ret += countWords(std::data(flags_) + first_word + 1, last_word - first_word - 1);
+    ret += popcount(flags_[last_word] & spanMask(0, last_bit_end));
+
+    TR_ASSERT(ret <= (end - begin));
     return ret;
 }
 
@@ -145,13 +232,62 @@ size_t tr_bitfield::count(size_t begin, size_t end) const
 
 bool tr_bitfield::testFlag(size_t n) const
 {
-    if (n >> 3U >= std::size(flags_))
+    if (n / BitsPerWord >= std::size(flags_))
     {
         return false;
     }
 
-    bool ret = (flags_[n >> 3U] << (n & 7U) & 0x80) != 0;
-    return ret;
+    return (flags_[n / BitsPerWord] & bitMask(n)) != 0;
+}
+
+bool tr_bitfield::intersects(tr_bitfield const& that) const
+{
+    if (hasNone() || that.hasNone())
+    {
+        return false;
+    }
+
+    auto const n = std::min(size(), that.size());
+
+    if (hasAll())
+    {
+        return that.count(0, n) != 0;
+    }
+
+    if (that.hasAll())
+    {
+        return count(0, n) != 0;
+    }
+
+    return anyWordsAnd(std::data(flags_), std::data(that.flags_), std::min(std::size(flags_), std::size(that.flags_)));
+}
+
+size_t tr_bitfield::countAnd(tr_bitfield const& that) const
+{
+    if (hasNone() || that.hasNone())
+    {
+        return 0;
+    }
+
+    auto const n = std::min(size(), that.size());
+
+    if (hasAll())
+    {
+        return that.count(0, n);
+    }
+
+    if (that.hasAll())
+    {
+        return count(0, n);
+    }
+
+    auto const n_words = std::min(std::size(flags_), std::size(that.flags_));
+    return countWords(std::data(flags_), std::data(that.flags_), n_words, OpAnd{});
+}
+
+size_t tr_bitfield::countAndNot(tr_bitfield const& that) const
+{
+    return count() - countAnd(that);
 }
 
 /***
@@ -165,18 +301,22 @@ bool tr_bitfield::isValid() const
 
 std::vector<uint8_t> tr_bitfield::raw() const
 {
-    auto const n = getBytesNeeded(bit_count_);
+    auto const n = bit_count_ != 0 ? getBytesNeeded(bit_count_) : std::size(flags_) * sizeof(uint64_t);
+    auto raw = std::vector<uint8_t>(n);
 
     if (!std::empty(flags_))
     {
-        return flags_;
-    }
-
-    auto raw = std::vector<uint8_t>(n);
+        auto const n_bytes = std::min(n, std::size(flags_) * sizeof(uint64_t));
 
-    if (hasAll())
+        for (size_t i = 0; i < n_bytes; ++i)
+        {
+            raw[i] = static_cast<uint8_t>(flags_[i >> 3U] >> (56 - (i & 7U) * 8));
+        }
+    }
+    else if (hasAll() && n > 0)
     {
-        setAllTrue(std::data(raw), std::size(raw));
+        std::fill(std::begin(raw), std::end(raw), uint8_t{ 0xFF });
+        raw.back() = uint8_t(0xFF << (n * 8 - bit_count_));
     }
 
     return raw;
@@ -186,11 +326,11 @@ void tr_bitfield::ensureBitsAlloced(size_t n)
 {
     bool const has_all = hasAll();
 
-    size_t const bytes_needed = has_all ? getBytesNeeded(std::max(n, true_count_)) : getBytesNeeded(n);
+    size_t const words_needed = has_all ? getWordsNeeded(std::max(n, true_count_)) : getWordsNeeded(n);
 
-    if (std::size(flags_) < bytes_needed)
+    if (std::size(flags_) < words_needed)
     {
-        flags_.resize(bytes_needed);
+        flags_.resize(words_needed);
 
         if (has_all)
         {
@@ -213,7 +353,7 @@ bool tr_bitfield::ensureNthBitAlloced(size_t nth)
 
 void tr_bitfield::freeArray()
 {
-    flags_ = std::vector<uint8_t>{};
+    flags_ = std::vector<uint64_t>{};
 }
 
 void tr_bitfield::setTrueCount(size_t n)
@@ -285,20 +425,22 @@ void tr_bitfield::setHasAll()
 
 void tr_bitfield::setRaw(uint8_t const* raw, size_t byte_count)
 {
-    flags_ = std::vector<uint8_t>(raw, raw + byte_count);
-
-    // ensure any excess bits at the end of the array are set to '0'.
-    if (byte_count == getBytesNeeded(bit_count_))
+    if (bit_count_ != 0)
     {
-        int const excess_bit_count = byte_count * 8 - bit_count_;
+        byte_count = std::min(byte_count, getBytesNeeded(bit_count_));
+    }
 
-        TR_ASSERT(excess_bit_count >= 0);
-        TR_ASSERT(excess_bit_count <= 7);
+    flags_.assign(getWordsNeeded(byte_count * 8), 0);
 
-        if (excess_bit_count != 0)
-        {
-            flags_.back() &= 0xff << excess_bit_count;
-        }
+    for (size_t i = 0; i < byte_count; ++i)
+    {
+        flags_[i >> 3U] |= uint64_t{ raw[i] } << (56 - (i & 7U) * 8);
+    }
+
+    // ensure any excess bits at the end of the array are set to '0'.
+    if (bit_count_ != 0 && std::size(flags_) * BitsPerWord > bit_count_)
+    {
+        flags_.back() &= spanMask(0, bit_count_ - (std::size(flags_) - 1) * BitsPerWord);
     }
 
     rebuildTrueCount();
@@ -316,7 +458,7 @@ void tr_bitfield::setFromBools(bool const* flags, size_t n)
         if (flags[i])
         {
             ++trueCount;
-            flags_[i >> 3U] |= (0x80 >> (i & 7U));
+            flags_[i / BitsPerWord] |= bitMask(i);
         }
     }
 
@@ -337,12 +479,12 @@ void tr_bitfield::set(size_t nth, bool value)
 
     if (value)
     {
-        flags_[nth >> 3U] |= 0x80 >> (nth & 7U);
+        flags_[nth / BitsPerWord] |= bitMask(nth);
         incrementTrueCount(1);
     }
     else
     {
-        flags_[nth >> 3U] &= 0xff7f >> (nth & 7U);
+        flags_[nth / BitsPerWord] &= ~bitMask(nth);
         decrementTrueCount(1);
     }
 }
@@ -365,57 +507,46 @@ void tr_bitfield::setSpan(size_t begin, size_t end, bool value)
         return;
     }
 
-    --end;
-    if (!ensureNthBitAlloced(end))
+    if (!ensureNthBitAlloced(end - 1))
     {
         return;
     }
 
-    size_t walk = begin >> 3;
-    size_t const last_byte = end >> 3;
+    size_t const first_word = begin / BitsPerWord;
+    size_t const last_word = (end - 1) / BitsPerWord;
+    size_t const first_bit = begin - first_word * BitsPerWord;
+    size_t const last_bit_end = end - last_word * BitsPerWord;
+    auto const fill = value ? ~uint64_t{} : uint64_t{};
 
-    if (value)
+    auto const apply = [this, value](size_t word, uint64_t mask)
     {
-        unsigned char const first_mask = ~(0xff << (8 - (begin & 7)));
-        unsigned char const last_mask = 0xff << (7 - (end & 7));
-
-        if (walk == last_byte)
+        if (value)
         {
-            flags_[walk] |= first_mask & last_mask;
+            flags_[word] |= mask;
         }
         else
         {
-            flags_[walk] |= first_mask;
-            flags_[last_byte] |= last_mask;
-
-            if (++walk < last_byte)
-            {
-                std::fill_n(std::begin(flags_) + walk, last_byte - walk, 0xff);
-            }
+            flags_[word] &= ~mask;
         }
+    };
 
-        incrementTrueCount(new_count - old_count);
+    if (first_word == last_word)
+    {
+        apply(first_word, spanMask(first_bit, last_bit_end));
     }
     else
     {
-        unsigned char const first_mask = 0xff << (8 - (begin & 7));
-        unsigned char const last_mask = ~(0xff << (7 - (end & 7)));
-
-        if (walk == last_byte)
-        {
-            flags_[walk] &= first_mask | last_mask;
-        }
-        else
-        {
-            flags_[walk] &= first_mask;
-            flags_[last_byte] &= last_mask;
-
-            if (++walk < last_byte)
-            {
-                std::fill_n(std::begin(flags_) + walk, last_byte - walk, 0);
-            }
-        }
+        apply(first_word, spanMask(first_bit, BitsPerWord));
+        std::fill(std::begin(flags_) + first_word + 1, std::begin(flags_) + last_word, fill);
+        apply(last_word, spanMask(0, last_bit_end));
+    }
 
+    if (value)
+    {
+        incrementTrueCount(new_count - old_count);
+    }
+    else
+    {
         decrementTrueCount(old_count);
     }
 }
@@ -10,6 +10,7 @@
 #endif
 
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 /**
@@ -32,6 +33,10 @@
  *
  * - "Have none" is another special case that has the same advantages
  *   and motivations as "Have all".
+ *
+ * The bits are stored in 64-bit words so that counting and comparing
+ * bitfields can work a word at a time. Within each word, bit 0 is the
+ * most significant bit so that raw() is just the words in big-endian.
  */
 class tr_bitfield
 {
@@ -87,6 +92,13 @@ public:
         return bit_count_;
     }
 
+    // Compare against another bitfield of the same size, e.g. to find
+    // the pieces a peer has that we don't. Bits past the end of either
+    // bitfield count as unset.
+    [[nodiscard]] bool intersects(tr_bitfield const& that) const; // any bits set in both?
+    [[nodiscard]] size_t countAnd(tr_bitfield const& that) const; // how many bits are set in both?
+    [[nodiscard]] size_t countAndNot(tr_bitfield const& that) const; // how many are set here but not in `that`?
+
     [[nodiscard]] constexpr size_t empty() const
     {
         return size() == 0;
@@ -95,7 +107,7 @@ public:
     bool isValid() const;
 
 private:
-    std::vector<uint8_t> flags_;
+    std::vector<uint64_t> flags_;
     [[nodiscard]] size_t countFlags() const;
     [[nodiscard]] size_t countFlags(size_t begin, size_t end) const;
     [[nodiscard]] bool testFlag(size_t bit) const;
@@ -3,17 +3,22 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <cstdlib> /* qsort() */
+#include <algorithm> // std::sort, std::lower_bound, std::remove_if
+#include <cstring> // memcpy()
 #include <ctime>
+#include <iterator> // std::prev
+#include <map>
+#include <memory>
+#include <vector>
 
 #include <event2/buffer.h>
 
 #include "transmission.h"
 #include "cache.h"
+#include "file.h" // tr_sys_iovec
 #include "inout.h"
 #include "log.h"
 #include "peer-common.h" /* MAX_BLOCK_SIZE */
-#include "ptrarray.h"
 #include "torrent.h"
 #include "tr-assert.h"
 #include "trevent.h"
@@ -27,9 +32,89 @@ static char constexpr MyName[] = "Cache";
 *****
 ****/
 
+/**
+ * Fixed-size block slots carved out of large slab allocations.
+ *
+ * Cached blocks used to be a separate heap allocation apiece; with a
+ * multi-gigabyte cache that's hundreds of thousands of small allocations.
+ * Instead, slabs of `SlotsPerSlab` slots are allocated as needed and
+ * their slots are recycled through a free list.
+ */
+class BlockSlots
+{
+public:
+    using slot_t = uint32_t;
+
+    static auto constexpr SlotSize = size_t{ MAX_BLOCK_SIZE };
+    static auto constexpr SlotsPerSlab = size_t{ 64 };
+
+    [[nodiscard]] slot_t acquire()
+    {
+        if (std::empty(free_))
+        {
+            addSlab();
+        }
+
+        auto const slot = free_.back();
+        free_.pop_back();
+        return slot;
+    }
+
+    void release(slot_t slot)
+    {
+        TR_ASSERT(slot < capacity());
+
+        free_.push_back(slot);
+    }
+
+    [[nodiscard]] uint8_t* data(slot_t slot)
+    {
+        TR_ASSERT(slot < capacity());
+
+        return slabs_[slot / SlotsPerSlab].get() + (slot % SlotsPerSlab) * SlotSize;
+    }
+
+    [[nodiscard]] size_t capacity() const
+    {
+        return std::size(slabs_) * SlotsPerSlab;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return capacity() - std::size(free_);
+    }
+
+    // free all the slabs. Only valid when no slots are in use.
+    void clear()
+    {
+        TR_ASSERT(size() == 0);
+
+        slabs_.clear();
+        slabs_.shrink_to_fit();
+        free_.clear();
+        free_.shrink_to_fit();
+    }
+
+private:
+    void addSlab()
+    {
+        auto const first = static_cast<slot_t>(capacity());
+        slabs_.emplace_back(new uint8_t[SlotsPerSlab * SlotSize]);
+
+        // push in reverse so that acquire() hands out slots in ascending order
+        for (auto i = SlotsPerSlab; i > 0; --i)
+        {
+            free_.push_back(static_cast<slot_t>(first + i - 1));
+        }
+    }
+
+    std::vector<std::unique_ptr<uint8_t[]>> slabs_;
+    std::vector<slot_t> free_;
+};
+
 struct cache_block
 {
-    tr_torrent* tor;
+    tr_block_index_t block;
 
     // TODO: use tr_block_info::Location
     tr_piece_index_t piece;
@@ -37,21 +122,47 @@ struct cache_block
     uint32_t length;
 
     time_t time;
-    tr_block_index_t block;
 
-    struct evbuffer* evbuf;
+    BlockSlots::slot_t slot;
+};
+
+// a block that's been written to disk and is waiting for eraseFlushed()
+static auto constexpr FlushedSlot = ~BlockSlots::slot_t{};
+
+// a torrent's cached blocks, sorted by block index. This is one
+// allocation per torrent instead of one map node per cached block.
+using block_map_t = std::vector<cache_block>;
+
+template<typename Blocks>
+static auto lowerBound(Blocks& blocks, tr_block_index_t block)
+{
+    return std::lower_bound(
+        std::begin(blocks),
+        std::end(blocks),
+        block,
+        [](cache_block const& cb, tr_block_index_t b) { return cb.block < b; });
+}
+
+struct torrent_blocks
+{
+    tr_torrent* tor = nullptr;
+    block_map_t blocks;
 };
 
 struct tr_cache
 {
-    tr_ptrArray blocks;
-    int max_blocks;
-    size_t max_bytes;
-
-    size_t disk_writes;
-    size_t disk_write_bytes;
-    size_t cache_writes;
-    size_t cache_write_bytes;
+    // primary key: torrent id
+    std::map<int, torrent_blocks> torrents;
+    BlockSlots slots;
+
+    size_t n_blocks = 0;
+    size_t max_blocks = 0;
+    size_t max_bytes = 0;
+
+    size_t disk_writes = 0;
+    size_t disk_write_bytes = 0;
+    size_t cache_writes = 0;
+    size_t cache_write_bytes = 0;
 };
 
 /****
@@ -60,62 +171,30 @@ struct tr_cache
 
 struct run_info
 {
-    int pos;
+    int tor_id;
+    tr_block_index_t block;
     int rank;
     time_t last_block_time;
     bool is_multi_piece;
     bool is_piece_done;
-    unsigned int len;
+    size_t len;
 };
 
 /* return a count of how many contiguous blocks there are starting at this pos */
-static int getBlockRun(tr_cache const* cache, int pos, struct run_info* info)
+static size_t getBlockRun(block_map_t const& blocks, block_map_t::const_iterator it)
 {
-    int const n = tr_ptrArraySize(&cache->blocks);
-    auto const* const* blocks = (struct cache_block const* const*)tr_ptrArrayBase(&cache->blocks);
-    struct cache_block const* ref = blocks[pos];
-    tr_block_index_t block = ref->block;
-    int len = 0;
+    auto block = it->block;
+    auto len = size_t{ 0 };
 
-    for (int i = pos; i < n; ++i)
+    for (auto const end = std::end(blocks); it != end && it->block == block; ++it)
     {
-        struct cache_block const* b = blocks[i];
-
-        if (b->block != block)
-        {
-            break;
-        }
-
-        if (b->tor != ref->tor)
-        {
-            break;
-        }
-
         ++block;
         ++len;
     }
 
-    if (info != nullptr)
-    {
-        struct cache_block const* b = blocks[pos + len - 1];
-        info->last_block_time = b->time;
-        info->is_piece_done = b->tor->hasPiece(b->piece);
-        info->is_multi_piece = b->piece != blocks[pos]->piece;
-        info->len = len;
-        info->pos = pos;
-    }
-
     return len;
 }
 
-/* higher rank comes before lower rank */
-static int compareRuns(void const* va, void const* vb)
-{
-    auto const* const a = static_cast<struct run_info const*>(va);
-    auto const* const b = static_cast<struct run_info const*>(vb);
-    return b->rank - a->rank;
-}
-
 enum
 {
     MULTIFLAG = 0x1000,
@@ -125,84 +204,116 @@ enum
 
 /* Calculte runs
  *   - Stale runs, runs sitting in cache for a long time or runs not growing, get priority.
- *     Returns number of runs.
  */
-// TODO: return std::vector
-static int calcRuns(tr_cache const* cache, struct run_info* runs)
+static std::vector<run_info> calcRuns(tr_cache const* cache)
 {
-    int const n = tr_ptrArraySize(&cache->blocks);
-    int i = 0;
+    auto runs = std::vector<run_info>{};
+    runs.reserve(cache->n_blocks);
     time_t const now = tr_time();
 
-    for (int pos = 0; pos < n; pos += runs[i++].len)
+    for (auto const& [tor_id, tb] : cache->torrents)
     {
-        int rank = getBlockRun(cache, pos, &runs[i]);
+        auto const& blocks = tb.blocks;
 
-        /* This adds ~2 to the relative length of a run for every minute it has
-         * languished in the cache. */
-        rank += (now - runs[i].last_block_time) / 32;
-
-        /* Flushing stale blocks should be a top priority as the probability of them
-         * growing is very small, for blocks on piece boundaries, and nonexistant for
-         * blocks inside pieces. */
-        rank |= runs[i].is_piece_done ? DONEFLAG : 0;
-
-        /* Move the multi piece runs higher */
-        rank |= runs[i].is_multi_piece ? MULTIFLAG : 0;
-
-        runs[i].rank = rank;
+        for (auto it = std::begin(blocks), end = std::end(blocks); it != end;)
+        {
+            auto const len = getBlockRun(blocks, it);
+            auto const& first = *it;
+            std::advance(it, len);
+            auto const& last = *std::prev(it);
+
+            auto run = run_info{};
+            run.tor_id = tor_id;
+            run.block = first.block;
+            run.len = len;
+            run.last_block_time = last.time;
+            run.is_piece_done = tb.tor->hasPiece(last.piece);
+            run.is_multi_piece = last.piece != first.piece;
+
+            int rank = static_cast<int>(len);
+
+            /* This adds ~2 to the relative length of a run for every minute it has
+             * languished in the cache. */
+            rank += (now - run.last_block_time) / 32;
+
+            /* Flushing stale blocks should be a top priority as the probability of them
+             * growing is very small, for blocks on piece boundaries, and nonexistant for
+             * blocks inside pieces. */
+            rank |= run.is_piece_done ? DONEFLAG : 0;
+
+            /* Move the multi piece runs higher */
+            rank |= run.is_multi_piece ? MULTIFLAG : 0;
+
+            run.rank = rank;
+            runs.push_back(run);
+        }
     }
 
-    qsort(runs, i, sizeof(struct run_info), compareRuns);
-    return i;
+    /* higher rank comes before lower rank */
+    std::sort(std::begin(runs), std::end(runs), [](auto const& a, auto const& b) { return a.rank > b.rank; });
+    return runs;
 }
 
-static int flushContiguous(tr_cache* cache, int pos, int n)
+// Writes `n` blocks and frees their slots. The blocks stay in `tb.blocks`,
+// so that iterators into it stay valid, until eraseFlushed() is called.
+static int flushContiguous(tr_cache* cache, torrent_blocks& tb, block_map_t::iterator begin, size_t n)
 {
-    int err = 0;
-    auto* const buf = tr_new(uint8_t, n * MAX_BLOCK_SIZE);
-    auto* walk = buf;
-    auto** blocks = (struct cache_block**)tr_ptrArrayBase(&cache->blocks);
+    tr_torrent* const tor = tb.tor;
+    tr_piece_index_t const piece = begin->piece;
+    uint32_t const offset = begin->offset;
+
+    // write the blocks straight out of their slots
+    auto iov = std::vector<tr_sys_iovec>{};
+    iov.reserve(n);
+    auto end = begin;
+    auto n_bytes = size_t{};
+    for (size_t i = 0; i < n; ++i, ++end)
+    {
+        auto const& b = *end;
+        iov.push_back({ cache->slots.data(b.slot), b.length });
+        n_bytes += b.length;
+    }
 
-    struct cache_block* b = blocks[pos];
-    tr_torrent* tor = b->tor;
-    tr_piece_index_t const piece = b->piece;
-    uint32_t const offset = b->offset;
+    int const err = tr_ioWritev(tor, piece, offset, std::data(iov), std::size(iov));
 
-    for (int i = 0; i < n; ++i)
+    for (auto it = begin; it != end; ++it)
     {
-        b = blocks[pos + i];
-        evbuffer_copyout(b->evbuf, walk, b->length);
-        walk += b->length;
-        evbuffer_free(b->evbuf);
-        tr_free(b);
+        cache->slots.release(it->slot);
+        it->slot = FlushedSlot;
     }
 
-    tr_ptrArrayErase(&cache->blocks, pos, pos + n);
-
-    err = tr_ioWrite(tor, piece, offset, walk - buf, buf);
-    tr_free(buf);
+    cache->n_blocks -= n;
 
     ++cache->disk_writes;
-    cache->disk_write_bytes += walk - buf;
+    cache->disk_write_bytes += n_bytes;
     return err;
 }
 
-static int flushRuns(tr_cache* cache, struct run_info* runs, int n)
+// drop the blocks that flushContiguous() wrote, and the torrent too if it has none left
+static auto eraseFlushed(tr_cache* cache, std::map<int, torrent_blocks>::iterator tor_it)
+{
+    auto& blocks = tor_it->second.blocks;
+    blocks.erase(
+        std::remove_if(std::begin(blocks), std::end(blocks), [](auto const& cb) { return cb.slot == FlushedSlot; }),
+        std::end(blocks));
+    return std::empty(blocks) ? cache->torrents.erase(tor_it) : std::next(tor_it);
+}
+
+static int flushRuns(tr_cache* cache, std::vector<run_info> const& runs, size_t n)
 {
     int err = 0;
 
-    for (int i = 0; err == 0 && i < n; i++)
+    for (size_t i = 0; err == 0 && i < n; ++i)
     {
-        err = flushContiguous(cache, runs[i].pos, runs[i].len);
+        auto const& run = runs[i];
+        auto& tb = cache->torrents[run.tor_id];
+        err = flushContiguous(cache, tb, lowerBound(tb.blocks, run.block), run.len);
+    }
 
-        for (int j = i + 1; j < n; j++)
-        {
-            if (runs[j].pos > runs[i].pos)
-            {
-                runs[j].pos -= runs[i].len;
-            }
-        }
+    // one pass per torrent, rather than shifting its blocks down after every run
+    for (auto it = std::begin(cache->torrents); it != std::end(cache->torrents);)
+    {
+        it = eraseFlushed(cache, it);
     }
 
     return err;
@@ -212,16 +323,14 @@ static int cacheTrim(tr_cache* cache)
 {
     int err = 0;
 
-    if (tr_ptrArraySize(&cache->blocks) > cache->max_blocks)
+    if (cache->n_blocks > cache->max_blocks)
     {
         /* Amount of cache that should be removed by the flush. This influences how large
          * runs can grow as well as how often flushes will happen. */
-        int const cacheCutoff = 1 + cache->max_blocks / 4;
-        auto* const runs = tr_new(struct run_info, tr_ptrArraySize(&cache->blocks));
-        int i = 0;
-        int j = 0;
-
-        calcRuns(cache, runs);
+        size_t const cacheCutoff = 1 + cache->max_blocks / 4;
+        auto const runs = calcRuns(cache);
+        size_t i = 0;
+        size_t j = 0;
 
         while (j < cacheCutoff)
         {
@@ -229,7 +338,6 @@ static int cacheTrim(tr_cache* cache)
         }
 
         err = flushRuns(cache, runs, i);
-        tr_free(runs);
     }
 
     return err;
@@ -239,7 +347,7 @@ static int cacheTrim(tr_cache* cache)
 ****
 ***/
 
-static int getMaxBlocks(int64_t max_bytes)
+static size_t getMaxBlocks(int64_t max_bytes)
 {
     return max_bytes / (double)MAX_BLOCK_SIZE;
 }
@@ -251,10 +359,24 @@ int tr_cacheSetLimit(tr_cache* cache, int64_t max_bytes)
 
     tr_logAddNamedDbg(
         MyName,
-        "Maximum cache size set to %s (%d blocks)",
+        "Maximum cache size set to %s (%zu blocks)",
         tr_formatter_mem_B(cache->max_bytes).c_str(),
         cache->max_blocks);
 
+    // If the cache shrank, flush everything so that the now-oversized
+    // slabs can be given back to the system
+    if (cache->slots.capacity() > cache->max_blocks + BlockSlots::SlotsPerSlab)
+    {
+        auto const runs = calcRuns(cache);
+
+        if (int const err = flushRuns(cache, runs, std::size(runs)); err != 0)
+        {
+            return err;
+        }
+
+        cache->slots.clear();
+    }
+
     return cacheTrim(cache);
 }
 
@@ -265,8 +387,7 @@ int64_t tr_cacheGetLimit(tr_cache const* cache)
 
 tr_cache* tr_cacheNew(int64_t max_bytes)
 {
-    auto* const cache = tr_new0(tr_cache, 1);
-    cache->blocks = {};
+    auto* const cache = new tr_cache{};
     cache->max_bytes = max_bytes;
     cache->max_blocks = getMaxBlocks(max_bytes);
     return cache;
@@ -274,41 +395,32 @@ tr_cache* tr_cacheNew(int64_t max_bytes)
 
 void tr_cacheFree(tr_cache* cache)
 {
-    tr_ptrArrayDestruct(&cache->blocks, nullptr);
-    tr_free(cache);
+    delete cache;
 }
 
 /***
 ****
 ***/
 
-static int cache_block_compare(void const* va, void const* vb)
+static torrent_blocks& getTorrentBlocks(tr_cache* cache, tr_torrent* torrent)
 {
-    auto const* a = static_cast<struct cache_block const*>(va);
-    auto const* b = static_cast<struct cache_block const*>(vb);
-
-    /* primary key: torrent id */
-    if (a->tor->uniqueId != b->tor->uniqueId)
-    {
-        return a->tor->uniqueId < b->tor->uniqueId ? -1 : 1;
-    }
+    auto& tb = cache->torrents[torrent->uniqueId];
+    tb.tor = torrent;
+    return tb;
+}
 
-    /* secondary key: block # */
-    if (a->block != b->block)
+static cache_block* findBlock(tr_cache* cache, tr_torrent* torrent, tr_piece_index_t piece, uint32_t offset)
+{
+    auto const tor_it = cache->torrents.find(torrent->uniqueId);
+    if (tor_it == std::end(cache->torrents))
     {
-        return a->block < b->block ? -1 : 1;
+        return nullptr;
     }
 
-    /* they're equal */
-    return 0;
-}
-
-static struct cache_block* findBlock(tr_cache* cache, tr_torrent* torrent, tr_piece_index_t piece, uint32_t offset)
-{
-    auto key = cache_block{};
-    key.tor = torrent;
-    key.block = torrent->pieceLoc(piece, offset).block;
-    return static_cast<struct cache_block*>(tr_ptrArrayFindSorted(&cache->blocks, &key, cache_block_compare));
+    auto& blocks = tor_it->second.blocks;
+    auto const block = torrent->pieceLoc(piece, offset).block;
+    auto const it = lowerBound(blocks, block);
+    return it != std::end(blocks) && it->block == block ? &*it : nullptr;
 }
 
 int tr_cacheWriteBlock(
@@ -320,30 +432,28 @@ int tr_cacheWriteBlock(
     struct evbuffer* writeme)
 {
     TR_ASSERT(tr_amInEventThread(torrent->session));
+    TR_ASSERT(length <= BlockSlots::SlotSize);
 
-    struct cache_block* cb = findBlock(cache, torrent, piece, offset);
+    auto& blocks = getTorrentBlocks(cache, torrent).blocks;
+    auto const block = torrent->pieceLoc(piece, offset).block;
+    auto it = lowerBound(blocks, block);
 
-    if (cb == nullptr)
+    if (it == std::end(blocks) || it->block != block)
     {
-        cb = tr_new(struct cache_block, 1);
-        cb->tor = torrent;
-        cb->piece = piece;
-        cb->offset = offset;
-        cb->length = length;
-        cb->block = torrent->pieceLoc(piece, offset).block;
-        cb->evbuf = evbuffer_new();
-        tr_ptrArrayInsertSorted(&cache->blocks, cb, cache_block_compare);
+        it = blocks.insert(it, cache_block{ block, piece, offset, length, 0, cache->slots.acquire() });
+        ++cache->n_blocks;
     }
 
-    TR_ASSERT(cb->length == length);
+    auto& cb = *it;
 
-    cb->time = tr_time();
+    TR_ASSERT(cb.length == length);
 
-    evbuffer_drain(cb->evbuf, evbuffer_get_length(cb->evbuf));
-    evbuffer_remove_buffer(writeme, cb->evbuf, cb->length);
+    cb.time = tr_time();
+
+    evbuffer_remove(writeme, cache->slots.data(cb.slot), cb.length);
 
     cache->cache_writes++;
-    cache->cache_write_bytes += cb->length;
+    cache->cache_write_bytes += cb.length;
 
     return cacheTrim(cache);
 }
@@ -358,9 +468,9 @@ int tr_cacheReadBlock(
 {
     int err = 0;
 
-    if (auto* const cb = findBlock(cache, torrent, piece, offset); cb != nullptr)
+    if (auto const* const cb = findBlock(cache, torrent, piece, offset); cb != nullptr)
     {
-        evbuffer_copyout(cb->evbuf, setme, len);
+        memcpy(setme, cache->slots.data(cb->slot), std::min(len, cb->length));
     }
     else
     {
@@ -382,27 +492,34 @@ int tr_cachePrefetchBlock(tr_cache* cache, tr_torrent* torrent, tr_piece_index_t
     return err;
 }
 
+bool tr_cacheIsDirty(tr_cache* cache, tr_torrent* torrent, tr_piece_index_t piece, uint32_t offset, uint32_t len)
+{
+    auto const tor_it = cache->torrents.find(torrent->uniqueId);
+    if (tor_it == std::end(cache->torrents) || len == 0)
+    {
+        return false;
+    }
+
+    auto const& blocks = tor_it->second.blocks;
+    auto const first = torrent->pieceLoc(piece, offset).block;
+    auto const last = torrent->pieceLoc(piece, offset + len - 1).block;
+    auto const it = lowerBound(blocks, first);
+    return it != std::end(blocks) && it->block <= last;
+}
+
 /***
 ****
 ***/
 
-static int findBlockPos(tr_cache const* cache, tr_torrent* torrent, tr_piece_index_t block)
-{
-    struct cache_block key;
-    key.tor = torrent;
-    key.block = block;
-    return tr_ptrArrayLowerBound(&cache->blocks, &key, cache_block_compare, nullptr);
-}
-
 int tr_cacheFlushDone(tr_cache* cache)
 {
     int err = 0;
 
-    if (tr_ptrArraySize(&cache->blocks) > 0)
+    if (cache->n_blocks > 0)
     {
-        auto* const runs = tr_new(struct run_info, tr_ptrArraySize(&cache->blocks));
-        int i = 0;
-        int const n = calcRuns(cache, runs);
+        auto runs = calcRuns(cache);
+        size_t i = 0;
+        size_t const n = std::size(runs);
 
         while (i < n && (runs[i].is_piece_done || runs[i].is_multi_piece))
         {
@@ -410,58 +527,61 @@ int tr_cacheFlushDone(tr_cache* cache)
         }
 
         err = flushRuns(cache, runs, i);
-        tr_free(runs);
     }
 
     return err;
 }
 
-int tr_cacheFlushFile(tr_cache* cache, tr_torrent* torrent, tr_file_index_t i)
+// flush all the runs that start in [begin, end)
+static int flushSpan(tr_cache* cache, tr_torrent* torrent, tr_block_index_t begin, tr_block_index_t end)
 {
-    auto const [begin, end] = tr_torGetFileBlockSpan(torrent, i);
+    auto const tor_it = cache->torrents.find(torrent->uniqueId);
+    if (tor_it == std::end(cache->torrents))
+    {
+        return 0;
+    }
 
-    int pos = findBlockPos(cache, torrent, begin);
-    dbgmsg("flushing file %d from cache to disk: blocks [%zu...%zu)", (int)i, (size_t)begin, (size_t)end);
+    auto& tb = tor_it->second;
+    auto& blocks = tb.blocks;
 
-    /* flush out all the blocks in that file */
     int err = 0;
-    while (err == 0 && pos < tr_ptrArraySize(&cache->blocks))
+    for (auto it = lowerBound(blocks, begin); err == 0 && it != std::end(blocks) && it->block < end;)
     {
-        auto const* b = static_cast<struct cache_block const*>(tr_ptrArrayNth(&cache->blocks, pos));
+        auto const len = getBlockRun(blocks, it);
+        err = flushContiguous(cache, tb, it, len);
+        std::advance(it, len);
+    }
 
-        if (b->tor != torrent)
-        {
-            break;
-        }
+    eraseFlushed(cache, tor_it);
+    return err;
+}
 
-        if (b->block < begin || b->block >= end)
-        {
-            break;
-        }
+int tr_cacheFlushFile(tr_cache* cache, tr_torrent* torrent, tr_file_index_t i)
+{
+    auto const [begin, end] = tr_torGetFileBlockSpan(torrent, i);
 
-        err = flushContiguous(cache, pos, getBlockRun(cache, pos, nullptr));
-    }
+    dbgmsg("flushing file %d from cache to disk: blocks [%zu...%zu)", (int)i, (size_t)begin, (size_t)end);
 
-    return err;
+    /* flush out all the blocks in that file */
+    return flushSpan(cache, torrent, begin, end);
 }
 
 int tr_cacheFlushTorrent(tr_cache* cache, tr_torrent* torrent)
 {
-    int err = 0;
-    int const pos = findBlockPos(cache, torrent, 0);
-
     /* flush out all the blocks in that torrent */
-    while (err == 0 && pos < tr_ptrArraySize(&cache->blocks))
-    {
-        auto const* b = static_cast<struct cache_block const*>(tr_ptrArrayNth(&cache->blocks, pos));
-
-        if (b->tor != torrent)
-        {
-            break;
-        }
+    return flushSpan(cache, torrent, 0, torrent->blockCount());
+}
 
-        err = flushContiguous(cache, pos, getBlockRun(cache, pos, nullptr));
-    }
+/***
+****
+***/
 
-    return err;
+tr_cache_stats tr_cacheGetStats(tr_cache const* cache)
+{
+    auto stats = tr_cache_stats{};
+    stats.blocks = cache->n_blocks;
+    stats.slots = cache->slots.capacity();
+    stats.slots_in_use = cache->slots.size();
+    stats.torrents = std::size(cache->torrents);
+    return stats;
 }
@@ -9,6 +9,7 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // size_t
 #include <cstdint> // intX_t, uintX_t
 
 struct evbuffer;
@@ -49,6 +50,9 @@ int tr_cacheReadBlock(
 
 int tr_cachePrefetchBlock(tr_cache* cache, tr_torrent* torrent, tr_piece_index_t piece, uint32_t offset, uint32_t len);
 
+// true if any of these bytes are in the cache, waiting to be written to disk
+bool tr_cacheIsDirty(tr_cache* cache, tr_torrent* torrent, tr_piece_index_t piece, uint32_t offset, uint32_t len);
+
 /***
 ****
 ***/
@@ -58,3 +62,21 @@ int tr_cacheFlushDone(tr_cache* cache);
 int tr_cacheFlushTorrent(tr_cache* cache, tr_torrent* torrent);
 
 int tr_cacheFlushFile(tr_cache* cache, tr_torrent* torrent, tr_file_index_t file);
+
+/***
+****
+***/
+
+/**
+ * How many blocks are waiting in the cache,
+ * and how many block-sized slots are set aside to hold them.
+ */
+struct tr_cache_stats
+{
+    size_t blocks = 0;
+    size_t slots = 0;
+    size_t slots_in_use = 0;
+    size_t torrents = 0; // torrents with blocks in the cache
+};
+
+tr_cache_stats tr_cacheGetStats(tr_cache const* cache);
@@ -86,6 +86,13 @@ void tr_completion::amountDone(float* tab, size_t n_tabs) const
         return;
     }
 
+    // seeds and brand-new downloads don't need a bitfield walk
+    if (blocks_.hasAll() || blocks_.hasNone())
+    {
+        std::fill_n(tab, n_tabs, blocks_.hasAll() ? 1.0F : 0.0F);
+        return;
+    }
+
     auto const blocks_per_tab = std::size(blocks_) / n_tabs;
     for (size_t i = 0; i < n_tabs; ++i)
     {
@@ -138,14 +138,14 @@ bool check_ccrypto_pointer(void const* pointer, CCCryptorStatus const* result, c
 ****
 ***/
 
-tr_sha1_ctx_t tr_sha1_init(void)
+tr_sha1_ctx_t tr_sha1_lib_init(void)
 {
     auto* handle = new CC_SHA1_CTX();
     CC_SHA1_Init(handle);
     return handle;
 }
 
-bool tr_sha1_update(tr_sha1_ctx_t handle, void const* data, size_t data_length)
+bool tr_sha1_lib_update(tr_sha1_ctx_t handle, void const* data, size_t data_length)
 {
     TR_ASSERT(handle != nullptr);
 
@@ -160,7 +160,7 @@ bool tr_sha1_update(tr_sha1_ctx_t handle, void const* data, size_t data_length)
     return true;
 }
 
-std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t raw_handle)
+std::optional<tr_sha1_digest_t> tr_sha1_lib_final(tr_sha1_ctx_t raw_handle)
 {
     TR_ASSERT(raw_handle != nullptr);
     auto* handle = static_cast<CC_SHA1_CTX*>(raw_handle);
@@ -168,11 +168,15 @@ std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t raw_handle)
     auto digest = tr_sha1_digest_t{};
     auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
     CC_SHA1_Final(digest_as_uchar, handle);
-
-    delete handle;
+    CC_SHA1_Init(handle);
     return digest;
 }
 
+void tr_sha1_lib_free(tr_sha1_ctx_t raw_handle)
+{
+    delete static_cast<CC_SHA1_CTX*>(raw_handle);
+}
+
 /***
 ****
 ***/
@@ -107,7 +107,7 @@ static std::mutex rng_mutex_;
 ****
 ***/
 
-tr_sha1_ctx_t tr_sha1_init(void)
+tr_sha1_ctx_t tr_sha1_lib_init(void)
 {
     Sha* handle = tr_new(Sha, 1);
 
@@ -120,7 +120,7 @@ tr_sha1_ctx_t tr_sha1_init(void)
     return nullptr;
 }
 
-bool tr_sha1_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_length)
+bool tr_sha1_lib_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_length)
 {
     auto* handle = static_cast<Sha*>(raw_handle);
     TR_ASSERT(handle != nullptr);
@@ -135,19 +135,23 @@ bool tr_sha1_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_leng
     return check_result(API(ShaUpdate)(handle, static_cast<byte const*>(data), data_length));
 }
 
-std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t raw_handle)
+std::optional<tr_sha1_digest_t> tr_sha1_lib_final(tr_sha1_ctx_t raw_handle)
 {
     auto* handle = static_cast<Sha*>(raw_handle);
     TR_ASSERT(handle != nullptr);
 
     auto digest = tr_sha1_digest_t{};
     auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
-    auto const ok = check_result(API(ShaFinal)(handle, digest_as_uchar));
-    tr_free(handle);
+    auto const ok = check_result(API(ShaFinal)(handle, digest_as_uchar)) && check_result(API(InitSha)(handle));
 
     return ok ? std::make_optional(digest) : std::nullopt;
 }
 
+void tr_sha1_lib_free(tr_sha1_ctx_t raw_handle)
+{
+    tr_free(raw_handle);
+}
+
 /***
 ****
 ***/
@@ -98,7 +98,7 @@ static bool check_openssl_pointer(void const* pointer, char const* file, int lin
 ****
 ***/
 
-tr_sha1_ctx_t tr_sha1_init()
+tr_sha1_ctx_t tr_sha1_lib_init()
 {
     EVP_MD_CTX* handle = EVP_MD_CTX_create();
 
@@ -111,7 +111,7 @@ tr_sha1_ctx_t tr_sha1_init()
     return nullptr;
 }
 
-bool tr_sha1_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_length)
+bool tr_sha1_lib_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_length)
 {
     auto* const handle = static_cast<EVP_MD_CTX*>(raw_handle);
 
@@ -127,7 +127,7 @@ bool tr_sha1_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_leng
     return check_result(EVP_DigestUpdate(handle, data, data_length));
 }
 
-std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t raw_handle)
+std::optional<tr_sha1_digest_t> tr_sha1_lib_final(tr_sha1_ctx_t raw_handle)
 {
     auto* handle = static_cast<EVP_MD_CTX*>(raw_handle);
     TR_ASSERT(handle != nullptr);
@@ -138,8 +138,17 @@ std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t raw_handle)
     bool const ok = check_result(EVP_DigestFinal_ex(handle, digest_as_uchar, &hash_length));
     TR_ASSERT(!ok || hash_length == std::size(digest));
 
-    EVP_MD_CTX_destroy(handle);
-    return ok ? std::make_optional(digest) : std::nullopt;
+    if (!ok || !check_result(EVP_DigestInit_ex(handle, EVP_sha1(), nullptr)))
+    {
+        return {};
+    }
+
+    return digest;
+}
+
+void tr_sha1_lib_free(tr_sha1_ctx_t raw_handle)
+{
+    EVP_MD_CTX_destroy(static_cast<EVP_MD_CTX*>(raw_handle));
 }
 
 /***
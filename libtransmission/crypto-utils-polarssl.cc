@@ -122,7 +122,7 @@ static std::recursive_mutex rng_mutex_;
 ****
 ***/
 
-tr_sha1_ctx_t tr_sha1_init(void)
+tr_sha1_ctx_t tr_sha1_lib_init(void)
 {
     api_sha1_context* handle = tr_new0(api_sha1_context, 1);
 
@@ -134,7 +134,7 @@ tr_sha1_ctx_t tr_sha1_init(void)
     return handle;
 }
 
-bool tr_sha1_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_length)
+bool tr_sha1_lib_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_length)
 {
     auto* handle = static_cast<api_sha1_context*>(raw_handle);
     TR_ASSERT(handle != nullptr);
@@ -150,7 +150,7 @@ bool tr_sha1_update(tr_sha1_ctx_t raw_handle, void const* data, size_t data_leng
     return true;
 }
 
-std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t raw_handle)
+std::optional<tr_sha1_digest_t> tr_sha1_lib_final(tr_sha1_ctx_t raw_handle)
 {
     auto* handle = static_cast<api_sha1_context*>(raw_handle);
     TR_ASSERT(handle != nullptr);
@@ -158,12 +158,19 @@ std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t raw_handle)
     auto digest = tr_sha1_digest_t{};
     auto* const digest_as_uchar = reinterpret_cast<unsigned char*>(std::data(digest));
     API(sha1_finish)(handle, digest_as_uchar);
+    API(sha1_starts)(handle);
+    return digest;
+}
+
+void tr_sha1_lib_free(tr_sha1_ctx_t raw_handle)
+{
+    auto* handle = static_cast<api_sha1_context*>(raw_handle);
+
 #if API_VERSION_NUMBER >= 0x01030800
     API(sha1_free)(handle);
 #endif
 
     tr_free(handle);
-    return digest;
 }
 
 /***
@@ -11,6 +11,7 @@
 #include <random>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <arc4.h>
 
@@ -22,6 +23,7 @@ extern "C"
 
 #include "transmission.h"
 #include "crypto-utils.h"
+#include "sha1.h"
 #include "tr-assert.h"
 #include "utils.h"
 
@@ -50,6 +52,150 @@ void tr_dh_align_key(uint8_t* key_buffer, size_t key_size, size_t buffer_size)
 ****
 ***/
 
+namespace
+{
+
+// What a tr_sha1_ctx_t points to. Which hasher it uses is decided when
+// it's created, so a context can't be stranded by a kernel switch.
+struct Sha1Context
+{
+    tr_sha1_state builtin;
+    tr_sha1_ctx_t lib = nullptr;
+};
+
+void sha1ContextFree(Sha1Context* ctx)
+{
+    if (ctx->lib != nullptr)
+    {
+        tr_sha1_lib_free(ctx->lib);
+    }
+
+    delete ctx;
+}
+
+// Finished contexts, kept for the thread's next hash so that hashing
+// doesn't allocate once the thread is warm. A library context is
+// restarted by tr_sha1_lib_final(), so it's kept along with its owner.
+class Sha1Pool
+{
+public:
+    Sha1Pool() = default;
+    Sha1Pool(Sha1Pool const&) = delete;
+    Sha1Pool& operator=(Sha1Pool const&) = delete;
+
+    ~Sha1Pool()
+    {
+        std::for_each(std::begin(idle_), std::end(idle_), sha1ContextFree);
+    }
+
+    [[nodiscard]] Sha1Context* take()
+    {
+        if (std::empty(idle_))
+        {
+            return new Sha1Context{};
+        }
+
+        auto* const ctx = idle_.back();
+        idle_.pop_back();
+        return ctx;
+    }
+
+    void give(Sha1Context* ctx)
+    {
+        if (std::size(idle_) >= MaxIdle)
+        {
+            sha1ContextFree(ctx);
+            return;
+        }
+
+        idle_.push_back(ctx);
+    }
+
+private:
+    static auto constexpr MaxIdle = size_t{ 8 };
+
+    std::vector<Sha1Context*> idle_;
+};
+
+thread_local auto sha1_pool = Sha1Pool{};
+
+} // namespace
+
+tr_sha1_ctx_t tr_sha1_init()
+{
+    auto* const ctx = sha1_pool.take();
+
+    // the built-in generic kernel is slower than the crypto libraries',
+    // so only use our own when it has hardware help
+    if (tr_sha1_get_impl() == tr_sha1_impl::ShaNi)
+    {
+        if (ctx->lib != nullptr)
+        {
+            tr_sha1_lib_free(ctx->lib);
+            ctx->lib = nullptr;
+        }
+
+        tr_sha1_state_init(ctx->builtin);
+        return ctx;
+    }
+
+    if (ctx->lib == nullptr)
+    {
+        ctx->lib = tr_sha1_lib_init();
+    }
+
+    if (ctx->lib == nullptr)
+    {
+        sha1ContextFree(ctx);
+        return nullptr;
+    }
+
+    return ctx;
+}
+
+bool tr_sha1_update(tr_sha1_ctx_t handle, void const* data, size_t data_length)
+{
+    auto* const ctx = static_cast<Sha1Context*>(handle);
+    TR_ASSERT(ctx != nullptr);
+
+    if (ctx->lib != nullptr)
+    {
+        return tr_sha1_lib_update(ctx->lib, data, data_length);
+    }
+
+    if (data_length != 0)
+    {
+        TR_ASSERT(data != nullptr);
+        tr_sha1_state_update(ctx->builtin, data, data_length);
+    }
+
+    return true;
+}
+
+std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t handle)
+{
+    auto* const ctx = static_cast<Sha1Context*>(handle);
+    TR_ASSERT(ctx != nullptr);
+
+    auto const digest = ctx->lib != nullptr ? tr_sha1_lib_final(ctx->lib) : tr_sha1_state_final(ctx->builtin);
+
+    // a library context that failed may not have restarted cleanly
+    if (digest)
+    {
+        sha1_pool.give(ctx);
+    }
+    else
+    {
+        sha1ContextFree(ctx);
+    }
+
+    return digest;
+}
+
+/***
+****
+***/
+
 int tr_rand_int(int upper_bound)
 {
     TR_ASSERT(upper_bound > 0);
@@ -33,7 +33,7 @@ using tr_x509_store_t = void*;
 using tr_x509_cert_t = void*;
 
 /**
- * @brief Allocate and initialize new SHA1 hasher context.
+ * @brief Initialize a SHA1 hasher context, reusing one of this thread's finished ones when it can.
  */
 tr_sha1_ctx_t tr_sha1_init(void);
 
@@ -43,10 +43,19 @@ tr_sha1_ctx_t tr_sha1_init(void);
 bool tr_sha1_update(tr_sha1_ctx_t handle, void const* data, size_t data_length);
 
 /**
- * @brief Finalize and export SHA1 hash, free hasher context.
+ * @brief Finalize and export SHA1 hash, release hasher context.
  */
 std::optional<tr_sha1_digest_t> tr_sha1_final(tr_sha1_ctx_t handle);
 
+/**
+ * @brief The crypto library's SHA1, used by tr_sha1_init() when the CPU has no faster built-in kernel.
+ * tr_sha1_lib_final() restarts the context so it can be reused; tr_sha1_lib_free() releases it.
+ */
+tr_sha1_ctx_t tr_sha1_lib_init(void);
+bool tr_sha1_lib_update(tr_sha1_ctx_t handle, void const* data, size_t data_length);
+std::optional<tr_sha1_digest_t> tr_sha1_lib_final(tr_sha1_ctx_t handle);
+void tr_sha1_lib_free(tr_sha1_ctx_t handle);
+
 /**
  * @brief Generate a SHA1 hash from one or more chunks of memory.
  */
@@ -3,9 +3,9 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <array>
 #include <cstring> /* memcpy(), memmove(), memset() */
-
-#include <arc4.h>
+#include <numeric> // std::iota()
 
 #include "transmission.h"
 #include "crypto.h"
@@ -88,24 +88,104 @@ uint8_t const* tr_cryptoGetMyPublicKey(tr_crypto const* crypto, int* setme_len)
 ***
 **/
 
-static void init_rc4(tr_crypto const* crypto, struct arc4_context** setme, char const* key)
+// RC4's keystream is inherently serial, so there's nothing to vectorize.
+// What we can do is keep i and j in registers for the whole buffer, use a
+// 32-bit S-box to avoid partial-register stalls on byte swaps, and XOR
+// the data eight bytes at a time.
+struct tr_rc4
+{
+    std::array<uint32_t, 256> s;
+    uint8_t i;
+    uint8_t j;
+};
+
+static void rc4_init(tr_rc4* rc4, uint8_t const* key, size_t key_len)
+{
+    auto& s = rc4->s;
+    std::iota(std::begin(s), std::end(s), 0);
+
+    auto j = uint8_t{};
+    for (size_t i = 0; i < std::size(s); ++i)
+    {
+        j = uint8_t(j + s[i] + key[i % key_len]);
+        std::swap(s[i], s[j]);
+    }
+
+    rc4->i = 0;
+    rc4->j = 0;
+}
+
+static void rc4_process(tr_rc4* rc4, uint8_t const* in, uint8_t* out, size_t len)
+{
+    auto* const s = std::data(rc4->s);
+    auto i = rc4->i;
+    auto j = rc4->j;
+
+    auto const next = [s, &i, &j]()
+    {
+        i = uint8_t(i + 1);
+        auto const si = s[i];
+        j = uint8_t(j + si);
+        auto const sj = s[j];
+        s[i] = sj;
+        s[j] = si;
+        return uint8_t(s[uint8_t(si + sj)]);
+    };
+
+    if (in == nullptr)
+    {
+        // just advance the keystream
+        for (; len > 0; --len)
+        {
+            next();
+        }
+    }
+    else
+    {
+        for (; len >= 8; len -= 8, in += 8, out += 8)
+        {
+            auto keystream = std::array<uint8_t, 8>{};
+            for (auto& k : keystream)
+            {
+                k = next();
+            }
+
+            uint64_t data = 0;
+            uint64_t key = 0;
+            memcpy(&data, in, sizeof(data));
+            memcpy(&key, std::data(keystream), sizeof(key));
+            data ^= key;
+            memcpy(out, &data, sizeof(data));
+        }
+
+        for (; len > 0; --len)
+        {
+            *out++ = *in++ ^ next();
+        }
+    }
+
+    rc4->i = i;
+    rc4->j = j;
+}
+
+static void init_rc4(tr_crypto const* crypto, tr_rc4** setme, char const* key)
 {
     TR_ASSERT(crypto->torrent_hash);
 
     if (*setme == nullptr)
     {
-        *setme = tr_new0(struct arc4_context, 1);
+        *setme = tr_new0(tr_rc4, 1);
     }
 
     auto const buf = tr_cryptoSecretKeySha1(crypto, key, 4, std::data(*crypto->torrent_hash), std::size(*crypto->torrent_hash));
     if (buf)
     {
-        arc4_init(*setme, std::data(*buf), std::size(*buf));
-        arc4_discard(*setme, 1024);
+        rc4_init(*setme, reinterpret_cast<uint8_t const*>(std::data(*buf)), std::size(*buf));
+        rc4_process(*setme, nullptr, nullptr, 1024);
     }
 }
 
-static void crypt_rc4(struct arc4_context* key, size_t buf_len, void const* buf_in, void* buf_out)
+static void crypt_rc4(tr_rc4* key, size_t buf_len, void const* buf_in, void* buf_out)
 {
     if (key == nullptr)
     {
@@ -117,7 +197,7 @@ static void crypt_rc4(struct arc4_context* key, size_t buf_len, void const* buf_
         return;
     }
 
-    arc4_process(key, buf_in, buf_out, buf_len);
+    rc4_process(key, static_cast<uint8_t const*>(buf_in), static_cast<uint8_t*>(buf_out), buf_len);
 }
 
 void tr_cryptoDecryptInit(tr_crypto* crypto)
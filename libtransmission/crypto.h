@@ -35,8 +35,8 @@ struct tr_crypto
     ~tr_crypto();
 
     std::optional<tr_sha1_digest_t> torrent_hash = {};
-    struct arc4_context* dec_key = nullptr;
-    struct arc4_context* enc_key = nullptr;
+    struct tr_rc4* dec_key = nullptr;
+    struct tr_rc4* enc_key = nullptr;
     tr_dh_ctx_t dh = {};
     uint8_t myPublicKey[KEY_LEN] = {};
     tr_dh_secret_t mySecret = {};
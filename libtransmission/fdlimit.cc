@@ -7,7 +7,18 @@
 #include <array>
 #include <cerrno>
 #include <cinttypes>
-#include <ctime>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/resource.h> // getrlimit()
+#include <unistd.h> // dup()
+#endif
+
+#include <event2/buffer.h>
 
 #include "transmission.h"
 
@@ -19,7 +30,7 @@
 #include "session.h"
 #include "torrent.h" /* tr_isTorrent() */
 #include "tr-assert.h"
-#include "utils.h" // tr_time()
+#include "utils.h"
 
 #define dbgmsg(...) tr_logAddDeepNamed(nullptr, __VA_ARGS__)
 
@@ -120,25 +131,24 @@ struct tr_cached_file
     tr_sys_file_t fd;
     int torrent_id;
     tr_file_index_t file_index;
-    time_t used_at;
+    std::shared_ptr<tr_file_mapping const> mapping = {};
+    evbuffer_file_segment* segment = nullptr;
+    uint64_t segment_size = 0;
 };
 
-static constexpr bool cached_file_is_open(struct tr_cached_file const* o)
+static void cached_file_close(tr_cached_file& o)
 {
-    TR_ASSERT(o != nullptr);
+    tr_sys_file_close(o.fd, nullptr);
 
-    return (o != nullptr) && (o->fd != TR_BAD_SYS_FILE);
+    if (o.segment != nullptr)
+    {
+        evbuffer_file_segment_free(o.segment);
+    }
 }
 
-static void cached_file_close(struct tr_cached_file* o)
+tr_file_mapping::~tr_file_mapping()
 {
-    TR_ASSERT(cached_file_is_open(o));
-
-    if (o != nullptr)
-    {
-        tr_sys_file_close(o->fd, nullptr);
-        o->fd = TR_BAD_SYS_FILE;
-    }
+    tr_sys_file_unmap(base_, size_, nullptr);
 }
 
 /**
@@ -262,102 +272,143 @@ FAIL:
 ****
 ***/
 
-struct tr_fileset
+// The pool of files that are kept open.
+// Files are found by a hash of their torrent id and file index,
+// and kept in a list ordered by when they were last used, so that
+// both finding a file and picking one to close are O(1).
+class tr_fileset
 {
-    struct tr_cached_file* begin;
-    struct tr_cached_file const* end;
-};
+public:
+    explicit tr_fileset(size_t capacity)
+        : capacity_{ capacity }
+    {
+        index_.reserve(capacity);
+    }
 
-static void fileset_construct(struct tr_fileset* set, int n)
-{
-    set->begin = tr_new(struct tr_cached_file, n);
-    set->end = set->begin + n;
+    tr_fileset(tr_fileset const&) = delete;
+    tr_fileset& operator=(tr_fileset const&) = delete;
 
-    for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+    ~tr_fileset()
     {
-        *o = { false, TR_BAD_SYS_FILE, 0, 0, 0 };
+        for (auto& file : lru_)
+        {
+            cached_file_close(file);
+        }
     }
-}
 
-static void fileset_close_all(struct tr_fileset* set)
-{
-    if (set != nullptr)
+    // Find an open file, and mark it as the most recently used.
+    [[nodiscard]] tr_cached_file* get(int torrent_id, tr_file_index_t file_index)
     {
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        auto const it = index_.find(makeKey(torrent_id, file_index));
+        if (it == std::end(index_))
         {
-            if (cached_file_is_open(o))
-            {
-                cached_file_close(o);
-            }
+            return nullptr;
         }
+
+        lru_.splice(std::begin(lru_), lru_, it->second);
+        return &*it->second;
     }
-}
 
-static void fileset_destruct(struct tr_fileset* set)
-{
-    fileset_close_all(set);
-    tr_free(set->begin);
-    set->end = set->begin = nullptr;
-}
+    // Add a file that was just opened, closing the least recently used one if the pool is full.
+    void add(tr_cached_file const& file)
+    {
+        TR_ASSERT(file.fd != TR_BAD_SYS_FILE);
+        TR_ASSERT(index_.count(makeKey(file.torrent_id, file.file_index)) == 0);
 
-static void fileset_close_torrent(struct tr_fileset* set, int torrent_id)
-{
-    if (set != nullptr)
+        if (std::size(lru_) >= capacity_ && !std::empty(lru_))
+        {
+            dbgmsg("closing least recently used file to make room");
+            close(std::prev(std::end(lru_)));
+            ++stats.evictions;
+        }
+
+        lru_.push_front(file);
+        index_.emplace(makeKey(file.torrent_id, file.file_index), std::begin(lru_));
+    }
+
+    void close(int torrent_id, tr_file_index_t file_index)
     {
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        if (auto const it = index_.find(makeKey(torrent_id, file_index)); it != std::end(index_))
         {
-            if (o->torrent_id == torrent_id && cached_file_is_open(o))
-            {
-                cached_file_close(o);
-            }
+            close(it->second);
         }
     }
-}
 
-static struct tr_cached_file* fileset_lookup(struct tr_fileset* set, int torrent_id, tr_file_index_t i)
-{
-    if (set != nullptr)
+    void closeTorrent(int torrent_id)
     {
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        for (auto it = std::begin(lru_); it != std::end(lru_);)
         {
-            if (torrent_id == o->torrent_id && i == o->file_index && cached_file_is_open(o))
+            auto const next = std::next(it);
+
+            if (it->torrent_id == torrent_id)
             {
-                return o;
+                close(it);
             }
+
+            it = next;
         }
     }
 
-    return nullptr;
-}
-
-static struct tr_cached_file* fileset_get_empty_slot(struct tr_fileset* set)
-{
-    struct tr_cached_file* cull = nullptr;
+    [[nodiscard]] auto capacity() const
+    {
+        return capacity_;
+    }
 
-    if (set != nullptr && set->begin != nullptr)
+    // Change how many files may be open, closing the least recently used ones if needed.
+    void setCapacity(size_t capacity)
     {
-        /* try to find an unused slot */
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        capacity_ = capacity;
+
+        while (std::size(lru_) > capacity_)
         {
-            if (!cached_file_is_open(o))
-            {
-                return o;
-            }
+            close(std::prev(std::end(lru_)));
+            ++stats.evictions;
         }
+    }
+
+    tr_fd_stats stats = {};
+
+private:
+    using list_t = std::list<tr_cached_file>;
+
+    static constexpr uint64_t makeKey(int torrent_id, tr_file_index_t file_index)
+    {
+        return (uint64_t{ static_cast<uint32_t>(torrent_id) } << 32) | file_index;
+    }
+
+    void close(list_t::iterator it)
+    {
+        cached_file_close(*it);
+        index_.erase(makeKey(it->torrent_id, it->file_index));
+        lru_.erase(it);
+    }
+
+    size_t capacity_;
+    list_t lru_; // most recently used first
+    std::unordered_map<uint64_t, list_t::iterator> index_;
+};
+
+// How many fds the pool of files may use. Use a share of the process' fd limit,
+// leaving the rest for peer sockets and everything else.
+static size_t getFilesetFdBudget()
+{
+    static auto constexpr MinFiles = size_t{ 32 };
+    static auto constexpr MaxFiles = size_t{ 1024 };
 
-        /* all slots are full... recycle the least recently used */
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+#ifndef _WIN32
+    auto limit = rlimit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        if (limit.rlim_cur == RLIM_INFINITY)
         {
-            if (cull == nullptr || o->used_at < cull->used_at)
-            {
-                cull = o;
-            }
+            return MaxFiles;
         }
 
-        cached_file_close(cull);
+        return std::clamp(static_cast<size_t>(limit.rlim_cur / 4), MinFiles, MaxFiles);
     }
+#endif
 
-    return cull;
+    return MinFiles;
 }
 
 /***
@@ -368,22 +419,33 @@ static struct tr_cached_file* fileset_get_empty_slot(struct tr_fileset* set)
 
 struct tr_fdInfo
 {
-    int peerCount;
-    struct tr_fileset fileset;
+    size_t const fd_budget = getFilesetFdBudget();
+    int peerCount = 0;
+    tr_fileset fileset{ fd_budget };
 };
 
+// With sendfile uploads, each open file can also hold
+// a dup()ed fd for its segment (see tr_fdFileGetSegment()).
+static size_t getFilesetCapacity(tr_session const* session, size_t fd_budget)
+{
+#ifdef TR_HAVE_SENDFILE
+    if (session->isSendfileUploadsEnabled)
+    {
+        return std::max(fd_budget / 2, size_t{ 1 });
+    }
+#endif
+
+    return fd_budget;
+}
+
 static void ensureSessionFdInfoExists(tr_session* session)
 {
     TR_ASSERT(tr_isSession(session));
 
     if (session->fdInfo == nullptr)
     {
-        int const FILE_CACHE_SIZE = 32;
-
-        /* Create the local file cache */
-        auto* const i = tr_new0(struct tr_fdInfo, 1);
-        fileset_construct(&i->fileset, FILE_CACHE_SIZE);
-        session->fdInfo = i;
+        session->fdInfo = new tr_fdInfo{};
+        dbgmsg("using up to %zu fds for open files", session->fdInfo->fd_budget);
     }
 }
 
@@ -391,9 +453,7 @@ void tr_fdClose(tr_session* session)
 {
     if (session != nullptr && session->fdInfo != nullptr)
     {
-        struct tr_fdInfo* i = session->fdInfo;
-        fileset_destruct(&i->fileset);
-        tr_free(i);
+        delete session->fdInfo;
         session->fdInfo = nullptr;
     }
 }
@@ -402,7 +462,7 @@ void tr_fdClose(tr_session* session)
 ****
 ***/
 
-static struct tr_fileset* get_fileset(tr_session* session)
+static tr_fileset* get_fileset(tr_session* session)
 {
     if (session == nullptr)
     {
@@ -410,12 +470,21 @@ static struct tr_fileset* get_fileset(tr_session* session)
     }
 
     ensureSessionFdInfoExists(session);
-    return &session->fdInfo->fileset;
+
+    // sendfile uploads can be turned on and off while the pool is in use
+    auto* const info = session->fdInfo;
+    if (auto const capacity = getFilesetCapacity(session, info->fd_budget); capacity != info->fileset.capacity())
+    {
+        info->fileset.setCapacity(capacity);
+    }
+
+    return &info->fileset;
 }
 
 void tr_fdFileClose(tr_session* s, tr_torrent const* tor, tr_file_index_t i)
 {
-    tr_cached_file* const o = fileset_lookup(get_fileset(s), tr_torrentId(tor), i);
+    auto* const set = get_fileset(s);
+    tr_cached_file const* const o = set->get(tr_torrentId(tor), i);
     if (o != nullptr)
     {
         /* flush writable files so that their mtimes will be
@@ -425,20 +494,21 @@ void tr_fdFileClose(tr_session* s, tr_torrent const* tor, tr_file_index_t i)
             tr_sys_file_flush(o->fd, nullptr);
         }
 
-        cached_file_close(o);
+        set->close(tr_torrentId(tor), i);
     }
 }
 
 tr_sys_file_t tr_fdFileGetCached(tr_session* s, int torrent_id, tr_file_index_t i, bool writable)
 {
-    struct tr_cached_file* o = fileset_lookup(get_fileset(s), torrent_id, i);
+    auto* const set = get_fileset(s);
+    tr_cached_file const* const o = set->get(torrent_id, i);
 
     if (o == nullptr || (writable && !o->is_writable))
     {
         return TR_BAD_SYS_FILE;
     }
 
-    o->used_at = tr_time();
+    ++set->stats.hits;
     return o->fd;
 }
 
@@ -446,7 +516,7 @@ void tr_fdTorrentClose(tr_session* session, int torrent_id)
 {
     auto const lock = session->unique_lock();
 
-    fileset_close_torrent(get_fileset(session), torrent_id);
+    get_fileset(session)->closeTorrent(torrent_id);
 }
 
 /* returns an fd on success, or a TR_BAD_SYS_FILE on failure and sets errno */
@@ -459,35 +529,140 @@ tr_sys_file_t tr_fdFileCheckout(
     tr_preallocation_mode allocation,
     uint64_t file_size)
 {
-    struct tr_fileset* set = get_fileset(session);
-    struct tr_cached_file* o = fileset_lookup(set, torrent_id, i);
+    auto* const set = get_fileset(session);
 
-    if (o != nullptr && writable && !o->is_writable)
+    if (tr_cached_file const* const o = set->get(torrent_id, i); o != nullptr)
     {
-        cached_file_close(o); /* close it so we can reopen in rw mode */
+        if (!writable || o->is_writable)
+        {
+            dbgmsg("checking out '%s'", filename);
+            ++set->stats.hits;
+            return o->fd;
+        }
+
+        set->close(torrent_id, i); /* close it so we can reopen in rw mode */
     }
-    else if (o == nullptr)
+
+    ++set->stats.misses;
+
+    auto o = tr_cached_file{ writable, TR_BAD_SYS_FILE, torrent_id, i };
+    if (int const err = cached_file_open(&o, filename, writable, allocation, file_size); err != 0)
     {
-        o = fileset_get_empty_slot(set);
+        errno = err;
+        return TR_BAD_SYS_FILE;
     }
 
-    if (!cached_file_is_open(o))
+    dbgmsg("opened '%s' writable %c", filename, writable ? 'y' : 'n');
+    set->add(o);
+
+    dbgmsg("checking out '%s'", filename);
+    return o.fd;
+}
+
+std::shared_ptr<tr_file_mapping const> tr_fdFileGetMapping(
+    tr_session* session,
+    int torrent_id,
+    tr_file_index_t i,
+    uint64_t min_size)
+{
+    // whole files are mapped, so don't try it where address space is scarce
+    if constexpr (sizeof(void*) < 8)
     {
-        if (int const err = cached_file_open(o, filename, writable, allocation, file_size); err != 0)
-        {
-            errno = err;
-            return TR_BAD_SYS_FILE;
-        }
+        return {};
+    }
 
-        dbgmsg("opened '%s' writable %c", filename, writable ? 'y' : 'n');
-        o->is_writable = writable;
+    auto* const set = get_fileset(session);
+    tr_cached_file* const o = set->get(torrent_id, i);
+    if (o == nullptr || min_size == 0)
+    {
+        return {};
     }
 
-    dbgmsg("checking out '%s'", filename);
-    o->torrent_id = torrent_id;
-    o->file_index = i;
-    o->used_at = tr_time();
-    return o->fd;
+    if (o->mapping && o->mapping->size() >= min_size)
+    {
+        return o->mapping;
+    }
+
+    auto info = tr_sys_path_info{};
+    if (!tr_sys_file_get_info(o->fd, &info, nullptr) || info.size < min_size)
+    {
+        return {};
+    }
+
+    tr_error* error = nullptr;
+    auto const* const base = tr_sys_file_map_for_reading(o->fd, 0, info.size, &error);
+    if (base == nullptr)
+    {
+        dbgmsg("couldn't map file: %s", error->message);
+        tr_error_free(error);
+        return {};
+    }
+
+    // any older mapping stays alive until its last reference is dropped
+    o->mapping = std::make_shared<tr_file_mapping const>(base, info.size);
+    ++set->stats.mappings;
+    return o->mapping;
+}
+
+evbuffer_file_segment* tr_fdFileGetSegment(
+    [[maybe_unused]] tr_session* session,
+    [[maybe_unused]] int torrent_id,
+    [[maybe_unused]] tr_file_index_t i,
+    [[maybe_unused]] uint64_t min_size)
+{
+#ifdef TR_HAVE_SENDFILE
+    auto* const set = get_fileset(session);
+    tr_cached_file* const o = set->get(torrent_id, i);
+    if (o == nullptr || min_size == 0)
+    {
+        return nullptr;
+    }
+
+    if (o->segment != nullptr && o->segment_size >= min_size)
+    {
+        return o->segment;
+    }
+
+    auto info = tr_sys_path_info{};
+    if (!tr_sys_file_get_info(o->fd, &info, nullptr) || info.size < min_size)
+    {
+        return nullptr;
+    }
+
+    auto const fd = dup(o->fd);
+    if (fd == -1)
+    {
+        return nullptr;
+    }
+
+    auto* const segment = evbuffer_file_segment_new(fd, 0, info.size, EVBUF_FS_CLOSE_ON_FREE);
+    if (segment == nullptr)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    // an older segment lives on in any evbuffers that still hold it
+    if (o->segment != nullptr)
+    {
+        evbuffer_file_segment_free(o->segment);
+    }
+
+    o->segment = segment;
+    o->segment_size = info.size;
+    ++set->stats.segments;
+    return segment;
+#else
+    return nullptr;
+#endif
+}
+
+tr_fd_stats tr_fdGetStats(tr_session* session)
+{
+    auto* const set = get_fileset(session);
+    auto stats = set->stats;
+    stats.capacity = set->capacity();
+    return stats;
 }
 
 /***
@@ -9,10 +9,24 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <memory>
+
+#include <event2/event-config.h>
+
 #include "transmission.h"
 #include "file.h"
 #include "net.h"
 
+struct evbuffer_file_segment;
+
+// libevent only sends file segments with sendfile() where it has one;
+// elsewhere it would read them into memory
+#if defined(EVENT__HAVE_SENDFILE) && !defined(_WIN32)
+#define TR_HAVE_SENDFILE
+#endif
+
 /**
  * @addtogroup file_io File IO
  * @{
@@ -63,6 +77,95 @@ void tr_fdFileClose(tr_session* session, tr_torrent const* tor, tr_file_index_t
  */
 void tr_fdTorrentClose(tr_session* session, int torrentId);
 
+/**
+ * A read-only memory mapping of a file in the pool of open files.
+ *
+ * The pool drops its reference when the file is closed or evicted, and
+ * the file is unmapped once the last reference is gone. Touching pages
+ * past the end of a file that was truncated after being mapped raises
+ * SIGBUS, so callers should only hand the memory to the kernel (e.g.
+ * as the source of a socket write, which fails with EFAULT instead).
+ */
+class tr_file_mapping
+{
+public:
+    tr_file_mapping(void const* base, uint64_t size)
+        : base_{ static_cast<uint8_t const*>(base) }
+        , size_{ size }
+    {
+    }
+
+    tr_file_mapping(tr_file_mapping const&) = delete;
+    tr_file_mapping& operator=(tr_file_mapping const&) = delete;
+
+    ~tr_file_mapping();
+
+    [[nodiscard]] constexpr uint8_t const* data() const
+    {
+        return base_;
+    }
+
+    [[nodiscard]] constexpr uint64_t size() const
+    {
+        return size_;
+    }
+
+private:
+    uint8_t const* const base_;
+    uint64_t const size_;
+};
+
+/**
+ * Returns a mapping of a file that's already open in the pool,
+ * mapping it if needed. If the file's current mapping is smaller
+ * than min_size (e.g. the file has grown), it's mapped again.
+ *
+ * Returns nullptr if the file isn't open, is too small, or
+ * can't be mapped on this platform.
+ */
+std::shared_ptr<tr_file_mapping const> tr_fdFileGetMapping(
+    tr_session* session,
+    int torrent_id,
+    tr_file_index_t file_num,
+    uint64_t min_size);
+
+/**
+ * Returns a libevent file segment that covers a file that's already
+ * open in the pool, so that its contents can be sent to sockets with
+ * sendfile(). If the file's current segment is smaller than min_size,
+ * a new one is made.
+ *
+ * The segment owns a duplicate of the file's descriptor, so blocks that
+ * are still queued when the pool closes or evicts the file can be sent.
+ * The pool's reference is freed when the file is closed, so add the
+ * returned segment to an evbuffer right away.
+ *
+ * Returns nullptr if the file isn't open, is too small, or if
+ * sendfile() isn't available.
+ */
+struct evbuffer_file_segment* tr_fdFileGetSegment(
+    tr_session* session,
+    int torrent_id,
+    tr_file_index_t file_num,
+    uint64_t min_size);
+
+/**
+ * How well the pool of open files is working: how often a file was
+ * already open when it was needed, how often it had to be opened,
+ * and how often another file had to be closed to make room for it.
+ */
+struct tr_fd_stats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t mappings = 0;
+    uint64_t segments = 0;
+    size_t capacity = 0;
+};
+
+tr_fd_stats tr_fdGetStats(tr_session* session);
+
 /***********************************************************************
  * Sockets
  **********************************************************************/
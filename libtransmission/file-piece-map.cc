@@ -100,11 +100,13 @@ void tr_file_priorities::reset(tr_file_piece_map const* fpm)
     priorities_.resize(n);
     priorities_.shrink_to_fit();
     std::fill_n(std::begin(priorities_), n, TR_PRI_NORMAL);
+    highest_.reset();
 }
 
 void tr_file_priorities::set(tr_file_index_t file, tr_priority_t priority)
 {
     priorities_[file] = priority;
+    highest_.reset();
 }
 
 void tr_file_priorities::set(tr_file_index_t const* files, size_t n, tr_priority_t priority)
@@ -135,6 +137,17 @@ tr_priority_t tr_file_priorities::piecePriority(tr_piece_index_t piece) const
     return *it;
 }
 
+tr_priority_t tr_file_priorities::highestPriority() const
+{
+    if (!highest_)
+    {
+        auto const it = std::max_element(std::begin(priorities_), std::end(priorities_));
+        highest_ = it == std::end(priorities_) ? tr_priority_t{ TR_PRI_NORMAL } : *it;
+    }
+
+    return *highest_;
+}
+
 /***
 ****
 ***/
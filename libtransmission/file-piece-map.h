@@ -10,6 +10,7 @@
 #endif
 
 #include <cstddef> // size_t
+#include <optional>
 #include <vector>
 
 #include "transmission.h"
@@ -122,9 +123,13 @@ public:
     [[nodiscard]] tr_priority_t filePriority(tr_file_index_t file) const;
     [[nodiscard]] tr_priority_t piecePriority(tr_piece_index_t piece) const;
 
+    // the highest priority of any file
+    [[nodiscard]] tr_priority_t highestPriority() const;
+
 private:
     tr_file_piece_map const* fpm_;
     std::vector<tr_priority_t> priorities_;
+    mutable std::optional<tr_priority_t> highest_;
 };
 
 class tr_files_wanted
@@ -14,6 +14,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <iterator> // std::back_inserter
 #include <string_view>
 #include <vector>
 
@@ -24,6 +25,7 @@
 #include <sys/mman.h> /* mmap(), munmap() */
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h> /* pwritev(), struct iovec */
 #include <unistd.h> /* lseek(), write(), ftruncate(), pread(), pwrite(), pathconf(), etc */
 
 #ifdef HAVE_XFS_XFS_H
@@ -868,6 +870,92 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* iov,
+    size_t iov_count,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(iov != nullptr || iov_count == 0);
+    /* seek requires signed offset, so it should be in mod range */
+    TR_ASSERT(offset < UINT64_MAX / 2);
+
+    bool ret = true;
+    uint64_t total = 0;
+
+#ifdef HAVE_PWRITEV
+
+#ifdef IOV_MAX
+    auto constexpr MaxIov = size_t{ IOV_MAX };
+#else
+    auto constexpr MaxIov = size_t{ 16 };
+#endif
+
+    auto vecs = std::vector<struct iovec>{};
+    vecs.reserve(iov_count);
+    std::transform(
+        iov,
+        iov + iov_count,
+        std::back_inserter(vecs),
+        [](auto const& vec) { return iovec{ const_cast<void*>(vec.base), vec.len }; });
+
+    auto* walk = std::data(vecs);
+    auto n_left = std::size(vecs);
+
+    while (n_left > 0)
+    {
+        ssize_t const my_bytes_written = pwritev(handle, walk, static_cast<int>(std::min(n_left, MaxIov)), offset);
+
+        if (my_bytes_written == -1)
+        {
+            set_system_error(error, errno);
+            ret = false;
+            break;
+        }
+
+        offset += my_bytes_written;
+        total += my_bytes_written;
+
+        // skip past what got written. Short writes leave `walk`
+        // pointing at the unwritten remainder of a buffer.
+        auto n = size_t(my_bytes_written);
+        while (n_left > 0 && n >= walk->iov_len)
+        {
+            n -= walk->iov_len;
+            ++walk;
+            --n_left;
+        }
+
+        if (n > 0)
+        {
+            walk->iov_base = static_cast<char*>(walk->iov_base) + n;
+            walk->iov_len -= n;
+        }
+        else if (my_bytes_written == 0 && n_left > 0)
+        {
+            set_system_error(error, EIO);
+            ret = false;
+            break;
+        }
+    }
+
+#else
+
+    ret = tr_sys_file_write_at_each(handle, iov, iov_count, offset, &total, error);
+
+#endif
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return ret;
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
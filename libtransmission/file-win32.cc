@@ -1210,6 +1210,21 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* iov,
+    size_t iov_count,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(iov != nullptr || iov_count == 0);
+
+    // WriteFileGather() needs page-sized, page-aligned buffers, so just write them one at a time
+    return tr_sys_file_write_at_each(handle, iov, iov_count, offset, bytes_written, error);
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
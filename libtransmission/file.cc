@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <cerrno>
 #include <string_view>
 
 #include "transmission.h"
@@ -14,6 +15,57 @@
 
 using namespace std::literals;
 
+bool tr_sys_file_write_at_each(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* iov,
+    size_t iov_count,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(iov != nullptr || iov_count == 0);
+
+    bool ret = true;
+    uint64_t total = 0;
+
+    for (size_t i = 0; ret && i < iov_count; ++i)
+    {
+        auto const* walk = static_cast<char const*>(iov[i].base);
+        auto left = uint64_t{ iov[i].len };
+
+        // keep going after short writes
+        while (left > 0)
+        {
+            auto n = uint64_t{};
+            ret = tr_sys_file_write_at(handle, walk, left, offset, &n, error);
+
+            if (ret && n == 0)
+            {
+                tr_error_set(error, EIO, tr_strerror(EIO));
+                ret = false;
+            }
+
+            if (!ret)
+            {
+                break;
+            }
+
+            walk += n;
+            left -= n;
+            offset += n;
+            total += n;
+        }
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return ret;
+}
+
 bool tr_sys_file_read_line(tr_sys_file_t handle, char* buffer, size_t buffer_size, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -50,6 +50,13 @@ using tr_sys_dir_t = tr_sys_dir_win32*;
 /** @brief Platform-specific invalid directory descriptor constant. */
 #define TR_BAD_SYS_DIR ((tr_sys_dir_t) nullptr)
 
+/** @brief Buffer descriptor for vectored writes, like POSIX `struct iovec`. */
+struct tr_sys_iovec
+{
+    void const* base;
+    size_t len;
+};
+
 enum tr_std_sys_file_t
 {
     TR_STD_SYS_FILE_IN,
@@ -445,6 +452,43 @@ bool tr_sys_file_write_at(
     uint64_t* bytes_written,
     struct tr_error** error);
 
+/**
+ * @brief Like `pwritev()`, except that the position is undefined afterwards.
+ *        Unlike `pwritev()`, this keeps writing until all the buffers have
+ *        been written or an error occurs. Not thread-safe.
+ *
+ * @param[in]  handle        Valid file descriptor.
+ * @param[in]  iov           Buffers to get data being written from.
+ * @param[in]  iov_count     Number of buffers in `iov`.
+ * @param[in]  offset        File offset in bytes to start writing from.
+ * @param[out] bytes_written Number of bytes actually written. Optional, pass
+ *                           `nullptr` if you are not interested.
+ * @param[out] error         Pointer to error object. Optional, pass `nullptr`
+ *                          if you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* iov,
+    size_t iov_count,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    struct tr_error** error);
+
+/**
+ * @brief Same as `tr_sys_file_write_at_v()`, but writes the buffers one at
+ *        a time with `tr_sys_file_write_at()`. This is what platforms
+ *        without a usable vectored write fall back to.
+ */
+bool tr_sys_file_write_at_each(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* iov,
+    size_t iov_count,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    struct tr_error** error);
+
 /**
  * @brief Portability wrapper for `fsync()`.
  *
@@ -6,9 +6,13 @@
 #include <algorithm>
 #include <cerrno>
 #include <cstdlib> /* abort() */
+#include <memory>
+#include <numeric>
 #include <optional>
 #include <vector>
 
+#include <event2/buffer.h>
+
 #include "transmission.h"
 #include "cache.h" /* tr_cacheReadBlock() */
 #include "crypto-utils.h"
@@ -37,33 +41,12 @@ enum
     TR_IO_WRITE
 };
 
-/* returns 0 on success, or an errno on failure */
-static int readOrWriteBytes(
-    tr_session* session,
-    tr_torrent* tor,
-    int ioMode,
-    tr_file_index_t file_index,
-    uint64_t file_offset,
-    void* buf,
-    size_t buflen)
+/* finds (and maybe opens or creates) a torrent file's fd.
+ * returns 0 on success, or an errno on failure */
+static int getFile(tr_session* session, tr_torrent* tor, tr_file_index_t file_index, bool doWrite, tr_sys_file_t* setme)
 {
-    TR_ASSERT(file_index < tor->fileCount());
-
     int err = 0;
-    bool const doWrite = ioMode >= TR_IO_WRITE;
     auto const file_size = tor->fileSize(file_index);
-    TR_ASSERT(file_size == 0 || file_offset < file_size);
-    TR_ASSERT(file_offset + buflen <= file_size);
-
-    if (file_size == 0)
-    {
-        return 0;
-    }
-
-    /***
-    ****  Find the fd
-    ***/
-
     auto fd = tr_fdFileGetCached(session, tr_torrentId(tor), file_index, doWrite);
 
     if (fd == TR_BAD_SYS_FILE) /* it's not cached, so open/create it now */
@@ -108,9 +91,34 @@ static int readOrWriteBytes(
         tr_free(subpath);
     }
 
-    /***
-    ****  Use the fd
-    ***/
+    *setme = fd;
+    return err;
+}
+
+/* returns 0 on success, or an errno on failure */
+static int readOrWriteBytes(
+    tr_session* session,
+    tr_torrent* tor,
+    int ioMode,
+    tr_file_index_t file_index,
+    uint64_t file_offset,
+    void* buf,
+    size_t buflen)
+{
+    TR_ASSERT(file_index < tor->fileCount());
+
+    bool const doWrite = ioMode >= TR_IO_WRITE;
+    auto const file_size = tor->fileSize(file_index);
+    TR_ASSERT(file_size == 0 || file_offset < file_size);
+    TR_ASSERT(file_offset + buflen <= file_size);
+
+    if (file_size == 0)
+    {
+        return 0;
+    }
+
+    auto fd = tr_sys_file_t{ TR_BAD_SYS_FILE };
+    int err = getFile(session, tor, file_index, doWrite, &fd);
 
     if (err == 0)
     {
@@ -147,6 +155,34 @@ static int readOrWriteBytes(
     return err;
 }
 
+/* returns 0 on success, or an errno on failure */
+static int writevBytes(tr_torrent* tor, tr_file_index_t file_index, uint64_t file_offset, std::vector<tr_sys_iovec> const& iov)
+{
+    TR_ASSERT(file_index < tor->fileCount());
+
+    auto fd = tr_sys_file_t{ TR_BAD_SYS_FILE };
+    int err = getFile(tor->session, tor, file_index, true, &fd);
+
+    if (tr_error* error = nullptr;
+        err == 0 && !tr_sys_file_write_at_v(fd, std::data(iov), std::size(iov), file_offset, nullptr, &error))
+    {
+        err = error->code;
+        tr_logAddTorErr(tor, "write failed for \"%s\": %s", tor->fileSubpath(file_index).c_str(), error->message);
+        tr_error_free(error);
+    }
+
+    return err;
+}
+
+static void setWriteError(tr_torrent* tor, tr_file_index_t file_index, int err)
+{
+    if (tor->error != TR_STAT_LOCAL_ERROR)
+    {
+        auto const path = tr_strvPath(tor->downloadDir().sv(), tor->fileSubpath(file_index));
+        tor->setLocalError(tr_strvJoin(tr_strerror(err), " ("sv, path, ")"sv));
+    }
+}
+
 /* returns 0 on success, or an errno on failure */
 static int readOrWritePiece(
     tr_torrent* tor,
@@ -173,10 +209,9 @@ static int readOrWritePiece(
         buf += bytes_this_pass;
         buflen -= bytes_this_pass;
 
-        if (err != 0 && ioMode == TR_IO_WRITE && tor->error != TR_STAT_LOCAL_ERROR)
+        if (err != 0 && ioMode == TR_IO_WRITE)
         {
-            auto const path = tr_strvPath(tor->downloadDir().sv(), tor->fileSubpath(file_index));
-            tor->setLocalError(tr_strvJoin(tr_strerror(err), " ("sv, path, ")"sv));
+            setWriteError(tor, file_index, err);
         }
 
         ++file_index;
@@ -201,6 +236,169 @@ int tr_ioWrite(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, uin
     return readOrWritePiece(tor, TR_IO_WRITE, pieceIndex, begin, (uint8_t*)buf, len);
 }
 
+/* Appends a block to `out` without copying it, one file at a time.
+ * `add(tmp, file_index, file_offset, len)` appends that file's part
+ * and returns 0 on success, or an errno on failure.
+ * Returns 0 on success, or an errno on failure, in which case `out` is unchanged. */
+template<typename AddFunc>
+static int appendBlock(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, uint32_t len, evbuffer* out, AddFunc add)
+{
+    if (pieceIndex >= tor->pieceCount())
+    {
+        return EINVAL;
+    }
+
+    auto* const tmp = evbuffer_new();
+    int err = 0;
+    auto [file_index, file_offset] = tor->fileOffset(pieceIndex, begin);
+
+    // don't let libevent read file segments into memory
+    evbuffer_set_flags(tmp, EVBUFFER_FLAG_DRAINS_TO_FD);
+
+    while (len != 0 && err == 0 && file_index < tor->fileCount())
+    {
+        auto const file_size = tor->fileSize(file_index);
+        auto const bytes_this_pass = uint32_t(std::min(uint64_t{ len }, file_size - file_offset));
+
+        if (bytes_this_pass != 0)
+        {
+            auto fd = tr_sys_file_t{ TR_BAD_SYS_FILE };
+            err = getFile(tor->session, tor, file_index, false, &fd);
+
+            if (err == 0)
+            {
+                err = add(tmp, file_index, file_offset, bytes_this_pass);
+            }
+        }
+
+        len -= bytes_this_pass;
+        ++file_index;
+        file_offset = 0;
+    }
+
+    if (err == 0 && len != 0)
+    {
+        err = EINVAL;
+    }
+
+    if (err == 0)
+    {
+        evbuffer_add_buffer(out, tmp);
+    }
+
+    evbuffer_free(tmp);
+    return err;
+}
+
+int tr_ioReadReference(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, uint32_t len, struct evbuffer* out)
+{
+    // each reference holds its own share of its file's mapping
+    using mapping_ref = std::shared_ptr<tr_file_mapping const>;
+    auto const release = [](void const* /*data*/, size_t /*datalen*/, void* extra)
+    {
+        delete static_cast<mapping_ref*>(extra);
+    };
+
+    auto const add = [tor, &release](evbuffer* buf, tr_file_index_t file_index, uint64_t file_offset, uint32_t n)
+    {
+        auto mapping = tr_fdFileGetMapping(tor->session, tor->uniqueId, file_index, file_offset + n);
+        if (!mapping)
+        {
+            return ENOTSUP;
+        }
+
+        auto const* const data = mapping->data() + file_offset;
+        auto* const ref = new mapping_ref{ std::move(mapping) };
+        if (evbuffer_add_reference(buf, data, n, release, ref) != 0)
+        {
+            delete ref;
+            return ENOMEM;
+        }
+
+        return 0;
+    };
+
+    return appendBlock(tor, pieceIndex, begin, len, out, add);
+}
+
+int tr_ioReadSegment(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, uint32_t len, struct evbuffer* out)
+{
+    auto const add = [tor](evbuffer* buf, tr_file_index_t file_index, uint64_t file_offset, uint32_t n)
+    {
+        auto* const segment = tr_fdFileGetSegment(tor->session, tor->uniqueId, file_index, file_offset + n);
+        if (segment == nullptr)
+        {
+            return ENOTSUP;
+        }
+
+        return evbuffer_add_file_segment(buf, segment, file_offset, n) == 0 ? 0 : ENOMEM;
+    };
+
+    return appendBlock(tor, pieceIndex, begin, len, out, add);
+}
+
+int tr_ioWritev(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, tr_sys_iovec const* iov, size_t iov_count)
+{
+    if (pieceIndex >= tor->pieceCount())
+    {
+        return EINVAL;
+    }
+
+    // the buffers must not run past the end of the last file
+    auto const n_bytes = std::accumulate(
+        iov,
+        iov + iov_count,
+        uint64_t{},
+        [](uint64_t sum, tr_sys_iovec const& vec) { return sum + vec.len; });
+    auto const fits = tor->pieceLoc(pieceIndex, begin).byte + n_bytes <= tor->totalSize();
+    TR_ASSERT(fits);
+    if (!fits)
+    {
+        return EINVAL;
+    }
+
+    int err = 0;
+    auto [file_index, file_offset] = tor->fileOffset(pieceIndex, begin);
+    auto const* const iov_end = iov + iov_count;
+    auto used = size_t{}; // how much of `*iov` has already been written
+    auto file_iov = std::vector<tr_sys_iovec>{};
+    file_iov.reserve(iov_count);
+
+    while (err == 0 && iov != iov_end && file_index < tor->fileCount())
+    {
+        // gather the buffers, or pieces of buffers, that land in this file
+        file_iov.clear();
+        for (auto file_left = tor->fileSize(file_index) - file_offset; file_left > 0 && iov != iov_end;)
+        {
+            auto const len = std::min(uint64_t{ iov->len - used }, file_left);
+            file_iov.push_back({ static_cast<uint8_t const*>(iov->base) + used, size_t(len) });
+            file_left -= len;
+            used += len;
+
+            if (used == iov->len)
+            {
+                ++iov;
+                used = 0;
+            }
+        }
+
+        if (!std::empty(file_iov))
+        {
+            err = writevBytes(tor, file_index, file_offset, file_iov);
+
+            if (err != 0)
+            {
+                setWriteError(tor, file_index, err);
+            }
+        }
+
+        ++file_index;
+        file_offset = 0;
+    }
+
+    return err;
+}
+
 /****
 *****
 ****/
@@ -234,6 +432,34 @@ static std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece
     return tr_sha1_final(sha);
 }
 
+bool tr_ioReadPiece(tr_torrent* tor, tr_piece_index_t piece, uint32_t begin, std::vector<uint8_t>& setme)
+{
+    TR_ASSERT(tor != nullptr);
+    TR_ASSERT(piece < tor->pieceCount());
+    TR_ASSERT(begin <= tor->pieceSize(piece));
+
+    auto const piece_size = size_t(tor->pieceSize(piece));
+    setme.resize(piece_size - begin);
+    if (std::empty(setme))
+    {
+        return true;
+    }
+
+    tr_ioPrefetch(tor, piece, begin, std::size(setme));
+
+    auto const block_size = size_t(tor->blockSize());
+    for (size_t offset = begin; offset < piece_size; offset += block_size)
+    {
+        auto const len = std::min(piece_size - offset, block_size);
+        if (tr_cacheReadBlock(tor->session->cache, tor, piece, offset, len, &setme[offset - begin]) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece)
 {
     auto const hash = recalculateHash(tor, piece);
@@ -9,6 +9,12 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <vector>
+
+struct evbuffer;
+struct tr_sys_iovec;
 struct tr_torrent;
 
 /**
@@ -30,6 +36,45 @@ int tr_ioPrefetch(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin,
  */
 int tr_ioWrite(struct tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t offset, uint32_t len, uint8_t const* writeme);
 
+/**
+ * Writes the buffers in `iov`, in order, starting at the specified piece index
+ * and offset. This is a vectored tr_ioWrite() that can write a run of
+ * separately-allocated blocks without first copying them into one buffer.
+ * @return 0 on success, or an errno value on failure. Buffers that would run
+ *         past the end of the torrent's last file are an EINVAL.
+ */
+int tr_ioWritev(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, tr_sys_iovec const* iov, size_t iov_count);
+
+/**
+ * Appends the block specified by the piece index, offset, and length to `out`
+ * as references into the torrent's memory-mapped files, so that it can be
+ * written to a socket without being copied first. The mappings stay alive
+ * until `out` releases the block.
+ *
+ * Don't read the appended bytes in userspace: see tr_file_mapping.
+ * @return 0 on success, or an errno value on failure, in which case
+ *         nothing is appended and the caller should fall back to tr_ioRead().
+ */
+int tr_ioReadReference(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, uint32_t len, struct evbuffer* out);
+
+/**
+ * Appends the block specified by the piece index, offset, and length to `out`
+ * as libevent file segments, which are written to sockets with sendfile().
+ * The segments keep their files open until `out` releases the block.
+ *
+ * The appended bytes can't be read in userspace at all, so only
+ * pass `out` to tr_peerIoWriteFileSegments().
+ * @return 0 on success, or an errno value on failure, in which case
+ *         nothing is appended and the caller should fall back to tr_ioRead().
+ */
+int tr_ioReadSegment(tr_torrent* tor, tr_piece_index_t pieceIndex, uint32_t begin, uint32_t len, struct evbuffer* out);
+
+/**
+ * Reads a piece, from `begin` to the end of the piece, through the cache into `setme`.
+ * @return true on success, false if any of it couldn't be read.
+ */
+bool tr_ioReadPiece(tr_torrent* tor, tr_piece_index_t piece, uint32_t begin, std::vector<uint8_t>& setme);
+
 /**
  * @brief Test to see if the piece matches its metainfo's SHA1 checksum.
  */
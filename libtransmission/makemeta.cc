@@ -5,23 +5,27 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring> /* strcmp, strlen */
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string_view>
 #include <thread>
+#include <vector>
 
 #include <event2/util.h> /* evutil_ascii_strcasecmp() */
 
 #include "transmission.h"
 
-#include "crypto-utils.h"
 #include "error.h"
 #include "file.h"
 #include "log.h"
 #include "makemeta.h"
 #include "session.h"
+#include "sha1.h"
 #include "tr-assert.h"
 #include "utils.h" /* buildpath */
 #include "variant.h"
@@ -249,103 +253,311 @@ void tr_metaInfoBuilderFree(tr_metainfo_builder* builder)
 *****
 ****/
 
-static std::vector<std::byte> getHashInfo(tr_metainfo_builder* b)
+namespace
 {
-    auto ret = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * b->pieceCount);
 
-    if (b->totalSize == 0)
+// Hashes a new torrent's pieces on a pool of worker threads.
+// The reader fills chunks of whole pieces and submits them; each worker
+// hashes one chunk at a time and writes the digests straight into their
+// slots in the output, so the hashes come out in piece order no matter
+// which worker finishes first. The chunks together are capped at
+// MaxInFlightBytes, so with big pieces there may be fewer workers.
+class ChunkHasher
+{
+public:
+    struct Chunk
     {
-        return {};
+        tr_piece_index_t first_piece = 0;
+        size_t len = 0;
+        std::vector<char> buf;
+    };
+
+    static auto constexpr MaxInFlightBytes = size_t{ 64 * 1024 * 1024 };
+
+    ChunkHasher(tr_metainfo_builder* b, std::byte* digests, size_t n_workers)
+        : piece_size_{ b->pieceSize }
+        , digests_{ digests }
+        , n_hashed_{ &b->pieceIndex }
+    {
+        // big reads keep the disk busy, and whole pieces per chunk
+        // lets tr_sha1_many() hash small pieces side by side
+        auto constexpr ChunkSize = size_t{ 4 * 1024 * 1024 };
+        auto const chunk_size = std::max(ChunkSize / piece_size_, size_t{ 1 }) * piece_size_;
+
+        // one chunk per worker, plus a couple for the reader to fill meanwhile,
+        // but at least one to read into while another is hashed
+        auto const max_chunks = std::max(MaxInFlightBytes / chunk_size, size_t{ 2 });
+        auto const n_chunks = std::min(n_workers + 2, max_chunks);
+        n_workers = std::clamp(n_workers, size_t{ 1 }, n_chunks - 1);
+
+        for (size_t i = 0; i < n_chunks; ++i)
+        {
+            auto chunk = std::make_unique<Chunk>();
+            chunk->buf.resize(chunk_size);
+            free_.push_back(std::move(chunk));
+        }
+
+        for (size_t i = 0; i < n_workers; ++i)
+        {
+            workers_.emplace_back(&ChunkHasher::workerFunc, this);
+        }
     }
 
-    b->pieceIndex = 0;
-    uint64_t totalRemain = b->totalSize;
-    uint32_t fileIndex = 0;
-    auto* walk = std::data(ret);
-    auto buf = std::vector<char>(b->pieceSize);
-    uint64_t off = 0;
-    tr_error* error = nullptr;
-
-    tr_sys_file_t fd = tr_sys_file_open(b->files[fileIndex].filename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, &error);
-    if (fd == TR_BAD_SYS_FILE)
-    {
-        b->my_errno = error->code;
-        tr_strlcpy(b->errfile, b->files[fileIndex].filename, sizeof(b->errfile));
-        b->result = TrMakemetaResult::ERR_IO_READ;
-        tr_error_free(error);
-        return {};
+    ChunkHasher(ChunkHasher const&) = delete;
+    ChunkHasher& operator=(ChunkHasher const&) = delete;
+
+    ~ChunkHasher()
+    {
+        {
+            auto const lock = std::lock_guard(mutex_);
+            is_closing_ = true;
+        }
+
+        todo_cv_.notify_all();
+
+        for (auto& worker : workers_)
+        {
+            worker.join();
+        }
     }
 
-    while (totalRemain != 0)
+    // Get an empty chunk to read into, waiting for one if they're all in use.
+    std::unique_ptr<Chunk> acquire()
     {
-        TR_ASSERT(b->pieceIndex < b->pieceCount);
+        auto lock = std::unique_lock(mutex_);
+        done_cv_.wait(lock, [this]() { return !std::empty(free_); });
 
-        auto* bufptr = std::data(buf);
-        uint32_t const thisPieceSize = std::min(uint64_t{ b->pieceSize }, totalRemain);
-        uint64_t leftInPiece = thisPieceSize;
+        auto chunk = std::move(free_.back());
+        free_.pop_back();
+        return chunk;
+    }
 
-        while (leftInPiece != 0)
+    void submit(std::unique_ptr<Chunk> chunk)
+    {
         {
-            uint64_t const n_this_pass = std::min(b->files[fileIndex].size - off, leftInPiece);
-            uint64_t n_read = 0;
-            (void)tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, nullptr);
-            bufptr += n_read;
-            off += n_read;
-            leftInPiece -= n_read;
-
-            if (off == b->files[fileIndex].size)
+            auto const lock = std::lock_guard(mutex_);
+            todo_.push_back(std::move(chunk));
+            ++n_pending_;
+        }
+
+        todo_cv_.notify_one();
+    }
+
+    // Wait for all the submitted chunks to be hashed.
+    void finish()
+    {
+        auto lock = std::unique_lock(mutex_);
+        done_cv_.wait(lock, [this]() { return n_pending_ == 0; });
+    }
+
+private:
+    void workerFunc()
+    {
+        auto lock = std::unique_lock(mutex_);
+
+        for (;;)
+        {
+            todo_cv_.wait(lock, [this]() { return is_closing_ || !std::empty(todo_); });
+            if (std::empty(todo_))
             {
-                off = 0;
-                tr_sys_file_close(fd, nullptr);
-                fd = TR_BAD_SYS_FILE;
+                return;
+            }
+
+            auto chunk = std::move(todo_.front());
+            todo_.pop_front();
 
-                if (++fileIndex < b->fileCount)
+            lock.unlock();
+            auto const n_pieces = hash(*chunk);
+            lock.lock();
+
+            *n_hashed_ += n_pieces;
+            --n_pending_;
+            free_.push_back(std::move(chunk));
+            done_cv_.notify_one();
+        }
+    }
+
+    [[nodiscard]] uint32_t hash(Chunk const& chunk) const
+    {
+        auto pieces = std::vector<std::string_view>{};
+        for (size_t offset = 0; offset < chunk.len; offset += piece_size_)
+        {
+            pieces.emplace_back(std::data(chunk.buf) + offset, std::min(size_t{ piece_size_ }, chunk.len - offset));
+        }
+
+        auto hashes = std::vector<tr_sha1_digest_t>(std::size(pieces));
+        tr_sha1_many(std::data(pieces), std::size(pieces), std::data(hashes));
+
+        auto* walk = digests_ + size_t{ chunk.first_piece } * std::size(tr_sha1_digest_t{});
+        for (auto const& digest : hashes)
+        {
+            walk = std::copy(std::begin(digest), std::end(digest), walk);
+        }
+
+        return static_cast<uint32_t>(std::size(pieces));
+    }
+
+    size_t const piece_size_;
+    std::byte* const digests_;
+    uint32_t* const n_hashed_;
+
+    std::mutex mutex_;
+    std::condition_variable todo_cv_;
+    std::condition_variable done_cv_;
+    std::deque<std::unique_ptr<Chunk>> todo_;
+    std::vector<std::unique_ptr<Chunk>> free_;
+    size_t n_pending_ = 0;
+    bool is_closing_ = false;
+
+    std::vector<std::thread> workers_;
+};
+
+// Reads the builder's files back to back, as if they were one long file.
+class FileStreamReader
+{
+public:
+    explicit FileStreamReader(tr_metainfo_builder* b)
+        : b_{ b }
+    {
+    }
+
+    FileStreamReader(FileStreamReader const&) = delete;
+    FileStreamReader& operator=(FileStreamReader const&) = delete;
+
+    ~FileStreamReader()
+    {
+        if (fd_ != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd_, nullptr);
+        }
+    }
+
+    // Fill `buf` with the next `len` bytes.
+    // On failure, the builder's result and error fields are set.
+    bool read(char* buf, uint64_t len)
+    {
+        while (len > 0)
+        {
+            TR_ASSERT(file_index_ < b_->fileCount);
+            auto const& file = b_->files[file_index_];
+
+            tr_error* error = nullptr;
+
+            if (fd_ == TR_BAD_SYS_FILE)
+            {
+                fd_ = tr_sys_file_open(file.filename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, &error);
+                if (fd_ == TR_BAD_SYS_FILE)
                 {
-                    fd = tr_sys_file_open(b->files[fileIndex].filename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, &error);
-
-                    if (fd == TR_BAD_SYS_FILE)
-                    {
-                        b->my_errno = error->code;
-                        tr_strlcpy(b->errfile, b->files[fileIndex].filename, sizeof(b->errfile));
-                        b->result = TrMakemetaResult::ERR_IO_READ;
-                        tr_error_free(error);
-                        return {};
-                    }
+                    setError(file.filename, error->code);
+                    tr_error_free(error);
+                    return false;
                 }
             }
-        }
 
-        TR_ASSERT(bufptr - std::data(buf) == (int)thisPieceSize);
-        TR_ASSERT(leftInPiece == 0);
-        auto const digest = tr_sha1(buf);
-        if (!digest)
-        {
-            b->my_errno = EIO;
-            tr_snprintf(b->errfile, sizeof(b->errfile), "error hashing piece %" PRIu32, b->pieceIndex);
-            b->result = TrMakemetaResult::ERR_IO_READ;
-            break;
+            auto const n_this_pass = std::min(file.size - offset_, len);
+            auto n_read = uint64_t{};
+            if (n_this_pass > 0 && !tr_sys_file_read(fd_, buf, n_this_pass, &n_read, &error))
+            {
+                setError(file.filename, error->code);
+                tr_error_free(error);
+                return false;
+            }
+
+            // the file got shorter since the builder was created
+            if (n_this_pass > 0 && n_read == 0)
+            {
+                setError(file.filename, EIO);
+                return false;
+            }
+
+            buf += n_read;
+            len -= n_read;
+            offset_ += n_read;
+
+            if (offset_ == file.size)
+            {
+                tr_sys_file_close(fd_, nullptr);
+                fd_ = TR_BAD_SYS_FILE;
+                offset_ = 0;
+                ++file_index_;
+            }
         }
 
-        walk = std::copy(std::begin(*digest), std::end(*digest), walk);
+        return true;
+    }
+
+private:
+    void setError(char const* filename, int err)
+    {
+        b_->my_errno = err;
+        tr_strlcpy(b_->errfile, filename, sizeof(b_->errfile));
+        b_->result = TrMakemetaResult::ERR_IO_READ;
+    }
+
+    tr_metainfo_builder* const b_;
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+    uint32_t file_index_ = 0;
+    uint64_t offset_ = 0;
+};
+
+size_t hashThreadCount(tr_metainfo_builder const* b)
+{
+    if (b->hashThreads > 0)
+    {
+        return b->hashThreads;
+    }
 
+    // past this, the disk is almost always the bottleneck
+    static auto constexpr MaxAutoThreads = 8U;
+    return std::clamp(std::thread::hardware_concurrency(), 1U, MaxAutoThreads);
+}
+
+} // namespace
+
+static std::vector<std::byte> getHashInfo(tr_metainfo_builder* b)
+{
+    auto ret = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * b->pieceCount);
+
+    if (b->totalSize == 0)
+    {
+        return {};
+    }
+
+    b->pieceIndex = 0;
+
+    auto reader = FileStreamReader{ b };
+    auto hasher = ChunkHasher{ b, std::data(ret), hashThreadCount(b) };
+    auto total_remain = b->totalSize;
+    auto piece = tr_piece_index_t{};
+
+    while (total_remain != 0)
+    {
         if (b->abortFlag)
         {
             b->result = TrMakemetaResult::CANCELLED;
             break;
         }
 
-        totalRemain -= thisPieceSize;
-        ++b->pieceIndex;
-    }
+        auto chunk = hasher.acquire();
+        chunk->first_piece = piece;
+        chunk->len = std::min(uint64_t{ std::size(chunk->buf) }, total_remain);
 
-    TR_ASSERT(b->abortFlag || size_t(walk - std::data(ret)) == std::size(ret));
-    TR_ASSERT(b->abortFlag || !totalRemain);
+        if (!reader.read(std::data(chunk->buf), chunk->len))
+        {
+            hasher.finish();
+            return {};
+        }
 
-    if (fd != TR_BAD_SYS_FILE)
-    {
-        tr_sys_file_close(fd, nullptr);
+        piece += (chunk->len + b->pieceSize - 1) / b->pieceSize;
+        total_remain -= chunk->len;
+        hasher.submit(std::move(chunk));
     }
 
+    hasher.finish();
+
+    TR_ASSERT(b->abortFlag || piece == b->pieceCount);
+    TR_ASSERT(b->abortFlag || b->pieceIndex == b->pieceCount);
+
     return ret;
 }
 
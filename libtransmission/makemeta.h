@@ -43,6 +43,11 @@ struct tr_metainfo_builder
     uint32_t pieceCount;
     bool isFolder;
 
+    /* how many threads tr_makeMetaInfo() hashes pieces with.
+     * Clients may change this before calling it; 0 means pick one
+     * based on the number of CPU cores. */
+    uint32_t hashThreads;
+
     /**
     ***  These are set inside tr_makeMetaInfo()
     ***  by copying the arguments passed to it,
@@ -67,7 +72,7 @@ struct tr_metainfo_builder
     ***  tell tr_makeMetaInfo() to abort and clean up after itself.
     **/
 
-    uint32_t pieceIndex;
+    uint32_t pieceIndex; /* how many pieces have been hashed so far */
     bool abortFlag;
     bool isDone;
     TrMakemetaResult result;
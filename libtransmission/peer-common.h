@@ -42,10 +42,10 @@ enum PeerEventType
     TR_PEER_CLIENT_GOT_SUGGEST,
     TR_PEER_CLIENT_GOT_PORT,
     TR_PEER_CLIENT_GOT_REJ,
-    TR_PEER_CLIENT_GOT_BITFIELD,
+    TR_PEER_CLIENT_GOT_BITFIELD, /* published before tr_peer.have is replaced */
     TR_PEER_CLIENT_GOT_HAVE,
-    TR_PEER_CLIENT_GOT_HAVE_ALL,
-    TR_PEER_CLIENT_GOT_HAVE_NONE,
+    TR_PEER_CLIENT_GOT_HAVE_ALL, /* published before tr_peer.have is replaced */
+    TR_PEER_CLIENT_GOT_HAVE_NONE, /* published before tr_peer.have is replaced */
     TR_PEER_PEER_GOT_PIECE_DATA,
     TR_PEER_ERROR
 };
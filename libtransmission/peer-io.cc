@@ -4,10 +4,12 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <vector>
 
 #include <event2/event.h>
 #include <event2/buffer.h>
@@ -89,6 +91,7 @@ struct tr_datatype
     struct tr_datatype* next;
     size_t length;
     bool isPieceData;
+    bool isFileSegment;
 };
 
 static struct tr_datatype* datatype_pool = nullptr;
@@ -162,7 +165,7 @@ static void didWriteWrapper(tr_peerIo* io, unsigned int bytes_transferred)
         unsigned int const overhead = io->socket.type == TR_PEER_SOCKET_TYPE_TCP ? guessPacketOverhead(payload) : 0;
         uint64_t const now = tr_time_msec();
 
-        io->bandwidth->notifyBandwidthConsumed(TR_UP, payload, next->isPieceData, now);
+        io->bandwidth->notifyBandwidthConsumed(TR_UP, payload, next->isPieceData, now, next->isFileSegment);
 
         if (overhead > 0)
         {
@@ -329,12 +332,94 @@ static void event_read_cb(evutil_socket_t fd, short /*event*/, void* vio)
     }
 }
 
+static void consumeFileSegmentRuns(tr_peerIo* io, size_t n)
+{
+    auto& runs = io->outbuf_file_segments;
+
+    while (n != 0 && !std::empty(runs))
+    {
+        auto& run = runs.front();
+
+        auto take = std::min(n, run.gap);
+        run.gap -= take;
+        n -= take;
+
+        take = std::min(n, run.length);
+        run.length -= take;
+        n -= take;
+
+        if (run.length == 0)
+        {
+            runs.pop_front();
+        }
+    }
+}
+
+/* libevent writes either memory chains or a single file segment per call,
+ * and sends a file segment whole no matter what `howmuch` is. So write
+ * outbuf a step at a time, and don't start a run of segments unless it
+ * fits in what's left of `howmuch`. */
+static int tr_evbuffer_write_file_segments(tr_peerIo* io, int fd, size_t howmuch)
+{
+    auto const& runs = io->outbuf_file_segments;
+    auto total = size_t{};
+
+    while (total < howmuch && evbuffer_get_length(io->outbuf) != 0)
+    {
+        auto const left = howmuch - total;
+        auto step = left;
+
+        if (!std::empty(runs))
+        {
+            auto const& run = runs.front();
+
+            if (run.gap != 0)
+            {
+                step = std::min(left, run.gap);
+            }
+            else if (run.length > left)
+            {
+                // without a speed limit, `howmuch` is just this io's turn,
+                // so leave the run for a bigger one. With a speed limit,
+                // the budget might never be big enough, so send the run
+                // and let Bandwidth take the excess out of later periods
+                if (!io->bandwidth->isThrottled(TR_UP))
+                {
+                    break;
+                }
+
+                step = run.length;
+            }
+        }
+
+        int const n = evbuffer_write_atmost(io->outbuf, fd, step);
+        if (n <= 0)
+        {
+            if (total == 0)
+            {
+                return n;
+            }
+
+            // report what was written; any error will come up again next time
+            EVUTIL_SET_SOCKET_ERROR(0);
+            break;
+        }
+
+        total += n;
+        consumeFileSegmentRuns(io, n);
+    }
+
+    return int(total);
+}
+
 static int tr_evbuffer_write(tr_peerIo* io, int fd, size_t howmuch)
 {
     char errstr[256];
 
     EVUTIL_SET_SOCKET_ERROR(0);
-    int const n = evbuffer_write_atmost(io->outbuf, fd, howmuch);
+    int const n = std::empty(io->outbuf_file_segments) ? evbuffer_write_atmost(io->outbuf, fd, howmuch) :
+                                                          tr_evbuffer_write_file_segments(io, fd, howmuch);
+
     int const e = EVUTIL_SOCKET_ERROR();
     dbgmsg(io, "wrote %d to peer (%s)", n, (n == -1 ? tr_net_strerror(errstr, sizeof(errstr), e) : ""));
 
@@ -1050,6 +1135,35 @@ void tr_peerIoSetEncryption(tr_peerIo* io, tr_encryption_type encryption_type)
 ***
 **/
 
+// Call `func(data, len)` on each extent of the `len` bytes of `buffer`
+// that start at `start_at`, or at the front if that's nullptr. The
+// extents are all peeked at in one go rather than walked one at a time.
+template<typename Func>
+static void forEachExtent(struct evbuffer* buffer, struct evbuffer_ptr* start_at, size_t len, Func&& func)
+{
+    auto on_stack = std::array<evbuffer_iovec, 16>{};
+    auto on_heap = std::vector<evbuffer_iovec>{};
+    auto* vecs = std::data(on_stack);
+
+    auto n_vecs = evbuffer_peek(buffer, len, start_at, vecs, int(std::size(on_stack)));
+    if (n_vecs > int(std::size(on_stack)))
+    {
+        on_heap.resize(n_vecs);
+        vecs = std::data(on_heap);
+        n_vecs = evbuffer_peek(buffer, len, start_at, vecs, n_vecs);
+    }
+
+    // the last extent may run past `len`
+    for (int i = 0; i < n_vecs && len > 0; ++i)
+    {
+        auto const n = std::min(vecs[i].iov_len, len);
+        func(static_cast<uint8_t*>(vecs[i].iov_base), n);
+        len -= n;
+    }
+
+    TR_ASSERT(len == 0);
+}
+
 static inline void processBuffer(
     tr_crypto* crypto,
     struct evbuffer* buffer,
@@ -1057,31 +1171,21 @@ static inline void processBuffer(
     size_t size,
     void (*callback)(tr_crypto*, size_t, void const*, void*))
 {
-    struct evbuffer_ptr pos;
-    struct evbuffer_iovec iovec;
-
-    evbuffer_ptr_set(buffer, &pos, offset, EVBUFFER_PTR_SET);
-
-    do
+    if (size == 0)
     {
-        if (evbuffer_peek(buffer, size, &pos, &iovec, 1) <= 0)
-        {
-            break;
-        }
-
-        callback(crypto, iovec.iov_len, iovec.iov_base, iovec.iov_base);
-
-        TR_ASSERT(size >= iovec.iov_len);
-        size -= iovec.iov_len;
-    } while (evbuffer_ptr_set(buffer, &pos, iovec.iov_len, EVBUFFER_PTR_ADD) == 0);
+        return;
+    }
 
-    TR_ASSERT(size == 0);
+    struct evbuffer_ptr pos;
+    evbuffer_ptr_set(buffer, &pos, offset, EVBUFFER_PTR_SET);
+    forEachExtent(buffer, &pos, size, [crypto, callback](uint8_t* data, size_t len) { callback(crypto, len, data, data); });
 }
 
-static void addDatatype(tr_peerIo* io, size_t byteCount, bool isPieceData)
+static void addDatatype(tr_peerIo* io, size_t byteCount, bool isPieceData, bool isFileSegment = false)
 {
     auto* const d = datatype_new();
     d->isPieceData = isPieceData;
+    d->isFileSegment = isFileSegment;
     d->length = byteCount;
     peer_io_push_datatype(io, d);
 }
@@ -1102,6 +1206,28 @@ void tr_peerIoWriteBuf(tr_peerIo* io, struct evbuffer* buf, bool isPieceData)
     addDatatype(io, byteCount, isPieceData);
 }
 
+void tr_peerIoWriteFileSegments(tr_peerIo* io, struct evbuffer* buf, size_t segment_bytes)
+{
+    TR_ASSERT(tr_peerIoCanReferencePieceData(io));
+
+    size_t const byteCount = evbuffer_get_length(buf);
+    TR_ASSERT(segment_bytes <= byteCount);
+
+    auto gap = evbuffer_get_length(io->outbuf) + byteCount - segment_bytes;
+    for (auto const& run : io->outbuf_file_segments)
+    {
+        gap -= run.gap + run.length;
+    }
+
+    if (segment_bytes != 0)
+    {
+        io->outbuf_file_segments.push_back({ gap, segment_bytes });
+    }
+
+    evbuffer_add_buffer(io->outbuf, buf);
+    addDatatype(io, byteCount, true, segment_bytes != 0);
+}
+
 void tr_peerIoWriteBytes(tr_peerIo* io, void const* bytes, size_t byteCount, bool isPieceData)
 {
     struct evbuffer_iovec iovec;
@@ -1169,12 +1295,8 @@ void tr_peerIoReadBytesToBuf(tr_peerIo* io, struct evbuffer* inbuf, struct evbuf
 
     size_t const old_length = evbuffer_get_length(outbuf);
 
-    /* append it to outbuf */
-    struct evbuffer* tmp = evbuffer_new();
-    evbuffer_remove_buffer(inbuf, tmp, byteCount);
-    evbuffer_add_buffer(outbuf, tmp);
-    evbuffer_free(tmp);
-
+    /* move it to outbuf and decrypt it there */
+    evbuffer_remove_buffer(inbuf, outbuf, byteCount);
     maybeDecryptBuffer(io, outbuf, old_length, byteCount);
 }
 
@@ -1190,9 +1312,21 @@ void tr_peerIoReadBytes(tr_peerIo* io, struct evbuffer* inbuf, void* bytes, size
         break;
 
     case PEER_ENCRYPTION_RC4:
-        evbuffer_remove(inbuf, bytes, byteCount);
-        tr_cryptoDecrypt(&io->crypto, byteCount, bytes, bytes);
-        break;
+        {
+            // decrypt straight out of inbuf rather than copying first
+            auto* walk = static_cast<uint8_t*>(bytes);
+            forEachExtent(
+                inbuf,
+                nullptr,
+                byteCount,
+                [io, &walk](uint8_t const* data, size_t len)
+                {
+                    tr_cryptoDecrypt(&io->crypto, len, data, walk);
+                    walk += len;
+                });
+            evbuffer_drain(inbuf, byteCount);
+            break;
+        }
 
     default:
         TR_ASSERT_MSG(false, "unhandled encryption type %d", (int)io->encryption_type);
@@ -1215,6 +1349,12 @@ void tr_peerIoReadUint32(tr_peerIo* io, struct evbuffer* inbuf, uint32_t* setme)
 
 void tr_peerIoDrain(tr_peerIo* io, struct evbuffer* inbuf, size_t byteCount)
 {
+    if (io->encryption_type == PEER_ENCRYPTION_NONE)
+    {
+        evbuffer_drain(inbuf, byteCount);
+        return;
+    }
+
     char buf[4096];
     size_t const buflen = sizeof(buf);
 
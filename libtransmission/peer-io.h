@@ -16,6 +16,7 @@
 #include <cstddef> // size_t
 #include <cstdint> // uintX_t
 #include <ctime>
+#include <deque>
 #include <optional>
 
 #include <event2/buffer.h>
@@ -136,6 +137,19 @@ public:
     bool extendedProtocolSupported = false;
     bool fastExtensionSupported = false;
     bool utpSupported = false;
+
+    // the runs of file segments in outbuf, oldest first.
+    // `gap` is how many bytes come between a run and the one before it,
+    // or the front of outbuf.
+    struct FileSegmentRun
+    {
+        size_t gap;
+        size_t length;
+    };
+
+    // libevent sends a file segment whole, whatever size a write asks for,
+    // so tr_evbuffer_write() needs to know where these are
+    std::deque<FileSegmentRun> outbuf_file_segments;
 };
 
 /**
@@ -259,6 +273,13 @@ void tr_peerIoWriteBytes(tr_peerIo* io, void const* writeme, size_t writemeLen,
 
 void tr_peerIoWriteBuf(tr_peerIo* io, struct evbuffer* buf, bool isPieceData);
 
+/**
+ * Like tr_peerIoWriteBuf(), for piece data whose last `segment_bytes`
+ * bytes are file segments from tr_ioReadSegment().
+ * Only for ios where tr_peerIoCanSendFileSegments() is true.
+ */
+void tr_peerIoWriteFileSegments(tr_peerIo* io, struct evbuffer* buf, size_t segment_bytes);
+
 /**
 ***
 **/
@@ -275,6 +296,27 @@ constexpr bool tr_peerIoIsEncrypted(tr_peerIo const* io)
     return io != nullptr && io->encryption_type == PEER_ENCRYPTION_RC4;
 }
 
+/**
+ * True if piece data can be queued on this io as references to file
+ * pages or as file segments (see tr_ioReadReference() and tr_ioReadSegment()):
+ * that is, nothing in userspace reads it again on its way to the socket.
+ * That rules out encrypted peers and uTP.
+ */
+inline bool tr_peerIoCanReferencePieceData(tr_peerIo const* io)
+{
+    return io != nullptr && io->socket.type == TR_PEER_SOCKET_TYPE_TCP && !tr_peerIoIsEncrypted(io);
+}
+
+/**
+ * True if piece data can be queued on this io as file segments.
+ * On top of tr_peerIoCanReferencePieceData(), no upload limit may apply:
+ * a segment is sent whole, so it can't be cut down to the bytes a limit allows.
+ */
+inline bool tr_peerIoCanSendFileSegments(tr_peerIo const* io)
+{
+    return tr_peerIoCanReferencePieceData(io) && !io->bandwidth->isThrottled(TR_UP);
+}
+
 void evbuffer_add_uint8(struct evbuffer* outbuf, uint8_t byte);
 void evbuffer_add_uint16(struct evbuffer* outbuf, uint16_t hs);
 void evbuffer_add_uint32(struct evbuffer* outbuf, uint32_t hl);
@@ -0,0 +1,148 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint>
+#include <cstring> // memcpy()
+#include <memory>
+#include <vector>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include "transmission.h"
+
+#include "crypto-utils.h" // tr_rand_buffer()
+#include "net.h"
+#include "peer-mgr-atoms.h"
+#include "tr-assert.h"
+
+AtomPool::AtomPool()
+    : buckets_(MinBuckets)
+{
+    // seed the hash so that peers can't pick addresses that collide
+    tr_rand_buffer(&seed_, sizeof(seed_));
+}
+
+size_t AtomPool::hash(tr_address const& addr) const
+{
+    auto h = seed_ ^ uint64_t(addr.type);
+    auto const mix = [&h](uint64_t val)
+    {
+        h ^= val;
+        h *= UINT64_C(0x9E3779B97F4A7C15);
+        h ^= h >> 32;
+    };
+
+    if (addr.type == TR_AF_INET)
+    {
+        auto val = uint32_t{};
+        memcpy(&val, &addr.addr.addr4, sizeof(val));
+        mix(val);
+    }
+    else
+    {
+        uint64_t vals[2] = {};
+        memcpy(vals, &addr.addr.addr6, sizeof(vals));
+        mix(vals[0]);
+        mix(vals[1]);
+    }
+
+    return size_t(h);
+}
+
+// the bucket that holds `addr`'s atom, or the empty bucket where it would go
+size_t AtomPool::findBucket(tr_address const& addr) const
+{
+    auto const mask = std::size(buckets_) - 1;
+
+    for (auto i = hash(addr) & mask;; i = (i + 1) & mask)
+    {
+        auto const* const atom = buckets_[i];
+
+        if (atom == nullptr || tr_address_compare(&atom->addr, &addr) == 0)
+        {
+            return i;
+        }
+    }
+}
+
+void AtomPool::rehash(size_t n_buckets)
+{
+    buckets_.assign(n_buckets, nullptr);
+
+    for (auto* const atom : atoms_)
+    {
+        buckets_[findBucket(atom->addr)] = atom;
+    }
+}
+
+peer_atom* AtomPool::find(tr_address const& addr) const
+{
+    return buckets_[findBucket(addr)];
+}
+
+peer_atom* AtomPool::emplace(tr_address const& addr)
+{
+    TR_ASSERT(find(addr) == nullptr);
+
+    if ((std::size(atoms_) + 1) * 2 > std::size(buckets_))
+    {
+        rehash(std::size(buckets_) * 2);
+    }
+
+    if (std::empty(free_))
+    {
+        auto& chunk = chunks_.emplace_back(std::make_unique<peer_atom[]>(ChunkSize));
+
+        // hand them out in order so that atoms added together sit together
+        for (size_t i = ChunkSize; i > 0; --i)
+        {
+            free_.push_back(&chunk[i - 1]);
+        }
+    }
+
+    auto* const atom = free_.back();
+    free_.pop_back();
+
+    *atom = {};
+    atom->addr = addr;
+    atom->pool_pos = std::size(atoms_);
+    atoms_.push_back(atom);
+    buckets_[findBucket(addr)] = atom;
+
+    return atom;
+}
+
+void AtomPool::erase(peer_atom* atom)
+{
+    TR_ASSERT(atom->pool_pos < std::size(atoms_));
+    TR_ASSERT(atoms_[atom->pool_pos] == atom);
+
+    // remove it from the hash table, shifting back any atoms
+    // after it that would no longer be reachable by probing
+    auto const mask = std::size(buckets_) - 1;
+    auto hole = findBucket(atom->addr);
+    TR_ASSERT(buckets_[hole] == atom);
+    buckets_[hole] = nullptr;
+
+    for (auto i = (hole + 1) & mask; buckets_[i] != nullptr; i = (i + 1) & mask)
+    {
+        // can this atom be moved back to the hole without moving it before its home bucket?
+        auto const home = hash(buckets_[i]->addr) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            buckets_[hole] = buckets_[i];
+            buckets_[i] = nullptr;
+            hole = i;
+        }
+    }
+
+    // remove it from the list of atoms
+    auto* const last = atoms_.back();
+    atoms_[atom->pool_pos] = last;
+    last->pool_pos = atom->pool_pos;
+    atoms_.pop_back();
+
+    free_.push_back(atom);
+}
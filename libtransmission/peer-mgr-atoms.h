@@ -0,0 +1,140 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint16_t, uint64_t
+#include <ctime> // time_t
+#include <memory>
+#include <vector>
+
+#include "transmission.h" // tr_port
+
+#include "net.h" // tr_address
+
+class tr_peer;
+
+/**
+ * Peer information that should be kept even before we've connected and
+ * after we've disconnected. These are kept in a pool of peer_atoms to decide
+ * which ones would make good candidates for connecting to, and to watch out
+ * for banned peers.
+ *
+ * @see tr_peer
+ * @see tr_peerMsgs
+ */
+struct peer_atom
+{
+    uint8_t fromFirst; /* where the peer was first found */
+    uint8_t fromBest; /* the "best" value of where the peer has been found */
+    uint8_t flags; /* these match the added_f flags */
+    uint8_t flags2; /* flags that aren't defined in added_f */
+    int8_t blocklisted; /* -1 for unknown, true for blocklisted, false for not blocklisted */
+
+    tr_port port;
+    bool utp_failed; /* We recently failed to connect over uTP */
+    uint16_t numFails;
+    time_t time; /* when the peer's connection status last changed */
+    time_t piece_data_time;
+
+    time_t lastConnectionAttemptAt;
+    time_t lastConnectionAt;
+
+    /* similar to a TTL field, but less rigid --
+     * if the swarm is small, the atom will be kept past this date. */
+    time_t shelf_date;
+    tr_peer* peer; /* will be nullptr if not connected */
+    tr_address addr;
+
+    /* where this atom is in its swarm's candidate heaps. see updatePeerCandidate() */
+    uint64_t candidate_score; /* sort key in tr_swarm.candidates */
+    time_t candidate_ready_at; /* sort key in tr_swarm.waiting */
+    size_t candidate_pos;
+    size_t waiting_pos;
+
+    size_t pool_pos; /* index in AtomPool's list of atoms */
+};
+
+/**
+ * A swarm's peer_atoms, looked up by address.
+ *
+ * Atoms are allocated in contiguous chunks and recycled when they're
+ * erased, so adding thousands of them from a PEX or DHT flood doesn't
+ * mean thousands of small allocations. An atom's address doesn't change
+ * while it's in the pool, so peers and heaps can point to it.
+ *
+ * Lookups use an open-addressing hash table with a per-pool seed, and
+ * adding or erasing an atom is O(1) on average.
+ */
+class AtomPool
+{
+public:
+    using const_iterator = std::vector<peer_atom*>::const_iterator;
+
+    AtomPool();
+    ~AtomPool() = default;
+
+    AtomPool(AtomPool const&) = delete;
+    AtomPool& operator=(AtomPool const&) = delete;
+
+    // the atom for `addr`, or nullptr if there isn't one
+    [[nodiscard]] peer_atom* find(tr_address const& addr) const;
+
+    // adds a zeroed atom for `addr`, which mustn't be in the pool yet
+    [[nodiscard]] peer_atom* emplace(tr_address const& addr);
+
+    // removes `atom` from the pool and recycles it
+    void erase(peer_atom* atom);
+
+    [[nodiscard]] size_t size() const
+    {
+        return std::size(atoms_);
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return std::empty(atoms_);
+    }
+
+    // the atoms, in no particular order.
+    // iterators are invalidated when atoms are added or erased.
+    [[nodiscard]] const_iterator begin() const
+    {
+        return std::cbegin(atoms_);
+    }
+
+    [[nodiscard]] const_iterator end() const
+    {
+        return std::cend(atoms_);
+    }
+
+private:
+    static auto constexpr ChunkSize = size_t{ 64 };
+    static auto constexpr MinBuckets = size_t{ 16 };
+
+    [[nodiscard]] size_t hash(tr_address const& addr) const;
+    [[nodiscard]] size_t findBucket(tr_address const& addr) const;
+    void rehash(size_t n_buckets);
+
+    // every atom, in use or not, lives in one of these
+    std::vector<std::unique_ptr<peer_atom[]>> chunks_;
+
+    // erased atoms that can be handed out again
+    std::vector<peer_atom*> free_;
+
+    // the atoms in the pool; atom->pool_pos is its index here
+    std::vector<peer_atom*> atoms_;
+
+    // open-addressing hash table with linear probing. empty buckets are nullptr.
+    // its size is a power of two and it's kept at most half full.
+    std::vector<peer_atom*> buckets_;
+
+    uint64_t seed_ = 0;
+};
@@ -0,0 +1,189 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include "transmission.h"
+
+#include "bitfield.h"
+#include "crypto-utils.h" // tr_rand_int_weak()
+#include "peer-mgr-availability.h"
+#include "tr-assert.h"
+
+void PieceAvailability::reset(tr_piece_index_t n_pieces)
+{
+    counts_.assign(n_pieces, 0);
+
+    // shuffle the pieces so that pieces with the same count
+    // aren't always walked in the same order by every client
+    pieces_.resize(n_pieces);
+    std::iota(std::begin(pieces_), std::end(pieces_), 0);
+    std::shuffle(std::begin(pieces_), std::end(pieces_), std::minstd_rand(tr_rand_int_weak(INT32_MAX)));
+
+    pos_.resize(n_pieces);
+    for (tr_piece_index_t i = 0; i < n_pieces; ++i)
+    {
+        pos_[pieces_[i]] = i;
+    }
+
+    begin_.assign(1, 0);
+}
+
+void PieceAvailability::swapPositions(tr_piece_index_t a, tr_piece_index_t b)
+{
+    std::swap(pieces_[a], pieces_[b]);
+    pos_[pieces_[a]] = a;
+    pos_[pieces_[b]] = b;
+}
+
+void PieceAvailability::trimEmptyBuckets()
+{
+    while (std::size(begin_) > 1 && begin_.back() == std::size(pieces_))
+    {
+        begin_.pop_back();
+    }
+}
+
+void PieceAvailability::addPiece(tr_piece_index_t piece)
+{
+    if (piece >= std::size(counts_))
+    {
+        return;
+    }
+
+    auto const n = counts_[piece]++;
+    TR_ASSERT(counts_[piece] != 0);
+
+    if (pos_[piece] == NoPos)
+    {
+        return;
+    }
+
+    // move the piece to the end of its bucket, then shrink that bucket by one
+    // so that the piece becomes the first in the next bucket up.
+    if (n + size_t{ 1 } == std::size(begin_))
+    {
+        begin_.push_back(std::size(pieces_));
+    }
+
+    auto& next_begin = begin_[n + 1];
+    --next_begin;
+    swapPositions(pos_[piece], next_begin);
+}
+
+void PieceAvailability::removePiece(tr_piece_index_t piece)
+{
+    if (piece >= std::size(counts_))
+    {
+        return;
+    }
+
+    TR_ASSERT(counts_[piece] > 0);
+    auto const n = counts_[piece]--;
+
+    if (pos_[piece] == NoPos)
+    {
+        return;
+    }
+
+    // move the piece to the front of its bucket, then shrink that bucket by one
+    // so that the piece becomes the last in the next bucket down.
+    auto& begin = begin_[n];
+    swapPositions(pos_[piece], begin);
+    ++begin;
+    trimEmptyBuckets();
+}
+
+void PieceAvailability::addPeer(tr_bitfield const& have)
+{
+    if (have.hasNone())
+    {
+        return;
+    }
+
+    auto const n = have.hasAll() ? size() : std::min(size_t{ size() }, std::size(have));
+    for (tr_piece_index_t piece = 0; piece < n; ++piece)
+    {
+        if (have.test(piece))
+        {
+            addPiece(piece);
+        }
+    }
+}
+
+void PieceAvailability::removePeer(tr_bitfield const& have)
+{
+    if (have.hasNone())
+    {
+        return;
+    }
+
+    auto const n = have.hasAll() ? size() : std::min(size_t{ size() }, std::size(have));
+    for (tr_piece_index_t piece = 0; piece < n; ++piece)
+    {
+        if (have.test(piece))
+        {
+            removePiece(piece);
+        }
+    }
+}
+
+void PieceAvailability::setClientHas(tr_piece_index_t piece)
+{
+    if (piece >= std::size(counts_) || pos_[piece] == NoPos)
+    {
+        return;
+    }
+
+    // bubble the piece up into the last bucket...
+    for (size_t n = counts_[piece]; n + 1 < std::size(begin_); ++n)
+    {
+        auto& next_begin = begin_[n + 1];
+        --next_begin;
+        swapPositions(pos_[piece], next_begin);
+    }
+
+    // ...and then off the end of the list
+    swapPositions(pos_[piece], std::size(pieces_) - 1);
+    pieces_.pop_back();
+    pos_[piece] = NoPos;
+    trimEmptyBuckets();
+}
+
+void PieceAvailability::setClientLacks(tr_piece_index_t piece)
+{
+    if (piece >= std::size(counts_) || pos_[piece] != NoPos)
+    {
+        return;
+    }
+
+    // put the piece back on the end of the list, in the last bucket...
+    pieces_.push_back(piece);
+    pos_[piece] = std::size(pieces_) - 1;
+
+    size_t const n = counts_[piece];
+    while (std::size(begin_) <= n)
+    {
+        begin_.push_back(pos_[piece]);
+    }
+
+    // ...and then bubble it down into its own bucket
+    for (auto i = std::size(begin_) - 1; i > n; --i)
+    {
+        auto& begin = begin_[i];
+        swapPositions(pos_[piece], begin);
+        ++begin;
+    }
+
+    trimEmptyBuckets();
+}
@@ -0,0 +1,107 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint16_t
+#include <vector>
+
+#include "transmission.h" // tr_piece_index_t
+
+class tr_bitfield;
+
+/**
+ * Counts how many of our peers have each piece.
+ *
+ * The pieces we still need are kept sorted from rarest to most common.
+ * They're grouped into buckets by peer count, so a peer gaining or losing
+ * a piece just moves it across one bucket boundary. This lets the wishlist
+ * walk pieces in rarest-first order without rescanning or sorting them.
+ */
+class PieceAvailability
+{
+public:
+    // forget all counts and start tracking `n_pieces` pieces
+    void reset(tr_piece_index_t n_pieces);
+
+    // a peer told us it has `piece`
+    void addPiece(tr_piece_index_t piece);
+
+    // a peer that had `piece` went away
+    void removePiece(tr_piece_index_t piece);
+
+    // a peer told us it has all the pieces in `have`
+    void addPeer(tr_bitfield const& have);
+
+    // a peer that had all the pieces in `have` went away
+    void removePeer(tr_bitfield const& have);
+
+    // we have `piece` now, so it no longer needs to be walked
+    void setClientHas(tr_piece_index_t piece);
+
+    // we lost `piece`, e.g. it failed its checksum, so walk it again
+    void setClientLacks(tr_piece_index_t piece);
+
+    // how many peers have `piece`
+    [[nodiscard]] size_t count(tr_piece_index_t piece) const
+    {
+        return piece < std::size(counts_) ? counts_[piece] : 0;
+    }
+
+    [[nodiscard]] tr_piece_index_t size() const
+    {
+        return std::size(counts_);
+    }
+
+    /**
+     * Call `func(piece, n_peers)` on each piece that we don't have
+     * and that at least one peer has, from the rarest to the most
+     * common, until `func` returns false.
+     */
+    template<typename Func>
+    void forEachRarestFirst(Func&& func) const
+    {
+        if (std::size(begin_) < 2)
+        {
+            return;
+        }
+
+        auto n_peers = size_t{ 1 };
+        for (auto i = begin_[1], n = tr_piece_index_t(std::size(pieces_)); i < n; ++i)
+        {
+            while (n_peers + 1 < std::size(begin_) && i >= begin_[n_peers + 1])
+            {
+                ++n_peers;
+            }
+
+            if (!func(pieces_[i], n_peers))
+            {
+                break;
+            }
+        }
+    }
+
+private:
+    static auto constexpr NoPos = ~tr_piece_index_t{};
+
+    void swapPositions(tr_piece_index_t a, tr_piece_index_t b);
+    void trimEmptyBuckets();
+
+    // how many peers have each piece
+    std::vector<uint16_t> counts_;
+
+    // the pieces we don't have, sorted by count.
+    // the pieces with count `n` are in [begin_[n], begin_[n+1])
+    std::vector<tr_piece_index_t> pieces_;
+    std::vector<tr_piece_index_t> begin_;
+
+    // each piece's index in `pieces_`, or NoPos if we have the piece
+    std::vector<tr_piece_index_t> pos_;
+};
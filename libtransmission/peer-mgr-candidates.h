@@ -0,0 +1,170 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <vector>
+
+#include "tr-assert.h"
+
+/**
+ * A binary min-heap of pointers that remembers where each element is, so
+ * that an element whose key changed can be removed in O(log n) instead of
+ * the heap being rebuilt.
+ *
+ * `Traits::key(T const*)` returns an element's sort key, and
+ * `Traits::pos(T*)` returns a reference to the `size_t` where the heap
+ * keeps the element's 1-based position. A position of 0 means that the
+ * element isn't in the heap, so zero-initialized elements are handled.
+ * An element's key mustn't change while it's in the heap.
+ */
+template<typename T, typename Traits>
+class IndexedHeap
+{
+public:
+    IndexedHeap() = default;
+
+    ~IndexedHeap()
+    {
+        clear();
+    }
+
+    IndexedHeap(IndexedHeap const&) = delete;
+    IndexedHeap& operator=(IndexedHeap const&) = delete;
+
+    [[nodiscard]] bool empty() const
+    {
+        return std::empty(items_);
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return std::size(items_);
+    }
+
+    [[nodiscard]] T* top() const
+    {
+        TR_ASSERT(!empty());
+        return items_.front();
+    }
+
+    [[nodiscard]] static bool contains(T* item)
+    {
+        return Traits::pos(item) != 0;
+    }
+
+    void insert(T* item)
+    {
+        TR_ASSERT(!contains(item));
+
+        items_.push_back(item);
+        siftUp(std::size(items_) - 1);
+    }
+
+    // removes `item` if it's in the heap
+    void erase(T* item)
+    {
+        if (!contains(item))
+        {
+            return;
+        }
+
+        auto const pos = Traits::pos(item) - 1;
+        TR_ASSERT(items_[pos] == item);
+        Traits::pos(item) = 0;
+
+        auto* const last = items_.back();
+        items_.pop_back();
+        if (pos < std::size(items_))
+        {
+            items_[pos] = last;
+            siftUp(pos);
+            siftDown(Traits::pos(last) - 1);
+        }
+    }
+
+    void pop()
+    {
+        erase(top());
+    }
+
+    void clear()
+    {
+        for (auto* item : items_)
+        {
+            Traits::pos(item) = 0;
+        }
+
+        items_.clear();
+    }
+
+private:
+    static bool less(T const* a, T const* b)
+    {
+        return Traits::key(a) < Traits::key(b);
+    }
+
+    void place(size_t pos, T* item)
+    {
+        items_[pos] = item;
+        Traits::pos(item) = pos + 1;
+    }
+
+    void siftUp(size_t pos)
+    {
+        auto* const item = items_[pos];
+
+        while (pos > 0)
+        {
+            auto const parent = (pos - 1) / 2;
+            if (!less(item, items_[parent]))
+            {
+                break;
+            }
+
+            place(pos, items_[parent]);
+            pos = parent;
+        }
+
+        place(pos, item);
+    }
+
+    void siftDown(size_t pos)
+    {
+        auto* const item = items_[pos];
+        auto const n = std::size(items_);
+
+        for (;;)
+        {
+            auto child = pos * 2 + 1;
+            if (child >= n)
+            {
+                break;
+            }
+
+            if (child + 1 < n && less(items_[child + 1], items_[child]))
+            {
+                ++child;
+            }
+
+            if (!less(items_[child], item))
+            {
+                break;
+            }
+
+            place(pos, items_[child]);
+            pos = child;
+        }
+
+        place(pos, item);
+    }
+
+    std::vector<T*> items_;
+};
@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <numeric>
 #include <utility>
@@ -25,31 +26,39 @@ struct Candidate
 {
     tr_piece_index_t piece;
     size_t n_blocks_missing;
+    size_t n_peers;
     tr_priority_t priority;
     uint8_t salt;
 
-    Candidate(tr_piece_index_t piece_in, size_t missing_in, tr_priority_t priority_in, uint8_t salt_in)
+    Candidate(tr_piece_index_t piece_in, size_t missing_in, size_t peers_in, tr_priority_t priority_in)
         : piece{ piece_in }
         , n_blocks_missing{ missing_in }
+        , n_peers{ peers_in }
         , priority{ priority_in }
-        , salt{ salt_in }
+        , salt{}
     {
     }
 
     [[nodiscard]] int compare(Candidate const& that) const // <=>
     {
-        // prefer pieces closer to completion
-        if (n_blocks_missing != that.n_blocks_missing)
-        {
-            return n_blocks_missing < that.n_blocks_missing ? -1 : 1;
-        }
-
         // prefer higher priority
         if (priority != that.priority)
         {
             return priority > that.priority ? -1 : 1;
         }
 
+        // prefer rarer pieces
+        if (n_peers != that.n_peers)
+        {
+            return n_peers < that.n_peers ? -1 : 1;
+        }
+
+        // prefer pieces closer to completion
+        if (n_blocks_missing != that.n_blocks_missing)
+        {
+            return n_blocks_missing < that.n_blocks_missing ? -1 : 1;
+        }
+
         if (salt != that.salt)
         {
             return salt < that.salt ? -1 : 1;
@@ -64,38 +73,77 @@ struct Candidate
     }
 };
 
-std::vector<Candidate> getCandidates(Wishlist::PeerInfo const& peer_info)
+bool canRequestBlock(Wishlist::PeerInfo const& peer_info, tr_block_index_t block)
 {
-    // count up the pieces that we still want
-    auto wanted_pieces = std::vector<std::pair<tr_piece_index_t, size_t>>{};
-    auto const n_pieces = peer_info.countAllPieces();
-    wanted_pieces.reserve(n_pieces);
-    for (tr_piece_index_t i = 0; i < n_pieces; ++i)
+    // don't request blocks we've already got
+    if (!peer_info.clientCanRequestBlock(block))
     {
-        if (!peer_info.clientCanRequestPiece(i))
-        {
-            continue;
-        }
+        return false;
+    }
+
+    // don't request from too many peers
+    size_t const n_peers = peer_info.countActiveRequests(block);
+    size_t const max_peers = peer_info.isEndgame() ? 2 : 1;
+    return n_peers < max_peers;
+}
+
+std::vector<Candidate> getCandidates(Wishlist::PeerInfo const& peer_info, size_t n_wanted_blocks)
+{
+    // Once we've found enough blocks, look at a few more pieces that are
+    // just as rare so that ties can be broken by completeness and salt.
+    auto constexpr MaxLookahead = size_t{ 30 };
 
-        size_t const n_missing = peer_info.countMissingBlocks(i);
-        if (n_missing == 0)
+    auto const highest_priority = peer_info.highestPriority();
+    auto candidates = std::vector<Candidate>{};
+    auto n_blocks = size_t{};
+    auto n_peers_when_full = size_t{};
+    auto n_lookahead = size_t{};
+
+    // walk the pieces from rarest to most common until we have enough
+    // requestable blocks from pieces that nothing else can outrank
+    peer_info.forEachRarestPiece(
+        [&](tr_piece_index_t piece, size_t n_peers)
         {
-            continue;
-        }
+            if (n_blocks >= n_wanted_blocks && (n_peers != n_peers_when_full || ++n_lookahead > MaxLookahead))
+            {
+                return false;
+            }
 
-        wanted_pieces.emplace_back(i, n_missing);
-    }
+            if (!peer_info.clientCanRequestPiece(piece))
+            {
+                return true;
+            }
+
+            size_t const n_missing = peer_info.countMissingBlocks(piece);
+            if (n_missing == 0)
+            {
+                return true;
+            }
 
-    // transform them into candidates
-    auto const n = std::size(wanted_pieces);
-    auto saltbuf = std::vector<char>(n);
+            auto const priority = peer_info.priority(piece);
+            candidates.emplace_back(piece, n_missing, n_peers, priority);
+
+            if (priority >= highest_priority && n_blocks < n_wanted_blocks)
+            {
+                auto const [begin, end] = peer_info.blockSpan(piece);
+                for (auto block = begin; block < end && n_blocks < n_wanted_blocks; ++block)
+                {
+                    n_blocks += canRequestBlock(peer_info, block) ? 1 : 0;
+                }
+
+                n_peers_when_full = n_peers;
+            }
+
+            return true;
+        });
+
+    // salt the candidates so that ties are broken randomly
+    auto const n = std::size(candidates);
+    auto saltbuf = std::vector<uint8_t>(n);
     tr_rand_buffer(std::data(saltbuf), n);
-    auto candidates = std::vector<Candidate>{};
-    candidates.reserve(n);
     for (size_t i = 0; i < n; ++i)
     {
-        auto const [piece, n_missing] = wanted_pieces[i];
-        candidates.emplace_back(piece, n_missing, peer_info.priority(piece), saltbuf[i]);
+        candidates[i].salt = saltbuf[i];
     }
 
     return candidates;
@@ -141,7 +189,7 @@ std::vector<tr_block_span_t> Wishlist::next(Wishlist::PeerInfo const& peer_info,
 
     // We usually won't need all the candidates until endgame, so don't
     // waste cycles sorting all of them here. partial sort is enough.
-    auto candidates = getCandidates(peer_info);
+    auto candidates = getCandidates(peer_info, n_wanted_blocks);
     auto constexpr MaxSortedPieces = size_t{ 30 };
     auto const middle = std::min(std::size(candidates), MaxSortedPieces);
     std::partial_sort(std::begin(candidates), std::begin(candidates) + middle, std::end(candidates));
@@ -160,20 +208,10 @@ std::vector<tr_block_span_t> Wishlist::next(Wishlist::PeerInfo const& peer_info,
         blocks.reserve(end - begin);
         for (tr_block_index_t block = begin; block < end && n_blocks + std::size(blocks) < n_wanted_blocks; ++block)
         {
-            // don't request blocks we've already got
-            if (!peer_info.clientCanRequestBlock(block))
+            if (canRequestBlock(peer_info, block))
             {
-                continue;
+                blocks.push_back(block);
             }
-
-            // don't request from too many peers
-            size_t const n_peers = peer_info.countActiveRequests(block);
-            if (size_t const max_peers = peer_info.isEndgame() ? 2 : 1; n_peers >= max_peers)
-            {
-                continue;
-            }
-
-            blocks.push_back(block);
         }
 
         if (std::empty(blocks))
@@ -10,6 +10,7 @@
 #endif
 
 #include <cstddef> // size_t
+#include <functional>
 #include <vector>
 
 #include "transmission.h"
@@ -30,8 +31,12 @@ public:
         virtual size_t countActiveRequests(tr_block_index_t block) const = 0;
         virtual size_t countMissingBlocks(tr_piece_index_t piece) const = 0;
         virtual tr_block_span_t blockSpan(tr_piece_index_t) const = 0;
-        virtual tr_piece_index_t countAllPieces() const = 0;
         virtual tr_priority_t priority(tr_piece_index_t) const = 0;
+        virtual tr_priority_t highestPriority() const = 0;
+
+        // call `func(piece, n_peers)` on the pieces we're missing, rarest first, until it returns false
+        virtual void forEachRarestPiece(std::function<bool(tr_piece_index_t, size_t)> const& func) const = 0;
+
         virtual ~PeerInfo() = default;
     };
 
@@ -33,6 +33,9 @@
 #include "net.h"
 #include "peer-io.h"
 #include "peer-mgr-active-requests.h"
+#include "peer-mgr-atoms.h"
+#include "peer-mgr-availability.h"
+#include "peer-mgr-candidates.h"
 #include "peer-mgr-wishlist.h"
 #include "peer-mgr.h"
 #include "peer-msgs.h"
@@ -58,6 +61,10 @@ static auto constexpr OptimisticUnchokeMultiplier = int{ 4 };
 // how frequently to reallocate bandwidth
 static auto constexpr BandwidthPeriodMsec = int{ 500 };
 
+// how long a torrent's speeds take to settle after its last activity.
+// this is Bandwidth's speed history, rounded up to whole seconds.
+static auto constexpr SpeedSettleSeconds = time_t{ 3 };
+
 // how frequently to age out old piece request lists
 static auto constexpr RefillUpkeepPeriodMsec = int{ 10 * 1000 };
 
@@ -97,37 +104,30 @@ static auto constexpr CancelHistorySec = int{ 60 };
 ***
 **/
 
-/**
- * Peer information that should be kept even before we've connected and
- * after we've disconnected. These are kept in a pool of peer_atoms to decide
- * which ones would make good candidates for connecting to, and to watch out
- * for banned peers.
- *
- * @see tr_peer
- * @see tr_peerMsgs
- */
-struct peer_atom
-{
-    uint8_t fromFirst; /* where the peer was first found */
-    uint8_t fromBest; /* the "best" value of where the peer has been found */
-    uint8_t flags; /* these match the added_f flags */
-    uint8_t flags2; /* flags that aren't defined in added_f */
-    int8_t blocklisted; /* -1 for unknown, true for blocklisted, false for not blocklisted */
-
-    tr_port port;
-    bool utp_failed; /* We recently failed to connect over uTP */
-    uint16_t numFails;
-    time_t time; /* when the peer's connection status last changed */
-    time_t piece_data_time;
-
-    time_t lastConnectionAttemptAt;
-    time_t lastConnectionAt;
-
-    /* similar to a TTL field, but less rigid --
-     * if the swarm is small, the atom will be kept past this date. */
-    time_t shelf_date;
-    tr_peer* peer; /* will be nullptr if not connected */
-    tr_address addr;
+struct CandidateTraits
+{
+    static auto key(peer_atom const* atom)
+    {
+        return atom->candidate_score;
+    }
+
+    static auto& pos(peer_atom* atom)
+    {
+        return atom->candidate_pos;
+    }
+};
+
+struct WaitingTraits
+{
+    static auto key(peer_atom const* atom)
+    {
+        return atom->candidate_ready_at;
+    }
+
+    static auto& pos(peer_atom* atom)
+    {
+        return atom->waiting_pos;
+    }
 };
 
 #ifndef TR_ENABLE_ASSERTS
@@ -164,7 +164,7 @@ public:
     tr_swarm_stats stats = {};
 
     tr_ptrArray outgoingHandshakes = {}; /* tr_handshake */
-    tr_ptrArray pool = {}; /* struct peer_atom */
+    AtomPool pool;
     tr_ptrArray peers = {}; /* tr_peerMsgs */
     tr_ptrArray webseeds = {}; /* tr_webseed */
 
@@ -182,6 +182,18 @@ public:
 
     ActiveRequests active_requests;
 
+    // how many of our peers have each piece
+    PieceAvailability availability;
+
+    // the atoms we could connect to right now, best first
+    IndexedHeap<peer_atom, CandidateTraits> candidates;
+
+    // the atoms we could connect to once they've waited out their reconnect interval, soonest first
+    IndexedHeap<peer_atom, WaitingTraits> waiting;
+
+    // tor->isDone() when the candidate heaps were built, since seeds aren't candidates for seeds
+    bool candidatesAreForSeed = false;
+
     int interestedCount = 0;
     int maxPeers = 0;
     time_t lastCancel = 0;
@@ -267,23 +279,6 @@ static inline tr_handshake* getExistingHandshake(tr_ptrArray* handshakes, tr_add
     return static_cast<tr_handshake*>(tr_ptrArrayFindSorted(handshakes, addr, handshakeCompareToAddr));
 }
 
-static int comparePeerAtomToAddress(void const* va, void const* vb)
-{
-    auto const* const a = static_cast<struct peer_atom const*>(va);
-    auto const* const b = static_cast<tr_address const*>(vb);
-
-    return tr_address_compare(&a->addr, b);
-}
-
-static int compareAtomsByAddress(void const* va, void const* vb)
-{
-    auto const* const b = static_cast<struct peer_atom const*>(vb);
-
-    TR_ASSERT(tr_isAtom(b));
-
-    return comparePeerAtomToAddress(va, &b->addr);
-}
-
 /**
 ***
 **/
@@ -309,8 +304,7 @@ static int peerCompare(void const* va, void const* vb)
 
 static struct peer_atom* getExistingAtom(tr_swarm const* cswarm, tr_address const* addr)
 {
-    auto* swarm = const_cast<tr_swarm*>(cswarm);
-    return static_cast<struct peer_atom*>(tr_ptrArrayFindSorted(&swarm->pool, addr, comparePeerAtomToAddress));
+    return cswarm->pool.find(*addr);
 }
 
 static bool peerIsInUse(tr_swarm const* cs, struct peer_atom const* atom)
@@ -332,7 +326,8 @@ static void swarmFree(tr_swarm* s)
     TR_ASSERT(tr_ptrArrayEmpty(&s->peers));
 
     tr_ptrArrayDestruct(&s->webseeds, [](void* peer) { delete static_cast<tr_peer*>(peer); });
-    tr_ptrArrayDestruct(&s->pool, (PtrArrayForeachFunc)tr_free);
+    s->candidates.clear();
+    s->waiting.clear();
     tr_ptrArrayDestruct(&s->outgoingHandshakes, nullptr);
     tr_ptrArrayDestruct(&s->peers, nullptr);
     s->stats = {};
@@ -342,9 +337,18 @@ static void swarmFree(tr_swarm* s)
 
 static void peerCallbackFunc(tr_peer* /*peer*/, tr_peer_event const* /*e*/, void* /*vs*/);
 
+static void updatePeerCandidate(tr_swarm* s, struct peer_atom* atom, time_t now);
+
+static void rebuildPeerCandidates(tr_swarm* s);
+
 static void rebuildWebseedArray(tr_swarm* s, tr_torrent* tor)
 {
     /* clear the array */
+    for (int i = 0, n = tr_ptrArraySize(&s->webseeds); i < n; ++i)
+    {
+        s->availability.removePeer(static_cast<tr_peer const*>(tr_ptrArrayNth(&s->webseeds, i))->have);
+    }
+
     tr_ptrArrayDestruct(&s->webseeds, [](void* peer) { delete static_cast<tr_peer*>(peer); });
     s->webseeds = {};
     s->stats.activeWebseedCount = 0;
@@ -354,6 +358,7 @@ static void rebuildWebseedArray(tr_swarm* s, tr_torrent* tor)
     {
         auto* const w = tr_webseedNew(tor, tor->webseed(i), peerCallbackFunc, s);
         tr_ptrArrayAppend(&s->webseeds, w);
+        s->availability.addPeer(w->have);
     }
 }
 
@@ -424,11 +429,12 @@ void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr)
     {
         tr_swarm* s = tor->swarm;
 
-        for (int i = 0, n = tr_ptrArraySize(&s->pool); i < n; ++i)
+        for (auto* const atom : s->pool)
         {
-            auto* const atom = static_cast<struct peer_atom*>(tr_ptrArrayNth(&s->pool, i));
             atom->blocklisted = -1;
         }
+
+        rebuildPeerCandidates(s);
     }
 }
 
@@ -456,6 +462,7 @@ static void atomSetSeed(tr_swarm* s, struct peer_atom* atom)
     tordbg(s, "marking peer %s as a seed", tr_atomAddrStr(atom));
     atom->flags |= ADDED_F_SEED_FLAG;
     s->poolIsAllSeedsDirty = true;
+    updatePeerCandidate(s, atom, tr_time());
 }
 
 bool tr_peerMgrPeerIsSeed(tr_torrent const* tor, tr_address const* addr)
@@ -568,7 +575,7 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
 
         [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const override
         {
-            return torrent_->pieceIsWanted(piece) && peer_->have.test(piece);
+            return torrent_->pieceIsWanted(piece) && peer_->have.test(piece) && !torrent_->isPieceBeingChecked(piece);
         }
 
         [[nodiscard]] bool isEndgame() const override
@@ -591,14 +598,19 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
             return torrent_->blockSpanForPiece(piece);
         }
 
-        [[nodiscard]] tr_piece_index_t countAllPieces() const override
+        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
         {
-            return torrent_->pieceCount();
+            return torrent_->piecePriority(piece);
         }
 
-        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
+        [[nodiscard]] tr_priority_t highestPriority() const override
         {
-            return torrent_->piecePriority(piece);
+            return torrent_->highestPriority();
+        }
+
+        void forEachRarestPiece(std::function<bool(tr_piece_index_t, size_t)> const& func) const override
+        {
+            swarm_->availability.forEachRarestFirst(func);
         }
 
     private:
@@ -738,6 +750,8 @@ void tr_peerMgrPieceCompleted(tr_torrent* tor, tr_piece_index_t p)
     bool pieceCameFromPeers = false;
     tr_swarm* const s = tor->swarm;
 
+    s->availability.setClientHas(p);
+
     /* walk through our peers */
     for (int i = 0, n = tr_ptrArraySize(&s->peers); i < n; ++i)
     {
@@ -808,11 +822,25 @@ static void peerCallbackFunc(tr_peer* peer, tr_peer_event const* e, void* vs)
         }
 
     case TR_PEER_CLIENT_GOT_HAVE:
+        s->availability.addPiece(e->pieceIndex);
+        break;
+
     case TR_PEER_CLIENT_GOT_HAVE_ALL:
     case TR_PEER_CLIENT_GOT_HAVE_NONE:
     case TR_PEER_CLIENT_GOT_BITFIELD:
-        /* TODO: if we don't need these, should these events be removed? */
-        /* noop */
+        /* these are published before peer->have is replaced,
+           so swap the peer's old pieces out for its new ones */
+        s->availability.removePeer(peer->have);
+        if (e->eventType == TR_PEER_CLIENT_GOT_HAVE_ALL)
+        {
+            auto all = tr_bitfield{ s->tor->pieceCount() };
+            all.setHasAll();
+            s->availability.addPeer(all);
+        }
+        else if (e->eventType == TR_PEER_CLIENT_GOT_BITFIELD)
+        {
+            s->availability.addPeer(*e->bitfield);
+        }
         break;
 
     case TR_PEER_CLIENT_GOT_REJ:
@@ -918,15 +946,13 @@ static struct peer_atom* ensureAtomExists(
     if (a == nullptr)
     {
         int const jitter = tr_rand_int_weak(60 * 10);
-        a = tr_new0(struct peer_atom, 1);
-        a->addr = *addr;
+        a = s->pool.emplace(*addr);
         a->port = port;
         a->flags = flags;
         a->fromFirst = from;
         a->fromBest = from;
         a->shelf_date = tr_time() + getDefaultShelfLife(from) + jitter;
         a->blocklisted = -1;
-        tr_ptrArrayInsertSorted(&s->pool, a, compareAtomsByAddress);
 
         tordbg(s, "got a new atom: %s", tr_atomAddrStr(a));
     }
@@ -941,6 +967,7 @@ static struct peer_atom* ensureAtomExists(
     }
 
     s->poolIsAllSeedsDirty = true;
+    updatePeerCandidate(s, a, tr_time());
 
     return a;
 }
@@ -970,6 +997,7 @@ static void createBitTorrentPeer(tr_torrent* tor, tr_peerIo* io, struct peer_ato
     tr_ptrArrayInsertSorted(&swarm->peers, peer, peerCompare);
     ++swarm->stats.peerCount;
     ++swarm->stats.peerFromCount[atom->fromFirst];
+    tor->markStatsChanged();
 
     TR_ASSERT(swarm->stats.peerCount == tr_ptrArraySize(&swarm->peers));
     TR_ASSERT(swarm->stats.peerFromCount[atom->fromFirst] <= swarm->stats.peerCount);
@@ -1081,6 +1109,14 @@ static bool on_handshake_done(tr_handshake_result const& result)
         }
     }
 
+    if (s != nullptr)
+    {
+        if (auto* const atom = getExistingAtom(s, addr); atom != nullptr)
+        {
+            updatePeerCandidate(s, atom, tr_time());
+        }
+    }
+
     return success;
 }
 
@@ -1140,11 +1176,9 @@ void tr_peerMgrSetSwarmIsAllSeeds(tr_torrent* tor)
     auto const lock = tor->unique_lock();
 
     auto* const swarm = tor->swarm;
-    auto atomCount = int{};
-    auto** atoms = (struct peer_atom**)tr_ptrArrayPeek(&swarm->pool, &atomCount);
-    for (int i = 0; i < atomCount; ++i)
+    for (auto* const atom : swarm->pool)
     {
-        atomSetSeed(swarm, atoms[i]);
+        atomSetSeed(swarm, atom);
     }
 
     swarm->poolIsAllSeeds = true;
@@ -1243,6 +1277,10 @@ void tr_peerMgrGotBadPiece(tr_torrent* tor, tr_piece_index_t pieceIndex)
     }
 
     tr_announcerAddBytes(tor, TR_ANN_CORRUPT, byteCount);
+
+    // its blocks are about to be forgotten, so make sure
+    // the wishlist walks the piece again
+    s->availability.setClientLacks(pieceIndex);
 }
 
 int tr_pexCompare(void const* va, void const* vb)
@@ -1349,15 +1387,13 @@ int tr_peerMgrGetPeers(tr_torrent const* tor, tr_pex** setme_pex, uint8_t af, ui
     }
     else /* TR_PEERS_INTERESTING */
     {
-        auto** atomBase = (struct peer_atom**)tr_ptrArrayBase(&s->pool);
-        int const n = tr_ptrArraySize(&s->pool);
-        atoms = tr_new(struct peer_atom*, n);
+        atoms = tr_new(struct peer_atom*, std::size(s->pool));
 
-        for (int i = 0; i < n; ++i)
+        for (auto* const atom : s->pool)
         {
-            if (isAtomInteresting(tor, atomBase[i]))
+            if (isAtomInteresting(tor, atom))
             {
-                atoms[atomCount++] = atomBase[i];
+                atoms[atomCount++] = atom;
             }
         }
     }
@@ -1434,6 +1470,33 @@ static void ensureMgrTimersExist(struct tr_peerMgr* m)
     }
 }
 
+static void rebuildAvailability(tr_swarm* s)
+{
+    auto const* const tor = s->tor;
+
+    s->availability.reset(tor->pieceCount());
+
+    for (tr_piece_index_t piece = 0, n = tor->pieceCount(); piece < n; ++piece)
+    {
+        if (tor->hasPiece(piece))
+        {
+            s->availability.setClientHas(piece);
+        }
+    }
+
+    for (int i = 0, n = tr_ptrArraySize(&s->peers); i < n; ++i)
+    {
+        s->availability.addPeer(static_cast<tr_peer const*>(tr_ptrArrayNth(&s->peers, i))->have);
+    }
+
+    // webseeds have every piece. count them too, or the wishlist would
+    // never offer a piece that only a webseed has
+    for (int i = 0, n = tr_ptrArraySize(&s->webseeds); i < n; ++i)
+    {
+        s->availability.addPeer(static_cast<tr_peer const*>(tr_ptrArrayNth(&s->webseeds, i))->have);
+    }
+}
+
 void tr_peerMgrStartTorrent(tr_torrent* tor)
 {
     TR_ASSERT(tr_isTorrent(tor));
@@ -1445,6 +1508,8 @@ void tr_peerMgrStartTorrent(tr_torrent* tor)
 
     s->isRunning = true;
     s->maxPeers = tor->maxConnectedPeers;
+    rebuildAvailability(s);
+    rebuildPeerCandidates(s);
 
     // rechoke soon
     tr_timerAddMsec(s->manager->rechokeTimer, 100);
@@ -1464,6 +1529,9 @@ static void stopSwarm(tr_swarm* swarm)
     {
         tr_handshakeAbort(static_cast<tr_handshake*>(tr_ptrArrayNth(&swarm->outgoingHandshakes, 0)));
     }
+
+    swarm->candidates.clear();
+    swarm->waiting.clear();
 }
 
 void tr_peerMgrStopTorrent(tr_torrent* tor)
@@ -1529,6 +1597,9 @@ void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor)
     /* the webseed list may have changed... */
     rebuildWebseedArray(tor->swarm, tor);
 
+    /* now that we know how many pieces there are, start counting them */
+    rebuildAvailability(tor->swarm);
+
     /* some peer_msgs' progress fields may not be accurate if we
        didn't have the metadata before now... so refresh them all... */
     int const peerCount = tr_ptrArraySize(&tor->swarm->peers);
@@ -1558,8 +1629,9 @@ void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned
 
     if (tor->hasMetadata())
     {
-        int const peerCount = tr_ptrArraySize(&tor->swarm->peers);
-        auto const** peers = (tr_peer const**)tr_ptrArrayBase(&tor->swarm->peers);
+        auto const& availability = tor->swarm->availability;
+        // the availability index counts webseeds, but this only reports peers
+        auto const n_webseeds = size_t(tr_ptrArraySize(&tor->swarm->webseeds));
         float const interval = tor->pieceCount() / (float)tabCount;
         auto const isSeed = tor->isSeed();
 
@@ -1571,15 +1643,10 @@ void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned
             {
                 tab[i] = -1;
             }
-            else if (peerCount != 0)
+            else
             {
-                for (int j = 0; j < peerCount; ++j)
-                {
-                    if (peers[j]->have.test(piece))
-                    {
-                        ++tab[i];
-                    }
-                }
+                auto const n = availability.count(piece);
+                tab[i] = std::min(n > n_webseeds ? n - n_webseeds : 0, size_t{ INT8_MAX });
             }
         }
     }
@@ -1654,24 +1721,10 @@ uint64_t tr_peerMgrGetDesiredAvailable(tr_torrent const* tor)
 
     auto desired_available = uint64_t{};
     auto const n_pieces = tor->pieceCount();
-    auto have = std::vector<bool>(n_pieces);
-
-    for (size_t i = 0; i < n_peers; ++i)
-    {
-        auto const* const peer = peers[i];
-
-        for (size_t j = 0; j < n_pieces; ++j)
-        {
-            if (peer->have.test(j))
-            {
-                have[j] = true;
-            }
-        }
-    }
 
     for (size_t i = 0; i < n_pieces; ++i)
     {
-        if (tor->pieceIsWanted(i) && have.at(i))
+        if (tor->pieceIsWanted(i) && s->availability.count(i) != 0)
         {
             desired_available += tor->countMissingBytesInPiece(i);
         }
@@ -1826,7 +1879,7 @@ void tr_peerMgrClearInterest(tr_torrent* tor)
 }
 
 /* does this peer have any pieces that we want? */
-static bool isPeerInteresting(tr_torrent* const tor, bool const* const piece_is_interesting, tr_peer const* const peer)
+static bool isPeerInteresting(tr_torrent* const tor, tr_bitfield const& piece_is_interesting, tr_peer const* const peer)
 {
     /* these cases should have already been handled by the calling code... */
     TR_ASSERT(!tor->isDone());
@@ -1837,15 +1890,7 @@ static bool isPeerInteresting(tr_torrent* const tor, bool const* const piece_is_
         return true;
     }
 
-    for (tr_piece_index_t i = 0; i < tor->pieceCount(); ++i)
-    {
-        if (piece_is_interesting[i] && peer->have.test(i))
-        {
-            return true;
-        }
-    }
-
-    return false;
+    return peer->have.intersects(piece_is_interesting);
 }
 
 enum tr_rechoke_state
@@ -1968,11 +2013,14 @@ static void rechokeDownloads(tr_swarm* s)
         int const n = tor->pieceCount();
 
         /* build a bitfield of interesting pieces... */
-        auto* const piece_is_interesting = tr_new(bool, n);
+        auto piece_is_interesting = tr_bitfield{ size_t(n) };
 
         for (int i = 0; i < n; ++i)
         {
-            piece_is_interesting[i] = tor->pieceIsWanted(i) && !tor->hasPiece(i);
+            if (tor->pieceIsWanted(i) && !tor->hasPiece(i))
+            {
+                piece_is_interesting.set(i);
+            }
         }
 
         /* decide WHICH peers to be interested in (based on their cancel-to-block ratio) */
@@ -2022,8 +2070,6 @@ static void rechokeDownloads(tr_swarm* s)
                 rechoke_count++;
             }
         }
-
-        tr_free(piece_is_interesting);
     }
 
     if ((rechoke != nullptr) && (rechoke_count > 0))
@@ -2388,13 +2434,17 @@ static void removePeer(tr_peer* peer)
     atom->time = tr_time();
 
     tr_ptrArrayRemoveSortedPointer(&s->peers, peer, peerCompare);
+    s->availability.removePeer(peer->have);
     --s->stats.peerCount;
     --s->stats.peerFromCount[atom->fromFirst];
+    s->tor->markStatsChanged();
 
     TR_ASSERT(s->stats.peerCount == tr_ptrArraySize(&s->peers));
     TR_ASSERT(s->stats.peerFromCount[atom->fromFirst] >= 0);
 
     delete peer;
+
+    updatePeerCandidate(s, atom, tr_time());
 }
 
 static void closePeer(tr_peer* peer)
@@ -2624,6 +2674,7 @@ static void bandwidthPulse(evutil_socket_t /*fd*/, short /*what*/, void* vmgr)
     session->bandwidth->allocate(TR_DOWN, BandwidthPeriodMsec);
 
     /* torrent upkeep */
+    auto const now = tr_time();
     for (auto* tor : session->torrents)
     {
         /* possibly stop torrents that have seeded enough */
@@ -2644,7 +2695,18 @@ static void bandwidthPulse(evutil_socket_t /*fd*/, short /*what*/, void* vmgr)
         }
 
         /* update the torrent's stats */
-        tor->swarm->stats.activeWebseedCount = countActiveWebseeds(tor->swarm);
+        if (auto const n = countActiveWebseeds(tor->swarm); n != tor->swarm->stats.activeWebseedCount)
+        {
+            tor->swarm->stats.activeWebseedCount = n;
+            tor->markStatsChanged();
+        }
+
+        /* transfer speeds are averaged over the last couple of seconds,
+           so they keep changing for a bit after the last activity */
+        if (tor->activityDate + SpeedSettleSeconds >= now)
+        {
+            tor->markStatsChanged();
+        }
     }
 
     /* pump the queues */
@@ -2660,57 +2722,31 @@ static void bandwidthPulse(evutil_socket_t /*fd*/, short /*what*/, void* vmgr)
 ****
 ***/
 
-static int compareAtomPtrsByAddress(void const* va, void const* vb)
-{
-    struct peer_atom const* a = *(struct peer_atom const* const*)va;
-    struct peer_atom const* b = *(struct peer_atom const* const*)vb;
-
-    TR_ASSERT(tr_isAtom(a));
-    TR_ASSERT(tr_isAtom(b));
-
-    return tr_address_compare(&a->addr, &b->addr);
-}
-
 /* best come first, worst go last */
-static int compareAtomPtrsByShelfDate(void const* va, void const* vb)
+struct CompareAtomsByShelfDate
 {
-    struct peer_atom const* a = *(struct peer_atom const* const*)va;
-    struct peer_atom const* b = *(struct peer_atom const* const*)vb;
-
-    TR_ASSERT(tr_isAtom(a));
-    TR_ASSERT(tr_isAtom(b));
-
-    int const data_time_cutoff_secs = 60 * 60;
-    time_t const tr_now = tr_time();
+    time_t const now;
 
-    /* primary key: the last piece data time *if* it was within the last hour */
-    time_t atime = a->piece_data_time;
+    static auto constexpr DataTimeCutoffSecs = int{ 60 * 60 };
 
-    if (atime + data_time_cutoff_secs < tr_now)
+    [[nodiscard]] bool operator()(peer_atom const* a, peer_atom const* b) const
     {
-        atime = 0;
-    }
+        TR_ASSERT(tr_isAtom(a));
+        TR_ASSERT(tr_isAtom(b));
 
-    time_t btime = b->piece_data_time;
+        /* primary key: the last piece data time *if* it was within the last hour */
+        time_t const atime = a->piece_data_time + DataTimeCutoffSecs < now ? 0 : a->piece_data_time;
+        time_t const btime = b->piece_data_time + DataTimeCutoffSecs < now ? 0 : b->piece_data_time;
 
-    if (btime + data_time_cutoff_secs < tr_now)
-    {
-        btime = 0;
-    }
+        if (atime != btime)
+        {
+            return atime > btime;
+        }
 
-    if (atime != btime)
-    {
-        return atime > btime ? -1 : 1;
+        /* secondary key: shelf date. */
+        return a->shelf_date > b->shelf_date;
     }
-
-    /* secondary key: shelf date. */
-    if (a->shelf_date != b->shelf_date)
-    {
-        return a->shelf_date > b->shelf_date ? -1 : 1;
-    }
-
-    return 0;
-}
+};
 
 static int getMaxAtomCount(tr_torrent const* tor)
 {
@@ -2725,66 +2761,39 @@ static void atomPulse(evutil_socket_t /*fd*/, short /*what*/, void* vmgr)
     for (auto* tor : mgr->session->torrents)
     {
         tr_swarm* s = tor->swarm;
-        int const maxAtomCount = getMaxAtomCount(tor);
-        auto atomCount = int{};
-        auto** const atoms = (peer_atom**)tr_ptrArrayPeek(&s->pool, &atomCount);
+        auto const max_atom_count = size_t(getMaxAtomCount(tor));
+        auto const atom_count = std::size(s->pool);
 
-        if (atomCount > maxAtomCount) /* we've got too many atoms... time to prune */
+        if (atom_count > max_atom_count) /* we've got too many atoms... time to prune */
         {
-            int keepCount = 0;
-            int testCount = 0;
-            auto** keep = tr_new(struct peer_atom*, atomCount);
-            auto** test = tr_new(struct peer_atom*, atomCount);
-
             /* keep the ones that are in use */
-            for (int i = 0; i < atomCount; ++i)
-            {
-                struct peer_atom* atom = atoms[i];
-
-                if (peerIsInUse(s, atom))
+            auto test = std::vector<peer_atom*>{};
+            test.reserve(atom_count);
+            std::copy_if(
+                std::begin(s->pool),
+                std::end(s->pool),
+                std::back_inserter(test),
+                [s](auto const* atom) { return !peerIsInUse(s, atom); });
+
+            /* if there's room, keep the best of what's left.
+               they only need to be picked, not sorted */
+            auto const keep_count = atom_count - std::size(test);
+            auto const room = std::min(std::size(test), max_atom_count - std::min(max_atom_count, keep_count));
+            auto const cull_begin = std::begin(test) + room;
+            std::nth_element(std::begin(test), cull_begin, std::end(test), CompareAtomsByShelfDate{ tr_time() });
+
+            /* remove the culled atoms */
+            std::for_each(
+                cull_begin,
+                std::end(test),
+                [s](auto* atom)
                 {
-                    keep[keepCount++] = atom;
-                }
-                else
-                {
-                    test[testCount++] = atom;
-                }
-            }
+                    s->candidates.erase(atom);
+                    s->waiting.erase(atom);
+                    s->pool.erase(atom);
+                });
 
-            /* if there's room, keep the best of what's left */
-            int i = 0;
-
-            if (keepCount < maxAtomCount)
-            {
-                qsort(test, testCount, sizeof(struct peer_atom*), compareAtomPtrsByShelfDate);
-
-                while (i < testCount && keepCount < maxAtomCount)
-                {
-                    keep[keepCount++] = test[i++];
-                }
-            }
-
-            /* free the culled atoms */
-            while (i < testCount)
-            {
-                tr_free(test[i++]);
-            }
-
-            /* rebuild Torrent.pool with what's left */
-            tr_ptrArrayDestruct(&s->pool, nullptr);
-            s->pool = {};
-            qsort(keep, keepCount, sizeof(struct peer_atom*), compareAtomPtrsByAddress);
-
-            for (i = 0; i < keepCount; ++i)
-            {
-                tr_ptrArrayAppend(&s->pool, keep[i]);
-            }
-
-            tordbg(s, "max atom count is %d... pruned from %d to %d\n", maxAtomCount, atomCount, keepCount);
-
-            /* cleanup */
-            tr_free(test);
-            tr_free(keep);
+            tordbg(s, "max atom count is %zu... pruned from %zu to %zu\n", max_atom_count, atom_count, std::size(s->pool));
         }
     }
 
@@ -2797,8 +2806,8 @@ static void atomPulse(evutil_socket_t /*fd*/, short /*what*/, void* vmgr)
 ****
 ***/
 
-/* is this atom someone that we'd want to initiate a connection to? */
-static bool isPeerCandidate(tr_torrent const* tor, struct peer_atom* atom, time_t const now)
+/* is this atom someone that we'd want to initiate a connection to, now or later? */
+static bool isAtomConnectable(tr_torrent const* tor, struct peer_atom* atom)
 {
     /* not if we're both seeds */
     if (tor->isDone() && atomIsSeed(atom))
@@ -2812,12 +2821,6 @@ static bool isPeerCandidate(tr_torrent const* tor, struct peer_atom* atom, time_
         return false;
     }
 
-    /* not if we just tried them already */
-    if (now - atom->time < getReconnectIntervalSecs(atom, now))
-    {
-        return false;
-    }
-
     /* not if they're blocklisted */
     if (isAtomBlocklisted(tor->session, atom))
     {
@@ -2833,6 +2836,18 @@ static bool isPeerCandidate(tr_torrent const* tor, struct peer_atom* atom, time_
     return true;
 }
 
+/* is this atom someone that we'd want to initiate a connection to? */
+static bool isPeerCandidate(tr_torrent const* tor, struct peer_atom* atom, time_t const now)
+{
+    /* not if we just tried them already */
+    if (now - atom->time < getReconnectIntervalSecs(atom, now))
+    {
+        return false;
+    }
+
+    return isAtomConnectable(tor, atom);
+}
+
 struct peer_candidate
 {
     uint64_t score;
@@ -2852,20 +2867,12 @@ static constexpr uint64_t addValToKey(uint64_t value, int width, uint64_t addme)
     return value;
 }
 
-/* smaller value is better */
-static uint64_t getPeerCandidateScore(tr_torrent const* tor, struct peer_atom const* atom, uint8_t salt)
+/* the part of a candidate's score that comes from its torrent.
+   smaller value is better */
+static uint64_t getTorrentCandidateScore(tr_torrent const* tor)
 {
     auto i = uint64_t{};
     auto score = uint64_t{};
-    bool const failed = atom->lastConnectionAt < atom->lastConnectionAttemptAt;
-
-    /* prefer peers we've connected to, or never tried, over peers we failed to connect to. */
-    i = failed ? 1 : 0;
-    score = addValToKey(score, 1, i);
-
-    /* prefer the one we attempted least recently (to cycle through all peers) */
-    i = atom->lastConnectionAttemptAt;
-    score = addValToKey(score, 32, i);
 
     /* prefer peers belonging to a torrent of a higher priority */
     switch (tr_torrentGetPriority(tor))
@@ -2893,6 +2900,33 @@ static uint64_t getPeerCandidateScore(tr_torrent const* tor, struct peer_atom co
     i = tor->isDone() ? 1 : 0;
     score = addValToKey(score, 1, i);
 
+    return score;
+}
+
+static auto constexpr TorrentCandidateScoreBits = int{ 6 };
+static auto constexpr TorrentCandidateScoreShift = int{ 14 };
+
+/* the part of a candidate's score that comes from the atom itself.
+   there's a gap left for getTorrentCandidateScore() so that the atoms
+   in a swarm can be kept sorted without knowing their torrent's state.
+   smaller value is better */
+static uint64_t getAtomCandidateScore(struct peer_atom const* atom, uint8_t salt)
+{
+    auto i = uint64_t{};
+    auto score = uint64_t{};
+    bool const failed = atom->lastConnectionAt < atom->lastConnectionAttemptAt;
+
+    /* prefer peers we've connected to, or never tried, over peers we failed to connect to. */
+    i = failed ? 1 : 0;
+    score = addValToKey(score, 1, i);
+
+    /* prefer the one we attempted least recently (to cycle through all peers) */
+    i = atom->lastConnectionAttemptAt;
+    score = addValToKey(score, 32, i);
+
+    /* leave room for the torrent's score */
+    score = addValToKey(score, TorrentCandidateScoreBits, 0);
+
     /* prefer peers that are known to be connectible */
     i = (atom->flags & ADDED_F_CONNECTABLE) != 0 ? 0 : 1;
     score = addValToKey(score, 1, i);
@@ -2911,20 +2945,86 @@ static uint64_t getPeerCandidateScore(tr_torrent const* tor, struct peer_atom co
     return score;
 }
 
-static bool calculateAllSeeds(tr_swarm* swarm)
+/* smaller value is better */
+static uint64_t getPeerCandidateScore(tr_torrent const* tor, struct peer_atom const* atom)
 {
-    int nAtoms = 0;
-    auto** atoms = (struct peer_atom**)tr_ptrArrayPeek(&swarm->pool, &nAtoms);
+    return atom->candidate_score | (getTorrentCandidateScore(tor) << TorrentCandidateScoreShift);
+}
 
-    for (int i = 0; i < nAtoms; ++i)
+/**
+ * Each swarm keeps the atoms that it might connect to in two heaps:
+ * `candidates` has the ones that could be connected to now, sorted by
+ * getAtomCandidateScore(), and `waiting` has the ones that still have to
+ * wait out their reconnect interval, sorted by when that ends. Atoms that
+ * are in use or that we'd never connect to are in neither heap.
+ *
+ * This is kept up to date as atoms change state, so choosing the next
+ * connections only has to look at the best atom of each swarm.
+ */
+static void updatePeerCandidate(tr_swarm* s, struct peer_atom* atom, time_t now)
+{
+    s->candidates.erase(atom);
+    s->waiting.erase(atom);
+
+    if (!s->isRunning || !isAtomConnectable(s->tor, atom))
+    {
+        return;
+    }
+
+    if (auto const ready_at = atom->time + getReconnectIntervalSecs(atom, now); ready_at > now)
+    {
+        atom->candidate_ready_at = ready_at;
+        s->waiting.insert(atom);
+    }
+    else
     {
-        if (!atomIsSeed(atoms[i]))
+        atom->candidate_score = getAtomCandidateScore(atom, tr_rand_int_weak(1024));
+        s->candidates.insert(atom);
+    }
+}
+
+static void rebuildPeerCandidates(tr_swarm* s)
+{
+    s->candidates.clear();
+    s->waiting.clear();
+    s->candidatesAreForSeed = s->tor->isDone();
+
+    auto const now = tr_time();
+    for (auto* const atom : s->pool)
+    {
+        updatePeerCandidate(s, atom, now);
+    }
+}
+
+/* @return the swarm's best candidate, or nullptr if it has none */
+static struct peer_atom* getBestPeerCandidate(tr_swarm* s, time_t now)
+{
+    /* move the atoms that have waited long enough over to the candidates */
+    while (!s->waiting.empty() && s->waiting.top()->candidate_ready_at <= now)
+    {
+        updatePeerCandidate(s, s->waiting.top(), now);
+    }
+
+    /* the heaps are updated when atoms change, but some of what makes an atom
+       a candidate depends on the time, so check the best one before using it */
+    while (!s->candidates.empty())
+    {
+        auto* const atom = s->candidates.top();
+
+        if (isPeerCandidate(s->tor, atom, now))
         {
-            return false;
+            return atom;
         }
+
+        updatePeerCandidate(s, atom, now);
     }
 
-    return true;
+    return nullptr;
+}
+
+static bool calculateAllSeeds(tr_swarm* swarm)
+{
+    return std::all_of(std::begin(swarm->pool), std::end(swarm->pool), atomIsSeed);
 }
 
 static bool swarmIsAllSeeds(tr_swarm* swarm)
@@ -2938,7 +3038,7 @@ static bool swarmIsAllSeeds(tr_swarm* swarm)
     return swarm->poolIsAllSeeds;
 }
 
-/** @return an array of all the atoms we might want to connect to */
+/** @return the best `max` atoms that we might want to connect to */
 static std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t max)
 {
     time_t const now = tr_time();
@@ -2946,12 +3046,10 @@ static std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t
     /* leave 5% of connection slots for incoming connections -- ticket #2609 */
     int const maxCandidates = tr_sessionGetPeerLimit(session) * 0.95;
 
-    /* count how many peers and atoms we've got */
-    int atomCount = 0;
+    /* count how many peers we've got */
     int peerCount = 0;
     for (auto const* tor : session->torrents)
     {
-        atomCount += tr_ptrArraySize(&tor->swarm->pool);
         peerCount += tr_ptrArraySize(&tor->swarm->peers);
     }
 
@@ -2961,10 +3059,8 @@ static std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t
         return {};
     }
 
-    auto candidates = std::vector<peer_candidate>{};
-    candidates.reserve(atomCount);
-
-    /* populate the candidate array */
+    /* get the best candidate from each swarm that wants more peers */
+    auto best = std::vector<peer_candidate>{};
     for (auto* tor : session->torrents)
     {
         if (!tor->swarm->isRunning)
@@ -2972,9 +3068,15 @@ static std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t
             continue;
         }
 
+        /* seeds are only candidates when we're not seeding */
+        bool const seeding = tor->isDone();
+        if (seeding != tor->swarm->candidatesAreForSeed)
+        {
+            rebuildPeerCandidates(tor->swarm);
+        }
+
         /* if everyone in the swarm is seeds and pex is disabled because
          * the torrent is private, then don't initiate connections */
-        bool const seeding = tor->isDone();
         if (seeding && swarmIsAllSeeds(tor->swarm) && tor->isPrivate())
         {
             continue;
@@ -2992,30 +3094,34 @@ static std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t
             continue;
         }
 
-        auto nAtoms = int{};
-        auto** atoms = (peer_atom**)tr_ptrArrayPeek(&tor->swarm->pool, &nAtoms);
-
-        for (int i = 0; i < nAtoms; ++i)
+        if (auto* const atom = getBestPeerCandidate(tor->swarm, now); atom != nullptr)
         {
-            struct peer_atom* atom = atoms[i];
-
-            if (isPeerCandidate(tor, atom, now))
-            {
-                uint8_t const salt = tr_rand_int_weak(1024);
-                candidates.push_back({ getPeerCandidateScore(tor, atom, salt), tor, atom });
-            }
+            best.push_back({ getPeerCandidateScore(tor, atom), tor, atom });
         }
     }
 
-    // only keep the best `max` candidates
-    if (std::size(candidates) > max)
+    /* take the best of those, replacing each one that's taken with the next best from its swarm */
+    auto const compare = [](auto const& a, auto const& b)
+    {
+        return a.score > b.score;
+    };
+    std::make_heap(std::begin(best), std::end(best), compare);
+
+    auto candidates = std::vector<peer_candidate>{};
+    while (std::size(candidates) < max && !std::empty(best))
     {
-        std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + max,
-            std::end(candidates),
-            [](auto const& a, auto const& b) { return a.score < b.score; });
-        candidates.resize(max);
+        std::pop_heap(std::begin(best), std::end(best), compare);
+        auto const candidate = best.back();
+        best.pop_back();
+        candidates.push_back(candidate);
+
+        auto* const swarm = candidate.tor->swarm;
+        swarm->candidates.erase(candidate.atom);
+        if (auto* const atom = getBestPeerCandidate(swarm, now); atom != nullptr)
+        {
+            best.push_back({ getPeerCandidateScore(candidate.tor, atom), candidate.tor, atom });
+            std::push_heap(std::begin(best), std::end(best), compare);
+        }
     }
 
     return candidates;
@@ -3064,6 +3170,7 @@ static void initiateConnection(tr_peerMgr* mgr, tr_swarm* s, struct peer_atom* a
 
     atom->lastConnectionAttemptAt = now;
     atom->time = now;
+    updatePeerCandidate(s, atom, now);
 }
 
 static void initiateCandidateConnection(tr_peerMgr* mgr, peer_candidate& c)
@@ -20,6 +20,7 @@
 #include "cache.h"
 #include "completion.h"
 #include "file.h"
+#include "inout.h"
 #include "log.h"
 #include "peer-io.h"
 #include "peer-mgr.h"
@@ -1710,8 +1711,10 @@ static ReadState readBtMessage(tr_peerMsgsImpl* msgs, struct evbuffer* inbuf, si
             auto* const tmp = tr_new(uint8_t, msglen);
             dbgmsg(msgs, "got a bitfield");
             tr_peerIoReadBytes(msgs->io, inbuf, tmp, msglen);
-            msgs->have.setRaw(tmp, msglen);
-            msgs->publishClientGotBitfield(&msgs->have);
+            auto have = tr_bitfield{ msgs->have.size() };
+            have.setRaw(tmp, msglen);
+            msgs->publishClientGotBitfield(&have);
+            msgs->have = std::move(have);
             updatePeerProgress(msgs);
             tr_free(tmp);
             break;
@@ -1809,8 +1812,8 @@ static ReadState readBtMessage(tr_peerMsgsImpl* msgs, struct evbuffer* inbuf, si
 
         if (fext)
         {
-            msgs->have.setHasAll();
             msgs->publishClientGotHaveAll();
+            msgs->have.setHasAll();
             updatePeerProgress(msgs);
         }
         else
@@ -1826,8 +1829,8 @@ static ReadState readBtMessage(tr_peerMsgsImpl* msgs, struct evbuffer* inbuf, si
 
         if (fext)
         {
-            msgs->have.setHasNone();
             msgs->publishClientGotHaveNone();
+            msgs->have.setHasNone();
             updatePeerProgress(msgs);
         }
         else
@@ -1916,8 +1919,12 @@ static int clientGotBlock(tr_peerMsgsImpl* msgs, struct evbuffer* data, struct p
     ***  Save the block
     **/
 
+    // hash the block now, while it's still in memory, if it's the next one its piece needs
+    tor->hash_streams.add(req->index, tor->blockSpanForPiece(req->index).begin, block, data);
+
     if (int const err = tr_cacheWriteBlock(msgs->session->cache, tor, req->index, req->offset, req->length, data); err != 0)
     {
+        tor->hash_streams.erase(req->index);
         return err;
     }
 
@@ -2206,16 +2213,37 @@ static size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
             evbuffer_add_uint32(out, req.index);
             evbuffer_add_uint32(out, req.offset);
 
-            evbuffer_reserve_space(out, req.length, iovec, 1);
-            bool err = tr_cacheReadBlock(
-                           msgs->session->cache,
-                           msgs->torrent,
-                           req.index,
-                           req.offset,
-                           req.length,
-                           static_cast<uint8_t*>(iovec[0].iov_base)) != 0;
-            iovec[0].iov_len = req.length;
-            evbuffer_commit_space(out, iovec, 1);
+            auto err = bool{ true };
+            auto used_segments = bool{ false };
+
+            // when we can, hand the peer the file's pages instead of a copy of them
+            bool const zero_copy = tr_peerIoCanReferencePieceData(msgs->io) &&
+                !tr_cacheIsDirty(msgs->session->cache, msgs->torrent, req.index, req.offset, req.length);
+
+            if (zero_copy && msgs->session->isSendfileUploadsEnabled && tr_peerIoCanSendFileSegments(msgs->io))
+            {
+                err = tr_ioReadSegment(msgs->torrent, req.index, req.offset, req.length, out) != 0;
+                used_segments = !err;
+            }
+
+            if (err && zero_copy && msgs->session->isMmapUploadsEnabled)
+            {
+                err = tr_ioReadReference(msgs->torrent, req.index, req.offset, req.length, out) != 0;
+            }
+
+            if (err)
+            {
+                evbuffer_reserve_space(out, req.length, iovec, 1);
+                err = tr_cacheReadBlock(
+                          msgs->session->cache,
+                          msgs->torrent,
+                          req.index,
+                          req.offset,
+                          req.length,
+                          static_cast<uint8_t*>(iovec[0].iov_base)) != 0;
+                iovec[0].iov_len = req.length;
+                evbuffer_commit_space(out, iovec, 1);
+            }
 
             /* check the piece if it needs checking... */
             if (!err)
@@ -2243,7 +2271,15 @@ static size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
                 size_t const n = evbuffer_get_length(out);
                 dbgmsg(msgs, "sending block %u:%u->%u", req.index, req.offset, req.length);
                 TR_ASSERT(n == msglen);
-                tr_peerIoWriteBuf(msgs->io, out, true);
+
+                if (used_segments)
+                {
+                    tr_peerIoWriteFileSegments(msgs->io, out, req.length);
+                }
+                else
+                {
+                    tr_peerIoWriteBuf(msgs->io, out, true);
+                }
                 bytesWritten += n;
                 msgs->clientSentAnythingAt = now;
                 msgs->blocksSentToPeer.add(tr_time(), 1);
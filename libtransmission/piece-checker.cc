@@ -0,0 +1,236 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <utility>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "piece-checker.h"
+#include "session.h"
+#include "tr-assert.h"
+#include "trevent.h"
+
+PieceChecker::PieceChecker(tr_session* session, size_t n_workers, done_func on_done)
+    : session_{ session }
+    , on_done_{ on_done }
+{
+    for (size_t i = 0; i < n_workers; ++i)
+    {
+        workers_.emplace_back(&PieceChecker::workerFunc, this);
+    }
+}
+
+PieceChecker::~PieceChecker()
+{
+    TR_ASSERT(tr_amInEventThread(session_));
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        is_closing_ = true;
+    }
+
+    todo_cv_.notify_all();
+
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+
+    deliverResults();
+}
+
+void PieceChecker::add(
+    int torrent_id,
+    tr_piece_index_t piece,
+    tr_sha1_digest_t const& expected,
+    std::vector<uint8_t>&& data,
+    tr_sha1_ctx_t ctx)
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        todo_.push_back(Job{ torrent_id, piece, expected, std::move(data), ctx, false });
+    }
+
+    todo_cv_.notify_one();
+}
+
+size_t PieceChecker::size() const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return std::size(todo_) + n_hashing_ + std::size(done_);
+}
+
+bool PieceChecker::check(tr_sha1_digest_t const& expected, std::vector<uint8_t> const& data, tr_sha1_ctx_t ctx)
+{
+    if (ctx == nullptr)
+    {
+        ctx = tr_sha1_init();
+    }
+
+    if (ctx == nullptr)
+    {
+        return false;
+    }
+
+    auto const ok = tr_sha1_update(ctx, std::data(data), std::size(data));
+    auto const hash = tr_sha1_final(ctx);
+    return ok && hash && *hash == expected;
+}
+
+void PieceChecker::workerFunc()
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        // finish the queued pieces before closing so that none are left unchecked
+        todo_cv_.wait(lock, [this]() { return is_closing_ || !std::empty(todo_); });
+        if (std::empty(todo_))
+        {
+            return;
+        }
+
+        auto job = std::move(todo_.front());
+        todo_.pop_front();
+        ++n_hashing_;
+        lock.unlock();
+
+        job.pass = check(job.expected, job.data, job.ctx);
+        job.data = {};
+        job.ctx = nullptr;
+
+        lock.lock();
+        --n_hashing_;
+        done_.push_back(std::move(job));
+
+        // one callback delivers all the results that are ready by the time it runs
+        if (!results_posted_ && !is_closing_)
+        {
+            results_posted_ = true;
+            tr_runInEventThread(session_, onResultsReady, session_);
+        }
+    }
+}
+
+void PieceChecker::onResultsReady(void* vsession)
+{
+    // the checker may have been destroyed, and its results delivered, while this was queued
+    auto* const session = static_cast<tr_session*>(vsession);
+    if (session->piece_checker)
+    {
+        session->piece_checker->deliverResults();
+    }
+}
+
+void PieceChecker::deliverResults()
+{
+    auto done = std::vector<Job>{};
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        done.swap(done_);
+        results_posted_ = false;
+    }
+
+    for (auto const& job : done)
+    {
+        on_done_(session_, job.torrent_id, job.piece, job.pass);
+    }
+}
+
+/***
+****
+***/
+
+PieceHashStreams::~PieceHashStreams()
+{
+    clear();
+}
+
+void PieceHashStreams::add(tr_piece_index_t piece, tr_block_index_t piece_begin, tr_block_index_t block, evbuffer* data)
+{
+    auto it = streams_.find(piece);
+
+    // the first block (re)starts the piece's hash
+    if (block == piece_begin)
+    {
+        if (it == std::end(streams_))
+        {
+            it = streams_.try_emplace(piece).first;
+        }
+        else if (it->second.ctx != nullptr)
+        {
+            tr_sha1_final(it->second.ctx);
+        }
+
+        it->second = Stream{ tr_sha1_init(), piece_begin };
+    }
+
+    if (it == std::end(streams_) || it->second.next_block != block)
+    {
+        return;
+    }
+
+    auto& stream = it->second;
+    auto vecs = std::vector<evbuffer_iovec>(evbuffer_peek(data, -1, nullptr, nullptr, 0));
+    evbuffer_peek(data, -1, nullptr, std::data(vecs), std::size(vecs));
+
+    auto ok = stream.ctx != nullptr;
+    for (auto const& vec : vecs)
+    {
+        ok = ok && tr_sha1_update(stream.ctx, vec.iov_base, vec.iov_len);
+    }
+
+    if (!ok)
+    {
+        erase(piece);
+        return;
+    }
+
+    ++stream.next_block;
+}
+
+std::pair<tr_sha1_ctx_t, tr_block_index_t> PieceHashStreams::take(tr_piece_index_t piece, tr_block_index_t piece_begin)
+{
+    auto const it = streams_.find(piece);
+    if (it == std::end(streams_))
+    {
+        return { nullptr, piece_begin };
+    }
+
+    auto const ret = std::make_pair(it->second.ctx, it->second.next_block);
+    streams_.erase(it);
+    return ret;
+}
+
+void PieceHashStreams::erase(tr_piece_index_t piece)
+{
+    if (auto const it = streams_.find(piece); it != std::end(streams_))
+    {
+        if (it->second.ctx != nullptr)
+        {
+            tr_sha1_final(it->second.ctx);
+        }
+
+        streams_.erase(it);
+    }
+}
+
+void PieceHashStreams::clear()
+{
+    for (auto const& [piece, stream] : streams_)
+    {
+        if (stream.ctx != nullptr)
+        {
+            tr_sha1_final(stream.ctx);
+        }
+    }
+
+    streams_.clear();
+}
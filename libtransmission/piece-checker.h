@@ -0,0 +1,139 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "transmission.h" // tr_piece_index_t, tr_sha1_digest_t
+
+#include "crypto-utils.h" // tr_sha1_ctx_t
+
+struct evbuffer;
+
+/**
+ * Checks the SHA1 of newly-downloaded pieces on a pool of worker threads,
+ * so that hashing a big piece doesn't stall the session thread.
+ *
+ * Results are handed back to `done_func` on the session thread. Pieces
+ * are identified by torrent id, since a torrent may be removed while
+ * its pieces are still being checked.
+ */
+class PieceChecker
+{
+public:
+    using done_func = void (*)(tr_session* session, int torrent_id, tr_piece_index_t piece, bool pass);
+
+    PieceChecker(tr_session* session, size_t n_workers, done_func on_done);
+
+    // Must be called from the session thread. Waits for the pieces that
+    // have already been queued to finish, then delivers their results.
+    ~PieceChecker();
+
+    PieceChecker(PieceChecker const&) = delete;
+    PieceChecker& operator=(PieceChecker const&) = delete;
+
+    // If `ctx` is given, it holds the hash of the bytes that come before
+    // `data` in the piece. The checker takes ownership of it.
+    void add(
+        int torrent_id,
+        tr_piece_index_t piece,
+        tr_sha1_digest_t const& expected,
+        std::vector<uint8_t>&& data,
+        tr_sha1_ctx_t ctx = nullptr);
+
+    // number of pieces whose results haven't been delivered yet
+    [[nodiscard]] size_t size() const;
+
+    // Hash `data`, continuing from `ctx` if it's given, and compare it to `expected`.
+    // Takes ownership of `ctx`.
+    [[nodiscard]] static bool check(tr_sha1_digest_t const& expected, std::vector<uint8_t> const& data, tr_sha1_ctx_t ctx);
+
+private:
+    struct Job
+    {
+        int torrent_id = 0;
+        tr_piece_index_t piece = 0;
+        tr_sha1_digest_t expected = {};
+        std::vector<uint8_t> data;
+        tr_sha1_ctx_t ctx = nullptr;
+        bool pass = false;
+    };
+
+    static void onResultsReady(void* vsession);
+
+    void workerFunc();
+    void deliverResults();
+
+    tr_session* const session_;
+    done_func const on_done_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable todo_cv_;
+    std::deque<Job> todo_;
+    std::vector<Job> done_;
+    size_t n_hashing_ = 0;
+    bool results_posted_ = false;
+    bool is_closing_ = false;
+
+    std::vector<std::thread> workers_;
+};
+
+/**
+ * Hashes each piece's blocks as they're downloaded, for as long as they
+ * arrive in order, while they're still hot in the CPU cache. When a piece
+ * completes, only the blocks that came out of order need to be read back
+ * to finish its hash.
+ */
+class PieceHashStreams
+{
+public:
+    PieceHashStreams() = default;
+    ~PieceHashStreams();
+
+    PieceHashStreams(PieceHashStreams const&) = delete;
+    PieceHashStreams& operator=(PieceHashStreams const&) = delete;
+
+    // `block` of the piece that starts at `piece_begin` was just downloaded.
+    // Hash it if it's the next one that the piece's hash is waiting for.
+    void add(tr_piece_index_t piece, tr_block_index_t piece_begin, tr_block_index_t block, struct evbuffer* data);
+
+    // Stop hashing `piece`. Returns its hash context, which the caller now
+    // owns, and the first block that's not in it yet. If nothing has been
+    // hashed, the context is nullptr and the block is `piece_begin`.
+    [[nodiscard]] std::pair<tr_sha1_ctx_t, tr_block_index_t> take(tr_piece_index_t piece, tr_block_index_t piece_begin);
+
+    // forget `piece`'s hash, e.g. because one of the blocks in it wasn't saved
+    void erase(tr_piece_index_t piece);
+
+    // forget every piece's hash
+    void clear();
+
+    [[nodiscard]] auto size() const
+    {
+        return std::size(streams_);
+    }
+
+private:
+    struct Stream
+    {
+        tr_sha1_ctx_t ctx = nullptr;
+        tr_block_index_t next_block = 0;
+    };
+
+    std::unordered_map<tr_piece_index_t, Stream> streams_;
+};
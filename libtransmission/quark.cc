@@ -5,12 +5,16 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <mutex>
+#include <optional>
 #include <string_view>
-#include <vector>
+#include <unordered_map>
 
 #include "transmission.h"
 
 #include "quark.h"
+#include "tr-assert.h"
 #include "utils.h" // tr_strvDup()
 
 using namespace std::literals;
@@ -18,7 +22,7 @@ using namespace std::literals;
 namespace
 {
 
-auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
+auto constexpr my_static = std::array<std::string_view, 414>{ ""sv,
                                                               "activeTorrentCount"sv,
                                                               "activity-date"sv,
                                                               "activityDate"sv,
@@ -39,6 +43,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "announce"sv,
                                                               "announce-list"sv,
                                                               "announceState"sv,
+                                                              "announcer-stats"sv,
                                                               "anti-brute-force-enabled"sv,
                                                               "anti-brute-force-threshold"sv,
                                                               "arguments"sv,
@@ -55,6 +60,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "blocks"sv,
                                                               "bytesCompleted"sv,
                                                               "cache-size-mb"sv,
+                                                              "capacity"sv,
                                                               "clientIsChoked"sv,
                                                               "clientIsInterested"sv,
                                                               "clientName"sv,
@@ -72,6 +78,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "creator"sv,
                                                               "cumulative-stats"sv,
                                                               "current-stats"sv,
+                                                              "cursor"sv,
                                                               "date"sv,
                                                               "dateCreated"sv,
                                                               "delete-local-data"sv,
@@ -92,6 +99,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "downloadLimit"sv,
                                                               "downloadLimited"sv,
                                                               "downloadSpeed"sv,
+                                                              "downloadSpeeds"sv,
                                                               "downloaded"sv,
                                                               "downloaded-bytes"sv,
                                                               "downloadedBytes"sv,
@@ -108,6 +116,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "errorString"sv,
                                                               "eta"sv,
                                                               "etaIdle"sv,
+                                                              "evictions"sv,
                                                               "fields"sv,
                                                               "file-count"sv,
                                                               "fileStats"sv,
@@ -136,6 +145,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "have"sv,
                                                               "haveUnchecked"sv,
                                                               "haveValid"sv,
+                                                              "hits"sv,
                                                               "honorsSessionLimits"sv,
                                                               "host"sv,
                                                               "id"sv,
@@ -186,8 +196,10 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "main-window-x"sv,
                                                               "main-window-y"sv,
                                                               "manualAnnounceTime"sv,
+                                                              "mappings"sv,
                                                               "max-peers"sv,
                                                               "maxConnectedPeers"sv,
+                                                              "maxLagMsec"sv,
                                                               "memory-bytes"sv,
                                                               "memory-units"sv,
                                                               "message-level"sv,
@@ -196,6 +208,8 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "metainfo"sv,
                                                               "method"sv,
                                                               "min_request_interval"sv,
+                                                              "misses"sv,
+                                                              "mmap-uploads-enabled"sv,
                                                               "move"sv,
                                                               "msg_type"sv,
                                                               "mtimes"sv,
@@ -206,7 +220,10 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "nodes"sv,
                                                               "nodes6"sv,
                                                               "open-dialog-dir"sv,
+                                                              "open-file-stats"sv,
                                                               "p"sv,
+                                                              "packetsReceived"sv,
+                                                              "packetsSent"sv,
                                                               "path"sv,
                                                               "path.utf-8"sv,
                                                               "paused"sv,
@@ -267,7 +284,10 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "ratio-limit"sv,
                                                               "ratio-limit-enabled"sv,
                                                               "ratio-mode"sv,
+                                                              "rawDownloadSpeeds"sv,
+                                                              "rawUploadSpeeds"sv,
                                                               "read-clipboard"sv,
+                                                              "receiveCalls"sv,
                                                               "recent-download-dir-1"sv,
                                                               "recent-download-dir-2"sv,
                                                               "recent-download-dir-3"sv,
@@ -319,6 +339,9 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "seedRatioMode"sv,
                                                               "seederCount"sv,
                                                               "seeding-time-seconds"sv,
+                                                              "segments"sv,
+                                                              "sendCalls"sv,
+                                                              "sendfile-uploads-enabled"sv,
                                                               "session-count"sv,
                                                               "session-id"sv,
                                                               "sessionCount"sv,
@@ -330,6 +353,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "show-statusbar"sv,
                                                               "show-toolbar"sv,
                                                               "show-tracker-scrapes"sv,
+                                                              "since"sv,
                                                               "sitename"sv,
                                                               "size-bytes"sv,
                                                               "size-units"sv,
@@ -352,6 +376,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "statusbar-stats"sv,
                                                               "tag"sv,
                                                               "tier"sv,
+                                                              "tiersServed"sv,
                                                               "time-checked"sv,
                                                               "torrent-added"sv,
                                                               "torrent-added-notification-command"sv,
@@ -367,6 +392,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "torrentCount"sv,
                                                               "torrentFile"sv,
                                                               "torrents"sv,
+                                                              "totalLagMsec"sv,
                                                               "totalSize"sv,
                                                               "total_size"sv,
                                                               "trackerAdd"sv,
@@ -377,6 +403,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "trackers"sv,
                                                               "trash-can-enabled"sv,
                                                               "trash-original-torrent-files"sv,
+                                                              "udp-stats"sv,
                                                               "umask"sv,
                                                               "units"sv,
                                                               "upload-slots-per-torrent"sv,
@@ -384,6 +411,7 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "uploadLimited"sv,
                                                               "uploadRatio"sv,
                                                               "uploadSpeed"sv,
+                                                              "uploadSpeeds"sv,
                                                               "upload_only"sv,
                                                               "uploaded"sv,
                                                               "uploaded-bytes"sv,
@@ -400,6 +428,8 @@ auto constexpr my_static = std::array<std::string_view, 388>{ ""sv,
                                                               "ut_recommend"sv,
                                                               "utp-enabled"sv,
                                                               "v"sv,
+                                                              "verify-speed-limit"sv,
+                                                              "verify-threads"sv,
                                                               "version"sv,
                                                               "wanted"sv,
                                                               "watch-dir"sv,
@@ -423,13 +453,71 @@ bool constexpr quarks_are_sorted()
 static_assert(quarks_are_sorted(), "Predefined quarks must be sorted by their string value");
 static_assert(std::size(my_static) == TR_N_KEYS);
 
-auto& my_runtime{ *new std::vector<std::string_view>{} };
+// The strings of the quarks added at runtime. They're kept in chunks
+// that never move once allocated, so that a quark's string can be read
+// without locking while other threads add more quarks. A quark is
+// published by storing the new count after its string is in place.
+class RuntimeStrings
+{
+public:
+    // must be called with my_runtime_mutex held
+    size_t append(std::string_view str)
+    {
+        auto const n = count_.load(std::memory_order_relaxed);
+        TR_ASSERT(n < ChunkSize * MaxChunks);
 
-} // namespace
+        auto*& chunk = chunks_[n / ChunkSize];
+        if (chunk == nullptr)
+        {
+            chunk = new std::string_view[ChunkSize];
+        }
 
-std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+        chunk[n % ChunkSize] = str;
+        count_.store(n + 1, std::memory_order_release);
+        return n;
+    }
+
+    [[nodiscard]] std::string_view get(size_t n) const
+    {
+        if (n >= count_.load(std::memory_order_acquire))
+        {
+            return {};
+        }
+
+        return chunks_[n / ChunkSize][n % ChunkSize];
+    }
+
+private:
+    // 16M runtime quarks, far more than any session will add
+    static auto constexpr ChunkSize = size_t{ 4096 };
+    static auto constexpr MaxChunks = size_t{ 4096 };
+
+    std::array<std::string_view*, MaxChunks> chunks_ = {};
+    std::atomic<size_t> count_ = 0;
+};
+
+auto& my_runtime{ *new RuntimeStrings{} };
+
+// quarks may be added from any thread, e.g. when parsing
+// torrent files on tr_sessionLoadTorrents()'s worker threads.
+// Only adding and looking up runtime quarks takes the lock.
+auto& my_runtime_mutex{ *new std::mutex{} };
+
+// runtime quarks are mostly tracker URLs, so there can be a lot of them
+auto& my_runtime_index{ *new std::unordered_map<std::string_view, tr_quark>{} };
+
+std::optional<tr_quark> lookupRuntime(std::string_view key)
+{
+    if (auto const it = my_runtime_index.find(key); it != std::end(my_runtime_index))
+    {
+        return it->second;
+    }
+
+    return {};
+}
+
+std::optional<tr_quark> lookupStatic(std::string_view key)
 {
-    // is it in our static array?
     auto constexpr sbegin = std::begin(my_static);
     auto constexpr send = std::end(my_static);
     auto const sit = std::lower_bound(sbegin, send, key);
@@ -438,33 +526,52 @@ std::optional<tr_quark> tr_quark_lookup(std::string_view key)
         return std::distance(sbegin, sit);
     }
 
-    /* was it added during runtime? */
-    auto const rbegin = std::begin(my_runtime);
-    auto const rend = std::end(my_runtime);
-    auto const rit = std::find(rbegin, rend, key);
-    if (rit != rend)
+    return {};
+}
+
+} // namespace
+
+std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+{
+    // is it in our static array?
+    if (auto const quark = lookupStatic(key); quark)
     {
-        return TR_N_KEYS + std::distance(rbegin, rit);
+        return quark;
     }
 
-    return {};
+    /* was it added during runtime? */
+    auto const lock = std::lock_guard(my_runtime_mutex);
+    return lookupRuntime(key);
 }
 
 tr_quark tr_quark_new(std::string_view str)
 {
-    if (auto const prior = tr_quark_lookup(str); prior)
+    if (auto const quark = lookupStatic(str); quark)
+    {
+        return *quark;
+    }
+
+    auto const lock = std::lock_guard(my_runtime_mutex);
+
+    if (auto const prior = lookupRuntime(str); prior)
     {
         return *prior;
     }
 
-    auto const ret = TR_N_KEYS + std::size(my_runtime);
-    my_runtime.emplace_back(tr_strvDup(str), std::size(str));
+    auto const key = std::string_view{ tr_strvDup(str), std::size(str) };
+    auto const ret = TR_N_KEYS + my_runtime.append(key);
+    my_runtime_index.try_emplace(key, ret);
     return ret;
 }
 
 std::string_view tr_quark_get_string_view(tr_quark q)
 {
-    return q < TR_N_KEYS ? my_static[q] : my_runtime[q - TR_N_KEYS];
+    if (q < TR_N_KEYS)
+    {
+        return my_static[q];
+    }
+
+    return my_runtime.get(q - TR_N_KEYS);
 }
 
 char const* tr_quark_get_string(tr_quark q, size_t* len)
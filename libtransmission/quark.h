@@ -42,6 +42,7 @@ enum
     TR_KEY_announce, /* metainfo */
     TR_KEY_announce_list, /* metainfo */
     TR_KEY_announceState, /* rpc */
+    TR_KEY_announcer_stats, /* rpc */
     TR_KEY_anti_brute_force_enabled, /* rpc */
     TR_KEY_anti_brute_force_threshold, /* rpc */
     TR_KEY_arguments, /* rpc */
@@ -58,6 +59,7 @@ enum
     TR_KEY_blocks,
     TR_KEY_bytesCompleted,
     TR_KEY_cache_size_mb,
+    TR_KEY_capacity,
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
     TR_KEY_clientName,
@@ -75,6 +77,7 @@ enum
     TR_KEY_creator,
     TR_KEY_cumulative_stats,
     TR_KEY_current_stats,
+    TR_KEY_cursor,
     TR_KEY_date,
     TR_KEY_dateCreated,
     TR_KEY_delete_local_data,
@@ -95,6 +98,7 @@ enum
     TR_KEY_downloadLimit,
     TR_KEY_downloadLimited,
     TR_KEY_downloadSpeed,
+    TR_KEY_downloadSpeeds,
     TR_KEY_downloaded,
     TR_KEY_downloaded_bytes,
     TR_KEY_downloadedBytes,
@@ -111,6 +115,7 @@ enum
     TR_KEY_errorString,
     TR_KEY_eta,
     TR_KEY_etaIdle,
+    TR_KEY_evictions,
     TR_KEY_fields,
     TR_KEY_file_count,
     TR_KEY_fileStats,
@@ -139,6 +144,7 @@ enum
     TR_KEY_have,
     TR_KEY_haveUnchecked,
     TR_KEY_haveValid,
+    TR_KEY_hits,
     TR_KEY_honorsSessionLimits,
     TR_KEY_host,
     TR_KEY_id,
@@ -189,8 +195,10 @@ enum
     TR_KEY_main_window_x,
     TR_KEY_main_window_y,
     TR_KEY_manualAnnounceTime,
+    TR_KEY_mappings,
     TR_KEY_max_peers,
     TR_KEY_maxConnectedPeers,
+    TR_KEY_maxLagMsec,
     TR_KEY_memory_bytes,
     TR_KEY_memory_units,
     TR_KEY_message_level,
@@ -199,6 +207,8 @@ enum
     TR_KEY_metainfo,
     TR_KEY_method,
     TR_KEY_min_request_interval,
+    TR_KEY_misses,
+    TR_KEY_mmap_uploads_enabled,
     TR_KEY_move,
     TR_KEY_msg_type,
     TR_KEY_mtimes,
@@ -209,7 +219,10 @@ enum
     TR_KEY_nodes,
     TR_KEY_nodes6,
     TR_KEY_open_dialog_dir,
+    TR_KEY_open_file_stats, /* rpc */
     TR_KEY_p,
+    TR_KEY_packetsReceived,
+    TR_KEY_packetsSent,
     TR_KEY_path,
     TR_KEY_path_utf_8,
     TR_KEY_paused,
@@ -270,7 +283,10 @@ enum
     TR_KEY_ratio_limit,
     TR_KEY_ratio_limit_enabled,
     TR_KEY_ratio_mode,
+    TR_KEY_rawDownloadSpeeds,
+    TR_KEY_rawUploadSpeeds,
     TR_KEY_read_clipboard,
+    TR_KEY_receiveCalls,
     TR_KEY_recent_download_dir_1,
     TR_KEY_recent_download_dir_2,
     TR_KEY_recent_download_dir_3,
@@ -322,6 +338,9 @@ enum
     TR_KEY_seedRatioMode,
     TR_KEY_seederCount,
     TR_KEY_seeding_time_seconds,
+    TR_KEY_segments,
+    TR_KEY_sendCalls,
+    TR_KEY_sendfile_uploads_enabled,
     TR_KEY_session_count,
     TR_KEY_session_id,
     TR_KEY_sessionCount,
@@ -333,6 +352,7 @@ enum
     TR_KEY_show_statusbar,
     TR_KEY_show_toolbar,
     TR_KEY_show_tracker_scrapes,
+    TR_KEY_since,
     TR_KEY_sitename,
     TR_KEY_size_bytes,
     TR_KEY_size_units,
@@ -355,6 +375,7 @@ enum
     TR_KEY_statusbar_stats,
     TR_KEY_tag,
     TR_KEY_tier,
+    TR_KEY_tiersServed,
     TR_KEY_time_checked,
     TR_KEY_torrent_added,
     TR_KEY_torrent_added_notification_command,
@@ -370,6 +391,7 @@ enum
     TR_KEY_torrentCount,
     TR_KEY_torrentFile,
     TR_KEY_torrents,
+    TR_KEY_totalLagMsec,
     TR_KEY_totalSize,
     TR_KEY_total_size,
     TR_KEY_trackerAdd,
@@ -380,6 +402,7 @@ enum
     TR_KEY_trackers,
     TR_KEY_trash_can_enabled,
     TR_KEY_trash_original_torrent_files,
+    TR_KEY_udp_stats,
     TR_KEY_umask,
     TR_KEY_units,
     TR_KEY_upload_slots_per_torrent,
@@ -387,6 +410,7 @@ enum
     TR_KEY_uploadLimited,
     TR_KEY_uploadRatio,
     TR_KEY_uploadSpeed,
+    TR_KEY_uploadSpeeds,
     TR_KEY_upload_only,
     TR_KEY_uploaded,
     TR_KEY_uploaded_bytes,
@@ -403,6 +427,8 @@ enum
     TR_KEY_ut_recommend,
     TR_KEY_utp_enabled,
     TR_KEY_v,
+    TR_KEY_verify_speed_limit,
+    TR_KEY_verify_threads,
     TR_KEY_version,
     TR_KEY_wanted,
     TR_KEY_watch_dir,
@@ -4,8 +4,11 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
 #include <cstring>
 #include <ctime>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -130,17 +133,6 @@ static auto loadLabels(tr_variant* dict, tr_torrent* tor)
 ****
 ***/
 
-static void saveDND(tr_variant* dict, tr_torrent const* tor)
-{
-    auto const n = tor->fileCount();
-    tr_variant* const list = tr_variantDictAddList(dict, TR_KEY_dnd, n);
-
-    for (tr_file_index_t i = 0; i < n; ++i)
-    {
-        tr_variantListAddBool(list, !tr_torrentFile(tor, i).wanted);
-    }
-}
-
 static auto loadDND(tr_variant* dict, tr_torrent* tor)
 {
     auto ret = tr_resume::fields_t{};
@@ -190,17 +182,6 @@ static auto loadDND(tr_variant* dict, tr_torrent* tor)
 ****
 ***/
 
-static void saveFilePriorities(tr_variant* dict, tr_torrent const* tor)
-{
-    auto const n = tor->fileCount();
-
-    tr_variant* const list = tr_variantDictAddList(dict, TR_KEY_priority, n);
-    for (tr_file_index_t i = 0; i < n; ++i)
-    {
-        tr_variantListAddInt(list, tr_torrentFile(tor, i).priority);
-    }
-}
-
 static auto loadFilePriorities(tr_variant* dict, tr_torrent* tor)
 {
     auto ret = tr_resume::fields_t{};
@@ -419,23 +400,6 @@ static auto loadFilenames(tr_variant* dict, tr_torrent* tor)
 ****
 ***/
 
-static void bitfieldToRaw(tr_bitfield const& b, tr_variant* benc)
-{
-    if (b.hasNone() || (std::empty(b) != 0U))
-    {
-        tr_variantInitStr(benc, "none"sv);
-    }
-    else if (b.hasAll())
-    {
-        tr_variantInitStrView(benc, "all"sv);
-    }
-    else
-    {
-        auto const raw = b.raw();
-        tr_variantInitRaw(benc, raw.data(), std::size(raw));
-    }
-}
-
 static void rawToBitfield(tr_bitfield& bitfield, uint8_t const* raw, size_t rawlen)
 {
     if (raw == nullptr || rawlen == 0 || (rawlen == 4 && memcmp(raw, "none", 4) == 0))
@@ -452,32 +416,6 @@ static void rawToBitfield(tr_bitfield& bitfield, uint8_t const* raw, size_t rawl
     }
 }
 
-static void saveProgress(tr_variant* dict, tr_torrent const* tor)
-{
-    tr_variant* const prog = tr_variantDictAddDict(dict, TR_KEY_progress, 4);
-
-    // add the mtimes
-    auto const& mtimes = tor->file_mtimes_;
-    auto const n = std::size(mtimes);
-    tr_variant* const l = tr_variantDictAddList(prog, TR_KEY_mtimes, n);
-    for (auto const& mtime : mtimes)
-    {
-        tr_variantListAddInt(l, mtime);
-    }
-
-    // add the 'checked pieces' bitfield
-    bitfieldToRaw(tor->checked_pieces_, tr_variantDictAdd(prog, TR_KEY_pieces));
-
-    /* add the progress */
-    if (tor->completeness == TR_SEED)
-    {
-        tr_variantDictAddStrView(prog, TR_KEY_have, "all"sv);
-    }
-
-    /* add the blocks bitfield */
-    bitfieldToRaw(tor->blocks(), tr_variantDictAdd(prog, TR_KEY_blocks));
-}
-
 /*
  * Transmisison has iterated through a few strategies here, so the
  * code has some added complexity to support older approaches.
@@ -626,11 +564,442 @@ static auto loadProgress(tr_variant* dict, tr_torrent* tor)
     return tr_resume::fields_t{};
 }
 
+/***
+****  Binary .resume files
+***/
+
+// A binary .resume file is a header, two copies of a table of sections,
+// and then the sections themselves. The big per-block and per-file arrays
+// each get a section of their own at a fixed offset, and everything else
+// goes into a benc dict in the meta section. Since each section has room
+// to grow, saving a torrent again usually means rewriting just the
+// sections that changed, in place, rather than the whole file.
+//
+// To survive a crash in the middle of that, each section has two slots.
+// A changed section is written to the slot that the table doesn't point
+// to, then a table with the next generation number is written over the
+// older of the two tables. Nothing is fsync()ed: if the crash tears the
+// new table or a new slot, its checksum fails and the reader falls back
+// to the other table, which still points at the old, intact slots.
+//
+// header:        8-byte magic, u32 version, u32 section count
+// table:         u64 generation, u64 checksum of the entries, then the entries
+// table entries: u32 id, u32 length, u32 capacity, u32 slot, u64 offset, u64 checksum
+//
+// A section's slots are `capacity` bytes each, starting at `offset`.
+// Integers are little-endian. Bitfield sections start with a kind byte:
+// 'a' (has all), 'n' (has none), or 'r' (followed by the raw bitfield).
+
+namespace resume_file
+{
+
+auto constexpr Magic = "TRresume"sv;
+auto constexpr Version = uint32_t{ 2 };
+
+enum Section : uint32_t
+{
+    MetaSection, // benc dict with everything not listed below
+    BlocksSection, // which blocks we have
+    CheckedSection, // which pieces have been checked
+    MtimesSection, // int64 per file
+    PrioritiesSection, // int8 per file
+    DndSection, // uint8 per file
+    NumSections
+};
+
+auto constexpr HeaderSize = size_t{ 16 };
+auto constexpr EntrySize = size_t{ 32 };
+auto constexpr TableSize = 16 + EntrySize * NumSections;
+auto constexpr DataOffset = HeaderSize + 2 * TableSize;
+
+struct Entry
+{
+    uint32_t length = 0;
+    uint32_t capacity = 0;
+    uint32_t slot = 0;
+    uint64_t offset = 0;
+    uint64_t checksum = 0;
+
+    [[nodiscard]] constexpr uint64_t slotOffset() const
+    {
+        return offset + uint64_t{ slot } * capacity;
+    }
+};
+
+struct Table
+{
+    uint64_t generation = 0;
+    std::array<Entry, NumSections> entries = {};
+};
+
+using Sections = std::array<std::string, NumSections>;
+using Capacities = std::array<size_t, NumSections>;
+
+// the usable tables in a file, newest first
+using Tables = std::vector<Table>;
+
+// FNV-1a, to notice sections that changed or that were torn by a crash
+uint64_t checksum(std::string_view data)
+{
+    auto hash = uint64_t{ 14695981039346656037ULL };
+    for (auto const ch : data)
+    {
+        hash ^= uint8_t(ch);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void putUint(std::string& out, uint64_t val, size_t n_bytes)
+{
+    for (size_t i = 0; i < n_bytes; ++i)
+    {
+        out += char((val >> (8 * i)) & 0xFF);
+    }
+}
+
+uint64_t getUint(uint8_t const* in, size_t n_bytes)
+{
+    auto val = uint64_t{};
+    for (size_t i = 0; i < n_bytes; ++i)
+    {
+        val |= uint64_t{ in[i] } << (8 * i);
+    }
+    return val;
+}
+
+std::string serializeTable(Table const& table)
+{
+    auto entries = std::string{};
+    entries.reserve(EntrySize * NumSections);
+
+    for (uint32_t id = 0; id < NumSections; ++id)
+    {
+        auto const& entry = table.entries[id];
+        putUint(entries, id, 4);
+        putUint(entries, entry.length, 4);
+        putUint(entries, entry.capacity, 4);
+        putUint(entries, entry.slot, 4);
+        putUint(entries, entry.offset, 8);
+        putUint(entries, entry.checksum, 8);
+    }
+
+    auto out = std::string{};
+    out.reserve(TableSize);
+    putUint(out, table.generation, 8);
+    putUint(out, checksum(entries), 8);
+    out += entries;
+    return out;
+}
+
+// a table that was torn by a crash fails its checksum
+bool parseTable(uint8_t const* buf, uint64_t file_size, Table& setme)
+{
+    auto const entries = std::string_view{ reinterpret_cast<char const*>(buf) + 16, EntrySize * NumSections };
+    setme.generation = getUint(buf, 8);
+    if (setme.generation == 0 || getUint(buf + 8, 8) != checksum(entries))
+    {
+        return false;
+    }
+
+    for (uint32_t id = 0; id < NumSections; ++id)
+    {
+        auto const* const walk = buf + 16 + EntrySize * id;
+        auto& entry = setme.entries[id];
+        entry.length = uint32_t(getUint(walk + 4, 4));
+        entry.capacity = uint32_t(getUint(walk + 8, 4));
+        entry.slot = uint32_t(getUint(walk + 12, 4));
+        entry.offset = getUint(walk + 16, 8);
+        entry.checksum = getUint(walk + 24, 8);
+
+        if (getUint(walk, 4) != id || entry.length > entry.capacity || entry.slot > 1 || entry.offset < DataOffset ||
+            entry.offset > file_size || (file_size - entry.offset) / 2 < entry.capacity)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// `buf` holds at least the header and both tables
+Tables parseTables(uint8_t const* buf, size_t buflen, uint64_t file_size)
+{
+    auto tables = Tables{};
+
+    if (buflen < DataOffset ||
+        std::string_view{ reinterpret_cast<char const*>(buf), std::size(Magic) } != Magic || getUint(buf + 8, 4) != Version ||
+        getUint(buf + 12, 4) != NumSections)
+    {
+        return tables;
+    }
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        if (auto table = Table{}; parseTable(buf + HeaderSize + TableSize * i, file_size, table))
+        {
+            tables.push_back(table);
+        }
+    }
+
+    std::sort(
+        std::begin(tables),
+        std::end(tables),
+        [](auto const& a, auto const& b) { return a.generation > b.generation; });
+    return tables;
+}
+
+std::string serializeBitfield(tr_bitfield const& bitfield)
+{
+    if (bitfield.hasAll())
+    {
+        return "a";
+    }
+
+    if (bitfield.hasNone() || std::empty(bitfield))
+    {
+        return "n";
+    }
+
+    auto const raw = bitfield.raw();
+    auto ret = std::string{ "r" };
+    ret.append(reinterpret_cast<char const*>(std::data(raw)), std::size(raw));
+    return ret;
+}
+
+// "all", "none", or the raw bitfield, which is what loadProgress() expects
+void parseBitfield(std::string_view section, tr_variant* setme)
+{
+    if (tr_strvStartsWith(section, 'a'))
+    {
+        tr_variantInitStrView(setme, "all"sv);
+    }
+    else if (tr_strvStartsWith(section, 'r'))
+    {
+        section.remove_prefix(1);
+        tr_variantInitRaw(setme, std::data(section), std::size(section));
+    }
+    else
+    {
+        tr_variantInitStrView(setme, "none"sv);
+    }
+}
+
+bool writeAt(tr_sys_file_t fd, std::string_view data, uint64_t offset)
+{
+    while (!std::empty(data))
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(fd, std::data(data), std::size(data), offset, &n_written, nullptr) || n_written == 0)
+        {
+            return false;
+        }
+
+        data.remove_prefix(n_written);
+        offset += n_written;
+    }
+
+    return true;
+}
+
+// Update an existing binary .resume file by rewriting only the sections
+// that changed. Returns false if the whole file needs to be written.
+bool writeChangedSections(std::string const& filename, Sections const& sections)
+{
+    auto const fd = tr_sys_file_open(filename.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_WRITE, 0, nullptr);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto info = tr_sys_path_info{};
+    auto buf = std::array<uint8_t, DataOffset>{};
+    auto n_read = uint64_t{};
+    auto tables = Tables{};
+    if (tr_sys_file_get_info(fd, &info, nullptr) &&
+        tr_sys_file_read_at(fd, std::data(buf), std::size(buf), 0, &n_read, nullptr) && n_read == std::size(buf))
+    {
+        tables = parseTables(std::data(buf), std::size(buf), info.size);
+    }
+
+    auto ok = !std::empty(tables);
+    auto table = ok ? tables.front() : Table{};
+
+    for (size_t id = 0; ok && id < NumSections; ++id)
+    {
+        ok = std::size(sections[id]) <= table.entries[id].capacity;
+    }
+
+    // write changed sections to the slots that the newest table doesn't use
+    auto n_changed = size_t{};
+    for (size_t id = 0; ok && id < NumSections; ++id)
+    {
+        auto const& section = sections[id];
+        auto& entry = table.entries[id];
+        auto const sum = checksum(section);
+        if (entry.length == std::size(section) && entry.checksum == sum)
+        {
+            continue;
+        }
+
+        entry.slot ^= 1;
+        entry.length = uint32_t(std::size(section));
+        entry.checksum = sum;
+        ok = writeAt(fd, section, entry.slotOffset());
+        ++n_changed;
+    }
+
+    // then point the older table at them
+    if (ok && n_changed > 0)
+    {
+        auto const older = (table.generation + 1) % 2;
+        ++table.generation;
+        ok = writeAt(fd, serializeTable(table), HeaderSize + TableSize * older);
+    }
+
+    tr_sys_file_close(fd, nullptr);
+    return ok;
+}
+
+bool writeAllSections(std::string const& filename, Sections const& sections, Capacities const& capacities, tr_error** error)
+{
+    auto table = Table{};
+    table.generation = 1;
+    auto offset = uint64_t{ DataOffset };
+    for (size_t id = 0; id < NumSections; ++id)
+    {
+        auto& entry = table.entries[id];
+        entry.length = uint32_t(std::size(sections[id]));
+        entry.capacity = uint32_t(std::max(capacities[id], std::size(sections[id])));
+        entry.slot = 0;
+        entry.offset = offset;
+        entry.checksum = checksum(sections[id]);
+        offset += 2 * uint64_t{ entry.capacity };
+    }
+
+    auto out = std::string{};
+    out.reserve(offset);
+    out += Magic;
+    putUint(out, Version, 4);
+    putUint(out, NumSections, 4);
+
+    // generation 1 is table 1's; table 0 is empty until the next save
+    out.append(TableSize, '\0');
+    out += serializeTable(table);
+
+    for (size_t id = 0; id < NumSections; ++id)
+    {
+        out += sections[id];
+        out.append(2 * size_t{ table.entries[id].capacity } - table.entries[id].length, '\0');
+    }
+
+    return tr_saveFile(filename, out, error);
+}
+
+// Build the same tr_variant that a benc .resume file would give us,
+// so that the loadFoo() functions don't need to know about this format.
+// Each section comes from the newest table where it's intact, and the
+// ones that aren't intact anywhere are left out.
+bool parse(std::string_view buf, tr_variant* setme, tr_error** error)
+{
+    auto const tables = parseTables(reinterpret_cast<uint8_t const*>(std::data(buf)), std::size(buf), std::size(buf));
+    if (std::empty(tables))
+    {
+        tr_error_set(error, EILSEQ, "invalid resume file header"sv);
+        return false;
+    }
+
+    auto sections = std::array<std::string_view, NumSections>{};
+    auto n_found = size_t{};
+    for (size_t id = 0; id < NumSections; ++id)
+    {
+        for (auto const& table : tables)
+        {
+            auto const& entry = table.entries[id];
+            auto const section = buf.substr(entry.slotOffset(), entry.length);
+            if (checksum(section) == entry.checksum)
+            {
+                sections[id] = section;
+                n_found += std::empty(section) ? 0 : 1;
+                break;
+            }
+        }
+    }
+
+    if (n_found == 0)
+    {
+        tr_error_set(error, EILSEQ, "invalid resume file sections"sv);
+        return false;
+    }
+
+    auto meta_ok = !std::empty(sections[MetaSection]) &&
+        tr_variantFromBuf(setme, TR_VARIANT_PARSE_BENC, sections[MetaSection], nullptr, nullptr);
+    if (meta_ok && !tr_variantIsDict(setme))
+    {
+        tr_variantFree(setme);
+        meta_ok = false;
+    }
+
+    if (!meta_ok)
+    {
+        // keep what's left: losing the counters is better than losing the progress
+        tr_variantInitDict(setme, 3);
+    }
+
+    if (!std::empty(sections[BlocksSection]) || !std::empty(sections[CheckedSection]) || !std::empty(sections[MtimesSection]))
+    {
+        tr_variant* const prog = tr_variantDictAddDict(setme, TR_KEY_progress, 3);
+
+        if (auto const mtimes = sections[MtimesSection]; !std::empty(mtimes))
+        {
+            auto const* const walk = reinterpret_cast<uint8_t const*>(std::data(mtimes));
+            auto const n = std::size(mtimes) / 8;
+            tr_variant* const l = tr_variantDictAddList(prog, TR_KEY_mtimes, n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                tr_variantListAddInt(l, int64_t(getUint(walk + i * 8, 8)));
+            }
+        }
+
+        if (!std::empty(sections[CheckedSection]))
+        {
+            parseBitfield(sections[CheckedSection], tr_variantDictAdd(prog, TR_KEY_pieces));
+        }
+
+        if (!std::empty(sections[BlocksSection]))
+        {
+            parseBitfield(sections[BlocksSection], tr_variantDictAdd(prog, TR_KEY_blocks));
+        }
+    }
+
+    if (auto const priorities = sections[PrioritiesSection]; !std::empty(priorities))
+    {
+        tr_variant* const l = tr_variantDictAddList(setme, TR_KEY_priority, std::size(priorities));
+        for (auto const ch : priorities)
+        {
+            tr_variantListAddInt(l, int8_t(ch));
+        }
+    }
+
+    if (auto const dnd = sections[DndSection]; !std::empty(dnd))
+    {
+        tr_variant* const l = tr_variantDictAddList(setme, TR_KEY_dnd, std::size(dnd));
+        for (auto const ch : dnd)
+        {
+            tr_variantListAddBool(l, ch != 0);
+        }
+    }
+
+    return true;
+}
+
+} // namespace resume_file
+
 /***
 ****
 ***/
 
-static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, bool* did_migrate_filename)
+static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, tr_ctor const* ctor, bool* did_migrate_filename)
 {
     auto fields_loaded = tr_resume::fields_t{};
 
@@ -648,36 +1017,34 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, bool
     }
 
     auto const filename = tor->resumeFile();
-    auto buf = std::vector<char>{};
-    tr_error* error = nullptr;
-    auto top = tr_variant{};
-    if (!tr_loadFile(buf, filename, &error) ||
-        !tr_variantFromBuf(
-            &top,
-            TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE,
-            { std::data(buf), std::size(buf) },
-            nullptr,
-            &error))
-    {
-        tr_logAddTorDbg(tor, "Couldn't read \"%s\": %s", filename.c_str(), error->message);
-        tr_error_clear(&error);
-        return fields_loaded;
-    }
+    auto parsed = tr_variant{};
+    tr_variant* top = tr_ctorGetParsedResume(ctor, filename);
+    if (top == nullptr)
+    {
+        tr_error* error = nullptr;
+        if (!tr_resume::parseFile(filename, &parsed, &error))
+        {
+            tr_logAddTorDbg(tor, "Couldn't read \"%s\": %s", filename.c_str(), error->message);
+            tr_error_clear(&error);
+            return fields_loaded;
+        }
 
-    tr_logAddTorDbg(tor, "Read resume file \"%s\"", filename.c_str());
+        top = &parsed;
+        tr_logAddTorDbg(tor, "Read resume file \"%s\"", filename.c_str());
+    }
 
     auto boolVal = false;
     auto i = int64_t{};
     auto sv = std::string_view{};
 
-    if ((fieldsToLoad & tr_resume::Corrupt) != 0 && tr_variantDictFindInt(&top, TR_KEY_corrupt, &i))
+    if ((fieldsToLoad & tr_resume::Corrupt) != 0 && tr_variantDictFindInt(top, TR_KEY_corrupt, &i))
     {
         tor->corruptPrev = i;
         fields_loaded |= tr_resume::Corrupt;
     }
 
     if ((fieldsToLoad & (tr_resume::Progress | tr_resume::DownloadDir)) != 0 &&
-        tr_variantDictFindStrView(&top, TR_KEY_destination, &sv) && !std::empty(sv))
+        tr_variantDictFindStrView(top, TR_KEY_destination, &sv) && !std::empty(sv))
     {
         bool const is_current_dir = tor->current_dir == tor->download_dir;
         tor->download_dir = sv;
@@ -690,7 +1057,7 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, bool
     }
 
     if ((fieldsToLoad & (tr_resume::Progress | tr_resume::IncompleteDir)) != 0 &&
-        tr_variantDictFindStrView(&top, TR_KEY_incomplete_dir, &sv) && !std::empty(sv))
+        tr_variantDictFindStrView(top, TR_KEY_incomplete_dir, &sv) && !std::empty(sv))
     {
         bool const is_current_dir = tor->current_dir == tor->incomplete_dir;
         tor->incomplete_dir = sv;
@@ -702,61 +1069,61 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, bool
         fields_loaded |= tr_resume::IncompleteDir;
     }
 
-    if ((fieldsToLoad & tr_resume::Downloaded) != 0 && tr_variantDictFindInt(&top, TR_KEY_downloaded, &i))
+    if ((fieldsToLoad & tr_resume::Downloaded) != 0 && tr_variantDictFindInt(top, TR_KEY_downloaded, &i))
     {
         tor->downloadedPrev = i;
         fields_loaded |= tr_resume::Downloaded;
     }
 
-    if ((fieldsToLoad & tr_resume::Uploaded) != 0 && tr_variantDictFindInt(&top, TR_KEY_uploaded, &i))
+    if ((fieldsToLoad & tr_resume::Uploaded) != 0 && tr_variantDictFindInt(top, TR_KEY_uploaded, &i))
     {
         tor->uploadedPrev = i;
         fields_loaded |= tr_resume::Uploaded;
     }
 
-    if ((fieldsToLoad & tr_resume::MaxPeers) != 0 && tr_variantDictFindInt(&top, TR_KEY_max_peers, &i))
+    if ((fieldsToLoad & tr_resume::MaxPeers) != 0 && tr_variantDictFindInt(top, TR_KEY_max_peers, &i))
     {
         tor->maxConnectedPeers = i;
         fields_loaded |= tr_resume::MaxPeers;
     }
 
-    if ((fieldsToLoad & tr_resume::Run) != 0 && tr_variantDictFindBool(&top, TR_KEY_paused, &boolVal))
+    if ((fieldsToLoad & tr_resume::Run) != 0 && tr_variantDictFindBool(top, TR_KEY_paused, &boolVal))
     {
         tor->isRunning = !boolVal;
         fields_loaded |= tr_resume::Run;
     }
 
-    if ((fieldsToLoad & tr_resume::AddedDate) != 0 && tr_variantDictFindInt(&top, TR_KEY_added_date, &i))
+    if ((fieldsToLoad & tr_resume::AddedDate) != 0 && tr_variantDictFindInt(top, TR_KEY_added_date, &i))
     {
         tor->addedDate = i;
         fields_loaded |= tr_resume::AddedDate;
     }
 
-    if ((fieldsToLoad & tr_resume::DoneDate) != 0 && tr_variantDictFindInt(&top, TR_KEY_done_date, &i))
+    if ((fieldsToLoad & tr_resume::DoneDate) != 0 && tr_variantDictFindInt(top, TR_KEY_done_date, &i))
     {
         tor->doneDate = i;
         fields_loaded |= tr_resume::DoneDate;
     }
 
-    if ((fieldsToLoad & tr_resume::ActivityDate) != 0 && tr_variantDictFindInt(&top, TR_KEY_activity_date, &i))
+    if ((fieldsToLoad & tr_resume::ActivityDate) != 0 && tr_variantDictFindInt(top, TR_KEY_activity_date, &i))
     {
         tor->setDateActive(i);
         fields_loaded |= tr_resume::ActivityDate;
     }
 
-    if ((fieldsToLoad & tr_resume::TimeSeeding) != 0 && tr_variantDictFindInt(&top, TR_KEY_seeding_time_seconds, &i))
+    if ((fieldsToLoad & tr_resume::TimeSeeding) != 0 && tr_variantDictFindInt(top, TR_KEY_seeding_time_seconds, &i))
     {
         tor->secondsSeeding = i;
         fields_loaded |= tr_resume::TimeSeeding;
     }
 
-    if ((fieldsToLoad & tr_resume::TimeDownloading) != 0 && tr_variantDictFindInt(&top, TR_KEY_downloading_time_seconds, &i))
+    if ((fieldsToLoad & tr_resume::TimeDownloading) != 0 && tr_variantDictFindInt(top, TR_KEY_downloading_time_seconds, &i))
     {
         tor->secondsDownloading = i;
         fields_loaded |= tr_resume::TimeDownloading;
     }
 
-    if ((fieldsToLoad & tr_resume::BandwidthPriority) != 0 && tr_variantDictFindInt(&top, TR_KEY_bandwidth_priority, &i) &&
+    if ((fieldsToLoad & tr_resume::BandwidthPriority) != 0 && tr_variantDictFindInt(top, TR_KEY_bandwidth_priority, &i) &&
         tr_isPriority(i))
     {
         tr_torrentSetPriority(tor, i);
@@ -765,12 +1132,12 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, bool
 
     if ((fieldsToLoad & tr_resume::Peers) != 0)
     {
-        fields_loaded |= loadPeers(&top, tor);
+        fields_loaded |= loadPeers(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Progress) != 0)
     {
-        fields_loaded |= loadProgress(&top, tor);
+        fields_loaded |= loadProgress(top, tor);
     }
 
     // Only load file priorities if we are actually downloading.
@@ -778,42 +1145,42 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, bool
     // NB: this is why loadProgress() comes before loadFilePriorities()
     if (!tor->isDone() && (fieldsToLoad & tr_resume::FilePriorities) != 0)
     {
-        fields_loaded |= loadFilePriorities(&top, tor);
+        fields_loaded |= loadFilePriorities(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Dnd) != 0)
     {
-        fields_loaded |= loadDND(&top, tor);
+        fields_loaded |= loadDND(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Speedlimit) != 0)
     {
-        fields_loaded |= loadSpeedLimits(&top, tor);
+        fields_loaded |= loadSpeedLimits(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Ratiolimit) != 0)
     {
-        fields_loaded |= loadRatioLimits(&top, tor);
+        fields_loaded |= loadRatioLimits(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Idlelimit) != 0)
     {
-        fields_loaded |= loadIdleLimits(&top, tor);
+        fields_loaded |= loadIdleLimits(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Filenames) != 0)
     {
-        fields_loaded |= loadFilenames(&top, tor);
+        fields_loaded |= loadFilenames(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Name) != 0)
     {
-        fields_loaded |= loadName(&top, tor);
+        fields_loaded |= loadName(top, tor);
     }
 
     if ((fieldsToLoad & tr_resume::Labels) != 0)
     {
-        fields_loaded |= loadLabels(&top, tor);
+        fields_loaded |= loadLabels(top, tor);
     }
 
     /* loading the resume file triggers of a lot of changes,
@@ -821,7 +1188,7 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fieldsToLoad, bool
      * same resume information... */
     tor->isDirty = wasDirty;
 
-    tr_variantFree(&top);
+    tr_variantFree(&parsed);
     return fields_loaded;
 }
 
@@ -878,20 +1245,63 @@ fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor, boo
 
     ret |= useManditoryFields(tor, fields_to_load, ctor);
     fields_to_load &= ~ret;
-    ret |= loadFromFile(tor, fields_to_load, did_rename_to_hash_only_name);
+    ret |= loadFromFile(tor, fields_to_load, ctor, did_rename_to_hash_only_name);
     fields_to_load &= ~ret;
     ret |= useFallbackFields(tor, fields_to_load, ctor);
 
     return ret;
 }
 
+bool parseFile(std::string const& filename, tr_variant* setme, tr_error** error)
+{
+    auto const fd = tr_sys_file_open(filename.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto info = tr_sys_path_info{};
+    void* map = nullptr;
+    if (tr_sys_file_get_info(fd, &info, error))
+    {
+        if (info.size == 0)
+        {
+            tr_error_set(error, EILSEQ, "empty resume file"sv);
+        }
+        else
+        {
+            map = tr_sys_file_map_for_reading(fd, 0, info.size, error);
+        }
+    }
+
+    // the mapping outlives the fd
+    tr_sys_file_close(fd, nullptr);
+    if (map == nullptr)
+    {
+        return false;
+    }
+
+    // .resume files from before the binary format are benc dicts
+    auto const buf = std::string_view{ static_cast<char const*>(map), size_t(info.size) };
+    auto const ok = tr_strvStartsWith(buf, resume_file::Magic) ? resume_file::parse(buf, setme, error) :
+                                                                   tr_variantFromBuf(setme, TR_VARIANT_PARSE_BENC, buf, nullptr, error);
+
+    tr_sys_file_unmap(map, info.size, nullptr);
+    return ok;
+}
+
 void save(tr_torrent* tor)
 {
+    using namespace resume_file;
+
     if (!tr_isTorrent(tor))
     {
         return;
     }
 
+    auto sections = Sections{};
+    auto capacities = Capacities{};
+
     auto top = tr_variant{};
     tr_variantInitDict(&top, 50); /* arbitrary "big enough" number */
     tr_variantDictAddInt(&top, TR_KEY_seeding_time_seconds, tor->secondsSeeding);
@@ -913,27 +1323,62 @@ void save(tr_torrent* tor)
     tr_variantDictAddInt(&top, TR_KEY_bandwidth_priority, tr_torrentGetPriority(tor));
     tr_variantDictAddBool(&top, TR_KEY_paused, !tor->isRunning && !tor->isQueued());
     savePeers(&top, tor);
-
-    if (tor->hasMetadata())
-    {
-        saveFilePriorities(&top, tor);
-        saveDND(&top, tor);
-        saveProgress(&top, tor);
-    }
-
     saveSpeedLimits(&top, tor);
     saveRatioLimits(&top, tor);
     saveIdleLimits(&top, tor);
     saveFilenames(&top, tor);
     saveName(&top, tor);
     saveLabels(&top, tor);
+    sections[MetaSection] = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+    tr_variantFree(&top);
+
+    // the meta section grows and shrinks, e.g. with the number of known peers
+    auto const meta_size = std::size(sections[MetaSection]);
+    capacities[MetaSection] = meta_size + meta_size / 2 + 256;
+
+    if (tor->hasMetadata())
+    {
+        auto const n_files = tor->fileCount();
 
-    if (auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, tor->resumeFile()); err != 0)
+        sections[BlocksSection] = serializeBitfield(tor->blocks());
+        capacities[BlocksSection] = 1 + (tor->blockCount() + 7) / 8;
+
+        sections[CheckedSection] = serializeBitfield(tor->checked_pieces_);
+        capacities[CheckedSection] = 1 + (tor->pieceCount() + 7) / 8;
+
+        auto& mtimes = sections[MtimesSection];
+        for (auto const& mtime : tor->file_mtimes_)
+        {
+            putUint(mtimes, uint64_t(int64_t(mtime)), 8);
+        }
+        capacities[MtimesSection] = std::size(mtimes);
+
+        auto& priorities = sections[PrioritiesSection];
+        auto& dnd = sections[DndSection];
+        for (tr_file_index_t i = 0; i < n_files; ++i)
+        {
+            auto const file = tr_torrentFile(tor, i);
+            priorities += char(file.priority);
+            dnd += char(file.wanted ? 0 : 1);
+        }
+        capacities[PrioritiesSection] = n_files;
+        capacities[DndSection] = n_files;
+    }
+
+    auto const filename = tor->resumeFile();
+    if (writeChangedSections(filename, sections))
     {
-        tor->setLocalError(tr_strvJoin("Unable to save resume file: ", tr_strerror(err)));
+        return;
     }
 
-    tr_variantFree(&top);
+    // a new torrent, a .resume file in the older benc format,
+    // or a section outgrew its space: rewrite the whole file
+    tr_error* error = nullptr;
+    if (!writeAllSections(filename, sections, capacities, &error))
+    {
+        tor->setLocalError(tr_strvJoin("Unable to save resume file: ", error->message));
+        tr_error_clear(&error);
+    }
 }
 
 } // namespace tr_resume
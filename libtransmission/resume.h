@@ -10,9 +10,12 @@
 #endif
 
 #include <cstdint> // uint64_t
+#include <string>
 
 struct tr_ctor;
+struct tr_error;
 struct tr_torrent;
+struct tr_variant;
 
 namespace tr_resume
 {
@@ -49,4 +52,8 @@ fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor, boo
 
 void save(tr_torrent* tor);
 
+// reads a .resume file into the dict that load() expects.
+// handles both the binary format that save() writes and the older benc one.
+bool parseFile(std::string const& filename, tr_variant* setme, tr_error** error = nullptr);
+
 } // namespace tr_resume
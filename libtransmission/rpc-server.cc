@@ -265,10 +265,9 @@ struct rpc_response_data
     tr_rpc_server* server;
 };
 
-static void rpc_response_func(tr_session* /*session*/, tr_variant* response, void* user_data)
+static void rpc_response_json_func(tr_session* /*session*/, struct evbuffer* response_buf, void* user_data)
 {
     auto* data = static_cast<struct rpc_response_data*>(user_data);
-    struct evbuffer* response_buf = tr_variantToBuf(response, TR_VARIANT_FMT_JSON_LEAN);
     struct evbuffer* buf = evbuffer_new();
 
     add_response(data->req, data->server, buf, response_buf);
@@ -276,10 +275,16 @@ static void rpc_response_func(tr_session* /*session*/, tr_variant* response, voi
     evhttp_send_reply(data->req, HTTP_OK, "OK", buf);
 
     evbuffer_free(buf);
-    evbuffer_free(response_buf);
     tr_free(data);
 }
 
+static void rpc_response_func(tr_session* session, tr_variant* response, void* user_data)
+{
+    struct evbuffer* response_buf = tr_variantToBuf(response, TR_VARIANT_FMT_JSON_LEAN);
+    rpc_response_json_func(session, response_buf, user_data);
+    evbuffer_free(response_buf);
+}
+
 static void handle_rpc_from_json(struct evhttp_request* req, tr_rpc_server* server, std::string_view json)
 {
     auto top = tr_variant{};
@@ -289,7 +294,7 @@ static void handle_rpc_from_json(struct evhttp_request* req, tr_rpc_server* serv
     data->req = req;
     data->server = server;
 
-    tr_rpc_request_exec_json(server->session, have_content ? &top : nullptr, rpc_response_func, data);
+    tr_rpc_request_exec_json_to_buf(server->session, have_content ? &top : nullptr, rpc_response_json_func, data);
 
     if (have_content)
     {
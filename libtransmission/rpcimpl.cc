@@ -9,14 +9,19 @@
 #include <ctime>
 #include <iterator>
 #include <numeric>
+#include <optional>
 #include <string_view>
 #include <utility>
 #include <vector>
 
+#include <event2/buffer.h>
+
 #include <libdeflate.h>
 
 #include "transmission.h"
 
+#include "announcer.h"
+#include "bandwidth.h"
 #include "completion.h"
 #include "crypto-utils.h"
 #include "error.h"
@@ -376,6 +381,7 @@ static void addLabels(tr_torrent const* tor, tr_variant* list)
 
 static void addFileStats(tr_torrent const* tor, tr_variant* list)
 {
+    tr_variantInitList(list, tor->fileCount());
     for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
     {
         auto const file = tr_torrentFile(tor, i);
@@ -388,6 +394,7 @@ static void addFileStats(tr_torrent const* tor, tr_variant* list)
 
 static void addFiles(tr_torrent const* tor, tr_variant* list)
 {
+    tr_variantInitList(list, tor->fileCount());
     for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
     {
         auto const file = tr_torrentFile(tor, i);
@@ -400,6 +407,7 @@ static void addFiles(tr_torrent const* tor, tr_variant* list)
 
 static void addWebseeds(tr_torrent const* tor, tr_variant* webseeds)
 {
+    tr_variantInitList(webseeds, tor->webseedCount());
     for (size_t i = 0, n = tor->webseedCount(); i < n; ++i)
     {
         tr_variantListAddStr(webseeds, tor->webseed(i));
@@ -408,6 +416,7 @@ static void addWebseeds(tr_torrent const* tor, tr_variant* webseeds)
 
 static void addTrackers(tr_torrent const* tor, tr_variant* trackers)
 {
+    tr_variantInitList(trackers, tor->trackerCount());
     for (auto const& tracker : tor->announceList())
     {
         auto* const d = tr_variantListAddDict(trackers, 5);
@@ -483,196 +492,321 @@ static void addPeers(tr_torrent const* tor, tr_variant* list)
     tr_torrentPeersFree(peers, peerCount);
 }
 
-static void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant* const initme, tr_quark key)
+static void addPeersFrom(tr_stat const* st, tr_variant* dict)
+{
+    tr_variantInitDict(dict, 7);
+    int const* f = st->peersFrom;
+    tr_variantDictAddInt(dict, TR_KEY_fromCache, f[TR_PEER_FROM_RESUME]);
+    tr_variantDictAddInt(dict, TR_KEY_fromDht, f[TR_PEER_FROM_DHT]);
+    tr_variantDictAddInt(dict, TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
+    tr_variantDictAddInt(dict, TR_KEY_fromLpd, f[TR_PEER_FROM_LPD]);
+    tr_variantDictAddInt(dict, TR_KEY_fromLtep, f[TR_PEER_FROM_LTEP]);
+    tr_variantDictAddInt(dict, TR_KEY_fromPex, f[TR_PEER_FROM_PEX]);
+    tr_variantDictAddInt(dict, TR_KEY_fromTracker, f[TR_PEER_FROM_TRACKER]);
+}
+
+static void addPriorities(tr_torrent const* tor, tr_variant* list)
+{
+    auto const n = tor->fileCount();
+    tr_variantInitList(list, n);
+    for (tr_file_index_t i = 0; i < n; ++i)
+    {
+        tr_variantListAddInt(list, tr_torrentFile(tor, i).priority);
+    }
+}
+
+static void addWanted(tr_torrent const* tor, tr_variant* list)
+{
+    auto const n = tor->fileCount();
+    tr_variantInitList(list, n);
+    for (tr_file_index_t i = 0; i < n; ++i)
+    {
+        tr_variantListAddBool(list, tr_torrentFile(tor, i).wanted);
+    }
+}
+
+static void addAllTrackerStats(tr_torrent const* tor, tr_variant* list)
+{
+    auto const n = tr_torrentTrackerCount(tor);
+    tr_variantInitList(list, n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        addTrackerStats(tr_torrentTracker(tor, i), list);
+    }
+}
+
+// initField() writes each field either into a tr_variant or,
+// for torrent-get responses that skip building a tree, as JSON.
+
+class VariantFieldSink
+{
+public:
+    explicit VariantFieldSink(tr_variant* v)
+        : v_{ v }
+    {
+    }
+
+    void addInt(int64_t value)
+    {
+        tr_variantInitInt(v_, value);
+    }
+
+    void addBool(bool value)
+    {
+        tr_variantInitBool(v_, value);
+    }
+
+    void addReal(double value)
+    {
+        tr_variantInitReal(v_, value);
+    }
+
+    void addStr(std::string_view value)
+    {
+        tr_variantInitStr(v_, value);
+    }
+
+    void addStrView(std::string_view value)
+    {
+        tr_variantInitStrView(v_, value);
+    }
+
+    template<typename Func>
+    void addNested(Func&& func)
+    {
+        func(v_);
+    }
+
+private:
+    tr_variant* const v_;
+};
+
+class JsonFieldSink
+{
+public:
+    explicit JsonFieldSink(tr_variant_json_writer& writer)
+        : writer_{ writer }
+    {
+    }
+
+    void addInt(int64_t value)
+    {
+        writer_.addInt(value);
+    }
+
+    void addBool(bool value)
+    {
+        writer_.addBool(value);
+    }
+
+    void addReal(double value)
+    {
+        writer_.addReal(value);
+    }
+
+    void addStr(std::string_view value)
+    {
+        writer_.addStr(value);
+    }
+
+    void addStrView(std::string_view value)
+    {
+        writer_.addStr(value);
+    }
+
+    // containers are small, so build them as a variant and write that
+    template<typename Func>
+    void addNested(Func&& func)
+    {
+        auto v = tr_variant{};
+        func(&v);
+        writer_.addVariant(&v);
+        tr_variantFree(&v);
+    }
+
+private:
+    tr_variant_json_writer& writer_;
+};
+
+template<typename Sink>
+static void initField(tr_torrent const* const tor, tr_stat const* const st, Sink& sink, tr_quark key)
 {
     char* str = nullptr;
 
     switch (key)
     {
     case TR_KEY_activityDate:
-        tr_variantInitInt(initme, st->activityDate);
+        sink.addInt(st->activityDate);
         break;
 
     case TR_KEY_addedDate:
-        tr_variantInitInt(initme, st->addedDate);
+        sink.addInt(st->addedDate);
         break;
 
     case TR_KEY_bandwidthPriority:
-        tr_variantInitInt(initme, tr_torrentGetPriority(tor));
+        sink.addInt(tr_torrentGetPriority(tor));
         break;
 
     case TR_KEY_comment:
-        tr_variantInitStr(initme, tor->comment());
+        sink.addStr(tor->comment());
         break;
 
     case TR_KEY_corruptEver:
-        tr_variantInitInt(initme, st->corruptEver);
+        sink.addInt(st->corruptEver);
         break;
 
     case TR_KEY_creator:
-        tr_variantInitStrView(initme, tor->creator());
+        sink.addStrView(tor->creator());
         break;
 
     case TR_KEY_dateCreated:
-        tr_variantInitInt(initme, tor->dateCreated());
+        sink.addInt(tor->dateCreated());
         break;
 
     case TR_KEY_desiredAvailable:
-        tr_variantInitInt(initme, st->desiredAvailable);
+        sink.addInt(st->desiredAvailable);
         break;
 
     case TR_KEY_doneDate:
-        tr_variantInitInt(initme, st->doneDate);
+        sink.addInt(st->doneDate);
         break;
 
     case TR_KEY_downloadDir:
-        tr_variantInitStrView(initme, tr_torrentGetDownloadDir(tor));
+        sink.addStrView(tr_torrentGetDownloadDir(tor));
         break;
 
     case TR_KEY_downloadedEver:
-        tr_variantInitInt(initme, st->downloadedEver);
+        sink.addInt(st->downloadedEver);
         break;
 
     case TR_KEY_downloadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
+        sink.addInt(tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
         break;
 
     case TR_KEY_downloadLimited:
-        tr_variantInitBool(initme, tr_torrentUsesSpeedLimit(tor, TR_DOWN));
+        sink.addBool(tr_torrentUsesSpeedLimit(tor, TR_DOWN));
         break;
 
     case TR_KEY_error:
-        tr_variantInitInt(initme, st->error);
+        sink.addInt(st->error);
         break;
 
     case TR_KEY_errorString:
-        tr_variantInitStrView(initme, st->errorString);
+        sink.addStrView(st->errorString);
         break;
 
     case TR_KEY_eta:
-        tr_variantInitInt(initme, st->eta);
+        sink.addInt(st->eta);
         break;
 
     case TR_KEY_file_count:
-        tr_variantInitInt(initme, tor->fileCount());
+        sink.addInt(tor->fileCount());
         break;
 
     case TR_KEY_files:
-        tr_variantInitList(initme, tor->fileCount());
-        addFiles(tor, initme);
+        sink.addNested([tor](tr_variant* v) { addFiles(tor, v); });
         break;
 
     case TR_KEY_fileStats:
-        tr_variantInitList(initme, tor->fileCount());
-        addFileStats(tor, initme);
+        sink.addNested([tor](tr_variant* v) { addFileStats(tor, v); });
         break;
 
     case TR_KEY_hashString:
-        tr_variantInitStrView(initme, tor->infoHashString());
+        sink.addStrView(tor->infoHashString());
         break;
 
     case TR_KEY_haveUnchecked:
-        tr_variantInitInt(initme, st->haveUnchecked);
+        sink.addInt(st->haveUnchecked);
         break;
 
     case TR_KEY_haveValid:
-        tr_variantInitInt(initme, st->haveValid);
+        sink.addInt(st->haveValid);
         break;
 
     case TR_KEY_honorsSessionLimits:
-        tr_variantInitBool(initme, tr_torrentUsesSessionLimits(tor));
+        sink.addBool(tr_torrentUsesSessionLimits(tor));
         break;
 
     case TR_KEY_id:
-        tr_variantInitInt(initme, st->id);
+        sink.addInt(st->id);
         break;
 
     case TR_KEY_editDate:
-        tr_variantInitInt(initme, st->editDate);
+        sink.addInt(st->editDate);
         break;
 
     case TR_KEY_isFinished:
-        tr_variantInitBool(initme, st->finished);
+        sink.addBool(st->finished);
         break;
 
     case TR_KEY_isPrivate:
-        tr_variantInitBool(initme, tor->isPrivate());
+        sink.addBool(tor->isPrivate());
         break;
 
     case TR_KEY_isStalled:
-        tr_variantInitBool(initme, st->isStalled);
+        sink.addBool(st->isStalled);
         break;
 
     case TR_KEY_labels:
-        addLabels(tor, initme);
+        sink.addNested([tor](tr_variant* v) { addLabels(tor, v); });
         break;
 
     case TR_KEY_leftUntilDone:
-        tr_variantInitInt(initme, st->leftUntilDone);
+        sink.addInt(st->leftUntilDone);
         break;
 
     case TR_KEY_manualAnnounceTime:
-        tr_variantInitInt(initme, st->manualAnnounceTime);
+        sink.addInt(st->manualAnnounceTime);
         break;
 
     case TR_KEY_maxConnectedPeers:
-        tr_variantInitInt(initme, tr_torrentGetPeerLimit(tor));
+        sink.addInt(tr_torrentGetPeerLimit(tor));
         break;
 
     case TR_KEY_magnetLink:
         str = tr_torrentGetMagnetLink(tor);
-        tr_variantInitStr(initme, str);
+        sink.addStr(str);
         tr_free(str);
         break;
 
     case TR_KEY_metadataPercentComplete:
-        tr_variantInitReal(initme, st->metadataPercentComplete);
+        sink.addReal(st->metadataPercentComplete);
         break;
 
     case TR_KEY_name:
-        tr_variantInitStrView(initme, tr_torrentName(tor));
+        sink.addStrView(tr_torrentName(tor));
         break;
 
     case TR_KEY_percentComplete:
-        tr_variantInitReal(initme, st->percentComplete);
+        sink.addReal(st->percentComplete);
         break;
 
     case TR_KEY_percentDone:
-        tr_variantInitReal(initme, st->percentDone);
+        sink.addReal(st->percentDone);
         break;
 
     case TR_KEY_peer_limit:
-        tr_variantInitInt(initme, tr_torrentGetPeerLimit(tor));
+        sink.addInt(tr_torrentGetPeerLimit(tor));
         break;
 
     case TR_KEY_peers:
-        addPeers(tor, initme);
+        sink.addNested([tor](tr_variant* v) { addPeers(tor, v); });
         break;
 
     case TR_KEY_peersConnected:
-        tr_variantInitInt(initme, st->peersConnected);
+        sink.addInt(st->peersConnected);
         break;
 
     case TR_KEY_peersFrom:
-        {
-            tr_variantInitDict(initme, 7);
-            int const* f = st->peersFrom;
-            tr_variantDictAddInt(initme, TR_KEY_fromCache, f[TR_PEER_FROM_RESUME]);
-            tr_variantDictAddInt(initme, TR_KEY_fromDht, f[TR_PEER_FROM_DHT]);
-            tr_variantDictAddInt(initme, TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
-            tr_variantDictAddInt(initme, TR_KEY_fromLpd, f[TR_PEER_FROM_LPD]);
-            tr_variantDictAddInt(initme, TR_KEY_fromLtep, f[TR_PEER_FROM_LTEP]);
-            tr_variantDictAddInt(initme, TR_KEY_fromPex, f[TR_PEER_FROM_PEX]);
-            tr_variantDictAddInt(initme, TR_KEY_fromTracker, f[TR_PEER_FROM_TRACKER]);
-            break;
-        }
+        sink.addNested([st](tr_variant* v) { addPeersFrom(st, v); });
+        break;
 
     case TR_KEY_peersGettingFromUs:
-        tr_variantInitInt(initme, st->peersGettingFromUs);
+        sink.addInt(st->peersGettingFromUs);
         break;
 
     case TR_KEY_peersSendingToUs:
-        tr_variantInitInt(initme, st->peersSendingToUs);
+        sink.addInt(st->peersSendingToUs);
         break;
 
     case TR_KEY_pieces:
@@ -680,164 +814,142 @@ static void initField(tr_torrent const* const tor, tr_stat const* const st, tr_v
         {
             auto const bytes = tor->createPieceBitfield();
             auto const enc = tr_base64_encode({ reinterpret_cast<char const*>(std::data(bytes)), std::size(bytes) });
-            tr_variantInitStrView(initme, enc);
+            sink.addStr(enc);
         }
         else
         {
-            tr_variantInitStrView(initme, ""sv);
+            sink.addStrView(""sv);
         }
 
         break;
 
     case TR_KEY_pieceCount:
-        tr_variantInitInt(initme, tor->pieceCount());
+        sink.addInt(tor->pieceCount());
         break;
 
     case TR_KEY_pieceSize:
-        tr_variantInitInt(initme, tor->pieceSize());
+        sink.addInt(tor->pieceSize());
         break;
 
     case TR_KEY_primary_mime_type:
-        tr_variantInitStrView(initme, tor->primaryMimeType());
+        sink.addStrView(tor->primaryMimeType());
         break;
 
     case TR_KEY_priorities:
-        {
-            auto const n = tor->fileCount();
-            tr_variantInitList(initme, n);
-            for (tr_file_index_t i = 0; i < n; ++i)
-            {
-                tr_variantListAddInt(initme, tr_torrentFile(tor, i).priority);
-            }
-        }
+        sink.addNested([tor](tr_variant* v) { addPriorities(tor, v); });
         break;
 
     case TR_KEY_queuePosition:
-        tr_variantInitInt(initme, st->queuePosition);
+        sink.addInt(st->queuePosition);
         break;
 
     case TR_KEY_etaIdle:
-        tr_variantInitInt(initme, st->etaIdle);
+        sink.addInt(st->etaIdle);
         break;
 
     case TR_KEY_rateDownload:
-        tr_variantInitInt(initme, tr_toSpeedBytes(st->pieceDownloadSpeed_KBps));
+        sink.addInt(tr_toSpeedBytes(st->pieceDownloadSpeed_KBps));
         break;
 
     case TR_KEY_rateUpload:
-        tr_variantInitInt(initme, tr_toSpeedBytes(st->pieceUploadSpeed_KBps));
+        sink.addInt(tr_toSpeedBytes(st->pieceUploadSpeed_KBps));
         break;
 
     case TR_KEY_recheckProgress:
-        tr_variantInitReal(initme, st->recheckProgress);
+        sink.addReal(st->recheckProgress);
         break;
 
     case TR_KEY_seedIdleLimit:
-        tr_variantInitInt(initme, tr_torrentGetIdleLimit(tor));
+        sink.addInt(tr_torrentGetIdleLimit(tor));
         break;
 
     case TR_KEY_seedIdleMode:
-        tr_variantInitInt(initme, tr_torrentGetIdleMode(tor));
+        sink.addInt(tr_torrentGetIdleMode(tor));
         break;
 
     case TR_KEY_seedRatioLimit:
-        tr_variantInitReal(initme, tr_torrentGetRatioLimit(tor));
+        sink.addReal(tr_torrentGetRatioLimit(tor));
         break;
 
     case TR_KEY_seedRatioMode:
-        tr_variantInitInt(initme, tr_torrentGetRatioMode(tor));
+        sink.addInt(tr_torrentGetRatioMode(tor));
         break;
 
     case TR_KEY_sizeWhenDone:
-        tr_variantInitInt(initme, st->sizeWhenDone);
+        sink.addInt(st->sizeWhenDone);
         break;
 
     case TR_KEY_source:
-        tr_variantInitStrView(initme, tor->source());
+        sink.addStrView(tor->source());
         break;
 
     case TR_KEY_startDate:
-        tr_variantInitInt(initme, st->startDate);
+        sink.addInt(st->startDate);
         break;
 
     case TR_KEY_status:
-        tr_variantInitInt(initme, st->activity);
+        sink.addInt(st->activity);
         break;
 
     case TR_KEY_secondsDownloading:
-        tr_variantInitInt(initme, st->secondsDownloading);
+        sink.addInt(st->secondsDownloading);
         break;
 
     case TR_KEY_secondsSeeding:
-        tr_variantInitInt(initme, st->secondsSeeding);
+        sink.addInt(st->secondsSeeding);
         break;
 
     case TR_KEY_trackers:
-        tr_variantInitList(initme, tor->trackerCount());
-        addTrackers(tor, initme);
+        sink.addNested([tor](tr_variant* v) { addTrackers(tor, v); });
         break;
 
     case TR_KEY_trackerList:
-        tr_variantInitStr(initme, tor->trackerList());
+        sink.addStr(tor->trackerList());
         break;
 
     case TR_KEY_trackerStats:
-        {
-            auto const n = tr_torrentTrackerCount(tor);
-            tr_variantInitList(initme, n);
-            for (size_t i = 0; i < n; ++i)
-            {
-                auto const& tracker = tr_torrentTracker(tor, i);
-                addTrackerStats(tracker, initme);
-            }
-            break;
-        }
+        sink.addNested([tor](tr_variant* v) { addAllTrackerStats(tor, v); });
+        break;
 
     case TR_KEY_torrentFile:
-        tr_variantInitStrView(initme, tor->torrentFile());
+        sink.addStrView(tor->torrentFile());
         break;
 
     case TR_KEY_totalSize:
-        tr_variantInitInt(initme, tor->totalSize());
+        sink.addInt(tor->totalSize());
         break;
 
     case TR_KEY_uploadedEver:
-        tr_variantInitInt(initme, st->uploadedEver);
+        sink.addInt(st->uploadedEver);
         break;
 
     case TR_KEY_uploadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
+        sink.addInt(tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
         break;
 
     case TR_KEY_uploadLimited:
-        tr_variantInitBool(initme, tr_torrentUsesSpeedLimit(tor, TR_UP));
+        sink.addBool(tr_torrentUsesSpeedLimit(tor, TR_UP));
         break;
 
     case TR_KEY_uploadRatio:
-        tr_variantInitReal(initme, st->ratio);
+        sink.addReal(st->ratio);
         break;
 
     case TR_KEY_wanted:
-        {
-            auto const n = tor->fileCount();
-            tr_variantInitList(initme, n);
-            for (tr_file_index_t i = 0; i < n; ++i)
-            {
-                tr_variantListAddBool(initme, tr_torrentFile(tor, i).wanted);
-            }
-        }
+        sink.addNested([tor](tr_variant* v) { addWanted(tor, v); });
         break;
 
     case TR_KEY_webseeds:
-        tr_variantInitList(initme, tor->webseedCount());
-        addWebseeds(tor, initme);
+        sink.addNested([tor](tr_variant* v) { addWebseeds(tor, v); });
         break;
 
     case TR_KEY_webseedsSendingToUs:
-        tr_variantInitInt(initme, st->webseedsSendingToUs);
+        sink.addInt(st->webseedsSendingToUs);
         break;
 
     default:
+        // unknown fields are reported as 0
+        sink.addInt(0);
         break;
     }
 }
@@ -861,83 +973,262 @@ static void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry,
         {
             tr_variant* child = format == TrFormat::Table ? tr_variantListAdd(entry) : tr_variantDictAdd(entry, fields[i]);
 
-            initField(tor, st, child, fields[i]);
+            auto sink = VariantFieldSink{ child };
+            initField(tor, st, sink, fields[i]);
         }
     }
 }
 
-static char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+static TrFormat getTorrentGetFormat(tr_variant* args_in)
 {
-    auto const torrents = getTorrents(session, args_in);
-    tr_variant* const list = tr_variantDictAddList(args_out, TR_KEY_torrents, std::size(torrents) + 1);
-
     auto sv = std::string_view{};
-    auto const format = tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TrFormat::Table :
-                                                                                                    TrFormat::Object;
+    return tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TrFormat::Table : TrFormat::Object;
+}
+
+// the `since` cursor from an earlier torrent-get response, if any
+static std::optional<uint64_t> getTorrentGetSince(tr_variant* args_in)
+{
+    auto since = int64_t{};
+    if (!tr_variantDictFindInt(args_in, TR_KEY_since, &since))
+    {
+        return {};
+    }
+
+    return static_cast<uint64_t>(std::max(since, int64_t{ 0 }));
+}
+
+// the requested torrents, minus the ones that haven't changed since `since`
+static auto getChangedTorrents(tr_session* session, tr_variant* args_in, std::optional<uint64_t> since)
+{
+    auto torrents = getTorrents(session, args_in);
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
+    if (since)
     {
-        time_t const now = tr_time();
-        auto const interval = RecentlyActiveSeconds;
+        torrents.erase(
+            std::remove_if(
+                std::begin(torrents),
+                std::end(torrents),
+                [since = *since](auto const* tor) { return tor->changeSeq <= since; }),
+            std::end(torrents));
+    }
+
+    return torrents;
+}
 
-        auto const& removed = session->removed_torrents;
-        tr_variant* removed_out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(removed));
-        for (auto const& [id, time_removed] : removed)
+// the ids of torrents that were removed recently or since `since`, if they were asked for
+static std::optional<std::vector<int>> getRemoved(tr_session* session, tr_variant* args_in, std::optional<uint64_t> since)
+{
+    auto ids = std::vector<int>{};
+
+    if (since)
+    {
+        for (auto const& [id, time_removed, change_seq] : session->removed_torrents)
         {
-            if (time_removed >= now - interval)
+            if (change_seq > *since)
             {
-                tr_variantListAddInt(removed_out, id);
+                ids.push_back(id);
             }
         }
+
+        return ids;
+    }
+
+    auto sv = std::string_view{};
+    if (!tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) || sv != "recently-active"sv)
+    {
+        return {};
+    }
+
+    time_t const now = tr_time();
+    auto const interval = RecentlyActiveSeconds;
+
+    for (auto const& [id, time_removed, change_seq] : session->removed_torrents)
+    {
+        if (time_removed >= now - interval)
+        {
+            ids.push_back(id);
+        }
     }
 
+    return ids;
+}
+
+// the quarks of the requested fields, or nullopt if none were specified
+static std::optional<std::vector<tr_quark>> getTorrentGetFields(tr_variant* args_in)
+{
     tr_variant* fields = nullptr;
-    char const* errmsg = nullptr;
     if (!tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
     {
-        errmsg = "no fields specified";
+        return {};
     }
-    else
+
+    auto keys = std::vector<tr_quark>{};
+    size_t const n = tr_variantListSize(fields);
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i)
     {
-        /* make an array of property name quarks */
-        size_t keyCount = 0;
-        size_t const n = tr_variantListSize(fields);
-        auto* const keys = tr_new(tr_quark, n);
-        for (size_t i = 0; i < n; ++i)
+        auto sv = std::string_view{};
+        if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
         {
-            if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
-            {
-                continue;
-            }
+            continue;
+        }
 
-            auto const key = tr_quark_lookup(sv);
-            if (!key)
-            {
-                continue;
-            }
+        if (auto const key = tr_quark_lookup(sv); key)
+        {
+            keys.push_back(*key);
+        }
+    }
+
+    return keys;
+}
+
+static char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto const since = getTorrentGetSince(args_in);
+    auto const cursor = session->torrentChangeSeq.load();
+    auto const torrents = getChangedTorrents(session, args_in, since);
+    tr_variant* const list = tr_variantDictAddList(args_out, TR_KEY_torrents, std::size(torrents) + 1);
 
-            keys[keyCount++] = *key;
+    auto const format = getTorrentGetFormat(args_in);
+
+    if (since)
+    {
+        tr_variantDictAddInt(args_out, TR_KEY_cursor, cursor);
+    }
+
+    if (auto const removed = getRemoved(session, args_in, since); removed)
+    {
+        tr_variant* removed_out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(*removed));
+        for (auto const id : *removed)
+        {
+            tr_variantListAddInt(removed_out, id);
+        }
+    }
+
+    auto const keys = getTorrentGetFields(args_in);
+    if (!keys)
+    {
+        return "no fields specified";
+    }
+
+    if (format == TrFormat::Table)
+    {
+        /* first entry is an array of property names */
+        tr_variant* names = tr_variantListAddList(list, std::size(*keys));
+        for (auto const key : *keys)
+        {
+            tr_variantListAddQuark(names, key);
         }
+    }
+
+    for (auto* tor : torrents)
+    {
+        addTorrentInfo(tor, format, tr_variantListAdd(list), std::data(*keys), std::size(*keys));
+    }
+
+    return nullptr;
+}
+
+/**
+ * Writes the whole torrent-get response, envelope included, as lean JSON.
+ * This gives the same bytes as torrentGet() + tr_variantToBuf() but streams
+ * each torrent's fields into `out` instead of building a tree of them first.
+ */
+static void torrentGetJson(tr_session* session, tr_variant* args_in, int64_t const* tag, struct evbuffer* out)
+{
+    auto const since = getTorrentGetSince(args_in);
+    auto const cursor = session->torrentChangeSeq.load();
+    auto const torrents = getChangedTorrents(session, args_in, since);
+    auto const format = getTorrentGetFormat(args_in);
+    auto const removed = getRemoved(session, args_in, since);
+    auto const keys = getTorrentGetFields(args_in);
+
+    // dict keys are written in sorted order, same as tr_variantToBuf() does
+    auto sorted_keys = keys.value_or(std::vector<tr_quark>{});
+    std::stable_sort(
+        std::begin(sorted_keys),
+        std::end(sorted_keys),
+        [](tr_quark a, tr_quark b) { return tr_quark_get_string_view(a) < tr_quark_get_string_view(b); });
 
+    auto writer = tr_variant_json_writer{ out };
+    auto sink = JsonFieldSink{ writer };
+
+    writer.startDict();
+    writer.key(TR_KEY_arguments);
+    writer.startDict();
+
+    if (since)
+    {
+        writer.key(TR_KEY_cursor);
+        writer.addInt(cursor);
+    }
+
+    if (removed)
+    {
+        writer.key(TR_KEY_removed);
+        writer.startList();
+        for (auto const id : *removed)
+        {
+            writer.addInt(id);
+        }
+        writer.end();
+    }
+
+    writer.key(TR_KEY_torrents);
+    writer.startList();
+
+    if (keys)
+    {
         if (format == TrFormat::Table)
         {
             /* first entry is an array of property names */
-            tr_variant* names = tr_variantListAddList(list, keyCount);
-            for (size_t i = 0; i < keyCount; ++i)
+            writer.startList();
+            for (auto const key : *keys)
             {
-                tr_variantListAddQuark(names, keys[i]);
+                writer.addStr(tr_quark_get_string_view(key));
             }
+            writer.end();
         }
 
         for (auto* tor : torrents)
         {
-            addTorrentInfo(tor, format, tr_variantListAdd(list), keys, keyCount);
+            tr_stat const* const st = std::empty(*keys) ? nullptr : tr_torrentStat(tor);
+
+            if (format == TrFormat::Table)
+            {
+                writer.startList();
+                for (auto const key : *keys)
+                {
+                    initField(tor, st, sink, key);
+                }
+            }
+            else
+            {
+                writer.startDict();
+                for (auto const key : sorted_keys)
+                {
+                    writer.key(key);
+                    initField(tor, st, sink, key);
+                }
+            }
+
+            writer.end();
         }
+    }
+
+    writer.end(); // torrents
+    writer.end(); // arguments
+
+    writer.key(TR_KEY_result);
+    writer.addStr(keys ? "success"sv : "no fields specified"sv);
 
-        tr_free(keys);
+    if (tag != nullptr)
+    {
+        writer.key(TR_KEY_tag);
+        writer.addInt(*tag);
     }
 
-    return errmsg;
+    writer.end();
 }
 
 /***
@@ -1963,6 +2254,26 @@ static char const* sessionSet(
     return nullptr;
 }
 
+// speeds over the last second, ten seconds and minute
+static void addSpeeds(tr_variant* dict, tr_quark key, Bandwidth const& bandwidth, tr_direction dir, bool piece)
+{
+    static auto constexpr Horizons = std::array<Bandwidth::Horizon, 3>{
+        Bandwidth::Horizon::OneSecond,
+        Bandwidth::Horizon::TenSeconds,
+        Bandwidth::Horizon::OneMinute,
+    };
+
+    auto const now = tr_time_msec();
+    auto* const list = tr_variantDictAddList(dict, key, std::size(Horizons));
+    for (auto const horizon : Horizons)
+    {
+        tr_variantListAddInt(
+            list,
+            piece ? bandwidth.getPieceSpeedBytesPerSecond(now, dir, horizon) :
+                    bandwidth.getRawSpeedBytesPerSecond(now, dir, horizon));
+    }
+}
+
 static char const* sessionStats(
     tr_session* session,
     tr_variant* /*args_in*/,
@@ -1983,9 +2294,13 @@ static char const* sessionStats(
 
     tr_variantDictAddInt(args_out, TR_KEY_activeTorrentCount, running);
     tr_variantDictAddReal(args_out, TR_KEY_downloadSpeed, tr_sessionGetPieceSpeed_Bps(session, TR_DOWN));
+    addSpeeds(args_out, TR_KEY_downloadSpeeds, *session->bandwidth, TR_DOWN, true);
     tr_variantDictAddInt(args_out, TR_KEY_pausedTorrentCount, total - running);
+    addSpeeds(args_out, TR_KEY_rawDownloadSpeeds, *session->bandwidth, TR_DOWN, false);
+    addSpeeds(args_out, TR_KEY_rawUploadSpeeds, *session->bandwidth, TR_UP, false);
     tr_variantDictAddInt(args_out, TR_KEY_torrentCount, total);
     tr_variantDictAddReal(args_out, TR_KEY_uploadSpeed, tr_sessionGetPieceSpeed_Bps(session, TR_UP));
+    addSpeeds(args_out, TR_KEY_uploadSpeeds, *session->bandwidth, TR_UP, true);
 
     tr_variant* d = tr_variantDictAddDict(args_out, TR_KEY_cumulative_stats, 5);
     tr_variantDictAddInt(d, TR_KEY_downloadedBytes, cumulativeStats.downloadedBytes);
@@ -2001,6 +2316,28 @@ static char const* sessionStats(
     tr_variantDictAddInt(d, TR_KEY_sessionCount, currentStats.sessionCount);
     tr_variantDictAddInt(d, TR_KEY_uploadedBytes, currentStats.uploadedBytes);
 
+    auto const& udp_stats = session->udp_stats;
+    d = tr_variantDictAddDict(args_out, TR_KEY_udp_stats, 4);
+    tr_variantDictAddInt(d, TR_KEY_packetsReceived, udp_stats.packets_received);
+    tr_variantDictAddInt(d, TR_KEY_packetsSent, udp_stats.packets_sent);
+    tr_variantDictAddInt(d, TR_KEY_receiveCalls, udp_stats.receive_calls);
+    tr_variantDictAddInt(d, TR_KEY_sendCalls, udp_stats.send_calls);
+
+    auto const fd_stats = tr_fdGetStats(session);
+    d = tr_variantDictAddDict(args_out, TR_KEY_open_file_stats, 6);
+    tr_variantDictAddInt(d, TR_KEY_capacity, fd_stats.capacity);
+    tr_variantDictAddInt(d, TR_KEY_evictions, fd_stats.evictions);
+    tr_variantDictAddInt(d, TR_KEY_hits, fd_stats.hits);
+    tr_variantDictAddInt(d, TR_KEY_mappings, fd_stats.mappings);
+    tr_variantDictAddInt(d, TR_KEY_misses, fd_stats.misses);
+    tr_variantDictAddInt(d, TR_KEY_segments, fd_stats.segments);
+
+    auto const announcer_stats = tr_announcerGetStats(session->announcer);
+    d = tr_variantDictAddDict(args_out, TR_KEY_announcer_stats, 3);
+    tr_variantDictAddInt(d, TR_KEY_maxLagMsec, announcer_stats.max_lag_msec);
+    tr_variantDictAddInt(d, TR_KEY_tiersServed, announcer_stats.tiers_served);
+    tr_variantDictAddInt(d, TR_KEY_totalLagMsec, announcer_stats.total_lag_msec);
+
     return nullptr;
 }
 
@@ -2506,6 +2843,51 @@ void tr_rpc_parse_list_str(tr_variant* setme, std::string_view str)
     }
 }
 
+struct tr_rpc_json_response_data
+{
+    tr_rpc_response_json_func callback;
+    void* callback_user_data;
+};
+
+static void jsonResponseCallback(tr_session* session, tr_variant* response, void* user_data)
+{
+    auto* const data = static_cast<tr_rpc_json_response_data*>(user_data);
+
+    struct evbuffer* const buf = tr_variantToBuf(response, TR_VARIANT_FMT_JSON_LEAN);
+    (*data->callback)(session, buf, data->callback_user_data);
+    evbuffer_free(buf);
+
+    delete data;
+}
+
+void tr_rpc_request_exec_json_to_buf(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_response_json_func callback,
+    void* callback_user_data)
+{
+    auto* const mutable_request = const_cast<tr_variant*>(request);
+
+    // torrent-get responses can be huge, so skip building them as a tr_variant
+    if (auto sv = std::string_view{}; tr_variantDictFindStrView(mutable_request, TR_KEY_method, &sv) && sv == "torrent-get"sv)
+    {
+        auto tag = int64_t{};
+        bool const has_tag = tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag);
+
+        struct evbuffer* const buf = evbuffer_new();
+        torrentGetJson(session, tr_variantDictFind(mutable_request, TR_KEY_arguments), has_tag ? &tag : nullptr, buf);
+        (*callback)(session, buf, callback_user_data);
+        evbuffer_free(buf);
+        return;
+    }
+
+    tr_rpc_request_exec_json(
+        session,
+        request,
+        jsonResponseCallback,
+        new tr_rpc_json_response_data{ callback, callback_user_data });
+}
+
 void tr_rpc_request_exec_uri(
     tr_session* session,
     std::string_view request_uri,
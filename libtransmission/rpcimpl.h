@@ -14,6 +14,7 @@
 ****  RPC processing
 ***/
 
+struct evbuffer;
 struct tr_variant;
 
 using tr_rpc_response_func = void (*)(tr_session* session, tr_variant* response, void* user_data);
@@ -25,6 +26,17 @@ void tr_rpc_request_exec_json(
     tr_rpc_response_func callback,
     void* callback_user_data);
 
+using tr_rpc_response_json_func = void (*)(tr_session* session, struct evbuffer* response, void* user_data);
+
+/* Same as tr_rpc_request_exec_json(), but the response is passed to
+ * `callback` already serialized as lean JSON. torrent-get responses
+ * are written straight into the buffer without building a tr_variant. */
+void tr_rpc_request_exec_json_to_buf(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_response_json_func callback,
+    void* callback_user_data);
+
 /* see the RPC spec's "Request URI Notation" section */
 void tr_rpc_request_exec_uri(
     tr_session* session,
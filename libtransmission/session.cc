@@ -4,17 +4,23 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::partial_sort(), std::min(), std::max()
+#include <atomic>
 #include <cerrno> /* ENOENT */
 #include <climits> /* INT_MAX */
 #include <csignal>
 #include <cstdint>
 #include <cstdlib>
+#include <condition_variable>
 #include <ctime>
+#include <future>
 #include <iterator> // std::back_inserter
 #include <list>
 #include <memory>
+#include <mutex>
 #include <numeric> // std::acumulate()
+#include <string>
 #include <string_view>
+#include <thread>
 #include <tuple>
 #include <unordered_set>
 #include <vector>
@@ -41,9 +47,11 @@
 #include "net.h"
 #include "peer-io.h"
 #include "peer-mgr.h"
+#include "piece-checker.h"
 #include "platform-quota.h" /* tr_device_info_free() */
 #include "platform.h" /* tr_getTorrentDir() */
 #include "port-forwarding.h"
+#include "resume.h"
 #include "rpc-server.h"
 #include "session-id.h"
 #include "session.h"
@@ -343,6 +351,7 @@ void tr_sessionGetDefaultSettings(tr_variant* d)
     tr_variantDictAddInt(d, TR_KEY_message_level, TR_LOG_INFO);
     tr_variantDictAddInt(d, TR_KEY_download_queue_size, 5);
     tr_variantDictAddBool(d, TR_KEY_download_queue_enabled, true);
+    tr_variantDictAddBool(d, TR_KEY_mmap_uploads_enabled, false);
     tr_variantDictAddInt(d, TR_KEY_peer_limit_global, atoi(TR_DEFAULT_PEER_LIMIT_GLOBAL_STR));
     tr_variantDictAddInt(d, TR_KEY_peer_limit_per_torrent, atoi(TR_DEFAULT_PEER_LIMIT_TORRENT_STR));
     tr_variantDictAddInt(d, TR_KEY_peer_port, atoi(TR_DEFAULT_PEER_PORT_STR));
@@ -372,6 +381,7 @@ void tr_sessionGetDefaultSettings(tr_variant* d)
     tr_variantDictAddInt(d, TR_KEY_rpc_port, TR_DEFAULT_RPC_PORT);
     tr_variantDictAddStrView(d, TR_KEY_rpc_url, TR_DEFAULT_RPC_URL_STR);
     tr_variantDictAddBool(d, TR_KEY_scrape_paused_torrents_enabled, true);
+    tr_variantDictAddBool(d, TR_KEY_sendfile_uploads_enabled, false);
     tr_variantDictAddStrView(d, TR_KEY_script_torrent_added_filename, "");
     tr_variantDictAddBool(d, TR_KEY_script_torrent_added_enabled, false);
     tr_variantDictAddStrView(d, TR_KEY_script_torrent_done_filename, "");
@@ -391,6 +401,8 @@ void tr_sessionGetDefaultSettings(tr_variant* d)
     tr_variantDictAddBool(d, TR_KEY_speed_limit_up_enabled, false);
     tr_variantDictAddInt(d, TR_KEY_umask, 022);
     tr_variantDictAddInt(d, TR_KEY_upload_slots_per_torrent, 14);
+    tr_variantDictAddInt(d, TR_KEY_verify_speed_limit, 0);
+    tr_variantDictAddInt(d, TR_KEY_verify_threads, 0);
     tr_variantDictAddStrView(d, TR_KEY_bind_address_ipv4, TR_DEFAULT_BIND_ADDRESS_IPV4);
     tr_variantDictAddStrView(d, TR_KEY_bind_address_ipv6, TR_DEFAULT_BIND_ADDRESS_IPV6);
     tr_variantDictAddBool(d, TR_KEY_start_added_torrents, true);
@@ -421,6 +433,7 @@ void tr_sessionGetSettings(tr_session const* s, tr_variant* d)
     tr_variantDictAddStr(d, TR_KEY_incomplete_dir, tr_sessionGetIncompleteDir(s));
     tr_variantDictAddBool(d, TR_KEY_incomplete_dir_enabled, tr_sessionIsIncompleteDirEnabled(s));
     tr_variantDictAddInt(d, TR_KEY_message_level, tr_logGetLevel());
+    tr_variantDictAddBool(d, TR_KEY_mmap_uploads_enabled, s->isMmapUploadsEnabled);
     tr_variantDictAddInt(d, TR_KEY_peer_limit_global, s->peerLimit);
     tr_variantDictAddInt(d, TR_KEY_peer_limit_per_torrent, s->peerLimitPerTorrent);
     tr_variantDictAddInt(d, TR_KEY_peer_port, tr_sessionGetPeerPort(s));
@@ -449,6 +462,7 @@ void tr_sessionGetSettings(tr_session const* s, tr_variant* d)
     tr_variantDictAddStr(d, TR_KEY_rpc_whitelist, tr_sessionGetRPCWhitelist(s));
     tr_variantDictAddBool(d, TR_KEY_rpc_whitelist_enabled, tr_sessionGetRPCWhitelistEnabled(s));
     tr_variantDictAddBool(d, TR_KEY_scrape_paused_torrents_enabled, s->scrapePausedTorrents);
+    tr_variantDictAddBool(d, TR_KEY_sendfile_uploads_enabled, s->isSendfileUploadsEnabled);
     tr_variantDictAddInt(d, TR_KEY_seed_queue_size, tr_sessionGetQueueSize(s, TR_UP));
     tr_variantDictAddBool(d, TR_KEY_seed_queue_enabled, tr_sessionGetQueueEnabled(s, TR_UP));
     tr_variantDictAddBool(d, TR_KEY_alt_speed_enabled, tr_sessionUsesAltSpeed(s));
@@ -462,6 +476,8 @@ void tr_sessionGetSettings(tr_session const* s, tr_variant* d)
     tr_variantDictAddBool(d, TR_KEY_speed_limit_up_enabled, tr_sessionIsSpeedLimited(s, TR_UP));
     tr_variantDictAddInt(d, TR_KEY_umask, s->umask);
     tr_variantDictAddInt(d, TR_KEY_upload_slots_per_torrent, s->uploadSlotsPerTorrent);
+    tr_variantDictAddInt(d, TR_KEY_verify_speed_limit, s->verifySpeedLimit_KBps);
+    tr_variantDictAddInt(d, TR_KEY_verify_threads, s->verifyThreads);
     tr_variantDictAddStr(d, TR_KEY_bind_address_ipv4, tr_address_to_string(&s->bind_ipv4->addr));
     tr_variantDictAddStr(d, TR_KEY_bind_address_ipv6, tr_address_to_string(&s->bind_ipv6->addr));
     tr_variantDictAddBool(d, TR_KEY_start_added_torrents, !tr_sessionGetPaused(s));
@@ -756,6 +772,10 @@ static void tr_sessionInitImpl(void* vdata)
 
     tr_sessionSet(session, &settings);
 
+    // SHA1 of a piece is quick; a couple of threads keep up with a fast link
+    auto const n_piece_check_threads = std::clamp(std::thread::hardware_concurrency() / 2, 1U, 2U);
+    session->piece_checker = std::make_unique<PieceChecker>(session, n_piece_check_threads, tr_torrentPieceChecked);
+
     tr_udpInit(session);
 
     session->web = tr_web::create(session->web_controller);
@@ -919,6 +939,16 @@ static void sessionSetImpl(void* vdata)
         session->isPrefetchEnabled = boolVal;
     }
 
+    if (tr_variantDictFindBool(settings, TR_KEY_mmap_uploads_enabled, &boolVal))
+    {
+        session->isMmapUploadsEnabled = boolVal;
+    }
+
+    if (tr_variantDictFindBool(settings, TR_KEY_sendfile_uploads_enabled, &boolVal))
+    {
+        session->isSendfileUploadsEnabled = boolVal;
+    }
+
     if (tr_variantDictFindInt(settings, TR_KEY_preallocation, &i))
     {
         session->preallocationMode = tr_preallocation_mode(i);
@@ -1010,6 +1040,16 @@ static void sessionSetImpl(void* vdata)
         session->uploadSlotsPerTorrent = i;
     }
 
+    if (tr_variantDictFindInt(settings, TR_KEY_verify_speed_limit, &i))
+    {
+        session->verifySpeedLimit_KBps = i < 0 ? 0 : i;
+    }
+
+    if (tr_variantDictFindInt(settings, TR_KEY_verify_threads, &i))
+    {
+        session->verifyThreads = i < 0 ? 0 : i;
+    }
+
     if (tr_variantDictFindInt(settings, TR_KEY_speed_limit_up, &i))
     {
         tr_sessionSetSpeedLimit_KBps(session, TR_UP, i);
@@ -1835,6 +1875,9 @@ static void sessionCloseImplStart(tr_session* session)
     tr_verifyClose(session);
     tr_sharedClose(session);
 
+    // finish checking the pieces in flight while their torrents still exist
+    session->piece_checker.reset();
+
     free_incoming_peer_port(session);
     session->rpc_server_.reset();
 
@@ -2003,86 +2046,269 @@ void tr_sessionClose(tr_session* session)
     delete session;
 }
 
-struct sessionLoadTorrentsData
+/***
+****  Loading torrents at startup
+***/
+
+namespace
 {
-    tr_session* session;
-    tr_ctor* ctor;
-    int* setmeCount;
-    tr_torrent** torrents;
-    bool done;
-};
 
-static void sessionLoadTorrents(void* vdata)
+// Reads and parses .torrent files and their .resume files on a few worker
+// threads, so that the session thread only has to create the torrents.
+class TorrentFileLoader
 {
-    auto* data = static_cast<struct sessionLoadTorrentsData*>(vdata);
-    TR_ASSERT(tr_isSession(data->session));
+public:
+    struct Parsed
+    {
+        Parsed() = default;
+        Parsed(Parsed const&) = delete;
+        Parsed& operator=(Parsed const&) = delete;
+
+        ~Parsed()
+        {
+            tr_variantFree(&resume);
+        }
 
-    tr_sys_path_info info;
-    char const* const dirname = tr_getTorrentDir(data->session);
-    tr_sys_dir_t odir = (tr_sys_path_get_info(dirname, 0, &info, nullptr) && info.type == TR_SYS_PATH_IS_DIRECTORY) ?
-        tr_sys_dir_open(dirname, nullptr) :
-        TR_BAD_SYS_DIR;
+        std::string filename;
+        std::vector<char> contents;
+        tr_torrent_metainfo metainfo;
+        bool is_valid = false;
 
-    auto torrents = std::list<tr_torrent*>{};
-    if (odir != TR_BAD_SYS_DIR)
+        std::string resume_filename;
+        tr_variant resume = {};
+    };
+
+    TorrentFileLoader(tr_session const* session, std::vector<std::string>&& filenames)
+        : session_{ session }
+        , filenames_{ std::move(filenames) }
+        , parsed_(std::size(filenames_))
     {
-        auto const dirname_sv = std::string_view{ dirname };
-        auto path = std::string{};
+        auto const n_threads = std::min(
+            size_t{ std::clamp(std::thread::hardware_concurrency(), 1U, MaxThreads) },
+            std::size(filenames_));
 
-        char const* name = nullptr;
-        while ((name = tr_sys_dir_read_name(odir, nullptr)) != nullptr)
+        for (size_t i = 0; i < n_threads; ++i)
         {
-            if (!tr_strvEndsWith(name, ".torrent"sv))
-            {
-                continue;
-            }
+            workers_.emplace_back(&TorrentFileLoader::workerMain, this);
+        }
+    }
 
-            tr_buildBuf(path, dirname_sv, "/", name);
-            tr_ctorSetMetainfoFromFile(data->ctor, path, nullptr);
-            if (tr_torrent* const tor = tr_torrentNew(data->ctor, nullptr); tor != nullptr)
+    TorrentFileLoader(TorrentFileLoader const&) = delete;
+    TorrentFileLoader& operator=(TorrentFileLoader const&) = delete;
+
+    ~TorrentFileLoader()
+    {
+        next_todo_ = std::size(filenames_);
+
+        for (auto& worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return std::size(filenames_);
+    }
+
+    // Returns up to `max_count` of the next parsed files, in directory order.
+    // Blocks until at least one is ready. Returns nothing once all are taken.
+    std::vector<std::unique_ptr<Parsed>> next(size_t max_count)
+    {
+        auto ret = std::vector<std::unique_ptr<Parsed>>{};
+        auto lock = std::unique_lock(mutex_);
+
+        if (next_done_ < size())
+        {
+            done_cv_.wait(lock, [this]() { return parsed_[next_done_] != nullptr; });
+        }
+
+        while (next_done_ < size() && parsed_[next_done_] != nullptr && std::size(ret) < max_count)
+        {
+            ret.push_back(std::move(parsed_[next_done_]));
+            ++next_done_;
+        }
+
+        return ret;
+    }
+
+private:
+    static auto constexpr MaxThreads = unsigned{ 8 };
+
+    void workerMain()
+    {
+        for (;;)
+        {
+            auto const i = next_todo_++;
+            if (i >= size())
             {
-                torrents.push_back(tor);
+                return;
             }
+
+            auto parsed = parse(filenames_[i]);
+
+            auto const lock = std::lock_guard(mutex_);
+            parsed_[i] = std::move(parsed);
+            done_cv_.notify_one();
+        }
+    }
+
+    [[nodiscard]] std::unique_ptr<Parsed> parse(std::string const& filename) const
+    {
+        auto parsed = std::make_unique<Parsed>();
+        parsed->filename = filename;
+
+        tr_error* error = nullptr;
+        if (!tr_loadFile(parsed->contents, filename, &error) ||
+            !parsed->metainfo.parseBenc({ std::data(parsed->contents), std::size(parsed->contents) }, &error))
+        {
+            tr_logAddDebug("Couldn't load \"%s\": %s", filename.c_str(), error != nullptr ? error->message : "");
+            tr_error_clear(&error);
+            return parsed;
+        }
+
+        parsed->is_valid = true;
+
+        // not every torrent has a resume file yet
+        parsed->resume_filename = parsed->metainfo.resumeFile(session_->resume_dir);
+        if (!tr_resume::parseFile(parsed->resume_filename, &parsed->resume))
+        {
+            tr_variantFree(&parsed->resume);
+            parsed->resume = {};
         }
 
-        tr_sys_dir_close(odir, nullptr);
+        return parsed;
     }
 
-    int const n = std::size(torrents);
-    data->torrents = tr_new(tr_torrent*, n); // NOLINT(bugprone-sizeof-expression)
-    std::copy(std::begin(torrents), std::end(torrents), data->torrents);
+    tr_session const* const session_;
+    std::vector<std::string> const filenames_;
 
-    if (n != 0)
+    std::atomic<size_t> next_todo_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    std::vector<std::unique_ptr<TorrentFileLoader::Parsed>> parsed_;
+    size_t next_done_ = 0;
+
+    std::vector<std::thread> workers_;
+};
+
+std::vector<std::string> getTorrentFilenames(tr_session const* session)
+{
+    auto filenames = std::vector<std::string>{};
+
+    auto info = tr_sys_path_info{};
+    char const* const dirname = tr_getTorrentDir(session);
+    if (!tr_sys_path_get_info(dirname, 0, &info, nullptr) || info.type != TR_SYS_PATH_IS_DIRECTORY)
     {
-        tr_logAddInfo(_("Loaded %d torrents"), n);
+        return filenames;
     }
 
-    if (data->setmeCount != nullptr)
+    auto const odir = tr_sys_dir_open(dirname, nullptr);
+    if (odir == TR_BAD_SYS_DIR)
     {
-        *data->setmeCount = n;
+        return filenames;
     }
 
-    data->done = true;
+    auto const dirname_sv = std::string_view{ dirname };
+    char const* name = nullptr;
+    while ((name = tr_sys_dir_read_name(odir, nullptr)) != nullptr)
+    {
+        if (tr_strvEndsWith(name, ".torrent"sv))
+        {
+            filenames.push_back(tr_strvJoin(dirname_sv, "/"sv, name));
+        }
+    }
+
+    tr_sys_dir_close(odir, nullptr);
+    return filenames;
 }
 
+// creates the torrents for parsed files. runs in the session thread.
+void addParsedTorrents(
+    tr_ctor* ctor,
+    std::vector<std::unique_ptr<TorrentFileLoader::Parsed>>& batch,
+    std::vector<tr_torrent*>& torrents)
+{
+    for (auto& parsed : batch)
+    {
+        if (!parsed->is_valid)
+        {
+            continue;
+        }
+
+        tr_ctorSetParsedMetainfo(ctor, parsed->filename, std::move(parsed->contents), std::move(parsed->metainfo));
+        tr_ctorSetParsedResume(
+            ctor,
+            parsed->resume_filename,
+            tr_variantIsDict(&parsed->resume) ? &parsed->resume : nullptr);
+
+        if (tr_torrent* const tor = tr_torrentNew(ctor, nullptr); tor != nullptr)
+        {
+            torrents.push_back(tor);
+        }
+    }
+
+    tr_ctorSetParsedResume(ctor, {}, nullptr);
+}
+
+} // namespace
+
 tr_torrent** tr_sessionLoadTorrents(tr_session* session, tr_ctor* ctor, int* setmeCount)
 {
-    struct sessionLoadTorrentsData data;
+    TR_ASSERT(tr_isSession(session));
 
-    data.session = session;
-    data.ctor = ctor;
-    data.setmeCount = setmeCount;
-    data.torrents = nullptr;
-    data.done = false;
+    // hand the parsed torrents to the session thread a few at a time
+    static auto constexpr BatchSize = size_t{ 64 };
+    static auto constexpr ProgressIntervalMsec = uint64_t{ 1000 };
 
-    tr_runInEventThread(session, sessionLoadTorrents, &data);
+    auto loader = TorrentFileLoader{ session, getTorrentFilenames(session) };
+    auto const n_files = loader.size();
+    auto n_done = size_t{};
+    auto last_progress_msec = tr_time_msec();
 
-    while (!data.done)
+    auto torrents = std::vector<tr_torrent*>{};
+    torrents.reserve(n_files);
+
+    for (;;)
     {
-        tr_wait_msec(100);
+        auto batch = loader.next(BatchSize);
+        if (std::empty(batch))
+        {
+            break;
+        }
+
+        auto task = std::packaged_task<void()>{ [ctor, &batch, &torrents]() { addParsedTorrents(ctor, batch, torrents); } };
+        auto done = task.get_future();
+        tr_runInEventThread(
+            session,
+            [](void* vtask) { (*static_cast<std::packaged_task<void()>*>(vtask))(); },
+            &task);
+        done.get();
+
+        n_done += std::size(batch);
+        if (auto const now = tr_time_msec(); now - last_progress_msec >= ProgressIntervalMsec)
+        {
+            tr_logAddInfo(_("Loading torrents: %zu of %zu"), n_done, n_files);
+            last_progress_msec = now;
+        }
+    }
+
+    int const n = std::size(torrents);
+    auto** const ret = tr_new(tr_torrent*, n); // NOLINT(bugprone-sizeof-expression)
+    std::copy(std::begin(torrents), std::end(torrents), ret);
+
+    if (n != 0)
+    {
+        tr_logAddInfo(_("Loaded %d torrents"), n);
+    }
+
+    if (setmeCount != nullptr)
+    {
+        *setmeCount = n;
     }
 
-    return data.torrents;
+    return ret;
 }
 
 /***
@@ -11,6 +11,7 @@
 
 #define TR_NAME "Transmission"
 
+#include <atomic>
 #include <array>
 #include <cstddef> // size_t
 #include <cstdint> // uintX_t
@@ -29,6 +30,7 @@
 
 #include "net.h" // tr_socket_t
 #include "quark.h"
+#include "tr-udp.h" // tr_udp_stats
 #include "web.h"
 
 enum tr_auto_switch_state_t
@@ -43,6 +45,7 @@ tr_peer_id_t tr_peerIdInit();
 struct event_base;
 struct evdns_base;
 
+class PieceChecker;
 class tr_bitfield;
 class tr_rpc_server;
 class tr_web;
@@ -255,6 +258,10 @@ public:
     bool isUTPEnabled;
     bool isLPDEnabled;
     bool isPrefetchEnabled;
+    bool isMmapUploadsEnabled;
+    // Not used for peers under an upload speed limit: libevent sends a file
+    // segment whole, so it can't be cut down to the bytes the limit allows.
+    bool isSendfileUploadsEnabled;
     bool is_closing_ = false;
     bool isClosed;
     bool isRatioLimited;
@@ -266,8 +273,12 @@ public:
 
     uint8_t peer_id_ttl_hours;
 
-    // torrent id, time removed
-    std::vector<std::pair<int, time_t>> removed_torrents;
+    // torrent id, time removed, torrentChangeSeq when removed
+    std::vector<std::tuple<int, time_t, uint64_t>> removed_torrents;
+
+    // bumped each time any torrent's stats change.
+    // torrent-get's "since" argument is one of these values.
+    std::atomic<uint64_t> torrentChangeSeq = 0;
 
     bool stalledEnabled;
     bool queueEnabled[2];
@@ -298,6 +309,12 @@ public:
 
     int uploadSlotsPerTorrent;
 
+    /* how many threads hash pieces when verifying local data. 0 means pick one for us. see tr_verifyThreadCount() */
+    int verifyThreads;
+
+    /* throttles how fast local data is read when verifying. 0 means unlimited */
+    unsigned int verifySpeedLimit_KBps;
+
     /* The UDP sockets used for the DHT and uTP. */
     tr_port udp_port;
     tr_socket_t udp_socket;
@@ -306,6 +323,12 @@ public:
     struct event* udp_event;
     struct event* udp6_event;
 
+    /* Batches the UDP sockets' reads and writes. See tr-udp.h */
+    tr_udp_send_queue* udp_send_queue;
+    tr_udp_recv_batch* udp_recv_batch;
+    struct event* udp_flush_event;
+    tr_udp_stats udp_stats;
+
     struct event* utp_timer;
 
     /* The open port on the local machine for incoming peer requests */
@@ -336,6 +359,9 @@ public:
 
     struct tr_cache* cache;
 
+    /* hashes pieces as they finish downloading */
+    std::unique_ptr<PieceChecker> piece_checker;
+
     class WebController final : public tr_web::Controller
     {
     public:
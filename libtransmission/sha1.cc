@@ -0,0 +1,669 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring> // memcpy()
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(__GNUC__) || defined(__clang__)
+#define TR_SHA1_X86
+#define TR_SHA1_TARGET(x) __attribute__((target(x)))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define TR_SHA1_X86
+#define TR_SHA1_TARGET(x)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "sha1.h"
+#include "tr-assert.h"
+
+namespace
+{
+
+auto constexpr BlockSize = size_t{ 64 };
+
+auto constexpr InitialState = std::array<uint32_t, 5>{ 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+auto constexpr K = std::array<uint32_t, 4>{ 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+
+constexpr uint32_t rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+uint32_t loadBE32(uint8_t const* p)
+{
+    return (uint32_t{ p[0] } << 24) | (uint32_t{ p[1] } << 16) | (uint32_t{ p[2] } << 8) | uint32_t{ p[3] };
+}
+
+void storeBE32(uint8_t* p, uint32_t x)
+{
+    p[0] = uint8_t(x >> 24);
+    p[1] = uint8_t(x >> 16);
+    p[2] = uint8_t(x >> 8);
+    p[3] = uint8_t(x);
+}
+
+tr_sha1_digest_t toDigest(uint32_t const* h)
+{
+    auto digest = tr_sha1_digest_t{};
+    auto* const out = reinterpret_cast<uint8_t*>(std::data(digest));
+    for (size_t i = 0; i < 5; ++i)
+    {
+        storeBE32(out + i * 4, h[i]);
+    }
+    return digest;
+}
+
+// Build the padding that ends a message of `length` bytes, given the
+// `length % 64` bytes that follow its last whole block. Returns the
+// number of blocks written to `setme`: one or two.
+size_t makeTail(uint8_t const* rest, uint64_t length, std::array<uint8_t, BlockSize * 2>& setme)
+{
+    auto const n_rest = size_t(length % BlockSize);
+    auto const n_blocks = n_rest + 9 <= BlockSize ? size_t{ 1 } : size_t{ 2 };
+
+    std::fill(std::begin(setme), std::end(setme), uint8_t{});
+    std::copy_n(rest, n_rest, std::begin(setme));
+    setme[n_rest] = 0x80;
+
+    auto const bits = length * 8;
+    auto* const end = std::data(setme) + n_blocks * BlockSize;
+    storeBE32(end - 8, uint32_t(bits >> 32));
+    storeBE32(end - 4, uint32_t(bits));
+
+    return n_blocks;
+}
+
+/***
+****  Generic
+***/
+
+void compressGeneric(uint32_t* h, uint8_t const* data, size_t n_blocks)
+{
+    for (; n_blocks > 0; --n_blocks, data += BlockSize)
+    {
+        auto w = std::array<uint32_t, 16>{};
+        for (size_t i = 0; i < 16; ++i)
+        {
+            w[i] = loadBE32(data + i * 4);
+        }
+
+        auto a = h[0];
+        auto b = h[1];
+        auto c = h[2];
+        auto d = h[3];
+        auto e = h[4];
+
+        for (size_t t = 0; t < 80; ++t)
+        {
+            if (t >= 16)
+            {
+                w[t & 15] = rotl(w[(t - 3) & 15] ^ w[(t - 8) & 15] ^ w[(t - 14) & 15] ^ w[t & 15], 1);
+            }
+
+            auto f = uint32_t{};
+            if (t < 20)
+            {
+                f = d ^ (b & (c ^ d));
+            }
+            else if (t < 40 || t >= 60)
+            {
+                f = b ^ c ^ d;
+            }
+            else
+            {
+                f = (b & c) | (d & (b | c));
+            }
+
+            auto const tmp = rotl(a, 5) + f + e + K[t / 20] + w[t & 15];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = tmp;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+}
+
+/***
+****  x86
+***/
+
+#ifdef TR_SHA1_X86
+
+struct CpuFeatures
+{
+    bool sha = false;
+    bool avx2 = false;
+};
+
+CpuFeatures detectCpuFeatures()
+{
+    auto regs = std::array<uint32_t, 4>{};
+    auto const cpuid = [&regs](uint32_t leaf, uint32_t subleaf)
+    {
+#ifdef _MSC_VER
+        auto r = std::array<int, 4>{};
+        __cpuidex(std::data(r), int(leaf), int(subleaf));
+        std::copy(std::begin(r), std::end(r), std::begin(regs));
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    };
+
+    auto ret = CpuFeatures{};
+
+    cpuid(0, 0);
+    if (regs[0] < 7)
+    {
+        return ret;
+    }
+
+    cpuid(1, 0);
+    auto const ssse3 = (regs[2] & (1U << 9)) != 0;
+    auto const sse41 = (regs[2] & (1U << 19)) != 0;
+    auto const osxsave = (regs[2] & (1U << 27)) != 0;
+    auto const avx = (regs[2] & (1U << 28)) != 0;
+
+    cpuid(7, 0);
+    auto const sha = (regs[1] & (1U << 29)) != 0;
+    auto const avx2 = (regs[1] & (1U << 5)) != 0;
+
+    // AVX registers are only usable if the OS saves them on context switches
+    auto os_saves_ymm = false;
+    if (osxsave && avx)
+    {
+#ifdef _MSC_VER
+        auto const xcr0 = uint64_t{ _xgetbv(0) };
+#else
+        uint32_t eax = 0;
+        uint32_t edx = 0;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        auto const xcr0 = (uint64_t{ edx } << 32) | eax;
+#endif
+        os_saves_ymm = (xcr0 & 0x6) == 0x6;
+    }
+
+    ret.sha = sha && ssse3 && sse41;
+    ret.avx2 = avx2 && os_saves_ymm;
+    return ret;
+}
+
+CpuFeatures const& cpuFeatures()
+{
+    static auto const features = detectCpuFeatures();
+    return features;
+}
+
+// Four rounds of SHA-NI. Group `I` covers rounds [4*I, 4*I + 4) and uses
+// message words M0; M1..M3 are the next three groups' words, which get
+// their schedule updates here as in Intel's reference code.
+#define TR_SHA1NI_GROUP(I, E_CUR, E_NEXT, M0, M1, M2, M3) \
+    do \
+    { \
+        if ((I) == 0) \
+        { \
+            E_CUR = _mm_add_epi32(E_CUR, M0); \
+        } \
+        else \
+        { \
+            E_CUR = _mm_sha1nexte_epu32(E_CUR, M0); \
+        } \
+        E_NEXT = abcd; \
+        if ((I) >= 3 && (I) <= 18) \
+        { \
+            M1 = _mm_sha1msg2_epu32(M1, M0); \
+        } \
+        abcd = _mm_sha1rnds4_epu32(abcd, E_CUR, (I) / 5); \
+        if ((I) >= 1 && (I) <= 16) \
+        { \
+            M3 = _mm_sha1msg1_epu32(M3, M0); \
+        } \
+        if ((I) >= 2 && (I) <= 17) \
+        { \
+            M2 = _mm_xor_si128(M2, M0); \
+        } \
+    } while (0)
+
+TR_SHA1_TARGET("sha,sse4.1,ssse3")
+void compressShaNi(uint32_t* h, uint8_t const* data, size_t n_blocks)
+{
+    auto const mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    auto abcd = _mm_loadu_si128(reinterpret_cast<__m128i const*>(h));
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);
+    auto e0 = _mm_set_epi32(int(h[4]), 0, 0, 0);
+
+    for (; n_blocks > 0; --n_blocks, data += BlockSize)
+    {
+        auto const abcd_save = abcd;
+        auto const e0_save = e0;
+        auto e1 = __m128i{};
+
+        auto m0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data + 0)), mask);
+        auto m1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data + 16)), mask);
+        auto m2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data + 32)), mask);
+        auto m3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data + 48)), mask);
+
+        TR_SHA1NI_GROUP(0, e0, e1, m0, m1, m2, m3);
+        TR_SHA1NI_GROUP(1, e1, e0, m1, m2, m3, m0);
+        TR_SHA1NI_GROUP(2, e0, e1, m2, m3, m0, m1);
+        TR_SHA1NI_GROUP(3, e1, e0, m3, m0, m1, m2);
+        TR_SHA1NI_GROUP(4, e0, e1, m0, m1, m2, m3);
+        TR_SHA1NI_GROUP(5, e1, e0, m1, m2, m3, m0);
+        TR_SHA1NI_GROUP(6, e0, e1, m2, m3, m0, m1);
+        TR_SHA1NI_GROUP(7, e1, e0, m3, m0, m1, m2);
+        TR_SHA1NI_GROUP(8, e0, e1, m0, m1, m2, m3);
+        TR_SHA1NI_GROUP(9, e1, e0, m1, m2, m3, m0);
+        TR_SHA1NI_GROUP(10, e0, e1, m2, m3, m0, m1);
+        TR_SHA1NI_GROUP(11, e1, e0, m3, m0, m1, m2);
+        TR_SHA1NI_GROUP(12, e0, e1, m0, m1, m2, m3);
+        TR_SHA1NI_GROUP(13, e1, e0, m1, m2, m3, m0);
+        TR_SHA1NI_GROUP(14, e0, e1, m2, m3, m0, m1);
+        TR_SHA1NI_GROUP(15, e1, e0, m3, m0, m1, m2);
+        TR_SHA1NI_GROUP(16, e0, e1, m0, m1, m2, m3);
+        TR_SHA1NI_GROUP(17, e1, e0, m1, m2, m3, m0);
+        TR_SHA1NI_GROUP(18, e0, e1, m2, m3, m0, m1);
+        TR_SHA1NI_GROUP(19, e1, e0, m3, m0, m1, m2);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(h), abcd);
+    h[4] = uint32_t(_mm_extract_epi32(e0, 3));
+}
+
+#undef TR_SHA1NI_GROUP
+
+TR_SHA1_TARGET("avx2")
+inline __m256i rotlAvx2(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+// Load the next block of each of the eight lanes and transpose them,
+// so that `w[i]` holds big-endian word `i` of every lane.
+TR_SHA1_TARGET("avx2")
+void loadBlocksAvx2(uint8_t const* const* blocks, __m256i* w)
+{
+    auto const bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (size_t half = 0; half < 2; ++half)
+    {
+        __m256i r[8];
+        for (size_t lane = 0; lane < 8; ++lane)
+        {
+            auto const* const p = reinterpret_cast<__m256i const*>(blocks[lane] + half * 32);
+            r[lane] = _mm256_shuffle_epi8(_mm256_loadu_si256(p), bswap);
+        }
+
+        auto const t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+        auto const t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+        auto const t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+        auto const t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+        auto const t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+        auto const t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+        auto const t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+        auto const t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+        auto const u0 = _mm256_unpacklo_epi64(t0, t2);
+        auto const u1 = _mm256_unpackhi_epi64(t0, t2);
+        auto const u2 = _mm256_unpacklo_epi64(t1, t3);
+        auto const u3 = _mm256_unpackhi_epi64(t1, t3);
+        auto const u4 = _mm256_unpacklo_epi64(t4, t6);
+        auto const u5 = _mm256_unpackhi_epi64(t4, t6);
+        auto const u6 = _mm256_unpacklo_epi64(t5, t7);
+        auto const u7 = _mm256_unpackhi_epi64(t5, t7);
+
+        auto* const out = w + half * 8;
+        out[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+        out[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+        out[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+        out[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+        out[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+        out[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+        out[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+        out[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+    }
+}
+
+// One block for each of eight independent messages.
+TR_SHA1_TARGET("avx2")
+void compressAvx2x8(__m256i* h, uint8_t const* const* blocks)
+{
+    __m256i w[16];
+    loadBlocksAvx2(blocks, w);
+
+    auto a = h[0];
+    auto b = h[1];
+    auto c = h[2];
+    auto d = h[3];
+    auto e = h[4];
+
+    for (size_t t = 0; t < 80; ++t)
+    {
+        if (t >= 16)
+        {
+            auto const x = _mm256_xor_si256(
+                _mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15]),
+                _mm256_xor_si256(w[(t - 14) & 15], w[t & 15]));
+            w[t & 15] = rotlAvx2(x, 1);
+        }
+
+        auto f = __m256i{};
+        if (t < 20)
+        {
+            f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+        }
+        else if (t < 40 || t >= 60)
+        {
+            f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+        }
+        else
+        {
+            f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+        }
+
+        auto tmp = _mm256_add_epi32(rotlAvx2(a, 5), f);
+        tmp = _mm256_add_epi32(tmp, e);
+        tmp = _mm256_add_epi32(tmp, _mm256_set1_epi32(int(K[t / 20])));
+        tmp = _mm256_add_epi32(tmp, w[t & 15]);
+        e = d;
+        d = c;
+        c = rotlAvx2(b, 30);
+        b = a;
+        a = tmp;
+    }
+
+    h[0] = _mm256_add_epi32(h[0], a);
+    h[1] = _mm256_add_epi32(h[1], b);
+    h[2] = _mm256_add_epi32(h[2], c);
+    h[3] = _mm256_add_epi32(h[3], d);
+    h[4] = _mm256_add_epi32(h[4], e);
+}
+
+// Hash up to eight messages together. The lanes run in lockstep for as
+// many blocks as the shortest message has; whatever is left of the longer
+// ones is finished one at a time. Pieces in a torrent are all the same
+// size except for the last one, so that's usually nothing.
+TR_SHA1_TARGET("avx2")
+void hashGroupAvx2(std::string_view const* messages, size_t n, tr_sha1_digest_t* setme)
+{
+    TR_ASSERT(n > 0 && n <= 8);
+
+    struct Lane
+    {
+        uint8_t const* data = nullptr;
+        size_t n_whole_blocks = 0;
+        size_t n_blocks = 0;
+        std::array<uint8_t, BlockSize * 2> tail = {};
+
+        [[nodiscard]] uint8_t const* block(size_t i) const
+        {
+            return i < n_whole_blocks ? data + i * BlockSize : std::data(tail) + (i - n_whole_blocks) * BlockSize;
+        }
+    };
+
+    auto lanes = std::array<Lane, 8>{};
+    auto n_common = ~size_t{};
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto& lane = lanes[i];
+        lane.data = reinterpret_cast<uint8_t const*>(std::data(messages[i]));
+        lane.n_whole_blocks = std::size(messages[i]) / BlockSize;
+        auto const n_tail = makeTail(lane.data + lane.n_whole_blocks * BlockSize, std::size(messages[i]), lane.tail);
+        lane.n_blocks = lane.n_whole_blocks + n_tail;
+        n_common = std::min(n_common, lane.n_blocks);
+    }
+
+    // unused lanes just rehash the first message
+    for (size_t i = n; i < 8; ++i)
+    {
+        lanes[i] = lanes[0];
+    }
+
+    __m256i h[5];
+    for (size_t i = 0; i < 5; ++i)
+    {
+        h[i] = _mm256_set1_epi32(int(InitialState[i]));
+    }
+
+    auto blocks = std::array<uint8_t const*, 8>{};
+    for (size_t block = 0; block < n_common; ++block)
+    {
+        for (size_t i = 0; i < 8; ++i)
+        {
+            blocks[i] = lanes[i].block(block);
+        }
+
+        compressAvx2x8(h, std::data(blocks));
+    }
+
+    alignas(32) auto words = std::array<std::array<uint32_t, 8>, 5>{};
+    for (size_t i = 0; i < 5; ++i)
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(std::data(words[i])), h[i]);
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto state = std::array<uint32_t, 5>{};
+        for (size_t j = 0; j < 5; ++j)
+        {
+            state[j] = words[j][i];
+        }
+
+        for (size_t block = n_common; block < lanes[i].n_blocks; ++block)
+        {
+            compressGeneric(std::data(state), lanes[i].block(block), 1);
+        }
+
+        setme[i] = toDigest(std::data(state));
+    }
+}
+
+#endif // TR_SHA1_X86
+
+/***
+****  Dispatch
+***/
+
+tr_sha1_impl bestImpl()
+{
+#ifdef TR_SHA1_X86
+    if (cpuFeatures().sha)
+    {
+        return tr_sha1_impl::ShaNi;
+    }
+
+    if (cpuFeatures().avx2)
+    {
+        return tr_sha1_impl::Avx2;
+    }
+#endif
+
+    return tr_sha1_impl::Generic;
+}
+
+std::atomic<tr_sha1_impl>& currentImpl()
+{
+    static auto impl = std::atomic<tr_sha1_impl>{ bestImpl() };
+    return impl;
+}
+
+void compress(uint32_t* h, uint8_t const* data, size_t n_blocks)
+{
+#ifdef TR_SHA1_X86
+    if (tr_sha1_get_impl() == tr_sha1_impl::ShaNi)
+    {
+        compressShaNi(h, data, n_blocks);
+        return;
+    }
+#endif
+
+    compressGeneric(h, data, n_blocks);
+}
+
+} // namespace
+
+/***
+****
+***/
+
+void tr_sha1_state_init(tr_sha1_state& state)
+{
+    state.h = InitialState;
+    state.length = 0;
+}
+
+void tr_sha1_state_update(tr_sha1_state& state, void const* data, size_t data_length)
+{
+    auto const* walk = static_cast<uint8_t const*>(data);
+    auto n_buffered = size_t(state.length % BlockSize);
+    state.length += data_length;
+
+    // top off a partial block from the last update
+    if (n_buffered != 0)
+    {
+        auto const n = std::min(BlockSize - n_buffered, data_length);
+        std::memcpy(std::data(state.buf) + n_buffered, walk, n);
+        walk += n;
+        data_length -= n;
+        n_buffered += n;
+
+        if (n_buffered < BlockSize)
+        {
+            return;
+        }
+
+        compress(std::data(state.h), std::data(state.buf), 1);
+    }
+
+    if (auto const n_blocks = data_length / BlockSize; n_blocks > 0)
+    {
+        compress(std::data(state.h), walk, n_blocks);
+        walk += n_blocks * BlockSize;
+        data_length -= n_blocks * BlockSize;
+    }
+
+    std::memcpy(std::data(state.buf), walk, data_length);
+}
+
+tr_sha1_digest_t tr_sha1_state_final(tr_sha1_state& state)
+{
+    auto tail = std::array<uint8_t, BlockSize * 2>{};
+    auto const n_blocks = makeTail(std::data(state.buf), state.length, tail);
+    compress(std::data(state.h), std::data(tail), n_blocks);
+    return toDigest(std::data(state.h));
+}
+
+void tr_sha1_many(std::string_view const* messages, size_t n, tr_sha1_digest_t* setme)
+{
+#ifdef TR_SHA1_X86
+    if (tr_sha1_get_impl() == tr_sha1_impl::Avx2)
+    {
+        while (n > 1)
+        {
+            auto const n_lanes = std::min(n, size_t{ 8 });
+            hashGroupAvx2(messages, n_lanes, setme);
+            messages += n_lanes;
+            setme += n_lanes;
+            n -= n_lanes;
+        }
+    }
+#endif
+
+    // whatever's left goes through tr_sha1(), which picks the faster of
+    // SHA-NI and the crypto library
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (auto const digest = tr_sha1(messages[i]); digest)
+        {
+            setme[i] = *digest;
+            continue;
+        }
+
+        auto state = tr_sha1_state{};
+        tr_sha1_state_init(state);
+        tr_sha1_state_update(state, std::data(messages[i]), std::size(messages[i]));
+        setme[i] = tr_sha1_state_final(state);
+    }
+}
+
+size_t tr_sha1_many_width()
+{
+    return tr_sha1_get_impl() == tr_sha1_impl::Avx2 ? 8 : 1;
+}
+
+tr_sha1_impl tr_sha1_get_impl()
+{
+    return currentImpl().load(std::memory_order_relaxed);
+}
+
+bool tr_sha1_impl_is_supported(tr_sha1_impl impl)
+{
+    switch (impl)
+    {
+#ifdef TR_SHA1_X86
+    case tr_sha1_impl::ShaNi:
+        return cpuFeatures().sha;
+
+    case tr_sha1_impl::Avx2:
+        return cpuFeatures().avx2;
+#endif
+
+    case tr_sha1_impl::Generic:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool tr_sha1_set_impl(tr_sha1_impl impl)
+{
+    if (!tr_sha1_impl_is_supported(impl))
+    {
+        return false;
+    }
+
+    currentImpl().store(impl, std::memory_order_relaxed);
+    return true;
+}
+
+char const* tr_sha1_impl_name(tr_sha1_impl impl)
+{
+    switch (impl)
+    {
+    case tr_sha1_impl::ShaNi:
+        return "sha-ni";
+
+    case tr_sha1_impl::Avx2:
+        return "avx2-x8";
+
+    default:
+        return "generic";
+    }
+}
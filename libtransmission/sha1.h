@@ -0,0 +1,69 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <string_view>
+
+#include "transmission.h" // tr_sha1_digest_t
+
+/**
+ * Built-in SHA1 for hashing piece data.
+ *
+ * There are three kernels and the fastest one this CPU supports is
+ * picked once, by CPUID:
+ *
+ * - ShaNi hashes one stream with the x86 SHA extensions.
+ * - Avx2 hashes eight independent streams at once in the lanes of
+ *   256-bit vectors. Only tr_sha1_many() can use it, since the streams
+ *   have to be known up front.
+ * - Generic is portable C++.
+ *
+ * tr_sha1_init() and friends use the built-in hasher when ShaNi is
+ * available and fall back to the crypto library's SHA1 otherwise.
+ */
+
+enum class tr_sha1_impl
+{
+    Generic,
+    Avx2,
+    ShaNi
+};
+
+struct tr_sha1_state
+{
+    std::array<uint32_t, 5> h = {};
+    std::array<uint8_t, 64> buf = {};
+    uint64_t length = 0;
+};
+
+void tr_sha1_state_init(tr_sha1_state& state);
+
+void tr_sha1_state_update(tr_sha1_state& state, void const* data, size_t data_length);
+
+[[nodiscard]] tr_sha1_digest_t tr_sha1_state_final(tr_sha1_state& state);
+
+// Hash `n` independent messages, writing their digests to `setme[0..n)`.
+void tr_sha1_many(std::string_view const* messages, size_t n, tr_sha1_digest_t* setme);
+
+// How many messages tr_sha1_many() hashes at once with the current kernel.
+// Callers that can batch their work should hand it this many at a time.
+[[nodiscard]] size_t tr_sha1_many_width();
+
+[[nodiscard]] tr_sha1_impl tr_sha1_get_impl();
+
+[[nodiscard]] bool tr_sha1_impl_is_supported(tr_sha1_impl impl);
+
+// Force a kernel; for tests and benchmarks. Returns false if the CPU doesn't support it.
+bool tr_sha1_set_impl(tr_sha1_impl impl);
+
+[[nodiscard]] char const* tr_sha1_impl_name(tr_sha1_impl impl);
@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <cerrno> // EINVAL
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -56,6 +57,16 @@ struct tr_ctor
 
     std::vector<char> contents;
 
+    // a resume file that was already parsed, and its filename
+    std::string resume_filename;
+    std::unique_ptr<tr_variant, void (*)(tr_variant*)> resume{ nullptr, freeResume };
+
+    static void freeResume(tr_variant* v)
+    {
+        tr_variantFree(v);
+        delete v;
+    }
+
     explicit tr_ctor(tr_session const* session_in)
         : session{ session_in }
     {
@@ -89,6 +100,34 @@ bool tr_ctorSetMetainfoFromFile(tr_ctor* ctor, char const* filename, tr_error**
     return tr_ctorSetMetainfoFromFile(ctor, std::string{ filename != nullptr ? filename : "" }, error);
 }
 
+void tr_ctorSetParsedMetainfo(
+    tr_ctor* ctor,
+    std::string const& filename,
+    std::vector<char>&& contents,
+    tr_torrent_metainfo&& metainfo)
+{
+    ctor->torrent_filename = filename;
+    ctor->contents = std::move(contents);
+    ctor->metainfo = std::move(metainfo);
+}
+
+void tr_ctorSetParsedResume(tr_ctor* ctor, std::string const& filename, tr_variant* resume)
+{
+    ctor->resume_filename = filename;
+    ctor->resume.reset();
+
+    if (resume != nullptr)
+    {
+        ctor->resume.reset(new tr_variant{ *resume });
+        *resume = {};
+    }
+}
+
+tr_variant* tr_ctorGetParsedResume(tr_ctor const* ctor, std::string_view filename)
+{
+    return ctor->resume && ctor->resume_filename == filename ? ctor->resume.get() : nullptr;
+}
+
 bool tr_ctorSetMetainfo(tr_ctor* ctor, char const* metainfo, size_t len, tr_error** error)
 {
     ctor->torrent_filename.clear();
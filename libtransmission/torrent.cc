@@ -38,11 +38,12 @@
 #include "error.h"
 #include "fdlimit.h" /* tr_fdTorrentClose */
 #include "file.h"
-#include "inout.h" /* tr_ioTestPiece() */
+#include "inout.h" /* tr_ioTestPiece(), tr_ioReadPiece() */
 #include "log.h"
 #include "magnet-metainfo.h"
 #include "peer-common.h" /* MAX_BLOCK_SIZE */
 #include "peer-mgr.h"
+#include "piece-checker.h"
 #include "resume.h"
 #include "session.h"
 #include "subprocess.h"
@@ -190,6 +191,7 @@ void tr_torrent::setSpeedLimitBps(tr_direction dir, unsigned int Bps)
 
     if (this->bandwidth->setDesiredSpeedBytesPerSecond(dir, Bps))
     {
+        this->markStatsChanged();
         this->setDirty();
     }
 }
@@ -221,6 +223,7 @@ void tr_torrentUseSpeedLimit(tr_torrent* tor, tr_direction dir, bool do_use)
 
     if (tor->bandwidth->setLimited(dir, do_use))
     {
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -238,6 +241,7 @@ void tr_torrentUseSessionLimits(tr_torrent* tor, bool doUse)
 
     if (tor->bandwidth->honorParentLimits(TR_UP, doUse) || tor->bandwidth->honorParentLimits(TR_DOWN, doUse))
     {
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -262,6 +266,7 @@ void tr_torrentSetRatioMode(tr_torrent* tor, tr_ratiolimit mode)
     {
         tor->ratioLimitMode = mode;
 
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -281,6 +286,7 @@ void tr_torrentSetRatioLimit(tr_torrent* tor, double desiredRatio)
     {
         tor->desiredRatio = desiredRatio;
 
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -377,6 +383,7 @@ void tr_torrentSetIdleMode(tr_torrent* tor, tr_idlelimit mode)
     {
         tor->idleLimitMode = mode;
 
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -396,6 +403,7 @@ void tr_torrentSetIdleLimit(tr_torrent* tor, uint16_t idleMinutes)
     {
         tor->idleLimitMinutes = idleMinutes;
 
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -587,6 +595,7 @@ static void torrentInitFromInfoDict(tr_torrent* tor)
     tor->file_priorities_.reset(&tor->fpm_);
     tor->files_wanted_.reset(&tor->fpm_);
     tor->checked_pieces_ = tr_bitfield{ size_t(tor->pieceCount()) };
+    tor->pieces_being_checked_ = tr_bitfield{ size_t(tor->pieceCount()) };
 }
 
 void tr_torrent::setMetainfo(tr_torrent_metainfo const& tm)
@@ -719,6 +728,7 @@ static void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     auto const now = tr_time();
     tor->addedDate = now; // this is a default that will be overwritten by the resume file
     tor->anyDate = now;
+    tor->markStatsChanged();
 
     // tr_resume::load() calls a lot of tr_torrentSetFoo() methods
     // that set things as dirty, but... these settings being loaded are
@@ -1423,12 +1433,22 @@ void tr_torrentStartNow(tr_torrent* tor)
     }
 }
 
-static void onVerifyDoneThreadFunc(void* vtor)
+struct verify_done_data
 {
-    auto* const tor = static_cast<tr_torrent*>(vtor);
-    TR_ASSERT(tr_amInEventThread(tor->session));
+    tr_session* session;
+    int torrent_id;
+};
 
-    if (tor->isDeleting)
+static void onVerifyDoneThreadFunc(void* vdata)
+{
+    auto* const data = static_cast<verify_done_data*>(vdata);
+    TR_ASSERT(tr_amInEventThread(data->session));
+
+    // the torrent may have been freed while this was queued
+    auto* const tor = tr_torrentFindFromId(data->session, data->torrent_id);
+    delete data;
+
+    if (tor == nullptr || tor->isDeleting)
     {
         return;
     }
@@ -1449,7 +1469,7 @@ static void onVerifyDone(tr_torrent* tor, bool aborted, void* /*unused*/)
         return;
     }
 
-    tr_runInEventThread(tor->session, onVerifyDoneThreadFunc, tor);
+    tr_runInEventThread(tor->session, onVerifyDoneThreadFunc, new verify_done_data{ tor->session, tor->uniqueId });
 }
 
 static void verifyTorrent(void* vtor)
@@ -1556,7 +1576,7 @@ static void closeTorrent(void* vtor)
     TR_ASSERT(tr_isTorrent(tor));
     TR_ASSERT(tr_amInEventThread(tor->session));
 
-    tor->session->removed_torrents.emplace_back(tor->uniqueId, tr_time());
+    tor->session->removed_torrents.emplace_back(tor->uniqueId, tr_time(), ++tor->session->torrentChangeSeq);
 
     tr_logAddTorInfo(tor, "%s", _("Removing torrent"));
 
@@ -1885,6 +1905,7 @@ void tr_torrentSetLabels(tr_torrent* tor, tr_labels_t&& labels)
     auto const lock = tor->unique_lock();
 
     tor->labels = std::move(labels);
+    tor->markStatsChanged();
     tor->setDirty();
 }
 
@@ -1908,6 +1929,7 @@ void tr_torrentSetPriority(tr_torrent* tor, tr_priority_t priority)
     {
         tor->bandwidth->setPriority(priority);
 
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -1924,6 +1946,7 @@ void tr_torrentSetPeerLimit(tr_torrent* tor, uint16_t maxConnectedPeers)
     {
         tor->maxConnectedPeers = maxConnectedPeers;
 
+        tor->markStatsChanged();
         tor->setDirty();
     }
 }
@@ -2560,41 +2583,106 @@ static void tr_torrentPieceCompleted(tr_torrent* tor, tr_piece_index_t pieceInde
     }
 }
 
+static void onPieceChecked(tr_torrent* tor, tr_piece_index_t piece, bool pass)
+{
+    if (pass)
+    {
+        tr_torrentPieceCompleted(tor, piece);
+    }
+    else
+    {
+        uint32_t const n = tor->pieceSize(piece);
+        tr_logAddTorErr(tor, _("Piece %" PRIu32 ", which was just downloaded, failed its checksum test"), piece);
+        tor->corruptCur += n;
+        tor->downloadedCur -= std::min(tor->downloadedCur, uint64_t{ n });
+        tr_peerMgrGotBadPiece(tor, piece);
+
+        // forget the bad blocks so that they get downloaded again
+        tor->setHasPiece(piece, false);
+        tor->setDirty();
+    }
+}
+
+void tr_torrentPieceChecked(tr_session* session, int torrent_id, tr_piece_index_t piece, bool pass)
+{
+    TR_ASSERT(tr_amInEventThread(session));
+
+    // the torrent may have been removed, or the piece rechecked, in the meantime
+    auto* const tor = tr_torrentFindFromId(session, torrent_id);
+    if (tor == nullptr || tor->isDeleting || !tor->isPieceBeingChecked(piece))
+    {
+        return;
+    }
+
+    tor->pieces_being_checked_.unset(piece);
+
+    // a copy of the piece's first block may have restarted its hash in the meantime
+    tor->hash_streams.erase(piece);
+
+    if (pass)
+    {
+        tor->completion.addPiece(piece);
+        tor->setDirty();
+    }
+
+    onPieceChecked(tor, piece, pass);
+}
+
 void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t block)
 {
     TR_ASSERT(tr_isTorrent(tor));
     TR_ASSERT(tr_amInEventThread(tor->session));
 
-    bool const block_is_new = !tor->hasBlock(block);
+    auto const piece = tor->blockLoc(block).piece;
+    bool const block_is_new = !tor->hasBlock(block) && !tor->isPieceBeingChecked(piece);
+
+    if (!block_is_new)
+    {
+        uint32_t const n = tor->blockSize(block);
+        tor->downloadedCur -= std::min(tor->downloadedCur, uint64_t{ n });
+        tr_logAddTorDbg(tor, "we have this block already...");
+        return;
+    }
+
+    tor->setDirty();
 
-    if (block_is_new)
+    if (tor->countMissingBlocksInPiece(piece) > 1)
     {
         tor->completion.addBlock(block);
-        tor->setDirty();
+        return;
+    }
 
-        auto const piece = tor->blockLoc(block).piece;
+    // most of the piece was probably hashed as it arrived.
+    // read back the rest and finish hashing it on a worker thread;
+    // see tr_torrentPieceChecked()
+    auto const piece_begin = tor->blockSpanForPiece(piece).begin;
+    auto const [ctx, next_block] = tor->hash_streams.take(piece, piece_begin);
+    auto* const checker = tor->session->piece_checker.get();
+    auto tail = std::vector<uint8_t>{};
+    if (!tr_ioReadPiece(tor, piece, (next_block - piece_begin) * tor->blockSize(), tail))
+    {
+        if (ctx != nullptr)
+        {
+            tr_sha1_final(ctx);
+        }
 
-        if (tor->hasPiece(piece))
+        onPieceChecked(tor, piece, false);
+    }
+    else if (checker == nullptr || (ctx != nullptr && std::empty(tail)))
+    {
+        bool const pass = PieceChecker::check(tor->pieceHash(piece), tail, ctx);
+        if (pass)
         {
-            if (tor->checkPiece(piece))
-            {
-                tr_torrentPieceCompleted(tor, piece);
-            }
-            else
-            {
-                uint32_t const n = tor->pieceSize(piece);
-                tr_logAddTorErr(tor, _("Piece %" PRIu32 ", which was just downloaded, failed its checksum test"), piece);
-                tor->corruptCur += n;
-                tor->downloadedCur -= std::min(tor->downloadedCur, uint64_t{ n });
-                tr_peerMgrGotBadPiece(tor, piece);
-            }
+            tor->completion.addBlock(block);
         }
+
+        onPieceChecked(tor, piece, pass);
     }
     else
     {
-        uint32_t const n = tor->blockSize(block);
-        tor->downloadedCur -= std::min(tor->downloadedCur, uint64_t{ n });
-        tr_logAddTorDbg(tor, "we have this block already...");
+        // until the check passes, the piece stays incomplete
+        tor->pieces_being_checked_.set(piece);
+        checker->add(tor->uniqueId, piece, tor->pieceHash(piece), std::move(tail), ctx);
     }
 }
 
@@ -3102,21 +3190,31 @@ bool tr_torrentHasMetadata(tr_torrent const* tor)
 void tr_torrent::markEdited()
 {
     this->editDate = tr_time();
+    this->markStatsChanged();
 }
 
 void tr_torrent::markChanged()
 {
     this->anyDate = tr_time();
+    this->markStatsChanged();
+}
+
+void tr_torrent::markStatsChanged()
+{
+    this->changeSeq = ++this->session->torrentChangeSeq;
 }
 
 void tr_torrent::setDateActive(time_t t)
 {
     this->activityDate = t;
     this->anyDate = std::max(this->anyDate, this->activityDate);
+    this->markStatsChanged();
 }
 
 void tr_torrent::setBlocks(tr_bitfield blocks)
 {
+    this->pieces_being_checked_.setHasNone();
+    this->hash_streams.clear();
     this->completion.setBlocks(std::move(blocks));
 }
 
@@ -9,6 +9,7 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <atomic>
 #include <cstddef> // size_t
 #include <ctime>
 #include <optional>
@@ -27,6 +28,7 @@
 #include "file.h"
 #include "file-piece-map.h"
 #include "interned-string.h"
+#include "piece-checker.h"
 #include "session.h"
 #include "torrent-metainfo.h"
 #include "tr-macros.h"
@@ -272,9 +274,19 @@ public:
 
     void setHasPiece(tr_piece_index_t piece, bool has)
     {
+        pieces_being_checked_.unset(piece);
+        hash_streams.erase(piece);
         completion.setHasPiece(piece, has);
     }
 
+    // a piece whose last block has arrived but whose checksum is still
+    // queued on the piece checker. its last block is kept out of
+    // `completion` until it passes, so we neither advertise nor serve it.
+    [[nodiscard]] bool isPieceBeingChecked(tr_piece_index_t piece) const
+    {
+        return pieces_being_checked_.test(piece);
+    }
+
     /// FILE <-> PIECE
 
     [[nodiscard]] auto piecesInFile(tr_file_index_t file) const
@@ -323,15 +335,22 @@ public:
         return file_priorities_.piecePriority(piece);
     }
 
+    [[nodiscard]] tr_priority_t highestPriority() const
+    {
+        return file_priorities_.highestPriority();
+    }
+
     void setFilePriorities(tr_file_index_t const* files, tr_file_index_t fileCount, tr_priority_t priority)
     {
         file_priorities_.set(files, fileCount, priority);
+        markStatsChanged();
         setDirty();
     }
 
     void setFilePriority(tr_file_index_t file, tr_priority_t priority)
     {
         file_priorities_.set(file, priority);
+        markStatsChanged();
         setDirty();
     }
 
@@ -578,6 +597,9 @@ public:
 
     tr_bitfield checked_pieces_ = tr_bitfield{ 0 };
 
+    // see isPieceBeingChecked()
+    tr_bitfield pieces_being_checked_ = tr_bitfield{ 0 };
+
     // TODO(ckerr): make private once some of torrent.cc's `tr_torrentFoo()` methods are member functions
     tr_completion completion;
 
@@ -659,6 +681,10 @@ public:
     time_t editDate = 0;
     time_t startDate = 0;
 
+    // the value of session->torrentChangeSeq when this torrent's stats last changed.
+    // atomic because the verify thread stamps it as it checks pieces
+    std::atomic<uint64_t> changeSeq = 0;
+
     int secondsDownloading = 0;
     int secondsSeeding = 0;
 
@@ -697,6 +723,9 @@ public:
     void markEdited();
     void markChanged();
 
+    // something in this torrent's tr_stat changed
+    void markStatsChanged();
+
     uint16_t maxConnectedPeers = TR_DEFAULT_PEER_LIMIT_TORRENT;
 
     tr_verify_state verifyState = TR_VERIFY_NONE;
@@ -715,6 +744,9 @@ public:
 
     tr_labels_t labels;
 
+    // hashes of the incomplete pieces whose blocks have arrived in order so far
+    PieceHashStreams hash_streams;
+
     static auto constexpr MagicNumber = int{ 95549 };
 
     tr_file_piece_map fpm_ = tr_file_piece_map{ metainfo_ };
@@ -733,6 +765,7 @@ private:
 
         if (!is_bootstrapping)
         {
+            markStatsChanged();
             setDirty();
             recheckCompleteness();
         }
@@ -753,6 +786,9 @@ constexpr bool tr_isTorrent(tr_torrent const* tor)
  */
 void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t blockIndex);
 
+/** called on the session thread when a PieceChecker finishes hashing a downloaded piece */
+void tr_torrentPieceChecked(tr_session* session, int torrent_id, tr_piece_index_t piece, bool pass);
+
 /**
  * @brief Like tr_torrentFindFile(), but splits the filename into base and subpath.
  *
@@ -780,3 +816,17 @@ tr_torrent_metainfo&& tr_ctorStealMetainfo(tr_ctor* ctor);
 
 bool tr_ctorSetMetainfoFromFile(tr_ctor* ctor, std::string const& filename, tr_error** error);
 void tr_ctorSetLabels(tr_ctor* ctor, tr_labels_t&& labels);
+
+// for .torrent and .resume files that were read and parsed ahead of time,
+// e.g. by tr_sessionLoadTorrents()'s worker threads
+void tr_ctorSetParsedMetainfo(
+    tr_ctor* ctor,
+    std::string const& filename,
+    std::vector<char>&& contents,
+    tr_torrent_metainfo&& metainfo);
+
+// takes ownership of `resume`. pass nullptr to clear it
+void tr_ctorSetParsedResume(tr_ctor* ctor, std::string const& filename, tr_variant* resume);
+
+// the parsed resume data, if it was read from `filename`
+tr_variant* tr_ctorGetParsedResume(tr_ctor const* ctor, std::string_view filename);
@@ -2,6 +2,7 @@
 // It may be used under the MIT (SPDX: MIT) license.
 // License text can be found in the licenses/ folder.
 
+#include <cerrno>
 #include <cstring> /* memcmp(), memcpy(), memset() */
 #include <cstdlib> /* malloc(), free() */
 
@@ -23,6 +24,7 @@
 #include "tr-dht.h"
 #include "tr-utp.h"
 #include "tr-udp.h"
+#include "trevent.h" /* tr_amInEventThread() */
 
 /* Since we use a single UDP socket in order to implement multiple
    uTP sockets, try to set up huge buffers. */
@@ -215,17 +217,213 @@ FAIL:
     }
 }
 
-static void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsession)
+/***
+****
+***/
+
+/* True if a send failed because the socket's send buffer is full.
+   The rest of the packets for that socket would fail the same way. */
+static bool is_send_buffer_full(int err)
 {
-    TR_ASSERT(tr_isSession(static_cast<tr_session*>(vsession)));
-    TR_ASSERT(type == EV_READ);
+#ifdef _WIN32
+    return err == WSAEWOULDBLOCK;
+#else
+    return err == EAGAIN || err == EWOULDBLOCK;
+#endif
+}
 
-    unsigned char buf[4096];
-    struct sockaddr_storage from;
-    auto* session = static_cast<tr_session*>(vsession);
+bool tr_udp_send_queue::push(tr_socket_t sock, void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen)
+{
+    if (full() || buflen > MaxPacketSize || tolen > socklen_t{ sizeof(sockaddr_storage) })
+    {
+        return false;
+    }
 
-    socklen_t fromlen = sizeof(from);
-    int rc = recvfrom(s, reinterpret_cast<char*>(buf), 4096 - 1, 0, (struct sockaddr*)&from, &fromlen);
+    auto& packet = packets_[n_packets_];
+    packet.sock = sock;
+    memcpy(&packet.to, to, tolen);
+    packet.tolen = tolen;
+    packet.len = buflen;
+    memcpy(data(n_packets_), buf, buflen);
+    ++n_packets_;
+
+    return true;
+}
+
+void tr_udp_send_queue::flush(tr_udp_stats& stats)
+{
+    auto begin = size_t{ 0 };
+
+    while (begin < n_packets_)
+    {
+        auto const sock = packets_[begin].sock;
+        auto end = begin + 1;
+        while (end < n_packets_ && packets_[end].sock == sock)
+        {
+            ++end;
+        }
+
+#ifdef HAVE_SENDMMSG
+        auto iovs = std::array<iovec, MaxPackets>{};
+        auto msgs = std::array<mmsghdr, MaxPackets>{};
+        for (auto i = begin; i < end; ++i)
+        {
+            iovs[i] = { data(i), packets_[i].len };
+            msgs[i].msg_hdr.msg_name = &packets_[i].to;
+            msgs[i].msg_hdr.msg_namelen = packets_[i].tolen;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        while (begin < end)
+        {
+            ++stats.send_calls;
+            int const n_sent = sendmmsg(sock, &msgs[begin], end - begin, 0);
+
+            if (n_sent > 0)
+            {
+                stats.packets_sent += n_sent;
+                begin += n_sent;
+            }
+            else if (auto const err = sockerrno; is_send_buffer_full(err))
+            {
+                // the socket is full, so drop the rest of the run
+                begin = end;
+            }
+            else if (err != EINTR)
+            {
+                // the first packet was refused, so drop it and try the rest
+                ++begin;
+            }
+        }
+#else
+        for (; begin < end; ++begin)
+        {
+            ++stats.send_calls;
+            auto const& packet = packets_[begin];
+            auto const* const to = reinterpret_cast<sockaddr const*>(&packet.to);
+
+            if (sendto(sock, reinterpret_cast<char const*>(data(begin)), packet.len, 0, to, packet.tolen) >= 0)
+            {
+                ++stats.packets_sent;
+            }
+            else if (is_send_buffer_full(sockerrno))
+            {
+                // the socket is full, so drop the rest of the run
+                begin = end;
+                break;
+            }
+        }
+#endif
+    }
+
+    n_packets_ = 0;
+}
+
+size_t tr_udp_recv_batch::read(tr_socket_t sock, tr_udp_stats& stats)
+{
+    ++stats.receive_calls;
+
+#ifdef HAVE_RECVMMSG
+    auto iovs = std::array<iovec, MaxPackets>{};
+    auto msgs = std::array<mmsghdr, MaxPackets>{};
+    for (size_t i = 0; i < MaxPackets; ++i)
+    {
+        // leave room for a terminating NUL
+        iovs[i] = { std::data(data_) + i * MaxPacketSize, MaxPacketSize - 1 };
+        msgs[i].msg_hdr.msg_name = &packets_[i].from;
+        msgs[i].msg_hdr.msg_namelen = sizeof(packets_[i].from);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int const n_read = recvmmsg(sock, std::data(msgs), MaxPackets, MSG_DONTWAIT, nullptr);
+    if (n_read <= 0)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < n_read; ++i)
+    {
+        auto& packet = packets_[i];
+        packet.buf = static_cast<unsigned char*>(iovs[i].iov_base);
+        packet.len = msgs[i].msg_len;
+        packet.buf[packet.len] = '\0';
+        packet.fromlen = msgs[i].msg_hdr.msg_namelen;
+    }
+#else
+    auto& packet = packets_.front();
+    packet.buf = std::data(data_);
+    packet.fromlen = sizeof(packet.from);
+    int const n_bytes = recvfrom(
+        sock,
+        reinterpret_cast<char*>(packet.buf),
+        MaxPacketSize - 1,
+        0,
+        reinterpret_cast<sockaddr*>(&packet.from),
+        &packet.fromlen);
+    if (n_bytes < 0)
+    {
+        return 0;
+    }
+
+    packet.len = n_bytes;
+    packet.buf[packet.len] = '\0';
+    int const n_read = 1;
+#endif
+
+    stats.packets_received += n_read;
+    return n_read;
+}
+
+int tr_udpSendTo(tr_session* session, tr_socket_t sock, void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen)
+{
+    TR_ASSERT(tr_amInEventThread(session));
+
+    if (auto* const queue = session->udp_send_queue; queue != nullptr)
+    {
+        if (queue->full())
+        {
+            queue->flush(session->udp_stats);
+        }
+
+        if (queue->push(sock, buf, buflen, to, tolen))
+        {
+            // flush once the event loop's done with everything else that's ready
+            if (std::size(*queue) == 1)
+            {
+                event_active(session->udp_flush_event, EV_TIMEOUT, 0);
+            }
+
+            return int(buflen);
+        }
+
+        // too big to queue. send it now, but after what's already queued
+        queue->flush(session->udp_stats);
+    }
+
+    ++session->udp_stats.send_calls;
+    int const rc = sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen);
+    if (rc >= 0)
+    {
+        ++session->udp_stats.packets_sent;
+    }
+
+    return rc;
+}
+
+static void flush_callback(evutil_socket_t /*s*/, short /*type*/, void* vsession)
+{
+    auto* const session = static_cast<tr_session*>(vsession);
+
+    session->udp_send_queue->flush(session->udp_stats);
+}
+
+static void dispatch_packet(tr_session* session, tr_udp_recv_batch::Packet& packet)
+{
+    auto* const buf = packet.buf;
+    auto const len = packet.len;
+    auto* const from = reinterpret_cast<sockaddr*>(&packet.from);
 
     /* Since most packets we receive here are ÂµTP, make quick inline
        checks for the other protocols.  The logic is as follows:
@@ -234,36 +432,53 @@ static void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void*
          is between 0 and 3
        - the above cannot be ÂµTP packets, since these start with a 4-bit
          version number (1). */
-    if (rc > 0)
+    if (len == 0)
+    {
+        return;
+    }
+
+    if (buf[0] == 'd')
     {
-        if (buf[0] == 'd')
+        if (tr_sessionAllowsDHT(session))
         {
-            if (tr_sessionAllowsDHT(session))
-            {
-                buf[rc] = '\0'; /* required by the DHT code */
-                tr_dhtCallback(buf, rc, (struct sockaddr*)&from, fromlen, vsession);
-            }
+            /* the DHT code requires buf to be NUL-terminated, which it is */
+            tr_dhtCallback(buf, len, from, packet.fromlen, session);
         }
-        else if (rc >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
+    }
+    else if (len >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
+    {
+        if (!tau_handle_message(session, buf, len))
         {
-            if (!tau_handle_message(session, buf, rc))
-            {
-                tr_logAddNamedDbg("UDP", "Couldn't parse UDP tracker packet.");
-            }
+            tr_logAddNamedDbg("UDP", "Couldn't parse UDP tracker packet.");
         }
-        else
+    }
+    else
+    {
+        if (tr_sessionIsUTPEnabled(session))
         {
-            if (tr_sessionIsUTPEnabled(session))
+            if (!tr_utpPacket(buf, len, from, packet.fromlen, session))
             {
-                if (!tr_utpPacket(buf, rc, (struct sockaddr*)&from, fromlen, session))
-                {
-                    tr_logAddNamedDbg("UDP", "Unexpected UDP packet");
-                }
+                tr_logAddNamedDbg("UDP", "Unexpected UDP packet");
             }
         }
     }
 }
 
+static void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsession)
+{
+    TR_ASSERT(tr_isSession(static_cast<tr_session*>(vsession)));
+    TR_ASSERT(type == EV_READ);
+
+    auto* session = static_cast<tr_session*>(vsession);
+    auto& batch = *session->udp_recv_batch;
+
+    auto const n_packets = batch.read(s, session->udp_stats);
+    for (size_t i = 0; i < n_packets; ++i)
+    {
+        dispatch_packet(session, batch[i]);
+    }
+}
+
 void tr_udpInit(tr_session* ss)
 {
     TR_ASSERT(ss->udp_socket == TR_BAD_SOCKET);
@@ -276,6 +491,10 @@ void tr_udpInit(tr_session* ss)
         return;
     }
 
+    ss->udp_send_queue = new tr_udp_send_queue{};
+    ss->udp_recv_batch = new tr_udp_recv_batch{};
+    ss->udp_flush_event = event_new(ss->event_base, -1, 0, flush_callback, ss);
+
     ss->udp_socket = socket(PF_INET, SOCK_DGRAM, 0);
 
     if (ss->udp_socket == TR_BAD_SOCKET)
@@ -355,6 +574,22 @@ void tr_udpUninit(tr_session* ss)
 {
     tr_dhtUninit(ss);
 
+    if (ss->udp_send_queue != nullptr)
+    {
+        ss->udp_send_queue->flush(ss->udp_stats);
+        delete ss->udp_send_queue;
+        ss->udp_send_queue = nullptr;
+    }
+
+    if (ss->udp_flush_event != nullptr)
+    {
+        event_free(ss->udp_flush_event);
+        ss->udp_flush_event = nullptr;
+    }
+
+    delete ss->udp_recv_batch;
+    ss->udp_recv_batch = nullptr;
+
     if (ss->udp_socket != TR_BAD_SOCKET)
     {
         tr_netCloseSocket(ss->udp_socket);
@@ -8,14 +8,134 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <array>
 #include <cstddef> // size_t
 #include <cstdint> // uintX_t
+#include <vector>
 
+#include "net.h" // tr_socket_t
+
+struct event;
 struct tr_session;
 
+/**
+ * How many UDP packets went through the session's UDP sockets,
+ * and how many syscalls it took to move them.
+ */
+struct tr_udp_stats
+{
+    uint64_t packets_received = 0;
+    uint64_t receive_calls = 0;
+    uint64_t packets_sent = 0;
+    uint64_t send_calls = 0;
+};
+
+/**
+ * Packets waiting to be sent from the session's UDP sockets.
+ *
+ * uTP, the DHT and UDP trackers all queue their packets here, and the
+ * queue is flushed once per pass of the event loop or whenever it fills
+ * up. Where sendmmsg() is available, each run of packets for the same
+ * socket goes out in a single syscall; elsewhere it's one sendto() each.
+ */
+class tr_udp_send_queue
+{
+public:
+    static auto constexpr MaxPackets = size_t{ 64 };
+    static auto constexpr MaxPacketSize = size_t{ 2048 };
+
+    tr_udp_send_queue()
+        : data_(MaxPackets * MaxPacketSize)
+    {
+    }
+
+    /* Copy a packet into the queue. Returns false if it's too big to be
+     * queued or the queue is full, in which case nothing is copied. */
+    bool push(tr_socket_t sock, void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen);
+
+    /* Send everything that's queued. Packets that can't be sent are dropped,
+     * as they would be anywhere else along the way. Once a socket's send
+     * buffer is full, the rest of its packets are dropped without retrying. */
+    void flush(tr_udp_stats& stats);
+
+    [[nodiscard]] constexpr size_t size() const noexcept
+    {
+        return n_packets_;
+    }
+
+    [[nodiscard]] constexpr bool empty() const noexcept
+    {
+        return n_packets_ == 0;
+    }
+
+    [[nodiscard]] constexpr bool full() const noexcept
+    {
+        return n_packets_ == MaxPackets;
+    }
+
+private:
+    struct Packet
+    {
+        tr_socket_t sock;
+        struct sockaddr_storage to;
+        socklen_t tolen;
+        size_t len;
+    };
+
+    [[nodiscard]] unsigned char* data(size_t i)
+    {
+        return std::data(data_) + i * MaxPacketSize;
+    }
+
+    std::array<Packet, MaxPackets> packets_ = {};
+    std::vector<unsigned char> data_;
+    size_t n_packets_ = 0;
+};
+
+/**
+ * Reads as many packets as are waiting on a UDP socket, up to MaxPackets.
+ * Where recvmmsg() is available that's a single syscall; elsewhere it's
+ * one recvfrom() per read().
+ */
+class tr_udp_recv_batch
+{
+public:
+    static auto constexpr MaxPackets = size_t{ 32 };
+    static auto constexpr MaxPacketSize = size_t{ 4096 };
+
+    struct Packet
+    {
+        unsigned char* buf; /* NUL-terminated; the DHT code needs that */
+        size_t len;
+        struct sockaddr_storage from;
+        socklen_t fromlen;
+    };
+
+    tr_udp_recv_batch()
+        : data_(MaxPackets * MaxPacketSize)
+    {
+    }
+
+    /* Returns how many packets were read. They're valid until the next read(). */
+    size_t read(tr_socket_t sock, tr_udp_stats& stats);
+
+    [[nodiscard]] Packet& operator[](size_t i)
+    {
+        return packets_[i];
+    }
+
+private:
+    std::array<Packet, MaxPackets> packets_ = {};
+    std::vector<unsigned char> data_;
+};
+
 void tr_udpInit(tr_session*);
 void tr_udpUninit(tr_session*);
 void tr_udpSetSocketBuffers(tr_session*);
 void tr_udpSetSocketTOS(tr_session*);
 
+/* Queue a packet to be sent from one of the session's UDP sockets. Returns
+ * buflen if it was queued or sent, or -1 and sets errno if it couldn't be. */
+int tr_udpSendTo(tr_session* session, tr_socket_t sock, void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen);
+
 bool tau_handle_message(tr_session* session, uint8_t const* msg, size_t msglen);
@@ -14,6 +14,7 @@
 #include "crypto-utils.h" /* tr_rand_int_weak() */
 #include "peer-mgr.h"
 #include "peer-socket.h"
+#include "tr-udp.h" /* tr_udpSendTo() */
 #include "tr-utp.h"
 #include "utils.h"
 
@@ -109,15 +110,15 @@ static void incoming(void* vsession, struct UTPSocket* s)
 
 void tr_utpSendTo(void* closure, unsigned char const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen)
 {
-    auto const* const ss = static_cast<tr_session const*>(closure);
+    auto* const ss = static_cast<tr_session*>(closure);
 
     if (to->sa_family == AF_INET && ss->udp_socket != TR_BAD_SOCKET)
     {
-        (void)sendto(ss->udp_socket, reinterpret_cast<char const*>(buf), buflen, 0, to, tolen);
+        (void)tr_udpSendTo(ss, ss->udp_socket, buf, buflen, to, tolen);
     }
     else if (to->sa_family == AF_INET6 && ss->udp6_socket != TR_BAD_SOCKET)
     {
-        (void)sendto(ss->udp6_socket, reinterpret_cast<char const*>(buf), buflen, 0, to, tolen);
+        (void)tr_udpSendTo(ss, ss->udp6_socket, buf, buflen, to, tolen);
     }
 }
 
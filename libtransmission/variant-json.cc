@@ -478,54 +478,39 @@ static void jsonPopParent(struct jsonWalk* data)
     data->parents.pop_back();
 }
 
-static void jsonIntFunc(tr_variant const* val, void* vdata)
+static void jsonAddInt(struct evbuffer* out, int64_t i)
 {
-    auto* data = static_cast<struct jsonWalk*>(vdata);
-    evbuffer_add_printf(data->out, "%" PRId64, val->val.i);
-    jsonChildFunc(data);
+    evbuffer_add_printf(out, "%" PRId64, i);
 }
 
-static void jsonBoolFunc(tr_variant const* val, void* vdata)
+static void jsonAddBool(struct evbuffer* out, bool b)
 {
-    auto* data = static_cast<struct jsonWalk*>(vdata);
-
-    if (val->val.b)
+    if (b)
     {
-        evbuffer_add(data->out, "true", 4);
+        evbuffer_add(out, "true", 4);
     }
     else
     {
-        evbuffer_add(data->out, "false", 5);
+        evbuffer_add(out, "false", 5);
     }
-
-    jsonChildFunc(data);
 }
 
-static void jsonRealFunc(tr_variant const* val, void* vdata)
+static void jsonAddReal(struct evbuffer* out, double d)
 {
-    auto* data = static_cast<struct jsonWalk*>(vdata);
-
-    if (fabs(val->val.d - (int)val->val.d) < 0.00001)
+    if (fabs(d - (int)d) < 0.00001)
     {
-        evbuffer_add_printf(data->out, "%d", (int)val->val.d);
+        evbuffer_add_printf(out, "%d", (int)d);
     }
     else
     {
-        evbuffer_add_printf(data->out, "%.4f", tr_truncd(val->val.d, 4));
+        evbuffer_add_printf(out, "%.4f", tr_truncd(d, 4));
     }
-
-    jsonChildFunc(data);
 }
 
-static void jsonStringFunc(tr_variant const* val, void* vdata)
+static void jsonAddString(struct evbuffer* evout, std::string_view sv)
 {
     struct evbuffer_iovec vec[1];
-    auto* data = static_cast<struct jsonWalk*>(vdata);
-
-    auto sv = std::string_view{};
-    (void)!tr_variantGetStrView(val, &sv);
-
-    evbuffer_reserve_space(data->out, std::size(sv) * 4, vec, 1);
+    evbuffer_reserve_space(evout, std::size(sv) * 6 + 2, vec, 1);
     auto* out = static_cast<char*>(vec[0].iov_base);
     char const* const outend = out + vec[0].iov_len;
 
@@ -598,7 +583,37 @@ static void jsonStringFunc(tr_variant const* val, void* vdata)
 
     *outwalk++ = '"';
     vec[0].iov_len = outwalk - out;
-    evbuffer_commit_space(data->out, vec, 1);
+    evbuffer_commit_space(evout, vec, 1);
+}
+
+static void jsonIntFunc(tr_variant const* val, void* vdata)
+{
+    auto* data = static_cast<struct jsonWalk*>(vdata);
+    jsonAddInt(data->out, val->val.i);
+    jsonChildFunc(data);
+}
+
+static void jsonBoolFunc(tr_variant const* val, void* vdata)
+{
+    auto* data = static_cast<struct jsonWalk*>(vdata);
+    jsonAddBool(data->out, val->val.b);
+    jsonChildFunc(data);
+}
+
+static void jsonRealFunc(tr_variant const* val, void* vdata)
+{
+    auto* data = static_cast<struct jsonWalk*>(vdata);
+    jsonAddReal(data->out, val->val.d);
+    jsonChildFunc(data);
+}
+
+static void jsonStringFunc(tr_variant const* val, void* vdata)
+{
+    auto* data = static_cast<struct jsonWalk*>(vdata);
+
+    auto sv = std::string_view{};
+    (void)!tr_variantGetStrView(val, &sv);
+    jsonAddString(data->out, sv);
 
     jsonChildFunc(data);
 }
@@ -668,9 +683,101 @@ void tr_variantToBufJson(tr_variant const* top, struct evbuffer* buf, bool lean)
     data.out = buf;
 
     tr_variantWalk(top, &walk_funcs, &data, true);
+}
+
+/***
+****
+***/
+
+void tr_variant_json_writer::beforeValue()
+{
+    if (std::empty(containers_))
+    {
+        return;
+    }
+
+    // dict children are separated by key()
+    auto& parent = containers_.back();
+    if (!parent.is_dict)
+    {
+        if (parent.has_children)
+        {
+            evbuffer_add(out_, ",", 1);
+        }
+
+        parent.has_children = true;
+    }
+}
+
+void tr_variant_json_writer::startDict()
+{
+    beforeValue();
+    containers_.push_back({ true, false });
+    evbuffer_add(out_, "{", 1);
+}
+
+void tr_variant_json_writer::startList()
+{
+    beforeValue();
+    containers_.push_back({ false, false });
+    evbuffer_add(out_, "[", 1);
+}
+
+void tr_variant_json_writer::end()
+{
+    TR_ASSERT(!std::empty(containers_));
+
+    evbuffer_add(out_, containers_.back().is_dict ? "}" : "]", 1);
+    containers_.pop_back();
 
-    if (evbuffer_get_length(buf) != 0)
+    if (std::empty(containers_))
     {
-        evbuffer_add_printf(buf, "\n");
+        evbuffer_add(out_, "\n", 1);
     }
 }
+
+void tr_variant_json_writer::key(tr_quark key)
+{
+    TR_ASSERT(!std::empty(containers_));
+    TR_ASSERT(containers_.back().is_dict);
+
+    auto& parent = containers_.back();
+    if (parent.has_children)
+    {
+        evbuffer_add(out_, ",", 1);
+    }
+
+    parent.has_children = true;
+    jsonAddString(out_, tr_quark_get_string_view(key));
+    evbuffer_add(out_, ":", 1);
+}
+
+void tr_variant_json_writer::addInt(int64_t value)
+{
+    beforeValue();
+    jsonAddInt(out_, value);
+}
+
+void tr_variant_json_writer::addBool(bool value)
+{
+    beforeValue();
+    jsonAddBool(out_, value);
+}
+
+void tr_variant_json_writer::addReal(double value)
+{
+    beforeValue();
+    jsonAddReal(out_, value);
+}
+
+void tr_variant_json_writer::addStr(std::string_view value)
+{
+    beforeValue();
+    jsonAddString(out_, value);
+}
+
+void tr_variant_json_writer::addVariant(tr_variant const* value)
+{
+    beforeValue();
+    tr_variantToBufJson(value, out_, true);
+}
@@ -226,16 +226,196 @@ static constexpr char const* getStr(tr_variant const* v)
     return tr_variant_string_get_string(&v->val.s);
 }
 
+/***
+****  Dict index
+****
+****  Finding a key in a dict is a linear scan, which gets expensive for
+****  big dicts such as a torrent-get response or a long settings file.
+****  So the first time a dict with at least DictIndexThreshold children
+****  is searched, it gets a hash table of its keys. After that the table
+****  is kept up to date by tr_variantDictAdd() and tr_variantDictRemove().
+***/
+
+static auto constexpr DictIndexThreshold = size_t{ 16 };
+
+// An open-addressing hash table with linear probing.
+// Each slot holds a child's position in `vals` plus one; zero means empty.
+struct tr_variant_dict_index
+{
+    std::vector<uint32_t> slots;
+
+    // how many slots are in use
+    size_t count = 0;
+
+    // if a key appears more than once, only its first child is indexed,
+    // matching the linear scan
+    bool has_duplicate_keys = false;
+};
+
+static size_t dictIndexHome(tr_variant_dict_index const* index, tr_quark const key)
+{
+    // quarks are small sequential integers; spread them out
+    return (key * size_t{ 0x9E3779B1U }) & (std::size(index->slots) - 1);
+}
+
+// returns the slot holding `key`, or the empty slot where it would go
+static size_t dictIndexFindSlot(tr_variant const* dict, tr_quark const key)
+{
+    auto const* const index = dict->val.l.index;
+    auto const mask = std::size(index->slots) - 1;
+
+    for (auto slot = dictIndexHome(index, key);; slot = (slot + 1) & mask)
+    {
+        auto const pos = index->slots[slot];
+
+        if (pos == 0 || dict->val.l.vals[pos - 1].key == key)
+        {
+            return slot;
+        }
+    }
+}
+
+static void dictIndexInsert(tr_variant* dict, size_t pos)
+{
+    auto* const index = dict->val.l.index;
+    auto& slot = index->slots[dictIndexFindSlot(dict, dict->val.l.vals[pos].key)];
+
+    if (slot != 0)
+    {
+        index->has_duplicate_keys = true;
+        return;
+    }
+
+    slot = static_cast<uint32_t>(pos + 1);
+    ++index->count;
+}
+
+static void dictIndexBuild(tr_variant* dict)
+{
+    auto& index = dict->val.l.index;
+
+    if (index == nullptr)
+    {
+        index = new tr_variant_dict_index{};
+    }
+
+    // keep the table at most half full
+    auto n_slots = size_t{ DictIndexThreshold * 2 };
+
+    while (n_slots < dict->val.l.count * 2)
+    {
+        n_slots *= 2;
+    }
+
+    index->slots.assign(n_slots, 0);
+    index->count = 0;
+    index->has_duplicate_keys = false;
+
+    for (size_t i = 0, n = dict->val.l.count; i < n; ++i)
+    {
+        dictIndexInsert(dict, i);
+    }
+}
+
+static void dictIndexFree(tr_variant* dict)
+{
+    delete dict->val.l.index;
+    dict->val.l.index = nullptr;
+}
+
+// call after the child at `pos` has been appended to the dict
+static void dictIndexOnAdd(tr_variant* dict, size_t pos)
+{
+    auto const* const index = dict->val.l.index;
+
+    if (index == nullptr)
+    {
+        return;
+    }
+
+    // grow once the table is three-quarters full
+    if ((index->count + 1) * 4 > std::size(index->slots) * 3)
+    {
+        dictIndexBuild(dict);
+    }
+    else
+    {
+        dictIndexInsert(dict, pos);
+    }
+}
+
+// call before the child at `pos` is removed by moving the last child into its place
+static void dictIndexOnRemove(tr_variant* dict, size_t pos)
+{
+    auto* const index = dict->val.l.index;
+
+    if (index == nullptr)
+    {
+        return;
+    }
+
+    // removing a duplicate's first copy would expose the next one,
+    // which isn't indexed. Let the index get rebuilt when it's needed.
+    if (index->has_duplicate_keys)
+    {
+        dictIndexFree(dict);
+        return;
+    }
+
+    auto& slots = index->slots;
+    auto const mask = std::size(slots) - 1;
+    auto const* const vals = dict->val.l.vals;
+
+    // backward-shift deletion: pull later entries in the probe run
+    // into the hole unless that would move them before their home slot
+    auto hole = dictIndexFindSlot(dict, vals[pos].key);
+    TR_ASSERT(slots[hole] == pos + 1);
+
+    for (auto next = (hole + 1) & mask; slots[next] != 0; next = (next + 1) & mask)
+    {
+        auto const home = dictIndexHome(index, vals[slots[next] - 1].key);
+
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+
+    slots[hole] = 0;
+    --index->count;
+
+    // the last child is about to move into `pos`
+    if (auto const last = dict->val.l.count - 1; pos != last)
+    {
+        slots[dictIndexFindSlot(dict, vals[last].key)] = static_cast<uint32_t>(pos + 1);
+    }
+}
+
 static int dictIndexOf(tr_variant const* dict, tr_quark const key)
 {
-    if (tr_variantIsDict(dict))
+    if (!tr_variantIsDict(dict))
     {
-        for (size_t i = 0; i < dict->val.l.count; ++i)
+        return -1;
+    }
+
+    if (dict->val.l.index == nullptr && dict->val.l.count >= DictIndexThreshold)
+    {
+        // the index is a cache, so building it doesn't change the dict
+        dictIndexBuild(const_cast<tr_variant*>(dict));
+    }
+
+    if (dict->val.l.index != nullptr)
+    {
+        auto const pos = dict->val.l.index->slots[dictIndexFindSlot(dict, key)];
+        return pos == 0 ? -1 : (int)(pos - 1);
+    }
+
+    for (size_t i = 0; i < dict->val.l.count; ++i)
+    {
+        if (dict->val.l.vals[i].key == key)
         {
-            if (dict->val.l.vals[i].key == key)
-            {
-                return (int)i;
-            }
+            return (int)i;
         }
     }
 
@@ -625,6 +805,7 @@ tr_variant* tr_variantDictAdd(tr_variant* dict, tr_quark const key)
     ++dict->val.l.count;
     val->key = key;
     tr_variantInit(val, TR_VARIANT_TYPE_INT);
+    dictIndexOnAdd(dict, dict->val.l.count - 1);
 
     return val;
 }
@@ -735,6 +916,7 @@ bool tr_variantDictRemove(tr_variant* dict, tr_quark const key)
     {
         int const last = (int)dict->val.l.count - 1;
 
+        dictIndexOnRemove(dict, i);
         tr_variantFree(&dict->val.l.vals[i]);
 
         if (i != last)
@@ -991,6 +1173,7 @@ static void freeStringFunc(tr_variant const* v, void* /*user_data*/)
 static void freeContainerEndFunc(tr_variant const* v, void* /*user_data*/)
 {
     tr_free(v->val.l.vals);
+    delete v->val.l.index;
 }
 
 static struct VariantWalkFuncs const freeWalkFuncs = {
@@ -1186,11 +1369,14 @@ struct evbuffer* tr_variantToBuf(tr_variant const* v, tr_variant_fmt fmt)
         break;
 
     case TR_VARIANT_FMT_JSON:
-        tr_variantToBufJson(v, buf, false);
-        break;
-
     case TR_VARIANT_FMT_JSON_LEAN:
-        tr_variantToBufJson(v, buf, true);
+        tr_variantToBufJson(v, buf, fmt == TR_VARIANT_FMT_JSON_LEAN);
+
+        if (evbuffer_get_length(buf) != 0)
+        {
+            evbuffer_add(buf, "\n", 1);
+        }
+
         break;
     }
 
@@ -1199,6 +1385,19 @@ struct evbuffer* tr_variantToBuf(tr_variant const* v, tr_variant_fmt fmt)
     return buf;
 }
 
+tr_variant_json_writer::tr_variant_json_writer(struct evbuffer* out)
+    : out_{ out }
+    , locale_{ std::make_unique<locale_context>() }
+{
+    /* write with LC_NUMERIC="C" to ensure a "." decimal separator */
+    use_numeric_locale(locale_.get(), "C");
+}
+
+tr_variant_json_writer::~tr_variant_json_writer()
+{
+    restore_locale(locale_.get());
+}
+
 std::string tr_variantToStr(tr_variant const* v, tr_variant_fmt fmt)
 {
     return evbuffer_free_to_str(tr_variantToBuf(v, fmt));
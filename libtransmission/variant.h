@@ -7,8 +7,10 @@
 
 #include <cinttypes> // int64_t
 #include <cstddef> // size_t
+#include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "quark.h"
 
@@ -50,6 +52,8 @@ struct tr_variant_string
     } str;
 };
 
+struct tr_variant_dict_index;
+
 /* these are PRIVATE IMPLEMENTATION details that should not be touched.
  * I'll probably change them just to break your code! HA HA HA!
  * it's included in the header for inlining and composition */
@@ -87,6 +91,10 @@ struct tr_variant
             size_t alloc;
             size_t count;
             struct tr_variant* vals;
+
+            /* dicts only: a hash index of the keys in `vals`, built
+             * the first time a big dict is searched. May be nullptr. */
+            struct tr_variant_dict_index* index;
         } l;
     } val = {};
 };
@@ -110,6 +118,50 @@ std::string tr_variantToStr(tr_variant const* variant, tr_variant_fmt fmt);
 
 struct evbuffer* tr_variantToBuf(tr_variant const* variant, tr_variant_fmt fmt);
 
+struct locale_context;
+
+/**
+ * Writes lean JSON straight into a buffer, for documents that are too big
+ * to be worth building as a tr_variant first. The output is the same that
+ * tr_variantToBuf(TR_VARIANT_FMT_JSON_LEAN) gives for the equivalent tree,
+ * provided that each dict's keys are written in sorted order.
+ */
+class tr_variant_json_writer
+{
+public:
+    explicit tr_variant_json_writer(struct evbuffer* out);
+    ~tr_variant_json_writer();
+
+    tr_variant_json_writer(tr_variant_json_writer const&) = delete;
+    tr_variant_json_writer& operator=(tr_variant_json_writer const&) = delete;
+
+    void startDict();
+    void startList();
+    void end();
+
+    // in a dict, this must come before each child
+    void key(tr_quark key);
+
+    void addInt(int64_t value);
+    void addBool(bool value);
+    void addReal(double value);
+    void addStr(std::string_view value);
+    void addVariant(tr_variant const* value);
+
+private:
+    struct Container
+    {
+        bool is_dict;
+        bool has_children;
+    };
+
+    void beforeValue();
+
+    struct evbuffer* const out_;
+    std::unique_ptr<locale_context> locale_;
+    std::vector<Container> containers_;
+};
+
 enum tr_variant_parse_opts
 {
     TR_VARIANT_PARSE_BENC = (1 << 0),
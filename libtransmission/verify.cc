@@ -4,18 +4,25 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
-#include <ctime>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <set>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 #include "transmission.h"
 #include "completion.h"
-#include "crypto-utils.h"
 #include "file.h"
 #include "log.h"
+#include "session.h"
+#include "sha1.h"
 #include "torrent.h"
 #include "tr-assert.h"
 #include "utils.h" /* tr_malloc(), tr_free() */
@@ -25,131 +32,374 @@
 ****
 ***/
 
-static auto constexpr MsecToSleepPerSecondDuringVerify = int{ 100 };
+namespace
+{
 
-static bool verifyTorrent(tr_torrent* tor, bool const* stopFlag)
+// Hashes pieces on a small pool of worker threads so that verification
+// isn't bottlenecked on a single core. The verify thread reads each piece
+// into one of a fixed number of buffers and hands it off; since there are
+// more buffers than workers, reads stay ahead of the hashing. When
+// tr_sha1_many() can hash several pieces at once, workers wait for a
+// full batch unless the reader has run out of buffers or is finishing.
+// The buffers hold whole pieces, so their number is capped by
+// MaxBufferBytes, and with big pieces there may be fewer workers too.
+class PieceHasher
 {
-    auto const begin = tr_time();
-
-    tr_sys_file_t fd = TR_BAD_SYS_FILE;
-    uint64_t filePos = 0;
-    bool changed = false;
-    bool hadPiece = false;
-    time_t lastSleptAt = 0;
-    uint32_t piecePos = 0;
-    tr_file_index_t fileIndex = 0;
-    tr_file_index_t prevFileIndex = ~fileIndex;
-    tr_piece_index_t piece = 0;
-    auto buffer = std::vector<std::byte>(1024 * 256);
-    auto sha = tr_sha1_init();
-
-    tr_logAddTorDbg(tor, "%s", "verifying torrent...");
-    tor->verify_progress = 0;
+public:
+    struct Job
+    {
+        tr_piece_index_t piece = 0;
+        std::vector<std::byte> buf;
+        bool is_readable = false;
+        bool has_piece = false;
+    };
 
-    while (!*stopFlag && piece < tor->pieceCount())
+    using done_func = std::function<void(Job const&)>;
+
+    static auto constexpr MaxBufferBytes = uint64_t{ 64 * 1024 * 1024 };
+
+    PieceHasher(tr_torrent const* tor, size_t n_workers)
+        : tor_{ tor }
+        , batch_size_{ tr_sha1_many_width() }
     {
-        auto const file_length = tor->fileSize(fileIndex);
+        // room for a full batch to build up while every worker is busy,
+        // but at least one buffer to read into while another is hashed
+        auto const piece_size = std::max(uint64_t{ tor->pieceSize() }, uint64_t{ 1 });
+        auto const max_buffers = std::max(MaxBufferBytes / piece_size, uint64_t{ 2 });
+        auto const n_buffers = size_t(std::min(uint64_t{ n_workers + std::max(n_workers, batch_size_) }, max_buffers));
+        n_workers = std::clamp(n_workers, size_t{ 1 }, n_buffers - 1);
+
+        for (size_t i = 0; i < n_buffers; ++i)
+        {
+            free_.push_back(std::make_unique<Job>());
+        }
 
-        /* if we're starting a new piece... */
-        if (piecePos == 0)
+        for (size_t i = 0; i < n_workers; ++i)
         {
-            hadPiece = tor->hasPiece(piece);
+            workers_.emplace_back(&PieceHasher::workerFunc, this);
         }
+    }
+
+    PieceHasher(PieceHasher const&) = delete;
+    PieceHasher& operator=(PieceHasher const&) = delete;
 
-        /* if we're starting a new file... */
-        if (filePos == 0 && fd == TR_BAD_SYS_FILE && fileIndex != prevFileIndex)
+    ~PieceHasher()
+    {
         {
-            char* const filename = tr_torrentFindFile(tor, fileIndex);
-            fd = filename == nullptr ? TR_BAD_SYS_FILE :
-                                       tr_sys_file_open(filename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, nullptr);
-            tr_free(filename);
-            prevFileIndex = fileIndex;
+            auto const lock = std::lock_guard(mutex_);
+            is_closing_ = true;
+        }
+
+        todo_cv_.notify_all();
+
+        for (auto& worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    // Get an empty buffer to read a piece into, waiting for one if they're all in use.
+    // Any pieces that finished hashing in the meantime are passed to `on_done`.
+    std::unique_ptr<Job> acquire(done_func const& on_done)
+    {
+        auto lock = std::unique_lock(mutex_);
+
+        // the workers may be holding out for a full batch that will
+        // never come, since every buffer is already queued
+        if (std::empty(free_))
+        {
+            todo_cv_.notify_all();
         }
 
-        /* figure out how much we can read this pass */
-        uint64_t leftInPiece = tor->pieceSize(piece) - piecePos;
-        uint64_t leftInFile = file_length - filePos;
-        uint64_t bytesThisPass = std::min(leftInFile, leftInPiece);
-        bytesThisPass = std::min(bytesThisPass, uint64_t(std::size(buffer)));
+        done_cv_.wait(lock, [this]() { return !std::empty(free_) || !std::empty(done_); });
+        collect(lock, on_done);
+
+        auto job = std::move(free_.back());
+        free_.pop_back();
+        return job;
+    }
+
+    void submit(std::unique_ptr<Job> job)
+    {
+        {
+            auto const lock = std::lock_guard(mutex_);
+            todo_.push_back(std::move(job));
+            ++n_pending_;
+        }
+
+        todo_cv_.notify_one();
+    }
+
+    // Wait for all the submitted pieces to be hashed and passed to `on_done`.
+    void finish(done_func const& on_done)
+    {
+        auto lock = std::unique_lock(mutex_);
+        is_flushing_ = true;
+        todo_cv_.notify_all();
+
+        while (n_pending_ > 0)
+        {
+            done_cv_.wait(lock, [this]() { return !std::empty(done_); });
+            collect(lock, on_done);
+        }
+    }
 
-        /* read a bit */
-        if (fd != TR_BAD_SYS_FILE)
+private:
+    void collect(std::unique_lock<std::mutex>& lock, done_func const& on_done)
+    {
+        while (!std::empty(done_))
         {
-            auto numRead = uint64_t{};
-            if (tr_sys_file_read_at(fd, std::data(buffer), bytesThisPass, filePos, &numRead, nullptr) && numRead > 0)
+            auto done = std::move(done_);
+            done_.clear();
+            n_pending_ -= std::size(done);
+
+            lock.unlock();
+            for (auto const& job : done)
             {
-                bytesThisPass = numRead;
-                tr_sha1_update(sha, std::data(buffer), bytesThisPass);
-                tr_sys_file_advise(fd, filePos, bytesThisPass, TR_SYS_FILE_ADVICE_DONT_NEED, nullptr);
+                on_done(*job);
             }
+            lock.lock();
+
+            std::move(std::begin(done), std::end(done), std::back_inserter(free_));
         }
+    }
 
-        /* move our offsets */
-        leftInPiece -= bytesThisPass;
-        leftInFile -= bytesThisPass;
-        piecePos += bytesThisPass;
-        filePos += bytesThisPass;
+    void workerFunc()
+    {
+        auto lock = std::unique_lock(mutex_);
 
-        /* if we're finishing a piece... */
-        if (leftInPiece == 0)
+        for (;;)
         {
-            auto hash = tr_sha1_final(sha);
-            auto const hasPiece = hash && *hash == tor->pieceHash(piece);
+            todo_cv_.wait(lock, [this]() { return is_closing_ || isBatchReady(); });
+            if (std::empty(todo_))
+            {
+                return;
+            }
 
-            if (hasPiece || hadPiece)
+            // take as many pieces as tr_sha1_many() can hash at once
+            auto batch = std::vector<std::unique_ptr<Job>>{};
+            while (!std::empty(todo_) && std::size(batch) < batch_size_)
             {
-                tor->setHasPiece(piece, hasPiece);
-                changed |= hasPiece != hadPiece;
+                batch.push_back(std::move(todo_.front()));
+                todo_.pop_front();
             }
 
-            tor->checked_pieces_.set(piece, true);
-            tor->markChanged();
+            lock.unlock();
+            hash(batch);
+            lock.lock();
+
+            std::move(std::begin(batch), std::end(batch), std::back_inserter(done_));
+            done_cv_.notify_one();
+        }
+    }
+
+    [[nodiscard]] bool isBatchReady() const
+    {
+        if (std::empty(todo_))
+        {
+            return false;
+        }
+
+        return std::size(todo_) >= batch_size_ || is_flushing_ || std::empty(free_);
+    }
 
-            /* sleeping even just a few msec per second goes a long
-             * way towards reducing IO load... */
-            if (auto const now = tr_time(); lastSleptAt != now)
+    void hash(std::vector<std::unique_ptr<Job>> const& batch) const
+    {
+        // don't bother hashing a piece we couldn't read
+        auto jobs = std::vector<Job*>{};
+        auto bufs = std::vector<std::string_view>{};
+        for (auto const& job : batch)
+        {
+            job->has_piece = false;
+
+            if (job->is_readable)
             {
-                lastSleptAt = now;
-                tr_wait_msec(MsecToSleepPerSecondDuringVerify);
+                jobs.push_back(job.get());
+                bufs.emplace_back(reinterpret_cast<char const*>(std::data(job->buf)), std::size(job->buf));
             }
+        }
 
-            sha = tr_sha1_init();
-            ++piece;
-            tor->verify_progress = piece / double(tor->pieceCount());
-            piecePos = 0;
+        auto hashes = std::vector<tr_sha1_digest_t>(std::size(bufs));
+        tr_sha1_many(std::data(bufs), std::size(bufs), std::data(hashes));
+
+        for (size_t i = 0, n = std::size(jobs); i < n; ++i)
+        {
+            jobs[i]->has_piece = hashes[i] == tor_->pieceHash(jobs[i]->piece);
         }
+    }
 
-        /* if we're finishing a file... */
-        if (leftInFile == 0)
+    tr_torrent const* const tor_;
+    size_t const batch_size_;
+
+    std::mutex mutex_;
+    std::condition_variable todo_cv_;
+    std::condition_variable done_cv_;
+    std::deque<std::unique_ptr<Job>> todo_;
+    std::vector<std::unique_ptr<Job>> done_;
+    std::vector<std::unique_ptr<Job>> free_;
+    size_t n_pending_ = 0;
+    bool is_flushing_ = false;
+    bool is_closing_ = false;
+
+    std::vector<std::thread> workers_;
+};
+
+// Reads a torrent's pieces in order, keeping the current file open between calls.
+class PieceReader
+{
+public:
+    explicit PieceReader(tr_torrent const* tor)
+        : tor_{ tor }
+    {
+    }
+
+    PieceReader(PieceReader const&) = delete;
+    PieceReader& operator=(PieceReader const&) = delete;
+
+    ~PieceReader()
+    {
+        closeFile();
+    }
+
+    // Returns false if any of the piece couldn't be read.
+    bool read(tr_piece_index_t piece, std::vector<std::byte>& setme)
+    {
+        auto const piece_size = tor_->pieceSize(piece);
+        setme.resize(piece_size);
+
+        auto [file_index, file_pos] = tor_->fileOffset(piece, 0);
+        auto ok = true;
+
+        for (uint64_t piece_pos = 0; piece_pos < piece_size; ++file_index, file_pos = 0)
         {
-            if (fd != TR_BAD_SYS_FILE)
+            auto const left_in_file = tor_->fileSize(file_index) - file_pos;
+            auto const n_bytes = std::min(left_in_file, piece_size - piece_pos);
+            if (n_bytes == 0)
             {
-                tr_sys_file_close(fd, nullptr);
-                fd = TR_BAD_SYS_FILE;
+                continue;
             }
 
-            fileIndex++;
-            filePos = 0;
+            auto const fd = openFile(file_index);
+            auto n_read = uint64_t{};
+            if (fd == TR_BAD_SYS_FILE || !tr_sys_file_read_at(fd, &setme[piece_pos], n_bytes, file_pos, &n_read, nullptr) ||
+                n_read != n_bytes)
+            {
+                ok = false;
+            }
+            else
+            {
+                tr_sys_file_advise(fd, file_pos, n_bytes, TR_SYS_FILE_ADVICE_DONT_NEED, nullptr);
+            }
+
+            piece_pos += n_bytes;
+        }
+
+        return ok;
+    }
+
+private:
+    tr_sys_file_t openFile(tr_file_index_t file_index)
+    {
+        if (file_index != fd_index_)
+        {
+            closeFile();
+
+            char* const filename = tr_torrentFindFile(tor_, file_index);
+            fd_ = filename == nullptr ? TR_BAD_SYS_FILE :
+                                        tr_sys_file_open(filename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, nullptr);
+            fd_index_ = file_index;
+            tr_free(filename);
+        }
+
+        return fd_;
+    }
+
+    void closeFile()
+    {
+        if (fd_ != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd_, nullptr);
+            fd_ = TR_BAD_SYS_FILE;
         }
     }
 
-    /* cleanup */
-    if (fd != TR_BAD_SYS_FILE)
+    tr_torrent const* const tor_;
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+    tr_file_index_t fd_index_ = ~tr_file_index_t{};
+};
+
+} // namespace
+
+size_t tr_verifyThreadCount(tr_session const* session)
+{
+    auto const n_cores = size_t{ std::max(std::thread::hardware_concurrency(), 1U) };
+
+    if (session->verifyThreads > 0)
+    {
+        return std::min(size_t(session->verifyThreads), n_cores);
+    }
+
+    // a few threads is plenty to keep up with one disk
+    static auto constexpr MaxAutoThreads = size_t{ 4 };
+    return std::min(n_cores, MaxAutoThreads);
+}
+
+static bool verifyTorrent(tr_torrent* tor, bool const* stopFlag)
+{
+    auto const begin = tr_time_msec();
+    auto const n_threads = tr_verifyThreadCount(tor->session);
+    auto throttle = tr_verify_throttle{ tr_toSpeedBytes(tor->session->verifySpeedLimit_KBps), begin };
+    auto n_checked = tr_piece_index_t{};
+    auto changed = false;
+
+    tr_logAddTorDbg(tor, "verifying torrent with %zu threads...", n_threads);
+    tor->verify_progress = 0;
+
+    auto const on_done = [tor, &n_checked, &changed](PieceHasher::Job const& job)
     {
-        tr_sys_file_close(fd, nullptr);
+        auto const had_piece = tor->hasPiece(job.piece);
+
+        if (job.has_piece || had_piece)
+        {
+            tor->setHasPiece(job.piece, job.has_piece);
+            changed |= job.has_piece != had_piece;
+        }
+
+        tor->checked_pieces_.set(job.piece, true);
+        tor->markChanged();
+
+        ++n_checked;
+        tor->verify_progress = n_checked / double(tor->pieceCount());
+    };
+
+    auto reader = PieceReader{ tor };
+    auto hasher = PieceHasher{ tor, n_threads };
+
+    for (tr_piece_index_t piece = 0; !*stopFlag && piece < tor->pieceCount(); ++piece)
+    {
+        auto job = hasher.acquire(on_done);
+        job->piece = piece;
+        job->is_readable = reader.read(piece, job->buf);
+        hasher.submit(std::move(job));
+
+        // throttle the reads so that verifying doesn't hog the disk
+        if (auto const wait_msec = throttle.add(tor->pieceSize(piece), tr_time_msec()); wait_msec > 0)
+        {
+            tr_wait_msec(wait_msec);
+        }
     }
 
+    hasher.finish(on_done);
     tor->verify_progress.reset();
-    tr_sha1_final(sha);
 
     /* stopwatch */
-    time_t const end = tr_time();
+    auto const elapsed_msec = tr_time_msec() - begin;
     tr_logAddTorDbg(
         tor,
-        "Verification is done. It took %d seconds to verify %" PRIu64 " bytes (%" PRIu64 " bytes per second)",
-        (int)(end - begin),
-        tor->totalSize(),
-        (uint64_t)(tor->totalSize() / (1 + (end - begin))));
+        "Verification is done. It took %" PRIu64 " msec to verify %" PRIu64 " bytes (%" PRIu64 " bytes per second)",
+        elapsed_msec,
+        throttle.bytesRead(),
+        throttle.bytesRead() * 1000 / (1 + elapsed_msec));
 
     return changed;
 }
@@ -9,6 +9,9 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+
 struct tr_session;
 struct tr_torrent;
 
@@ -25,4 +28,50 @@ void tr_verifyRemove(tr_torrent* tor);
 
 void tr_verifyClose(tr_session*);
 
+/**
+ * How many threads will hash pieces, given the session's verify-threads
+ * setting. The setting is capped at the number of cores, since more
+ * hashing threads than that would just contend with each other.
+ */
+size_t tr_verifyThreadCount(tr_session const* session);
+
+/**
+ * Paces a verify's reads so that they average out to `bytes_per_second`,
+ * measured from when the verify began. 0 means unlimited.
+ */
+class tr_verify_throttle
+{
+public:
+    tr_verify_throttle(uint64_t bytes_per_second, uint64_t begin_msec)
+        : bytes_per_second_{ bytes_per_second }
+        , begin_msec_{ begin_msec }
+    {
+    }
+
+    // Count `n_bytes` more as read by `now_msec`.
+    // Returns how many msec to wait before reading any more.
+    [[nodiscard]] uint64_t add(uint64_t n_bytes, uint64_t now_msec)
+    {
+        bytes_read_ += n_bytes;
+
+        if (bytes_per_second_ == 0)
+        {
+            return 0;
+        }
+
+        auto const target_msec = begin_msec_ + bytes_read_ * 1000 / bytes_per_second_;
+        return target_msec > now_msec ? target_msec - now_msec : 0;
+    }
+
+    [[nodiscard]] constexpr auto bytesRead() const
+    {
+        return bytes_read_;
+    }
+
+private:
+    uint64_t const bytes_per_second_;
+    uint64_t const begin_msec_;
+    uint64_t bytes_read_ = 0;
+};
+
 /* @} */
@@ -5,15 +5,21 @@
 
 #include <algorithm>
 #include <array>
+#include <ctime>
+#include <map>
 #include <string_view>
+#include <vector>
 
 #define LIBTRANSMISSION_ANNOUNCER_MODULE
 
 #include "transmission.h"
 
 #include "announcer-common.h"
+#include "announcer.h"
 #include "crypto-utils.h"
 #include "net.h"
+#include "session.h"
+#include "torrent.h"
 
 #include "test-fixtures.h"
 
@@ -300,3 +306,164 @@ TEST_F(AnnouncerTest, parseHttpScrapeResponseMultiWithMissing)
     EXPECT_EQ(8, response.rows[2].leechers);
     EXPECT_EQ(9, response.rows[2].downloads);
 }
+
+namespace
+{
+
+// stands in for a tr_tier in the tr_tier_queue tests
+struct MockTier
+{
+    tr_tier_queue::Key key;
+    time_t due_at = 0; // 0 means nothing is due
+    bool busy = false;
+};
+
+using MockTiers = std::map<tr_tier_queue::Key, MockTier>;
+
+MockTier& addTier(MockTiers& tiers, int tier_id)
+{
+    auto const key = tr_tier_queue::Key{ 1, tier_id };
+    return tiers.try_emplace(key, MockTier{ key }).first->second;
+}
+
+// what tr_tier::setAnnounceAt() does
+void setDueAt(tr_tier_queue& queue, MockTier& tier, time_t at)
+{
+    tier.due_at = at;
+    queue.schedule(at, tier.key);
+}
+
+// the ids of the tiers that `queue` says to serve at `now`
+std::vector<int> takeReady(tr_tier_queue& queue, MockTiers& tiers, time_t now)
+{
+    auto const ready = queue.takeReady(
+        now,
+        [&tiers](auto const& key)
+        {
+            auto const it = tiers.find(key);
+            return it != std::end(tiers) ? &it->second : nullptr;
+        },
+        [now](auto const* tier) { return tier->due_at != 0 && tier->due_at <= now; },
+        [](auto const* tier) { return !tier->busy; });
+
+    auto ret = std::vector<int>{};
+    for (auto const* tier : ready)
+    {
+        ret.push_back(tier->key.tier_id);
+    }
+    return ret;
+}
+
+} // namespace
+
+TEST_F(AnnouncerTest, tierQueueServesTiersInDeadlineOrder)
+{
+    auto queue = tr_tier_queue{};
+    auto tiers = MockTiers{};
+    setDueAt(queue, addTier(tiers, 1), 30);
+    setDueAt(queue, addTier(tiers, 2), 10);
+    setDueAt(queue, addTier(tiers, 3), 20);
+
+    EXPECT_EQ(std::vector<int>{}, takeReady(queue, tiers, 5));
+    EXPECT_EQ(std::vector<int>{ 2 }, takeReady(queue, tiers, 10));
+    tiers.at({ 1, 2 }).due_at = 0;
+    EXPECT_EQ(std::vector<int>{ 3 }, takeReady(queue, tiers, 25));
+    tiers.at({ 1, 3 }).due_at = 0;
+    EXPECT_EQ(std::vector<int>{ 1 }, takeReady(queue, tiers, 30));
+    tiers.at({ 1, 1 }).due_at = 0;
+    EXPECT_EQ(std::vector<int>{}, takeReady(queue, tiers, 40));
+    EXPECT_TRUE(std::empty(queue.deadlines));
+    EXPECT_TRUE(std::empty(queue.ready));
+}
+
+TEST_F(AnnouncerTest, tierQueueReschedulingReplacesOldDeadline)
+{
+    auto queue = tr_tier_queue{};
+    auto tiers = MockTiers{};
+    auto& tier = addTier(tiers, 1);
+
+    // pushed back: the old deadline doesn't make it due
+    setDueAt(queue, tier, 10);
+    setDueAt(queue, tier, 30);
+    EXPECT_EQ(std::vector<int>{}, takeReady(queue, tiers, 15));
+    EXPECT_TRUE(std::empty(queue.ready));
+    EXPECT_EQ(std::vector<int>{ 1 }, takeReady(queue, tiers, 30));
+
+    // pulled in: it's served once, and the old deadline is ignored
+    setDueAt(queue, tier, 100);
+    setDueAt(queue, tier, 50);
+    EXPECT_EQ(std::vector<int>{ 1 }, takeReady(queue, tiers, 50));
+    setDueAt(queue, tier, 200);
+    EXPECT_EQ(std::vector<int>{}, takeReady(queue, tiers, 100));
+    EXPECT_TRUE(std::empty(queue.ready));
+    EXPECT_EQ(1U, std::size(queue.deadlines));
+}
+
+TEST_F(AnnouncerTest, tierQueueDropsRemovedTiers)
+{
+    auto queue = tr_tier_queue{};
+    auto tiers = MockTiers{};
+    setDueAt(queue, addTier(tiers, 1), 10);
+    setDueAt(queue, addTier(tiers, 2), 10);
+    setDueAt(queue, addTier(tiers, 3), 20);
+
+    // tiers 1 and 3 go away with their torrent
+    tiers.erase({ 1, 1 });
+    tiers.erase({ 1, 3 });
+
+    EXPECT_EQ(std::vector<int>{ 2 }, takeReady(queue, tiers, 20));
+    EXPECT_EQ((std::vector<tr_tier_queue::Key>{ { 1, 2 } }), queue.ready);
+    EXPECT_TRUE(std::empty(queue.deadlines));
+}
+
+TEST_F(AnnouncerTest, tierQueueKeepsBusyTiersReady)
+{
+    auto queue = tr_tier_queue{};
+    auto tiers = MockTiers{};
+    auto& tier = addTier(tiers, 1);
+    setDueAt(queue, tier, 10);
+
+    tier.busy = true;
+    EXPECT_EQ(std::vector<int>{}, takeReady(queue, tiers, 10));
+    EXPECT_EQ(1U, std::size(queue.ready));
+
+    tier.busy = false;
+    EXPECT_EQ(std::vector<int>{ 1 }, takeReady(queue, tiers, 11));
+}
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+using AnnouncerSessionTest = SessionTest;
+
+TEST_F(AnnouncerSessionTest, lagCountersGoUp)
+{
+    auto const get_stats = [this]()
+    {
+        auto const lock = session_->unique_lock();
+        return tr_announcerGetStats(session_->announcer);
+    };
+
+    auto const before = get_stats();
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, true);
+
+    // starting the torrent queues a "started" announce
+    tr_torrentStart(tor);
+    EXPECT_TRUE(waitFor([&]() { return get_stats().tiers_served > before.tiers_served; }, 5000));
+
+    auto const after = get_stats();
+    EXPECT_LE(before.total_lag_msec, after.total_lag_msec);
+    EXPECT_LE(before.max_lag_msec, after.max_lag_msec);
+    EXPECT_LE(after.max_lag_msec, after.total_lag_msec);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
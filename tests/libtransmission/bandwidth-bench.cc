@@ -0,0 +1,186 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "transmission.h"
+
+#include "bandwidth.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+// Simulates a session uploading to many peers, to compare how many write
+// syscalls Bandwidth's scheduler makes with how many the old one made.
+// No sockets are involved: each simulated peer has a send buffer with
+// a random amount of free space, which the network drains every pulse.
+class BandwidthBench : public ::testing::Test
+{
+protected:
+    static auto constexpr PeriodMsec = 500U;
+    static auto constexpr NumPulses = 40;
+
+    struct Peer
+    {
+        Bandwidth bandwidth;
+        size_t torrent = 0;
+        size_t socket_space = 0;
+        uint64_t sent = 0;
+
+        Peer(Bandwidth* parent, size_t torrent_in)
+            : bandwidth{ parent }
+            , torrent{ torrent_in }
+        {
+        }
+    };
+
+    struct Swarm
+    {
+        Bandwidth session;
+        std::vector<std::unique_ptr<Bandwidth>> torrents;
+        std::vector<std::unique_ptr<Peer>> peers;
+        std::unordered_map<Bandwidth const*, Peer*> peer_of;
+        std::vector<Bandwidth*> leaves;
+        std::mt19937 rng{ 0 };
+        size_t n_syscalls = 0;
+
+        Swarm(size_t n_torrents, size_t peers_per_torrent, unsigned int session_limit_bps)
+        {
+            session.setLimited(TR_UP, session_limit_bps != 0);
+            session.setDesiredSpeedBytesPerSecond(TR_UP, session_limit_bps);
+
+            for (size_t i = 0; i < n_torrents; ++i)
+            {
+                auto& tor = torrents.emplace_back(std::make_unique<Bandwidth>(&session));
+                for (size_t j = 0; j < peers_per_torrent; ++j)
+                {
+                    auto& peer = peers.emplace_back(std::make_unique<Peer>(tor.get(), i));
+                    peer_of[&peer->bandwidth] = peer.get();
+                    leaves.push_back(&peer->bandwidth);
+                }
+            }
+        }
+
+        // the network drained some of each socket's send buffer since the last pulse
+        void startPulse()
+        {
+            session.allocate(TR_UP, PeriodMsec);
+
+            auto space = std::uniform_int_distribution<size_t>{ 16 * 1024, 256 * 1024 };
+            for (auto& peer : peers)
+            {
+                peer->socket_space = space(rng);
+            }
+        }
+
+        // what tr_peerIoTryWrite() does, with a peer that always has more to send
+        size_t write(Bandwidth* leaf, size_t max_bytes)
+        {
+            auto* const peer = peer_of[leaf];
+            auto n = size_t{ leaf->clamp(TR_UP, static_cast<unsigned int>(max_bytes)) };
+            if (n == 0)
+            {
+                return 0;
+            }
+
+            ++n_syscalls;
+            n = std::min(n, peer->socket_space);
+            peer->socket_space -= n;
+            peer->sent += n;
+            leaf->notifyBandwidthConsumed(TR_UP, n, true, tr_time_msec());
+            return n;
+        }
+
+        // Jain's fairness index: 1.0 if everyone got the same, 1/n if one got it all
+        template<typename Values>
+        static double fairness(Values const& values)
+        {
+            auto const sum = std::accumulate(std::begin(values), std::end(values), 0.0);
+            auto const sum_sq = std::accumulate(
+                std::begin(values),
+                std::end(values),
+                0.0,
+                [](double acc, auto val) { return acc + double(val) * double(val); });
+            return sum_sq > 0 ? sum * sum / (double(std::size(values)) * sum_sq) : 1.0;
+        }
+
+        void report(char const* name) const
+        {
+            auto per_torrent = std::vector<uint64_t>(std::size(torrents));
+            auto per_peer = std::vector<uint64_t>{};
+            for (auto const& peer : peers)
+            {
+                per_torrent[peer->torrent] += peer->sent;
+                per_peer.push_back(peer->sent);
+            }
+
+            auto const total = std::accumulate(std::begin(per_peer), std::end(per_peer), uint64_t{});
+            std::cout << "    " << name << ": " << n_syscalls / NumPulses << " writes/pulse, "
+                      << total / std::max(n_syscalls, size_t{ 1 }) << " bytes/write, " << total / NumPulses
+                      << " bytes/pulse, fairness " << fairness(per_torrent) << " by torrent, " << fairness(per_peer)
+                      << " by peer" << std::endl;
+        }
+    };
+
+    // the scheduler Bandwidth used before fairQueue(): pick a random
+    // peer and give it 3000 bytes until nobody can use any more
+    static void randomRoundRobin(Swarm& swarm)
+    {
+        auto leaves = swarm.leaves;
+        for (auto n = std::size(leaves); n > 0;)
+        {
+            auto const i = std::uniform_int_distribution<size_t>{ 0, n - 1 }(swarm.rng);
+            if (swarm.write(leaves[i], Bandwidth::MinQuantum) != Bandwidth::MinQuantum)
+            {
+                std::swap(leaves[i], leaves[n - 1]);
+                --n;
+            }
+        }
+    }
+
+    static void fairQueue(Swarm& swarm)
+    {
+        Bandwidth::fairQueue(
+            swarm.leaves,
+            TR_UP,
+            [&swarm](Bandwidth* leaf, size_t max_bytes) { return swarm.write(leaf, max_bytes); });
+    }
+
+    template<typename Scheduler>
+    static void simulate(char const* name, size_t n_torrents, size_t peers_per_torrent, unsigned int limit, Scheduler scheduler)
+    {
+        auto swarm = Swarm{ n_torrents, peers_per_torrent, limit };
+        for (int i = 0; i < NumPulses; ++i)
+        {
+            swarm.startPulse();
+            scheduler(swarm);
+        }
+        swarm.report(name);
+    }
+
+    static void compare(size_t n_torrents, size_t peers_per_torrent, unsigned int limit)
+    {
+        std::cout << "  " << n_torrents << " torrents x " << peers_per_torrent << " peers, "
+                  << (limit != 0 ? std::to_string(limit / 1024) + " KiB/s" : std::string{ "unlimited" }) << std::endl;
+        simulate("random 3000-byte round-robin", n_torrents, peers_per_torrent, limit, randomRoundRobin);
+        simulate("fair queueing", n_torrents, peers_per_torrent, limit, fairQueue);
+    }
+};
+
+TEST_F(BandwidthBench, writesPerPulse)
+{
+    compare(10, 50, 0);
+    compare(10, 50, 10 * 1024 * 1024);
+    compare(100, 50, 50 * 1024 * 1024);
+    compare(5, 1, 1024 * 1024);
+}
@@ -0,0 +1,217 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "transmission.h"
+
+#include "bandwidth.h"
+
+#include "gtest/gtest.h"
+
+class BandwidthTest : public ::testing::Test
+{
+protected:
+    // a leaf that always wants to send more, and whose socket takes whatever it's given
+    static size_t greedyFlush(Bandwidth* leaf, size_t max_bytes, std::map<Bandwidth*, size_t>& sent)
+    {
+        auto const n = leaf->clamp(TR_UP, max_bytes);
+        leaf->notifyBandwidthConsumed(TR_UP, n, true, 0);
+        sent[leaf] += n;
+        return n;
+    }
+};
+
+TEST_F(BandwidthTest, fairQueueSplitsEvenlyByTorrent)
+{
+    auto session = Bandwidth{};
+    session.setLimited(TR_UP, true);
+    session.setDesiredSpeedBytesPerSecond(TR_UP, 100000);
+
+    // one torrent with one peer, another with four
+    auto small = Bandwidth{ &session };
+    auto big = Bandwidth{ &session };
+    auto peers = std::vector<std::unique_ptr<Bandwidth>>{};
+    auto leaves = std::vector<Bandwidth*>{};
+    for (auto* parent : { &small, &big, &big, &big, &big })
+    {
+        leaves.push_back(peers.emplace_back(std::make_unique<Bandwidth>(parent)).get());
+    }
+
+    session.allocate(TR_UP, 1000);
+
+    auto sent = std::map<Bandwidth*, size_t>{};
+    auto const n_flushes = Bandwidth::fairQueue(
+        leaves,
+        TR_UP,
+        [&sent](Bandwidth* leaf, size_t max_bytes) { return greedyFlush(leaf, max_bytes, sent); });
+
+    // each torrent gets half, and big's peers split their half evenly
+    EXPECT_EQ(50000U, sent[leaves[0]]);
+    for (size_t i = 1; i < std::size(leaves); ++i)
+    {
+        EXPECT_EQ(12500U, sent[leaves[i]]);
+    }
+
+    // one round to use the bandwidth, one more to find that it's gone
+    EXPECT_EQ(std::size(leaves) * 2, n_flushes);
+}
+
+TEST_F(BandwidthTest, fairQueueHonorsTorrentLimits)
+{
+    auto session = Bandwidth{};
+
+    auto limited = Bandwidth{ &session };
+    limited.setLimited(TR_UP, true);
+    limited.setDesiredSpeedBytesPerSecond(TR_UP, 8000);
+    auto unlimited = Bandwidth{ &session };
+
+    auto limited_peer = Bandwidth{ &limited };
+    auto unlimited_peer = Bandwidth{ &unlimited };
+    auto const leaves = std::vector<Bandwidth*>{ &limited_peer, &unlimited_peer };
+
+    session.allocate(TR_UP, 1000);
+
+    // the unlimited peer's socket fills up after a few big writes
+    auto sent = std::map<Bandwidth*, size_t>{};
+    Bandwidth::fairQueue(
+        leaves,
+        TR_UP,
+        [&sent, &unlimited_peer](Bandwidth* leaf, size_t max_bytes)
+        {
+            if (leaf == &unlimited_peer && sent[leaf] >= 3 * Bandwidth::MaxQuantum)
+            {
+                return size_t{};
+            }
+
+            return greedyFlush(leaf, max_bytes, sent);
+        });
+
+    EXPECT_EQ(8000U, sent[&limited_peer]);
+    EXPECT_EQ(3 * Bandwidth::MaxQuantum, sent[&unlimited_peer]);
+}
+
+TEST_F(BandwidthTest, overdraftComesOutOfLaterPeriods)
+{
+    auto session = Bandwidth{};
+    auto torrent = Bandwidth{ &session };
+    torrent.setLimited(TR_UP, true);
+    torrent.setDesiredSpeedBytesPerSecond(TR_UP, 8000);
+    auto peer = Bandwidth{ &torrent };
+
+    session.allocate(TR_UP, 1000);
+    EXPECT_EQ(8000U, peer.clamp(TR_UP, 100000));
+
+    // a file segment that couldn't be split went 12000 bytes over budget...
+    peer.notifyBandwidthConsumed(TR_UP, 20000, true, 0, true);
+    EXPECT_EQ(0U, peer.clamp(TR_UP, 100000));
+
+    // ...so the next period has nothing left, and the one after has the rest
+    session.allocate(TR_UP, 1000);
+    EXPECT_EQ(0U, peer.clamp(TR_UP, 100000));
+    session.allocate(TR_UP, 1000);
+    EXPECT_EQ(4000U, peer.clamp(TR_UP, 100000));
+
+    // lifting the limit forgives the overdraft
+    peer.notifyBandwidthConsumed(TR_UP, 20000, true, 0, true);
+    torrent.setLimited(TR_UP, false);
+    torrent.setLimited(TR_UP, true);
+    session.allocate(TR_UP, 1000);
+    EXPECT_EQ(8000U, peer.clamp(TR_UP, 100000));
+}
+
+TEST_F(BandwidthTest, otherOvershootsAreForgotten)
+{
+    auto session = Bandwidth{};
+    auto torrent = Bandwidth{ &session };
+    torrent.setLimited(TR_UP, true);
+    torrent.setDesiredSpeedBytesPerSecond(TR_UP, 8000);
+    auto peer = Bandwidth{ &torrent };
+
+    session.allocate(TR_UP, 1000);
+    EXPECT_EQ(8000U, peer.clamp(TR_UP, 100000));
+
+    // piece data that wasn't sent as a file segment went 12000 bytes over...
+    peer.notifyBandwidthConsumed(TR_UP, 20000, true, 0);
+    EXPECT_EQ(0U, peer.clamp(TR_UP, 100000));
+
+    // ...but the next period still gets its full budget
+    session.allocate(TR_UP, 1000);
+    EXPECT_EQ(8000U, peer.clamp(TR_UP, 100000));
+}
+
+TEST_F(BandwidthTest, throttledByParents)
+{
+    auto session = Bandwidth{};
+    auto torrent = Bandwidth{ &session };
+    auto peer = Bandwidth{ &torrent };
+    EXPECT_FALSE(peer.isThrottled(TR_UP));
+
+    session.setLimited(TR_UP, true);
+    EXPECT_TRUE(peer.isThrottled(TR_UP));
+    EXPECT_FALSE(peer.isThrottled(TR_DOWN));
+
+    // a torrent that ignores the session's limits isn't throttled by it
+    torrent.honorParentLimits(TR_UP, false);
+    EXPECT_FALSE(peer.isThrottled(TR_UP));
+    EXPECT_TRUE(session.isThrottled(TR_UP));
+}
+
+TEST_F(BandwidthTest, speedsAtEachHorizon)
+{
+    auto parent = Bandwidth{};
+    auto child = Bandwidth{ &parent };
+
+    // a steady 10 KiB/s of piece data for a minute, each second also
+    // carrying 1 KiB of overhead. start just before a whole second so
+    // that each second's transfers land in the same bins.
+    auto constexpr Start = uint64_t{ 999950 };
+    auto now = Start;
+    for (int i = 0; i < 60; ++i)
+    {
+        for (int j = 0; j < 10; ++j)
+        {
+            now += 100;
+            child.notifyBandwidthConsumed(TR_DOWN, 1024, true, now);
+        }
+        child.notifyBandwidthConsumed(TR_DOWN, 1024, false, now);
+    }
+
+    auto const expect_near = [](unsigned int expected, unsigned int actual)
+    {
+        EXPECT_NEAR(expected, actual, expected / 100);
+    };
+
+    using Horizon = Bandwidth::Horizon;
+    for (auto const* bandwidth : { &child, &parent })
+    {
+        for (auto const horizon : { Horizon::Current, Horizon::OneSecond, Horizon::TenSeconds, Horizon::OneMinute })
+        {
+            expect_near(10240, bandwidth->getPieceSpeedBytesPerSecond(now, TR_DOWN, horizon));
+            expect_near(11264, bandwidth->getRawSpeedBytesPerSecond(now, TR_DOWN, horizon));
+            EXPECT_EQ(0U, bandwidth->getRawSpeedBytesPerSecond(now, TR_UP, horizon));
+        }
+    }
+
+    // after five quiet seconds, only the longer horizons remember any of it
+    now += 5000;
+    EXPECT_EQ(0U, parent.getPieceSpeedBytesPerSecond(now, TR_DOWN));
+    EXPECT_EQ(0U, parent.getPieceSpeedBytesPerSecond(now, TR_DOWN, Horizon::OneSecond));
+    expect_near(5120, parent.getPieceSpeedBytesPerSecond(now, TR_DOWN, Horizon::TenSeconds));
+    expect_near(9386, parent.getPieceSpeedBytesPerSecond(now, TR_DOWN, Horizon::OneMinute));
+
+    // the child doesn't keep the longer horizons, so it reports its current speed
+    EXPECT_EQ(0U, child.getPieceSpeedBytesPerSecond(now, TR_DOWN, Horizon::TenSeconds));
+    EXPECT_EQ(0U, child.getPieceSpeedBytesPerSecond(now, TR_DOWN, Horizon::OneMinute));
+
+    // and after a quiet minute, none of them do
+    now += 60000;
+    EXPECT_EQ(0U, parent.getPieceSpeedBytesPerSecond(now, TR_DOWN, Horizon::TenSeconds));
+    EXPECT_EQ(0U, parent.getPieceSpeedBytesPerSecond(now, TR_DOWN, Horizon::OneMinute));
+    EXPECT_EQ(0U, parent.getRawSpeedBytesPerSecond(now, TR_DOWN, Horizon::OneMinute));
+}
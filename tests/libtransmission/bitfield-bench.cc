@@ -0,0 +1,91 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "transmission.h"
+#include "bitfield.h"
+#include "crypto-utils.h"
+
+#include "gtest/gtest.h"
+
+class BitfieldBench : public ::testing::Test
+{
+protected:
+    // a torrent with many small pieces, e.g. 64 GiB in 16 KiB blocks
+    static auto constexpr BitCount = size_t{ 4 * 1024 * 1024 };
+    static auto constexpr NumPasses = size_t{ 64 };
+
+    static tr_bitfield makeRandomBitfield()
+    {
+        auto raw = std::vector<uint8_t>(BitCount / 8);
+        tr_rand_buffer(std::data(raw), std::size(raw));
+
+        auto bf = tr_bitfield{ BitCount };
+        bf.setRaw(std::data(raw), std::size(raw));
+        return bf;
+    }
+
+    template<typename Func>
+    static void time(char const* name, Func&& func)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        auto sum = size_t{};
+        for (size_t pass = 0; pass < NumPasses; ++pass)
+        {
+            sum += func(pass);
+        }
+        auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        auto const bits = double(BitCount) * NumPasses;
+        std::cout << "    " << name << ": " << bits / seconds / 1e9 << " Gbit/s (checksum " << sum << ")" << std::endl;
+    }
+};
+
+TEST_F(BitfieldBench, kernels)
+{
+    auto const ours = makeRandomBitfield();
+    auto const theirs = makeRandomBitfield();
+
+    // ranges that start and end mid-word, as piece block spans usually do
+    time("count(begin, end)", [&ours](size_t pass) { return ours.count(pass * 3, BitCount - pass * 5); });
+
+    time(
+        "test() loop",
+        [&ours](size_t pass)
+        {
+            auto n = size_t{};
+            for (size_t i = pass; i < BitCount; ++i)
+            {
+                n += ours.test(i) ? 1 : 0;
+            }
+            return n;
+        });
+
+    time("countAnd", [&ours, &theirs](size_t /*pass*/) { return theirs.countAnd(ours); });
+    time("countAndNot", [&ours, &theirs](size_t /*pass*/) { return theirs.countAndNot(ours); });
+
+    // the worst case for intersects() is two bitfields with nothing in common
+    auto lonely = tr_bitfield{ BitCount };
+    lonely.set(BitCount - 1);
+    auto rest = tr_bitfield{ BitCount };
+    rest.setSpan(0, BitCount - 1);
+    time("intersects", [&lonely, &rest](size_t /*pass*/) { return size_t{ lonely.intersects(rest) ? 1U : 0U }; });
+
+    auto tmp = tr_bitfield{ BitCount };
+    time(
+        "setSpan + unsetSpan",
+        [&tmp](size_t pass)
+        {
+            tmp.setSpan(pass, BitCount - pass);
+            tmp.unsetSpan(pass * 7, BitCount / 2);
+            return tmp.count();
+        });
+
+    EXPECT_EQ(ours.count(0, BitCount), ours.count());
+}
@@ -320,3 +320,88 @@ TEST(Bitfield, hasAllNone)
         EXPECT_TRUE(!field.hasNone());
     }
 }
+
+TEST(Bitfield, countAnd)
+{
+    auto constexpr IterCount = int{ 1000 };
+
+    for (auto i = 0; i < IterCount; ++i)
+    {
+        auto const bit_count = size_t(1 + tr_rand_int_weak(2000));
+
+        // generate two random bitfields
+        auto a = tr_bitfield{ bit_count };
+        auto b = tr_bitfield{ bit_count };
+        for (int j = 0, n = tr_rand_int_weak(bit_count); j < n; ++j)
+        {
+            a.set(tr_rand_int_weak(bit_count));
+            b.set(tr_rand_int_weak(bit_count));
+        }
+
+        auto expected_and = size_t{};
+        auto expected_and_not = size_t{};
+        for (size_t j = 0; j < bit_count; ++j)
+        {
+            expected_and += a.test(j) && b.test(j) ? 1 : 0;
+            expected_and_not += a.test(j) && !b.test(j) ? 1 : 0;
+        }
+
+        EXPECT_EQ(expected_and, a.countAnd(b));
+        EXPECT_EQ(expected_and, b.countAnd(a));
+        EXPECT_EQ(expected_and_not, a.countAndNot(b));
+        EXPECT_EQ(expected_and != 0, a.intersects(b));
+    }
+
+    auto constexpr BitCount = size_t{ 300 };
+    auto some = tr_bitfield{ BitCount };
+    some.setSpan(70, 140);
+    auto all = tr_bitfield{ BitCount };
+    all.setHasAll();
+    auto none = tr_bitfield{ BitCount };
+    none.setHasNone();
+
+    EXPECT_EQ(70U, some.countAnd(all));
+    EXPECT_EQ(70U, all.countAnd(some));
+    EXPECT_EQ(BitCount - 70U, all.countAndNot(some));
+    EXPECT_EQ(0U, some.countAndNot(all));
+    EXPECT_EQ(70U, some.countAndNot(none));
+    EXPECT_EQ(0U, none.countAnd(all));
+    EXPECT_TRUE(some.intersects(all));
+    EXPECT_FALSE(some.intersects(none));
+    EXPECT_FALSE(all.intersects(none));
+
+    // a lone bit past the first few words
+    auto one = tr_bitfield{ BitCount };
+    one.set(BitCount - 1);
+    EXPECT_FALSE(one.intersects(some));
+    some.set(BitCount - 1);
+    EXPECT_TRUE(one.intersects(some));
+    EXPECT_EQ(1U, one.countAnd(some));
+}
+
+TEST(Bitfield, rawRoundTrip)
+{
+    // bit counts on either side of the word and byte boundaries
+    for (auto const bit_count : { 1, 7, 8, 9, 63, 64, 65, 127, 128, 129, 1000 })
+    {
+        auto bf = tr_bitfield(bit_count);
+        for (int i = 0; i < bit_count; i += 3)
+        {
+            bf.set(i);
+        }
+
+        auto const raw = bf.raw();
+        EXPECT_EQ((bit_count + 7) / 8, std::size(raw));
+
+        auto bf2 = tr_bitfield(bit_count);
+        bf2.setRaw(std::data(raw), std::size(raw));
+        EXPECT_EQ(bf.count(), bf2.count());
+        EXPECT_EQ(raw, bf2.raw());
+
+        for (int i = 0; i < bit_count; ++i)
+        {
+            EXPECT_EQ(i % 3 == 0, bf2.test(i));
+            EXPECT_EQ(i % 3 == 0, ((raw[i / 8] >> (7 - i % 8)) & 1) != 0);
+        }
+    }
+}
@@ -0,0 +1,111 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+#include "cache.h"
+#include "session.h"
+#include "torrent.h"
+#include "trevent.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class CacheBench : public SessionTest
+{
+protected:
+    static auto constexpr PieceSize = uint64_t{ 1024 * 1024 };
+    static auto constexpr PieceCount = uint64_t{ 256 };
+
+    // run `func` in the libtransmission thread and return how long it took
+    std::chrono::microseconds timeInEventThread(std::function<void()> const& func)
+    {
+        auto elapsed = std::chrono::microseconds{};
+        runInEventThread(
+            [&func, &elapsed]()
+            {
+                auto const begin = std::chrono::steady_clock::now();
+                func();
+                auto const end = std::chrono::steady_clock::now();
+                elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
+            });
+        return elapsed;
+    }
+
+    static void report(char const* name, std::chrono::microseconds elapsed, size_t n_ops)
+    {
+        std::cout << "    " << name << ": " << elapsed.count() << " us total, "
+                  << double(elapsed.count()) * 1000.0 / double(std::max(n_ops, size_t{ 1 })) << " ns/op" << std::endl;
+    }
+};
+
+TEST_F(CacheBench, writeReadFlush)
+{
+    // big enough to hold the whole torrent so that nothing gets flushed early
+    tr_sessionSetCacheLimit_MB(session_, (PieceSize * PieceCount * 2) / (1024 * 1024));
+
+    auto* const tor = syntheticTorrentInit("cache-bench", PieceSize, PieceCount);
+    auto* const cache = session_->cache;
+    auto const block_size = tor->blockSize();
+    auto const n_blocks = size_t{ tor->blockCount() };
+
+    // peers send blocks in a mostly-random order
+    auto blocks = std::vector<tr_block_index_t>(n_blocks);
+    std::iota(std::begin(blocks), std::end(blocks), 0);
+    std::shuffle(std::begin(blocks), std::end(blocks), std::mt19937{ 0 });
+
+    auto const payload = std::vector<uint8_t>(block_size, 'x');
+    std::cout << "  " << n_blocks << " blocks of " << block_size << " bytes" << std::endl;
+
+    auto elapsed = timeInEventThread(
+        [&]()
+        {
+            auto* const buf = evbuffer_new();
+            for (auto const block : blocks)
+            {
+                auto const loc = tor->blockLoc(block);
+                evbuffer_add(buf, std::data(payload), tor->blockSize(block));
+                EXPECT_EQ(0, tr_cacheWriteBlock(cache, tor, loc.piece, loc.piece_offset, tor->blockSize(block), buf));
+            }
+            evbuffer_free(buf);
+        });
+    report("write", elapsed, n_blocks);
+
+    elapsed = timeInEventThread(
+        [&]()
+        {
+            auto setme = std::vector<uint8_t>(block_size);
+            for (auto const block : blocks)
+            {
+                auto const loc = tor->blockLoc(block);
+                EXPECT_EQ(0, tr_cacheReadBlock(cache, tor, loc.piece, loc.piece_offset, tor->blockSize(block), std::data(setme)));
+            }
+        });
+    report("read", elapsed, n_blocks);
+
+    elapsed = timeInEventThread([&]() { EXPECT_EQ(0, tr_cacheFlushTorrent(cache, tor)); });
+    report("flush", elapsed, n_blocks);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
@@ -0,0 +1,163 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+
+#include "cache.h"
+#include "session.h"
+#include "torrent.h"
+#include "trevent.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class CacheTest : public SessionTest
+{
+protected:
+    static auto constexpr PieceSize = uint64_t{ 64 * 1024 };
+    static auto constexpr PieceCount = uint64_t{ 8 };
+
+    tr_torrent* syntheticTorrentInit(std::string_view name) const
+    {
+        return SessionTest::syntheticTorrentInit(name, PieceSize, PieceCount);
+    }
+
+    tr_cache_stats stats()
+    {
+        auto ret = tr_cache_stats{};
+        runInEventThread([&]() { ret = tr_cacheGetStats(session_->cache); });
+        return ret;
+    }
+
+    // each torrent's blocks get their own bytes, so mixups show
+    static std::vector<uint8_t> payload(tr_torrent const* tor, tr_block_index_t block)
+    {
+        return std::vector<uint8_t>(tor->blockSize(block), uint8_t(tor->uniqueId * 31 + block));
+    }
+
+    void writeBlocks(tr_torrent* tor)
+    {
+        runInEventThread(
+            [&]()
+            {
+                auto* const buf = evbuffer_new();
+                for (tr_block_index_t block = 0, n = tor->blockCount(); block < n; ++block)
+                {
+                    auto const loc = tor->blockLoc(block);
+                    auto const data = payload(tor, block);
+                    evbuffer_add(buf, std::data(data), std::size(data));
+                    EXPECT_EQ(0, tr_cacheWriteBlock(session_->cache, tor, loc.piece, loc.piece_offset, std::size(data), buf));
+                }
+                evbuffer_free(buf);
+            });
+    }
+
+    void expectBlocks(tr_torrent* tor)
+    {
+        runInEventThread(
+            [&]()
+            {
+                for (tr_block_index_t block = 0, n = tor->blockCount(); block < n; ++block)
+                {
+                    auto const loc = tor->blockLoc(block);
+                    auto const expected = payload(tor, block);
+                    auto actual = std::vector<uint8_t>(std::size(expected));
+                    EXPECT_TRUE(tr_cacheIsDirty(session_->cache, tor, loc.piece, loc.piece_offset, std::size(actual)));
+                    EXPECT_EQ(
+                        0,
+                        tr_cacheReadBlock(session_->cache, tor, loc.piece, loc.piece_offset, std::size(actual), std::data(actual)));
+                    EXPECT_EQ(expected, actual) << block;
+                }
+            });
+    }
+
+    void flush(tr_torrent* tor)
+    {
+        runInEventThread([&]() { EXPECT_EQ(0, tr_cacheFlushTorrent(session_->cache, tor)); });
+    }
+};
+
+TEST_F(CacheTest, slotsAreReusedAfterFlush)
+{
+    // big enough that nothing gets flushed early
+    tr_sessionSetCacheLimit_MB(session_, 16);
+
+    auto* const tor = syntheticTorrentInit("slots");
+    auto const n_blocks = size_t{ tor->blockCount() };
+
+    writeBlocks(tor);
+    auto const written = stats();
+    EXPECT_EQ(n_blocks, written.blocks);
+    EXPECT_EQ(n_blocks, written.slots_in_use);
+    EXPECT_LE(n_blocks, written.slots);
+    EXPECT_EQ(1U, written.torrents);
+    expectBlocks(tor);
+
+    // flushing frees the slots but keeps the slabs around
+    flush(tor);
+    auto const flushed = stats();
+    EXPECT_EQ(0U, flushed.blocks);
+    EXPECT_EQ(0U, flushed.slots_in_use);
+    EXPECT_EQ(written.slots, flushed.slots);
+    EXPECT_EQ(0U, flushed.torrents);
+
+    // the next writes reuse those slots instead of adding slabs
+    writeBlocks(tor);
+    auto const rewritten = stats();
+    EXPECT_EQ(n_blocks, rewritten.slots_in_use);
+    EXPECT_EQ(written.slots, rewritten.slots);
+    expectBlocks(tor);
+
+    flush(tor);
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(CacheTest, indexSurvivesTorrentRemoval)
+{
+    tr_sessionSetCacheLimit_MB(session_, 16);
+
+    auto* const a = syntheticTorrentInit("a");
+    auto* const b = syntheticTorrentInit("b");
+    writeBlocks(a);
+    writeBlocks(b);
+    EXPECT_EQ(2U, stats().torrents);
+
+    // removing a torrent flushes its blocks and drops it from the index
+    tr_torrentRemove(a, false, nullptr);
+    EXPECT_TRUE(waitFor([this]() { return stats().torrents == 1; }, 5000));
+    auto const after_removal = stats();
+    EXPECT_EQ(size_t{ b->blockCount() }, after_removal.blocks);
+    EXPECT_EQ(size_t{ b->blockCount() }, after_removal.slots_in_use);
+    expectBlocks(b);
+
+    // a new torrent's blocks land in the freed slots without
+    // disturbing the blocks that are still cached
+    auto* const c = syntheticTorrentInit("c");
+    writeBlocks(c);
+    EXPECT_EQ(size_t{ b->blockCount() + c->blockCount() }, stats().slots_in_use);
+    expectBlocks(b);
+    expectBlocks(c);
+
+    flush(b);
+    flush(c);
+    EXPECT_EQ(0U, stats().slots_in_use);
+    tr_torrentRemove(b, false, nullptr);
+    tr_torrentRemove(c, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
@@ -35,6 +35,10 @@
 #define tr_sha1_init tr_sha1_init_
 #define tr_sha1_update tr_sha1_update_
 #define tr_sha1_final tr_sha1_final_
+#define tr_sha1_lib_init tr_sha1_lib_init_
+#define tr_sha1_lib_update tr_sha1_lib_update_
+#define tr_sha1_lib_final tr_sha1_lib_final_
+#define tr_sha1_lib_free tr_sha1_lib_free_
 #define tr_dh_new tr_dh_new_
 #define tr_dh_free tr_dh_free_
 #define tr_dh_make_key tr_dh_make_key_
@@ -93,6 +97,10 @@
 #undef tr_sha1_init
 #undef tr_sha1_update
 #undef tr_sha1_final
+#undef tr_sha1_lib_init
+#undef tr_sha1_lib_update
+#undef tr_sha1_lib_final
+#undef tr_sha1_lib_free
 #undef tr_dh_new
 #undef tr_dh_free
 #undef tr_dh_make_key
@@ -144,6 +152,10 @@
 #define tr_sha1_init_ tr_sha1_init
 #define tr_sha1_update_ tr_sha1_update
 #define tr_sha1_final_ tr_sha1_final
+#define tr_sha1_lib_init_ tr_sha1_lib_init
+#define tr_sha1_lib_update_ tr_sha1_lib_update
+#define tr_sha1_lib_final_ tr_sha1_lib_final
+#define tr_sha1_lib_free_ tr_sha1_lib_free
 #define tr_dh_new_ tr_dh_new
 #define tr_dh_free_ tr_dh_free
 #define tr_dh_make_key_ tr_dh_make_key
@@ -3,17 +3,20 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <numeric>
 #include <string>
 #include <string_view>
 #include <unordered_set>
+#include <vector>
 
 #include "transmission.h"
 
 #include "crypto.h"
 #include "crypto-utils.h"
+#include "sha1.h"
 #include "utils.h"
 
 #include "crypto-test-ref.h"
@@ -78,6 +81,41 @@ TEST(Crypto, encryptDecrypt)
     EXPECT_EQ(input2, std::string(decrypted2.data(), input2.size()));
 }
 
+TEST(Crypto, encryptDecryptChunked)
+{
+    auto a = tr_crypto{ &SomeHash, false };
+    auto b = tr_crypto_{ &SomeHash, true };
+
+    auto public_key_length = int{};
+    EXPECT_TRUE(tr_cryptoComputeSecret(&a, tr_cryptoGetMyPublicKey_(&b, &public_key_length)));
+    EXPECT_TRUE(tr_cryptoComputeSecret_(&b, tr_cryptoGetMyPublicKey(&a, &public_key_length)));
+
+    auto plaintext = std::vector<char>(10000);
+    tr_rand_buffer(std::data(plaintext), std::size(plaintext));
+
+    // encrypting in one call or in odd-sized pieces gives the same keystream
+    auto whole = std::vector<char>(std::size(plaintext));
+    tr_cryptoEncryptInit(&a);
+    tr_cryptoEncrypt(&a, std::size(plaintext), std::data(plaintext), std::data(whole));
+
+    auto chunked = plaintext;
+    tr_cryptoEncryptInit(&a);
+    for (size_t pos = 0, step = 1; pos < std::size(chunked); pos += step, step = step * 2 + 1)
+    {
+        auto const n = std::min(step, std::size(chunked) - pos);
+        tr_cryptoEncrypt(&a, n, std::data(chunked) + pos, std::data(chunked) + pos);
+    }
+    EXPECT_EQ(whole, chunked);
+
+    tr_cryptoDecryptInit_(&b);
+    for (size_t pos = 0, step = 7; pos < std::size(chunked); pos += step)
+    {
+        auto const n = std::min(step, std::size(chunked) - pos);
+        tr_cryptoDecrypt_(&b, n, std::data(chunked) + pos, std::data(chunked) + pos);
+    }
+    EXPECT_EQ(plaintext, chunked);
+}
+
 TEST(Crypto, sha1)
 {
     auto hash1 = tr_sha1("test"sv);
@@ -118,6 +156,89 @@ TEST(Crypto, sha1)
     EXPECT_EQ("a94a8fe5ccb19ba61c4c0873d391e987982fbbd3"sv, tr_sha1_to_string(*hash5));
 }
 
+TEST(Crypto, sha1Kernels)
+{
+    struct LocalTest
+    {
+        std::string input;
+        std::string_view digest;
+    };
+
+    auto const tests = std::array<LocalTest, 5>{ {
+        { "", "da39a3ee5e6b4b0d3255bfef95601890afd80709"sv },
+        { "abc", "a9993e364706816aba3e25717850c26c9cd0d89d"sv },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "84983e441c3bd26ebaae4aa1f95129e5e54670f1"sv },
+        { std::string(55, 'x'), "cef734ba81a024479e09eb5a75b6ddae62e6abf1"sv },
+        { std::string(1000000, 'a'), "34aa973cd4c4daa4f61eeb2bdbad27316534016f"sv },
+    } };
+
+    // messages of every length around the block boundaries,
+    // hashed by the crypto library for reference
+    auto random_msgs = std::vector<std::string>{};
+    for (size_t len = 0; len < 300; ++len)
+    {
+        auto msg = std::string(len, '\0');
+        tr_rand_buffer(std::data(msg), std::size(msg));
+        random_msgs.push_back(std::move(msg));
+    }
+
+    auto random_digests = std::vector<tr_sha1_digest_t>{};
+    for (auto const& msg : random_msgs)
+    {
+        auto* const ctx = tr_sha1_lib_init();
+        EXPECT_TRUE(tr_sha1_lib_update(ctx, std::data(msg), std::size(msg)));
+        random_digests.push_back(*tr_sha1_lib_final(ctx));
+
+        // final() restarts the context, so it can hash the message again
+        EXPECT_TRUE(tr_sha1_lib_update(ctx, std::data(msg), std::size(msg)));
+        EXPECT_EQ(random_digests.back(), *tr_sha1_lib_final(ctx));
+        tr_sha1_lib_free(ctx);
+    }
+
+    auto const default_impl = tr_sha1_get_impl();
+
+    for (auto const impl : { tr_sha1_impl::Generic, tr_sha1_impl::Avx2, tr_sha1_impl::ShaNi })
+    {
+        if (!tr_sha1_set_impl(impl))
+        {
+            EXPECT_FALSE(tr_sha1_impl_is_supported(impl));
+            continue;
+        }
+
+        SCOPED_TRACE(tr_sha1_impl_name(impl));
+
+        for (auto const& test : tests)
+        {
+            // feed it in uneven pieces to exercise the partial-block buffering
+            auto state = tr_sha1_state{};
+            tr_sha1_state_init(state);
+            for (size_t pos = 0, step = 1; pos < std::size(test.input); pos += step, step = step * 3 + 1)
+            {
+                auto const n = std::min(step, std::size(test.input) - pos);
+                tr_sha1_state_update(state, std::data(test.input) + pos, n);
+            }
+            EXPECT_EQ(test.digest, tr_sha1_to_string(tr_sha1_state_final(state)));
+
+            EXPECT_EQ(test.digest, tr_sha1_to_string(*tr_sha1(test.input)));
+        }
+
+        auto views = std::vector<std::string_view>(std::begin(random_msgs), std::end(random_msgs));
+        auto digests = std::vector<tr_sha1_digest_t>(std::size(views));
+        tr_sha1_many(std::data(views), std::size(views), std::data(digests));
+        EXPECT_EQ(random_digests, digests);
+
+        for (size_t i = 0; i < std::size(random_msgs); ++i)
+        {
+            auto state = tr_sha1_state{};
+            tr_sha1_state_init(state);
+            tr_sha1_state_update(state, std::data(random_msgs[i]), std::size(random_msgs[i]));
+            EXPECT_EQ(random_digests[i], tr_sha1_state_final(state));
+        }
+    }
+
+    EXPECT_TRUE(tr_sha1_set_impl(default_impl));
+}
+
 TEST(Crypto, ssha1)
 {
     struct LocalTest
@@ -0,0 +1,190 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+
+#include "fdlimit.h"
+#include "file.h"
+#include "session.h"
+#include "utils.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+using FdlimitTest = SessionTest;
+
+TEST_F(FdlimitTest, lruEviction)
+{
+    static auto constexpr TorrentId = int{ 1 };
+    static auto constexpr Payload = std::string_view{ "hello" };
+
+    auto const capacity = tr_fdGetStats(session_).capacity;
+    ASSERT_GT(capacity, 0U);
+
+    // one more file than the pool can hold
+    auto filenames = std::vector<std::string>{};
+    for (size_t i = 0; i <= capacity; ++i)
+    {
+        filenames.push_back(tr_strvPath(sandboxDir(), "files", "file-" + std::to_string(i)));
+        createFileWithContents(filenames.back(), std::data(Payload), std::size(Payload));
+    }
+
+    auto const checkout = [this, &filenames](tr_file_index_t i)
+    {
+        return tr_fdFileCheckout(
+            session_,
+            TorrentId,
+            i,
+            filenames[i].c_str(),
+            false,
+            TR_PREALLOCATE_NONE,
+            std::size(Payload));
+    };
+
+    auto const before = tr_fdGetStats(session_);
+
+    // first checkout opens the file; after that, it's cached
+    auto const fd = checkout(0);
+    EXPECT_NE(TR_BAD_SYS_FILE, fd);
+    EXPECT_EQ(fd, tr_fdFileGetCached(session_, TorrentId, 0, false));
+    EXPECT_EQ(fd, checkout(0));
+    EXPECT_EQ(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorrentId, 0, true));
+
+    auto stats = tr_fdGetStats(session_);
+    EXPECT_EQ(before.misses + 1, stats.misses);
+    EXPECT_EQ(before.hits + 2, stats.hits);
+    EXPECT_EQ(before.evictions, stats.evictions);
+
+    // fill the pool, then touch file #1 so that file #2 is the least recently used
+    for (tr_file_index_t i = 1; i < capacity; ++i)
+    {
+        EXPECT_NE(TR_BAD_SYS_FILE, checkout(i));
+    }
+    EXPECT_NE(TR_BAD_SYS_FILE, checkout(0));
+    EXPECT_NE(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorrentId, 1, false));
+    EXPECT_EQ(before.evictions, tr_fdGetStats(session_).evictions);
+
+    // one more file should push out #2
+    EXPECT_NE(TR_BAD_SYS_FILE, checkout(capacity));
+    EXPECT_EQ(before.evictions + 1, tr_fdGetStats(session_).evictions);
+    EXPECT_EQ(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorrentId, 2, false));
+    EXPECT_NE(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorrentId, 0, false));
+    EXPECT_NE(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorrentId, 1, false));
+    EXPECT_NE(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorrentId, capacity, false));
+
+    // closing the torrent closes all its files
+    tr_fdTorrentClose(session_, TorrentId);
+    for (tr_file_index_t i = 0; i <= capacity; ++i)
+    {
+        EXPECT_EQ(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorrentId, i, false));
+    }
+}
+
+TEST_F(FdlimitTest, mapping)
+{
+    static auto constexpr TorrentId = int{ 1 };
+    static auto constexpr Payload = std::string_view{ "hello, world" };
+
+    if (sizeof(void*) < 8)
+    {
+        GTEST_SKIP() << "files are only mapped on 64-bit platforms";
+    }
+
+    auto const filename = tr_strvPath(sandboxDir(), "mapped-file");
+    createFileWithContents(filename, std::data(Payload), std::size(Payload));
+
+    // files that aren't open in the pool aren't mapped
+    EXPECT_EQ(nullptr, tr_fdFileGetMapping(session_, TorrentId, 0, std::size(Payload)));
+
+    auto const fd = tr_fdFileCheckout(session_, TorrentId, 0, filename.c_str(), false, TR_PREALLOCATE_NONE, std::size(Payload));
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+
+    auto const before = tr_fdGetStats(session_);
+    auto const mapping = tr_fdFileGetMapping(session_, TorrentId, 0, std::size(Payload));
+    ASSERT_NE(nullptr, mapping);
+    EXPECT_EQ(std::size(Payload), mapping->size());
+    EXPECT_EQ(Payload, std::string_view(reinterpret_cast<char const*>(mapping->data()), mapping->size()));
+
+    // the mapping is reused until a bigger one is needed
+    EXPECT_EQ(mapping, tr_fdFileGetMapping(session_, TorrentId, 0, 1));
+    EXPECT_EQ(before.mappings + 1, tr_fdGetStats(session_).mappings);
+    EXPECT_EQ(nullptr, tr_fdFileGetMapping(session_, TorrentId, 0, std::size(Payload) + 1));
+
+    // closing the file drops the pool's reference, but not ours
+    tr_fdTorrentClose(session_, TorrentId);
+    EXPECT_EQ(nullptr, tr_fdFileGetMapping(session_, TorrentId, 0, std::size(Payload)));
+    EXPECT_EQ(1, mapping.use_count());
+    EXPECT_EQ(Payload, std::string_view(reinterpret_cast<char const*>(mapping->data()), mapping->size()));
+}
+
+TEST_F(FdlimitTest, segment)
+{
+    static auto constexpr TorrentId = int{ 1 };
+    static auto constexpr Payload = std::string_view{ "hello, world" };
+
+#ifndef TR_HAVE_SENDFILE
+    GTEST_SKIP() << "sendfile() segments aren't used on this platform";
+#endif
+
+    auto const filename = tr_strvPath(sandboxDir(), "segment-file");
+    createFileWithContents(filename, std::data(Payload), std::size(Payload));
+
+    // files that aren't open in the pool don't get segments
+    EXPECT_EQ(nullptr, tr_fdFileGetSegment(session_, TorrentId, 0, std::size(Payload)));
+
+    auto const fd = tr_fdFileCheckout(session_, TorrentId, 0, filename.c_str(), false, TR_PREALLOCATE_NONE, std::size(Payload));
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+
+    auto const before = tr_fdGetStats(session_);
+    auto* const segment = tr_fdFileGetSegment(session_, TorrentId, 0, std::size(Payload));
+    ASSERT_NE(nullptr, segment);
+
+    // the segment is reused, and can't reach past the end of the file
+    EXPECT_EQ(segment, tr_fdFileGetSegment(session_, TorrentId, 0, 1));
+    EXPECT_EQ(before.segments + 1, tr_fdGetStats(session_).segments);
+    EXPECT_EQ(nullptr, tr_fdFileGetSegment(session_, TorrentId, 0, std::size(Payload) + 1));
+
+    // a buffer holding the segment can still be read after the pool closes the file
+    auto* const buf = evbuffer_new();
+    EXPECT_EQ(0, evbuffer_add_file_segment(buf, segment, 7, 5));
+    tr_fdTorrentClose(session_, TorrentId);
+    EXPECT_EQ(nullptr, tr_fdFileGetSegment(session_, TorrentId, 0, std::size(Payload)));
+    auto str = std::string(evbuffer_get_length(buf), '\0');
+    EXPECT_EQ(5, evbuffer_remove(buf, std::data(str), std::size(str)));
+    EXPECT_EQ("world", str);
+    evbuffer_free(buf);
+}
+
+TEST_F(FdlimitTest, sendfileUploadsShrinkCapacity)
+{
+    auto const capacity = tr_fdGetStats(session_).capacity;
+    ASSERT_GT(capacity, 1U);
+
+    // each open file may also hold a dup()ed fd for its segment
+    session_->isSendfileUploadsEnabled = true;
+#ifdef TR_HAVE_SENDFILE
+    EXPECT_EQ(capacity / 2, tr_fdGetStats(session_).capacity);
+#else
+    EXPECT_EQ(capacity, tr_fdGetStats(session_).capacity);
+#endif
+
+    session_->isSendfileUploadsEnabled = false;
+    EXPECT_EQ(capacity, tr_fdGetStats(session_).capacity);
+}
+
+} // namespace test
+
+} // namespace libtransmission
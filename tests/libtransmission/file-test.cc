@@ -13,6 +13,7 @@
 #include <array>
 #include <cstring>
 #include <string>
+#include <vector>
 
 #ifndef _WIN32
 #include <sys/types.h>
@@ -1136,6 +1137,41 @@ TEST_F(FileTest, fileReadWriteSeek)
     tr_sys_path_remove(path1.c_str(), nullptr);
 }
 
+TEST_F(FileTest, fileWriteAtV)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path1 = tr_strvPath(test_dir, "a"sv);
+    auto const fd = tr_sys_file_open(path1.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0600, nullptr);
+
+    uint64_t n;
+    tr_error* err = nullptr;
+    auto const iov = std::array<tr_sys_iovec, 4>{ { { "hello", 5 }, { "", 0 }, { ", ", 2 }, { "world", 5 } } };
+    EXPECT_TRUE(tr_sys_file_write_at_v(fd, std::data(iov), std::size(iov), 3, &n, &err));
+    EXPECT_EQ(nullptr, err);
+    EXPECT_EQ(12, n);
+
+    auto buf = std::array<char, 100>{};
+    EXPECT_TRUE(tr_sys_file_read_at(fd, buf.data(), buf.size(), 3, &n, &err));
+    EXPECT_EQ(nullptr, err);
+    EXPECT_EQ(12, n);
+    EXPECT_EQ(0, memcmp("hello, world", buf.data(), 12));
+
+    // more buffers than a single pwritev() call accepts
+    auto const many = std::vector<tr_sys_iovec>(5000, tr_sys_iovec{ "x", 1 });
+    EXPECT_TRUE(tr_sys_file_write_at_v(fd, std::data(many), std::size(many), 0, &n, &err));
+    EXPECT_EQ(nullptr, err);
+    EXPECT_EQ(std::size(many), n);
+
+    auto info = tr_sys_path_info{};
+    EXPECT_TRUE(tr_sys_file_get_info(fd, &info, &err));
+    EXPECT_EQ(std::size(many), info.size);
+
+    tr_sys_file_close(fd, nullptr);
+
+    tr_sys_path_remove(path1.c_str(), nullptr);
+}
+
 TEST_F(FileTest, fileTruncate)
 {
     auto const test_dir = createTestDir(currentTestName());
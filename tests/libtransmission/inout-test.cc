@@ -0,0 +1,207 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+
+#include "cache.h"
+#include "file.h"
+#include "inout.h"
+#include "session.h"
+#include "torrent.h"
+#include "trevent.h"
+#include "utils.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class InoutTest : public SessionTest
+{
+protected:
+    void SetUp() override
+    {
+        SessionTest::SetUp();
+
+        if (sizeof(void*) < 8)
+        {
+            GTEST_SKIP() << "files are only mapped on 64-bit platforms";
+        }
+    }
+
+    static std::vector<uint8_t> drain(evbuffer* buf)
+    {
+        auto ret = std::vector<uint8_t>(evbuffer_get_length(buf));
+        evbuffer_remove(buf, std::data(ret), std::size(ret));
+        return ret;
+    }
+
+    std::vector<uint8_t> readCopy(tr_torrent* tor, tr_piece_index_t piece, uint32_t begin, uint32_t len)
+    {
+        auto ret = std::vector<uint8_t>(len);
+        runInEventThread([&]() { EXPECT_EQ(0, tr_ioRead(tor, piece, begin, len, std::data(ret))); });
+        return ret;
+    }
+
+    std::vector<uint8_t> readReference(tr_torrent* tor, tr_piece_index_t piece, uint32_t begin, uint32_t len)
+    {
+        auto* const buf = evbuffer_new();
+        runInEventThread([&]() { EXPECT_EQ(0, tr_ioReadReference(tor, piece, begin, len, buf)); });
+        EXPECT_EQ(len, evbuffer_get_length(buf));
+        auto ret = drain(buf);
+        evbuffer_free(buf);
+        return ret;
+    }
+};
+
+TEST_F(InoutTest, readReferenceAcrossFiles)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, true);
+
+    // give the last two files different contents so a misplaced byte shows
+    for (tr_file_index_t i = 1; i < 3; ++i)
+    {
+        auto contents = std::string(tr_torrentFile(tor, i).length, '\0');
+        for (size_t j = 0; j < std::size(contents); ++j)
+        {
+            contents[j] = char('a' + i * 7 + j % 13);
+        }
+        createFileWithContents(makeString(tr_torrentFindFile(tor, i)), std::data(contents), std::size(contents));
+    }
+
+    // the last piece holds all of files 1 and 2
+    auto const piece = tor->pieceCount() - 1;
+    auto const piece_size = tor->pieceSize(piece);
+    ASSERT_EQ(1U, tor->fileOffset(piece, 0).index);
+    ASSERT_EQ(tr_torrentFile(tor, 1).length + tr_torrentFile(tor, 2).length, piece_size);
+
+    EXPECT_EQ(readCopy(tor, piece, 0, piece_size), readReference(tor, piece, 0, piece_size));
+
+    // a range that straddles the boundary between the files
+    auto const boundary = uint32_t(tr_torrentFile(tor, 1).length);
+    EXPECT_EQ(readCopy(tor, piece, boundary - 100, 200), readReference(tor, piece, boundary - 100, 200));
+
+    // on failure, nothing is appended
+    auto* const buf = evbuffer_new();
+    runInEventThread([&]() { EXPECT_NE(0, tr_ioReadReference(tor, piece, 0, piece_size + 1, buf)); });
+    runInEventThread([&]() { EXPECT_NE(0, tr_ioReadReference(tor, piece + 1, 0, 1, buf)); });
+    EXPECT_EQ(0U, evbuffer_get_length(buf));
+    evbuffer_free(buf);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(InoutTest, writevAcrossFiles)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, true);
+
+    // the last piece holds all of files 1 and 2
+    auto const piece = tor->pieceCount() - 1;
+    auto const boundary = uint32_t(tr_torrentFile(tor, 1).length);
+    ASSERT_EQ(1U, tor->fileOffset(piece, 0).index);
+
+    // a block that starts 100 bytes before the end of file 1, in two buffers
+    // that don't line up with the boundary
+    auto first = std::vector<uint8_t>(150);
+    auto second = std::vector<uint8_t>(250);
+    for (size_t i = 0; i < std::size(first); ++i)
+    {
+        first[i] = uint8_t(i + 1);
+    }
+    for (size_t i = 0; i < std::size(second); ++i)
+    {
+        second[i] = uint8_t(200 - i);
+    }
+    auto const iov = std::array<tr_sys_iovec, 2>{ { { std::data(first), std::size(first) },
+                                                    { std::data(second), std::size(second) } } };
+    runInEventThread([&]() { EXPECT_EQ(0, tr_ioWritev(tor, piece, boundary - 100, std::data(iov), std::size(iov))); });
+
+    auto block = first;
+    block.insert(std::end(block), std::begin(second), std::end(second));
+
+    auto const load = [tor](tr_file_index_t i)
+    {
+        auto contents = std::vector<char>{};
+        EXPECT_TRUE(tr_loadFile(contents, makeString(tr_torrentFindFile(tor, i))));
+        return std::vector<uint8_t>{ std::begin(contents), std::end(contents) };
+    };
+
+    // file 1 ends with the first 100 bytes; the rest of it is untouched
+    auto expected = std::vector<uint8_t>(tr_torrentFile(tor, 1).length);
+    std::copy_n(std::begin(block), 100, std::end(expected) - 100);
+    EXPECT_EQ(expected, load(1));
+
+    // file 2 starts with the other 300
+    expected.assign(tr_torrentFile(tor, 2).length, 0);
+    std::copy(std::begin(block) + 100, std::end(block), std::begin(expected));
+    EXPECT_EQ(expected, load(2));
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(InoutTest, dirtyCacheBlockNeedsCopy)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, true);
+
+    auto* const cache = session_->cache;
+    auto const block_size = tor->blockSize();
+    auto const newer = std::vector<uint8_t>(block_size, 'x');
+
+    // a block that's been received but not yet written to disk
+    runInEventThread(
+        [&]()
+        {
+            auto* const buf = evbuffer_new();
+            evbuffer_add(buf, std::data(newer), std::size(newer));
+            EXPECT_EQ(0, tr_cacheWriteBlock(cache, tor, 0, 0, block_size, buf));
+            evbuffer_free(buf);
+        });
+
+    auto const is_dirty = [&](uint32_t begin, uint32_t len)
+    {
+        auto ret = bool{};
+        runInEventThread([&]() { ret = tr_cacheIsDirty(cache, tor, 0, begin, len); });
+        return ret;
+    };
+    EXPECT_TRUE(is_dirty(0, block_size));
+    EXPECT_TRUE(is_dirty(100, 10));
+    EXPECT_TRUE(is_dirty(block_size - 1, 2));
+    EXPECT_FALSE(is_dirty(block_size, block_size));
+
+    // the mapped file still has the old bytes, so that block has to
+    // be copied out of the cache instead of referenced
+    auto from_cache = std::vector<uint8_t>(block_size);
+    runInEventThread([&]() { EXPECT_EQ(0, tr_cacheReadBlock(cache, tor, 0, 0, block_size, std::data(from_cache))); });
+    EXPECT_EQ(newer, from_cache);
+    EXPECT_NE(newer, readReference(tor, 0, 0, block_size));
+
+    // once it's flushed, referencing the file is safe again
+    runInEventThread([&]() { EXPECT_EQ(0, tr_cacheFlushTorrent(cache, tor)); });
+    EXPECT_FALSE(is_dirty(0, block_size));
+    EXPECT_EQ(newer, readReference(tor, 0, 0, block_size));
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
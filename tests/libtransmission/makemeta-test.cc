@@ -8,6 +8,7 @@
 #include <cstring> // strlen()
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "transmission.h"
 
@@ -364,6 +365,63 @@ TEST_F(MakemetaTest, singleDirectoryRandomPayload)
     }
 }
 
+TEST_F(MakemetaTest, hashThreads)
+{
+    auto constexpr PieceSize = uint32_t{ 16 * 1024 };
+    auto constexpr FileSizes = std::array<size_t, 5>{ 3 * 1024 * 1024 + 17, 0, 1, PieceSize * 300, 5 * 1024 * 1024 + 5 };
+
+    // build the payload files in a temp directory
+    auto top = tr_strvPath(sandboxDir(), "folder.XXXXXX");
+    tr_sys_path_native_separators(std::data(top));
+    tr_sys_dir_create_temp(std::data(top), nullptr);
+
+    auto payload = std::string{};
+    for (size_t i = 0; i < std::size(FileSizes); ++i)
+    {
+        auto contents = std::string(FileSizes[i], '\0');
+        tr_rand_buffer(std::data(contents), std::size(contents));
+        payload += contents;
+
+        auto path = tr_strvPath(top, "file." + std::to_string(i));
+        createFileWithContents(path, std::data(contents), std::size(contents));
+    }
+
+    sync();
+
+    auto expected = std::vector<tr_sha1_digest_t>{};
+    for (size_t offset = 0; offset < std::size(payload); offset += PieceSize)
+    {
+        expected.push_back(*tr_sha1(std::string_view{ payload }.substr(offset, PieceSize)));
+    }
+
+    // the pieces should hash the same no matter how many threads do the work
+    for (auto const n_threads : { 1U, 3U, 0U })
+    {
+        auto* builder = tr_metaInfoBuilderCreate(top.c_str());
+        EXPECT_TRUE(tr_metaInfoBuilderSetPieceSize(builder, PieceSize));
+        EXPECT_EQ(std::size(payload), builder->totalSize);
+        builder->hashThreads = n_threads;
+
+        auto const torrent_file = tr_strvJoin(top, ".torrent"sv);
+        tr_makeMetaInfo(builder, torrent_file.c_str(), nullptr, 0, nullptr, 0, nullptr, false, nullptr);
+        EXPECT_TRUE(waitFor([&builder]() { return builder->isDone; }, 5000));
+        EXPECT_EQ(TrMakemetaResult::OK, builder->result);
+        EXPECT_EQ(std::size(expected), builder->pieceIndex);
+        sync();
+
+        auto metainfo = tr_torrent_metainfo{};
+        EXPECT_TRUE(metainfo.parseTorrentFile(torrent_file));
+        EXPECT_EQ(std::size(expected), metainfo.pieceCount());
+        for (tr_piece_index_t piece = 0, n = metainfo.pieceCount(); piece < n; ++piece)
+        {
+            EXPECT_EQ(expected[piece], metainfo.pieceHash(piece));
+        }
+
+        tr_metaInfoBuilderFree(builder);
+        tr_sys_path_remove(torrent_file.c_str(), nullptr);
+    }
+}
+
 } // namespace test
 
 } // namespace libtransmission
@@ -0,0 +1,328 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <event2/buffer.h>
+#include <event2/util.h>
+
+#include "transmission.h"
+#include "crypto.h"
+#include "fdlimit.h"
+#include "net.h"
+#include "peer-io.h"
+#include "peer-socket.h"
+#include "session.h"
+#include "trevent.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class PeerIoTest : public SessionTest
+{
+protected:
+    // connect a socket to a tr_peerIo.
+    // returns the io and the other end of the connection
+    std::pair<tr_peerIo*, tr_socket_t> connectedPeerIo()
+    {
+        auto loopback = tr_address{};
+        EXPECT_TRUE(tr_address_from_string(&loopback, "127.0.0.1"));
+        auto const listener = tr_netBindTCP(&loopback, 0, true);
+        EXPECT_NE(TR_BAD_SOCKET, listener);
+
+        auto sin = sockaddr_in{};
+        auto len = socklen_t{ sizeof(sin) };
+        EXPECT_EQ(0, getsockname(listener, reinterpret_cast<sockaddr*>(&sin), &len));
+
+        auto const remote = socket(AF_INET, SOCK_STREAM, 0);
+        EXPECT_NE(TR_BAD_SOCKET, remote);
+        EXPECT_EQ(0, connect(remote, reinterpret_cast<sockaddr*>(&sin), len));
+        evutil_make_socket_nonblocking(remote);
+
+        tr_peerIo* io = nullptr;
+        runInEventThread(
+            [&]()
+            {
+                auto addr = tr_address{};
+                auto port = tr_port{};
+                auto const fd = tr_netAccept(session_, listener, &addr, &port);
+                EXPECT_NE(TR_BAD_SOCKET, fd);
+                io = tr_peerIoNewIncoming(session_, session_->bandwidth, &addr, port, tr_peer_socket_tcp_create(fd));
+            });
+
+        tr_netCloseSocket(listener);
+        return { io, remote };
+    }
+
+    void freePeerIo(tr_peerIo* io)
+    {
+        runInEventThread(
+            [io]()
+            {
+                tr_peerIoClear(io);
+                tr_peerIoUnref(io);
+            });
+    }
+
+    static ReadState onCanRead(tr_peerIo* io, void* vself, size_t* /*piece*/)
+    {
+        auto* const self = static_cast<PeerIoTest*>(vself);
+        auto const len = evbuffer_get_length(io->inbuf);
+        auto const lock = std::lock_guard(self->received_mutex_);
+        auto const old_size = std::size(self->received_);
+        self->received_.resize(old_size + len);
+        evbuffer_remove(io->inbuf, std::data(self->received_) + old_size, len);
+        return READ_NOW;
+    }
+
+    std::string received()
+    {
+        auto const lock = std::lock_guard(received_mutex_);
+        return received_;
+    }
+
+    // read `n` bytes from the other end of a connection
+    static std::string recvAll(tr_socket_t remote, size_t n)
+    {
+        auto got = std::string{};
+        auto buf = std::array<char, 4096>{};
+        waitFor(
+            [&]()
+            {
+                auto const len = recv(remote, std::data(buf), std::min(std::size(buf), n - std::size(got)), 0);
+                if (len > 0)
+                {
+                    got.append(std::data(buf), len);
+                }
+                return std::size(got) == n;
+            },
+            5000);
+        return got;
+    }
+
+    std::mutex received_mutex_;
+    std::string received_;
+};
+
+TEST_F(PeerIoTest, readsFromPeer)
+{
+    auto const [io, remote] = connectedPeerIo();
+    ASSERT_NE(nullptr, io);
+
+    runInEventThread(
+        [this, io = io]()
+        {
+            tr_peerIoSetIOFuncs(io, onCanRead, nullptr, nullptr, this);
+            tr_peerIoSetEnabled(io, TR_DOWN, true);
+        });
+
+    auto const payload = std::string(100000, 'x') + "hello"s;
+    for (size_t sent = 0; sent < std::size(payload);)
+    {
+        auto const n = send(remote, std::data(payload) + sent, std::size(payload) - sent, 0);
+        if (n > 0)
+        {
+            sent += n;
+        }
+    }
+
+    EXPECT_TRUE(waitFor([this, &payload]() { return received() == payload; }, 5000));
+
+    freePeerIo(io);
+    tr_netCloseSocket(remote);
+}
+
+TEST_F(PeerIoTest, writesToPeer)
+{
+    auto const [io, remote] = connectedPeerIo();
+    ASSERT_NE(nullptr, io);
+
+    auto const payload = std::string(100000, 'y') + "world"s;
+    runInEventThread(
+        [io = io, &payload]()
+        {
+            tr_peerIoWriteBytes(io, std::data(payload), std::size(payload), false);
+            tr_peerIoSetEnabled(io, TR_UP, true);
+        });
+
+    auto got = std::string{};
+    auto buf = std::array<char, 4096>{};
+    EXPECT_TRUE(waitFor(
+        [&]()
+        {
+            auto const n = recv(remote, std::data(buf), std::size(buf), 0);
+            if (n > 0)
+            {
+                got.append(std::data(buf), n);
+            }
+            return got == payload;
+        },
+        5000));
+
+    freePeerIo(io);
+    tr_netCloseSocket(remote);
+}
+
+TEST_F(PeerIoTest, decryptsReads)
+{
+    auto const [io, remote] = connectedPeerIo();
+    ASSERT_NE(nullptr, io);
+
+    auto const payload = std::string(20000, 'z') + "encrypted"s;
+    auto got = std::string(std::size(payload), '\0');
+
+    runInEventThread(
+        [io = io, &payload, &got]()
+        {
+            // key the io's decryption to match an outgoing peer's encryption
+            auto const hash = tr_sha1_digest_t{};
+            auto peer = tr_crypto{ &hash, false };
+            tr_cryptoSetTorrentHash(&io->crypto, hash);
+            auto key_len = int{};
+            EXPECT_TRUE(tr_cryptoComputeSecret(&io->crypto, tr_cryptoGetMyPublicKey(&peer, &key_len)));
+            EXPECT_TRUE(tr_cryptoComputeSecret(&peer, tr_cryptoGetMyPublicKey(&io->crypto, &key_len)));
+            tr_cryptoDecryptInit(&io->crypto);
+            tr_cryptoEncryptInit(&peer);
+            tr_peerIoSetEncryption(io, PEER_ENCRYPTION_RC4);
+
+            auto ciphertext = payload;
+            tr_cryptoEncrypt(&peer, std::size(ciphertext), std::data(ciphertext), std::data(ciphertext));
+
+            // spread it over lots of small chains, like a socket read would
+            auto* const inbuf = evbuffer_new();
+            for (size_t pos = 0; pos < std::size(ciphertext); pos += 1000)
+            {
+                auto* const chain = evbuffer_new();
+                evbuffer_add(chain, std::data(ciphertext) + pos, std::min(size_t{ 1000 }, std::size(ciphertext) - pos));
+                evbuffer_add_buffer(inbuf, chain);
+                evbuffer_free(chain);
+            }
+
+            // read the first part straight into memory
+            auto pos = size_t{ 2500 };
+            tr_peerIoReadBytes(io, inbuf, std::data(got), pos);
+
+            // ...the next part into another evbuffer
+            auto* const outbuf = evbuffer_new();
+            evbuffer_add(outbuf, "x", 1);
+            tr_peerIoReadBytesToBuf(io, inbuf, outbuf, 10000);
+            evbuffer_drain(outbuf, 1);
+            evbuffer_remove(outbuf, std::data(got) + pos, 10000);
+            pos += 10000;
+            evbuffer_free(outbuf);
+
+            // ...skip some, and read the rest
+            tr_peerIoDrain(io, inbuf, 500);
+            pos += 500;
+            tr_peerIoReadBytes(io, inbuf, std::data(got) + pos, std::size(got) - pos);
+
+            // the drained bytes were never read
+            std::copy_n(std::data(payload) + 12500, 500, std::data(got) + 12500);
+
+            EXPECT_EQ(0U, evbuffer_get_length(inbuf));
+            evbuffer_free(inbuf);
+        });
+
+    EXPECT_EQ(payload, got);
+
+    freePeerIo(io);
+    tr_netCloseSocket(remote);
+}
+
+TEST_F(PeerIoTest, fileSegmentsStayWithinBudget)
+{
+#ifndef TR_HAVE_SENDFILE
+    GTEST_SKIP() << "sendfile() segments aren't used on this platform";
+#endif
+
+    static auto constexpr TorrentId = int{ 1 };
+    static auto constexpr SpeedLimit = size_t{ 8000 };
+    auto const header = std::string(13, 'h');
+    auto const block = std::string(16384, 'b');
+    auto const message = header + block;
+
+    auto const filename = tr_strvPath(sandboxDir(), "segment-file");
+    createFileWithContents(filename, std::data(block), std::size(block));
+
+    auto const [io, remote] = connectedPeerIo();
+    ASSERT_NE(nullptr, io);
+
+    // queue a header and a block from a file, the way peer-msgs does
+    auto const queue_message = [this, io = io, &header, &block, &filename]()
+    {
+        auto const fd = tr_fdFileCheckout(session_, TorrentId, 0, filename.c_str(), false, TR_PREALLOCATE_NONE, std::size(block));
+        EXPECT_NE(TR_BAD_SYS_FILE, fd);
+        auto* const segment = tr_fdFileGetSegment(session_, TorrentId, 0, std::size(block));
+        EXPECT_NE(nullptr, segment);
+
+        auto* const buf = evbuffer_new();
+        evbuffer_set_flags(buf, EVBUFFER_FLAG_DRAINS_TO_FD);
+        evbuffer_add(buf, std::data(header), std::size(header));
+        evbuffer_add_file_segment(buf, segment, 0, std::size(block));
+        tr_peerIoWriteFileSegments(io, buf, std::size(block));
+        evbuffer_free(buf);
+    };
+
+    // without a speed limit, a write too small for the block
+    // only sends the header, and the block waits for a bigger one
+    runInEventThread(
+        [io = io, &queue_message, &block, &message]()
+        {
+            queue_message();
+            EXPECT_EQ(13, tr_peerIoFlush(io, TR_UP, 987));
+            EXPECT_EQ(std::size(block), evbuffer_get_length(io->outbuf));
+            EXPECT_EQ(int(std::size(block)), tr_peerIoFlush(io, TR_UP, std::size(message)));
+            EXPECT_EQ(0U, evbuffer_get_length(io->outbuf));
+        });
+    EXPECT_EQ(message, recvAll(remote, std::size(message)));
+
+    // with a speed limit too low for a whole block, the block is sent
+    // anyway, and the excess comes out of the next periods' budgets
+    runInEventThread(
+        [io = io, &queue_message, &message]()
+        {
+            auto* const bandwidth = io->bandwidth;
+            bandwidth->setLimited(TR_UP, true);
+            bandwidth->setDesiredSpeedBytesPerSecond(TR_UP, SpeedLimit);
+            queue_message();
+
+            bandwidth->allocate(TR_UP, 1000);
+            EXPECT_EQ(0U, evbuffer_get_length(io->outbuf));
+            EXPECT_EQ(0U, bandwidth->clamp(TR_UP, 100000));
+
+            bandwidth->allocate(TR_UP, 1000);
+            EXPECT_EQ(0U, bandwidth->clamp(TR_UP, 100000));
+
+            // three periods' worth, less what was sent
+            bandwidth->allocate(TR_UP, 1000);
+            EXPECT_EQ(3 * SpeedLimit - std::size(message), bandwidth->clamp(TR_UP, 100000));
+        });
+    EXPECT_EQ(message, recvAll(remote, std::size(message)));
+
+    freePeerIo(io);
+    tr_netCloseSocket(remote);
+}
+
+} // namespace test
+
+} // namespace libtransmission
@@ -0,0 +1,108 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "transmission.h"
+
+#include "net.h"
+#include "peer-mgr-atoms.h"
+
+#include "gtest/gtest.h"
+
+class PeerMgrAtomsTest : public ::testing::Test
+{
+protected:
+    static tr_address makeAddress(size_t n, bool ipv6 = false)
+    {
+        auto const str = ipv6 ? "2001:db8::" + std::to_string(n % 0xffff) + ":" + std::to_string(n / 0xffff) :
+                                "10." + std::to_string((n >> 16) & 0xff) + "." + std::to_string((n >> 8) & 0xff) + "." +
+                std::to_string(n & 0xff);
+        auto addr = tr_address{};
+        EXPECT_TRUE(tr_address_from_string(&addr, str));
+        return addr;
+    }
+};
+
+TEST_F(PeerMgrAtomsTest, findsWhatWasAdded)
+{
+    auto pool = AtomPool{};
+    EXPECT_TRUE(std::empty(pool));
+    EXPECT_EQ(nullptr, pool.find(makeAddress(1)));
+
+    auto const addr = makeAddress(1);
+    auto* const atom = pool.emplace(addr);
+    ASSERT_NE(nullptr, atom);
+    EXPECT_EQ(0, tr_address_compare(&atom->addr, &addr));
+    EXPECT_EQ(nullptr, atom->peer);
+    EXPECT_EQ(0U, atom->numFails);
+    EXPECT_EQ(1U, std::size(pool));
+
+    EXPECT_EQ(atom, pool.find(makeAddress(1)));
+    EXPECT_EQ(nullptr, pool.find(makeAddress(2)));
+    EXPECT_EQ(nullptr, pool.find(makeAddress(1, true)));
+}
+
+TEST_F(PeerMgrAtomsTest, handlesFloods)
+{
+    static auto constexpr NumAtoms = size_t{ 5000 };
+
+    // add a lot of atoms, as a PEX or DHT flood would
+    auto pool = AtomPool{};
+    auto atoms = std::vector<peer_atom*>{};
+    for (size_t i = 0; i < NumAtoms; ++i)
+    {
+        auto* const atom = pool.emplace(makeAddress(i, i % 2 == 0));
+        atom->port = tr_port(i);
+        atoms.push_back(atom);
+    }
+    EXPECT_EQ(NumAtoms, std::size(pool));
+
+    // atoms don't move as the pool grows
+    for (size_t i = 0; i < NumAtoms; ++i)
+    {
+        EXPECT_EQ(atoms[i], pool.find(makeAddress(i, i % 2 == 0)));
+        EXPECT_EQ(tr_port(i), atoms[i]->port);
+    }
+
+    // erase most of them
+    for (size_t i = 0; i < NumAtoms; ++i)
+    {
+        if (i % 10 != 0)
+        {
+            pool.erase(atoms[i]);
+        }
+    }
+    EXPECT_EQ(NumAtoms / 10, std::size(pool));
+
+    // the survivors can still be found, and the rest can't
+    auto seen = std::set<peer_atom const*>{ std::begin(pool), std::end(pool) };
+    for (size_t i = 0; i < NumAtoms; ++i)
+    {
+        auto const* const found = pool.find(makeAddress(i, i % 2 == 0));
+        if (i % 10 == 0)
+        {
+            EXPECT_EQ(atoms[i], found);
+            EXPECT_EQ(1U, seen.count(found));
+        }
+        else
+        {
+            EXPECT_EQ(nullptr, found);
+        }
+    }
+
+    // erased atoms are recycled, and come back zeroed
+    auto* const atom = pool.emplace(makeAddress(1));
+    EXPECT_NE(std::end(atoms), std::find(std::begin(atoms), std::end(atoms), atom));
+    EXPECT_EQ(0U, atom->port);
+    EXPECT_EQ(atom, pool.find(makeAddress(1)));
+}
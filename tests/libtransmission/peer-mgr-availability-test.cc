@@ -0,0 +1,221 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <cstddef>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "bitfield.h"
+#include "peer-mgr-availability.h"
+
+#include "gtest/gtest.h"
+
+class PeerMgrAvailabilityTest : public ::testing::Test
+{
+protected:
+    static std::vector<std::pair<tr_piece_index_t, size_t>> walk(PieceAvailability const& availability)
+    {
+        auto ret = std::vector<std::pair<tr_piece_index_t, size_t>>{};
+        availability.forEachRarestFirst(
+            [&ret](tr_piece_index_t piece, size_t n_peers)
+            {
+                ret.emplace_back(piece, n_peers);
+                return true;
+            });
+        return ret;
+    }
+
+    // walk() should visit every piece that we don't have and that
+    // some peer has, rarest first, with the right peer count
+    static void expectSorted(PieceAvailability const& availability, std::vector<bool> const& client_has)
+    {
+        auto const walked = walk(availability);
+
+        auto n_expected = size_t{};
+        for (tr_piece_index_t piece = 0; piece < availability.size(); ++piece)
+        {
+            if (!client_has[piece] && availability.count(piece) > 0)
+            {
+                ++n_expected;
+            }
+        }
+        EXPECT_EQ(n_expected, std::size(walked));
+
+        for (size_t i = 0; i < std::size(walked); ++i)
+        {
+            auto const [piece, n_peers] = walked[i];
+            EXPECT_FALSE(client_has[piece]);
+            EXPECT_EQ(availability.count(piece), n_peers);
+            if (i > 0)
+            {
+                EXPECT_LE(walked[i - 1].second, n_peers);
+            }
+        }
+    }
+};
+
+TEST_F(PeerMgrAvailabilityTest, countsPieces)
+{
+    auto availability = PieceAvailability{};
+    availability.reset(10);
+    EXPECT_EQ(10U, availability.size());
+    EXPECT_TRUE(std::empty(walk(availability)));
+
+    availability.addPiece(3);
+    availability.addPiece(3);
+    availability.addPiece(7);
+    EXPECT_EQ(2U, availability.count(3));
+    EXPECT_EQ(1U, availability.count(7));
+    EXPECT_EQ(0U, availability.count(0));
+
+    auto walked = walk(availability);
+    ASSERT_EQ(2U, std::size(walked));
+    EXPECT_EQ(std::make_pair(tr_piece_index_t{ 7 }, size_t{ 1 }), walked[0]);
+    EXPECT_EQ(std::make_pair(tr_piece_index_t{ 3 }, size_t{ 2 }), walked[1]);
+
+    availability.removePiece(3);
+    availability.removePiece(3);
+    walked = walk(availability);
+    ASSERT_EQ(1U, std::size(walked));
+    EXPECT_EQ(std::make_pair(tr_piece_index_t{ 7 }, size_t{ 1 }), walked[0]);
+}
+
+TEST_F(PeerMgrAvailabilityTest, countsPeers)
+{
+    auto availability = PieceAvailability{};
+    availability.reset(8);
+
+    auto seed = tr_bitfield{ 8 };
+    seed.setHasAll();
+    auto leech = tr_bitfield{ 8 };
+    leech.set(1);
+    leech.set(2);
+
+    availability.addPeer(seed);
+    availability.addPeer(leech);
+    EXPECT_EQ(1U, availability.count(0));
+    EXPECT_EQ(2U, availability.count(1));
+    EXPECT_EQ(2U, availability.count(2));
+
+    availability.removePeer(seed);
+    EXPECT_EQ(0U, availability.count(0));
+    EXPECT_EQ(1U, availability.count(1));
+
+    availability.removePeer(leech);
+    EXPECT_TRUE(std::empty(walk(availability)));
+}
+
+TEST_F(PeerMgrAvailabilityTest, skipsPiecesTheClientHas)
+{
+    auto availability = PieceAvailability{};
+    availability.reset(4);
+
+    auto seed = tr_bitfield{ 4 };
+    seed.setHasAll();
+    availability.addPeer(seed);
+    availability.setClientHas(2);
+
+    auto walked = walk(availability);
+    EXPECT_EQ(3U, std::size(walked));
+    for (auto const& [piece, n_peers] : walked)
+    {
+        EXPECT_NE(2U, piece);
+    }
+
+    // we still keep count of pieces that we have
+    availability.addPiece(2);
+    EXPECT_EQ(2U, availability.count(2));
+    availability.removePeer(seed);
+    EXPECT_EQ(1U, availability.count(2));
+    EXPECT_TRUE(std::empty(walk(availability)));
+}
+
+TEST_F(PeerMgrAvailabilityTest, requeuesPiecesTheClientLost)
+{
+    auto availability = PieceAvailability{};
+    availability.reset(4);
+
+    auto seed = tr_bitfield{ 4 };
+    seed.setHasAll();
+    availability.addPeer(seed);
+    availability.addPiece(1);
+    availability.addPiece(1);
+    availability.setClientHas(1);
+    availability.setClientHas(3);
+    EXPECT_EQ(2U, std::size(walk(availability)));
+
+    // a lost piece goes back into the walk, in its own bucket
+    availability.setClientLacks(3);
+    auto walked = walk(availability);
+    EXPECT_EQ(3U, std::size(walked));
+    expectSorted(availability, { false, true, false, false });
+
+    // even one that's more common than any piece still in the walk
+    availability.setClientLacks(1);
+    walked = walk(availability);
+    ASSERT_EQ(4U, std::size(walked));
+    EXPECT_EQ(std::make_pair(tr_piece_index_t{ 1 }, size_t{ 3 }), walked.back());
+    expectSorted(availability, { false, false, false, false });
+
+    // losing a piece we didn't have changes nothing
+    availability.setClientLacks(1);
+    EXPECT_EQ(walked, walk(availability));
+}
+
+TEST_F(PeerMgrAvailabilityTest, staysSortedThroughRandomChanges)
+{
+    static auto constexpr NumPieces = tr_piece_index_t{ 200 };
+
+    auto availability = PieceAvailability{};
+    availability.reset(NumPieces);
+    auto client_has = std::vector<bool>(NumPieces);
+
+    auto rng = std::mt19937{ 0 };
+    auto pick = std::uniform_int_distribution<tr_piece_index_t>{ 0, NumPieces - 1 };
+    auto action = std::uniform_int_distribution<int>{ 0, 10 };
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        auto const piece = pick(rng);
+
+        switch (action(rng))
+        {
+        case 0:
+            client_has[piece] = true;
+            availability.setClientHas(piece);
+            break;
+
+        case 1:
+            client_has[piece] = false;
+            availability.setClientLacks(piece);
+            break;
+
+        case 2:
+        case 3:
+        case 4:
+            if (availability.count(piece) > 0)
+            {
+                availability.removePiece(piece);
+            }
+            break;
+
+        default:
+            availability.addPiece(piece);
+            break;
+        }
+
+        if (i % 100 == 0)
+        {
+            expectSorted(availability, client_has);
+        }
+    }
+
+    expectSorted(availability, client_has);
+}
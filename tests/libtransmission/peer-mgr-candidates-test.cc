@@ -0,0 +1,138 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "peer-mgr-candidates.h"
+
+#include "gtest/gtest.h"
+
+class PeerMgrCandidatesTest : public ::testing::Test
+{
+protected:
+    struct Item
+    {
+        int key;
+        size_t pos;
+    };
+
+    struct Traits
+    {
+        static auto key(Item const* item)
+        {
+            return item->key;
+        }
+
+        static auto& pos(Item* item)
+        {
+            return item->pos;
+        }
+    };
+
+    using Heap = IndexedHeap<Item, Traits>;
+
+    static std::vector<int> drain(Heap& heap)
+    {
+        auto ret = std::vector<int>{};
+        while (!heap.empty())
+        {
+            ret.push_back(heap.top()->key);
+            heap.pop();
+        }
+        return ret;
+    }
+};
+
+TEST_F(PeerMgrCandidatesTest, popsInKeyOrder)
+{
+    auto items = std::vector<Item>(100);
+    for (size_t i = 0; i < std::size(items); ++i)
+    {
+        items[i].key = int(i);
+    }
+    std::shuffle(std::begin(items), std::end(items), std::mt19937{ 1 });
+
+    auto heap = Heap{};
+    for (auto& item : items)
+    {
+        EXPECT_FALSE(Heap::contains(&item));
+        heap.insert(&item);
+        EXPECT_TRUE(Heap::contains(&item));
+    }
+    EXPECT_EQ(std::size(items), heap.size());
+
+    auto const keys = drain(heap);
+    EXPECT_EQ(std::size(items), std::size(keys));
+    EXPECT_TRUE(std::is_sorted(std::begin(keys), std::end(keys)));
+
+    // nothing is left pointing into the heap
+    EXPECT_TRUE(std::none_of(std::begin(items), std::end(items), [](auto& item) { return Heap::contains(&item); }));
+}
+
+TEST_F(PeerMgrCandidatesTest, erasesFromTheMiddle)
+{
+    auto items = std::vector<Item>(64);
+    auto rng = std::mt19937{ 2 };
+    for (auto& item : items)
+    {
+        item.key = int(rng() % 1000);
+    }
+
+    auto heap = Heap{};
+    for (auto& item : items)
+    {
+        heap.insert(&item);
+    }
+
+    // erase every third item, and rekey every fifth one
+    auto expected = std::vector<int>{};
+    for (size_t i = 0; i < std::size(items); ++i)
+    {
+        auto& item = items[i];
+
+        if (i % 3 == 0)
+        {
+            heap.erase(&item);
+            EXPECT_FALSE(Heap::contains(&item));
+            heap.erase(&item); // erasing twice is harmless
+            continue;
+        }
+
+        if (i % 5 == 0)
+        {
+            heap.erase(&item);
+            item.key = int(rng() % 1000);
+            heap.insert(&item);
+        }
+
+        expected.push_back(item.key);
+    }
+    std::sort(std::begin(expected), std::end(expected));
+
+    EXPECT_EQ(expected, drain(heap));
+}
+
+TEST_F(PeerMgrCandidatesTest, clearResetsPositions)
+{
+    auto items = std::vector<Item>(10);
+    auto heap = Heap{};
+    for (auto& item : items)
+    {
+        heap.insert(&item);
+    }
+
+    heap.clear();
+    EXPECT_TRUE(heap.empty());
+    EXPECT_TRUE(std::none_of(std::begin(items), std::end(items), [](auto& item) { return Heap::contains(&item); }));
+
+    // the items can go back in
+    heap.insert(&items[3]);
+    EXPECT_EQ(&items[3], heap.top());
+}
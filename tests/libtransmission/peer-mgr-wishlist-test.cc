@@ -4,12 +4,17 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <functional>
+#include <numeric>
 #include <type_traits>
+#include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
 
 #include "transmission.h"
 
+#include "bitfield.h"
+#include "peer-mgr-availability.h"
 #include "peer-mgr-wishlist.h"
 
 #include "gtest/gtest.h"
@@ -23,11 +28,15 @@ protected:
         mutable std::map<tr_piece_index_t, size_t> missing_block_count_;
         mutable std::map<tr_piece_index_t, tr_block_span_t> block_span_;
         mutable std::map<tr_piece_index_t, tr_priority_t> piece_priority_;
+        mutable std::map<tr_piece_index_t, size_t> n_peers_with_piece_;
         mutable std::set<tr_block_index_t> can_request_block_;
         mutable std::set<tr_piece_index_t> can_request_piece_;
         tr_piece_index_t piece_count_ = 0;
         bool is_endgame_ = false;
 
+        // if set, walk the pieces with this instead of `n_peers_with_piece_`
+        PieceAvailability const* availability_ = nullptr;
+
         [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const final
         {
             return can_request_block_.count(block) != 0;
@@ -58,14 +67,43 @@ protected:
             return block_span_[piece];
         }
 
-        [[nodiscard]] tr_piece_index_t countAllPieces() const final
+        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const final
         {
-            return piece_count_;
+            return piece_priority_[piece];
         }
 
-        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const final
+        [[nodiscard]] tr_priority_t highestPriority() const final
         {
-            return piece_priority_[piece];
+            auto ret = tr_priority_t{ TR_PRI_LOW };
+            for (tr_piece_index_t piece = 0; piece < piece_count_; ++piece)
+            {
+                ret = std::max(ret, piece_priority_[piece]);
+            }
+            return ret;
+        }
+
+        void forEachRarestPiece(std::function<bool(tr_piece_index_t, size_t)> const& func) const final
+        {
+            if (availability_ != nullptr)
+            {
+                availability_->forEachRarestFirst(func);
+                return;
+            }
+
+            auto pieces = std::vector<tr_piece_index_t>(piece_count_);
+            std::iota(std::begin(pieces), std::end(pieces), 0);
+            std::stable_sort(
+                std::begin(pieces),
+                std::end(pieces),
+                [this](auto a, auto b) { return n_peers_with_piece_[a] < n_peers_with_piece_[b]; });
+
+            for (auto const piece : pieces)
+            {
+                if (!func(piece, n_peers_with_piece_[piece]))
+                {
+                    break;
+                }
+            }
         }
     };
 };
@@ -342,3 +380,132 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
         EXPECT_EQ(0, requested.count(200, 300));
     }
 }
+
+TEST_F(PeerMgrWishlistTest, prefersRarePieces)
+{
+    auto peer_info = MockPeerInfo{};
+
+    // setup: three pieces, all missing
+    peer_info.piece_count_ = 3;
+    peer_info.missing_block_count_[0] = 100;
+    peer_info.missing_block_count_[1] = 100;
+    peer_info.missing_block_count_[2] = 100;
+    peer_info.block_span_[0] = { 0, 100 };
+    peer_info.block_span_[1] = { 100, 200 };
+    peer_info.block_span_[2] = { 200, 300 };
+
+    // and we want everything
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        peer_info.can_request_piece_.insert(i);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        peer_info.can_request_block_.insert(i);
+    }
+
+    // but the third piece is rarer than the others
+    peer_info.n_peers_with_piece_[0] = 5;
+    peer_info.n_peers_with_piece_[1] = 3;
+    peer_info.n_peers_with_piece_[2] = 1;
+
+    // wishlist should pick the rarest piece's blocks first,
+    // and then move on to the next-rarest piece
+    auto const num_runs = 1000;
+    for (int run = 0; run < num_runs; ++run)
+    {
+        auto const spans = Wishlist::next(peer_info, 150);
+        auto requested = tr_bitfield(300);
+        for (auto const& span : spans)
+        {
+            requested.setSpan(span.begin, span.end);
+        }
+        EXPECT_EQ(150, requested.count());
+        EXPECT_EQ(0, requested.count(0, 100));
+        EXPECT_EQ(50, requested.count(100, 200));
+        EXPECT_EQ(100, requested.count(200, 300));
+    }
+}
+
+TEST_F(PeerMgrWishlistTest, prefersHighPriorityPiecesOverRarePieces)
+{
+    auto peer_info = MockPeerInfo{};
+
+    // setup: three pieces, all missing
+    peer_info.piece_count_ = 3;
+    peer_info.missing_block_count_[0] = 100;
+    peer_info.missing_block_count_[1] = 100;
+    peer_info.missing_block_count_[2] = 100;
+    peer_info.block_span_[0] = { 0, 100 };
+    peer_info.block_span_[1] = { 100, 200 };
+    peer_info.block_span_[2] = { 200, 300 };
+
+    // and we want everything
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        peer_info.can_request_piece_.insert(i);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        peer_info.can_request_block_.insert(i);
+    }
+
+    // the first piece is the most common, but it's also high priority
+    peer_info.n_peers_with_piece_[0] = 5;
+    peer_info.n_peers_with_piece_[1] = 3;
+    peer_info.n_peers_with_piece_[2] = 1;
+    peer_info.piece_priority_[0] = TR_PRI_HIGH;
+
+    auto const spans = Wishlist::next(peer_info, 10);
+    auto requested = tr_bitfield(300);
+    for (auto const& span : spans)
+    {
+        requested.setSpan(span.begin, span.end);
+    }
+    EXPECT_EQ(10, requested.count());
+    EXPECT_EQ(10, requested.count(0, 100));
+}
+
+TEST_F(PeerMgrWishlistTest, requestsPiecesThatOnlyWebseedsHave)
+{
+    auto peer_info = MockPeerInfo{};
+
+    // setup: three pieces, all missing
+    peer_info.piece_count_ = 3;
+    peer_info.missing_block_count_[0] = 100;
+    peer_info.missing_block_count_[1] = 100;
+    peer_info.missing_block_count_[2] = 50;
+    peer_info.block_span_[0] = { 0, 100 };
+    peer_info.block_span_[1] = { 100, 200 };
+    peer_info.block_span_[2] = { 200, 250 };
+
+    // and we want everything
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        peer_info.can_request_piece_.insert(i);
+    }
+    for (tr_block_index_t i = 0; i < 250; ++i)
+    {
+        peer_info.can_request_block_.insert(i);
+    }
+
+    // no peers have anything, so there's nothing to walk
+    auto availability = PieceAvailability{};
+    availability.reset(peer_info.piece_count_);
+    peer_info.availability_ = &availability;
+    EXPECT_TRUE(std::empty(Wishlist::next(peer_info, 1000)));
+
+    // the swarm counts webseeds like a peer with every piece,
+    // so the webseed can be asked for all of them
+    auto webseed_have = tr_bitfield{ peer_info.piece_count_ };
+    webseed_have.setHasAll();
+    availability.addPeer(webseed_have);
+
+    auto const spans = Wishlist::next(peer_info, 1000);
+    auto requested = tr_bitfield(250);
+    for (auto const& span : spans)
+    {
+        requested.setSpan(span.begin, span.end);
+    }
+    EXPECT_EQ(250, requested.count());
+}
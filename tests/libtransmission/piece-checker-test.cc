@@ -0,0 +1,253 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "piece-checker.h"
+#include "session.h"
+#include "torrent.h"
+#include "trevent.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class PieceCheckerTest : public SessionTest
+{
+protected:
+    using Result = std::tuple<int, tr_piece_index_t, bool>;
+
+    // only touched from the session thread
+    static inline std::vector<Result> results_;
+
+    static void onDone(tr_session* session, int torrent_id, tr_piece_index_t piece, bool pass)
+    {
+        EXPECT_TRUE(tr_amInEventThread(session));
+        results_.emplace_back(torrent_id, piece, pass);
+    }
+
+    // results are delivered through the session's checker, so swap ours in
+    PieceChecker* installChecker(size_t n_workers)
+    {
+        results_.clear();
+        runInEventThread(
+            [this, n_workers]()
+            { session_->piece_checker = std::make_unique<PieceChecker>(session_, n_workers, onDone); });
+        return session_->piece_checker.get();
+    }
+
+    void destroyChecker()
+    {
+        runInEventThread([this]() { session_->piece_checker.reset(); });
+    }
+
+    size_t resultCount()
+    {
+        auto n = size_t{};
+        runInEventThread([&n]() { n = std::size(results_); });
+        return n;
+    }
+};
+
+TEST_F(PieceCheckerTest, checksPiecesOnWorkerThreads)
+{
+    auto* const checker = installChecker(2);
+
+    auto const good = std::vector<uint8_t>(16384, 'a');
+    auto const hash = *tr_sha1(good);
+    auto bad = good;
+    bad.back() = 'b';
+
+    checker->add(1, 0, hash, std::vector<uint8_t>{ good });
+    checker->add(1, 1, hash, std::move(bad));
+    checker->add(2, 7, hash, std::vector<uint8_t>{ good });
+
+    EXPECT_TRUE(waitFor([this]() { return resultCount() == 3; }, 5000));
+    EXPECT_EQ(0U, checker->size());
+
+    destroyChecker();
+
+    std::sort(std::begin(results_), std::end(results_));
+    auto const expected = std::vector<Result>{ { 1, 0, true }, { 1, 1, false }, { 2, 7, true } };
+    EXPECT_EQ(expected, results_);
+}
+
+TEST_F(PieceCheckerTest, finishesQueuedPiecesWhenDestroyed)
+{
+    auto* const checker = installChecker(1);
+
+    auto const data = std::vector<uint8_t>(1024 * 1024, 'z');
+    auto const hash = *tr_sha1(data);
+
+    static auto constexpr NumPieces = tr_piece_index_t{ 20 };
+    for (tr_piece_index_t piece = 0; piece < NumPieces; ++piece)
+    {
+        checker->add(1, piece, hash, std::vector<uint8_t>{ data });
+    }
+
+    // destroying the checker delivers every result before it returns
+    auto n_results = size_t{};
+    runInEventThread(
+        [this, &n_results]()
+        {
+            session_->piece_checker.reset();
+            n_results = std::size(results_);
+        });
+    EXPECT_EQ(NumPieces, n_results);
+}
+
+TEST_F(PieceCheckerTest, hashStreamsFollowInOrderBlocks)
+{
+    static auto constexpr BlockSize = size_t{ 16384 };
+    static auto constexpr PieceBegin = tr_block_index_t{ 8 };
+    static auto constexpr NumBlocks = tr_block_index_t{ 4 };
+
+    auto piece = std::vector<uint8_t>(BlockSize * NumBlocks);
+    for (size_t i = 0; i < std::size(piece); ++i)
+    {
+        piece[i] = static_cast<uint8_t>(i * 7);
+    }
+    auto const hash = *tr_sha1(piece);
+
+    auto streams = PieceHashStreams{};
+    auto const addBlock = [&streams, &piece](tr_block_index_t block)
+    {
+        auto* const buf = evbuffer_new();
+        evbuffer_add(buf, &piece[(block - PieceBegin) * BlockSize], BlockSize);
+        streams.add(2, PieceBegin, block, buf);
+        evbuffer_free(buf);
+    };
+
+    // blocks 0 and 1 arrive in order, then 3 skips ahead of 2
+    addBlock(PieceBegin + 1);
+    EXPECT_EQ(0U, std::size(streams));
+    addBlock(PieceBegin);
+    addBlock(PieceBegin + 1);
+    addBlock(PieceBegin + 3);
+    addBlock(PieceBegin + 2);
+    EXPECT_EQ(1U, std::size(streams));
+
+    auto const [ctx, next_block] = streams.take(2, PieceBegin);
+    EXPECT_NE(nullptr, ctx);
+    EXPECT_EQ(PieceBegin + 3, next_block);
+    EXPECT_EQ(0U, std::size(streams));
+
+    // finishing the hash with the blocks that came out of order gives the piece's hash
+    auto tail = std::vector<uint8_t>{ std::begin(piece) + (next_block - PieceBegin) * BlockSize, std::end(piece) };
+    EXPECT_TRUE(PieceChecker::check(hash, tail, ctx));
+
+    // a piece that has nothing hashed yet must be read back in full
+    auto const [empty_ctx, first_block] = streams.take(3, PieceBegin);
+    EXPECT_EQ(nullptr, empty_ctx);
+    EXPECT_EQ(PieceBegin, first_block);
+    EXPECT_TRUE(PieceChecker::check(hash, piece, empty_ctx));
+}
+
+TEST_F(PieceCheckerTest, hashStreamsAreDroppedWithTheirBlocks)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, true);
+
+    auto const block = std::vector<uint8_t>(tor->blockSize(), '\0');
+    auto const start_hashing = [tor, &block](tr_piece_index_t piece)
+    {
+        auto* const buf = evbuffer_new();
+        evbuffer_add(buf, std::data(block), std::size(block));
+        auto const piece_begin = tor->blockSpanForPiece(piece).begin;
+        tor->hash_streams.add(piece, piece_begin, piece_begin, buf);
+        evbuffer_free(buf);
+    };
+
+    runInEventThread(
+        [&]()
+        {
+            start_hashing(1);
+            start_hashing(2);
+            start_hashing(3);
+            EXPECT_EQ(3U, std::size(tor->hash_streams));
+
+            // a piece that's cleared, e.g. because it failed its check, loses its hash
+            tor->setHasPiece(2, false);
+            EXPECT_EQ(2U, std::size(tor->hash_streams));
+
+            // and resetting all the blocks loses all of them
+            tor->setBlocks(tor->blocks());
+            EXPECT_EQ(0U, std::size(tor->hash_streams));
+        });
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(PieceCheckerTest, queuedPieceIsNotAdvertised)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, true);
+    blockingTorrentVerify(tor);
+    ASSERT_TRUE(tor->hasAll());
+
+    // no workers, so the piece stays queued until we deliver its result
+    runInEventThread(
+        [this]() { session_->piece_checker = std::make_unique<PieceChecker>(session_, 0, tr_torrentPieceChecked); });
+
+    static auto constexpr Piece = tr_piece_index_t{ 1 };
+    auto const [begin, end] = tor->blockSpanForPiece(Piece);
+    ASSERT_LT(begin + 1, end);
+
+    auto const advertised = [tor]()
+    {
+        auto const bits = tor->createPieceBitfield();
+        return (bits[Piece / 8] & (0x80 >> (Piece % 8))) != 0;
+    };
+
+    runInEventThread(
+        [&]()
+        {
+            tor->setHasPiece(Piece, false);
+            for (auto block = begin; block < end; ++block)
+            {
+                tr_torrentGotBlock(tor, block);
+            }
+
+            EXPECT_TRUE(tor->isPieceBeingChecked(Piece));
+            EXPECT_EQ(1U, session_->piece_checker->size());
+            EXPECT_FALSE(tor->hasPiece(Piece));
+            EXPECT_FALSE(tor->hasBlock(end - 1));
+            EXPECT_FALSE(advertised());
+            EXPECT_FALSE(tor->hasAll());
+
+            // the same block arriving again doesn't sneak the piece in
+            tr_torrentGotBlock(tor, end - 1);
+            EXPECT_FALSE(tor->hasPiece(Piece));
+
+            tr_torrentPieceChecked(session_, tor->uniqueId, Piece, true);
+            EXPECT_FALSE(tor->isPieceBeingChecked(Piece));
+            EXPECT_TRUE(tor->hasPiece(Piece));
+            EXPECT_TRUE(advertised());
+            EXPECT_TRUE(tor->hasAll());
+
+            session_->piece_checker.reset();
+        });
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
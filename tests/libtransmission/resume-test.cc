@@ -0,0 +1,238 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h"
+
+#include "file.h"
+#include "resume.h"
+#include "torrent.h"
+#include "utils.h"
+#include "variant.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class ResumeTest : public SessionTest
+{
+protected:
+    static std::string readFile(std::string const& filename)
+    {
+        auto buf = std::vector<char>{};
+        EXPECT_TRUE(tr_loadFile(buf, filename));
+        return { std::data(buf), std::size(buf) };
+    }
+
+    static std::vector<int64_t> priorities(tr_variant* dict)
+    {
+        auto ret = std::vector<int64_t>{};
+        tr_variant* list = nullptr;
+        if (tr_variantDictFindList(dict, TR_KEY_priority, &list))
+        {
+            auto i = int64_t{};
+            for (size_t n = 0; tr_variantGetInt(tr_variantListChild(list, n), &i); ++n)
+            {
+                ret.push_back(i);
+            }
+        }
+        return ret;
+    }
+
+    // .resume layout: a 16-byte header, then two 208-byte tables of
+    // { generation, checksum, entries[] }, each entry being
+    // { id, length, capacity, slot, offset, checksum }
+    static auto constexpr TableOffsets = std::array<size_t, 2>{ 16, 224 };
+
+    static uint64_t getUint(std::string const& buf, size_t pos, size_t n_bytes)
+    {
+        auto val = uint64_t{};
+        for (size_t i = 0; i < n_bytes; ++i)
+        {
+            val |= uint64_t{ uint8_t(buf[pos + i]) } << (8 * i);
+        }
+        return val;
+    }
+
+    static size_t newestTable(std::string const& buf)
+    {
+        return getUint(buf, TableOffsets[0], 8) > getUint(buf, TableOffsets[1], 8) ? TableOffsets[0] : TableOffsets[1];
+    }
+
+    void corrupt(std::string const& filename, std::string buf, size_t pos) const
+    {
+        buf[pos] = char(~buf[pos]);
+        createFileWithContents(filename, std::data(buf), std::size(buf));
+    }
+};
+
+TEST_F(ResumeTest, savesAndLoadsBinaryFormat)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    ASSERT_EQ(3U, tor->fileCount());
+    tor->setFilePriority(0, TR_PRI_HIGH);
+    tor->setFilePriority(2, TR_PRI_LOW);
+    tr_torrentSetLabels(tor, { "foo"s });
+
+    tr_resume::save(tor);
+    auto const filename = tor->resumeFile();
+    EXPECT_TRUE(tr_strvStartsWith(readFile(filename), "TRresume"sv));
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_resume::parseFile(filename, &top));
+    EXPECT_EQ((std::vector<int64_t>{ TR_PRI_HIGH, TR_PRI_NORMAL, TR_PRI_LOW }), priorities(&top));
+    tr_variant* dnd = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(&top, TR_KEY_dnd, &dnd));
+    EXPECT_EQ(3U, tr_variantListSize(dnd));
+    tr_variant* progress = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&top, TR_KEY_progress, &progress));
+    tr_variant* labels = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(&top, TR_KEY_labels, &labels));
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantGetStrView(tr_variantListChild(labels, 0), &sv));
+    EXPECT_EQ("foo"sv, sv);
+    tr_variantFree(&top);
+
+    // confirm that tr_resume::load() gets it back
+    tor->setFilePriority(0, TR_PRI_NORMAL);
+    auto* const ctor = tr_ctorNew(session_);
+    auto const loaded = tr_resume::load(tor, tr_resume::All, ctor, nullptr);
+    EXPECT_NE(0U, loaded & tr_resume::FilePriorities);
+    EXPECT_EQ(TR_PRI_HIGH, tr_torrentFile(tor, 0).priority);
+    tr_ctorFree(ctor);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(ResumeTest, rewritesOnlyChangedSections)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    tr_resume::save(tor);
+    auto const filename = tor->resumeFile();
+    auto const before = readFile(filename);
+
+    // hold the file open: if save() replaced the file instead of
+    // updating it in place, this fd would still see the old contents
+    auto const fd = tr_sys_file_open(filename.c_str(), TR_SYS_FILE_READ, 0, nullptr);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+
+    tor->setFilePriority(1, TR_PRI_HIGH);
+    tr_resume::save(tor);
+    auto const after = readFile(filename);
+    EXPECT_EQ(std::size(before), std::size(after));
+    EXPECT_NE(before, after);
+
+    auto buf = std::string(std::size(after), '\0');
+    auto n_read = uint64_t{};
+    EXPECT_TRUE(tr_sys_file_read_at(fd, std::data(buf), std::size(buf), 0, &n_read, nullptr));
+    EXPECT_EQ(after, buf);
+    tr_sys_file_close(fd, nullptr);
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_resume::parseFile(filename, &top));
+    EXPECT_EQ((std::vector<int64_t>{ TR_PRI_NORMAL, TR_PRI_HIGH, TR_PRI_NORMAL }), priorities(&top));
+    tr_variantFree(&top);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(ResumeTest, tornTableFallsBackToPreviousGeneration)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    tr_resume::save(tor);
+    tor->setFilePriority(1, TR_PRI_HIGH);
+    tr_resume::save(tor);
+
+    // simulate a crash while the newest table was being written
+    auto const filename = tor->resumeFile();
+    auto const buf = readFile(filename);
+    corrupt(filename, buf, newestTable(buf) + 16 + 32 * 4 + 4);
+
+    // the section's previous slot is still intact, so we get the previous save
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_resume::parseFile(filename, &top));
+    EXPECT_EQ((std::vector<int64_t>{ TR_PRI_NORMAL, TR_PRI_NORMAL, TR_PRI_NORMAL }), priorities(&top));
+    tr_variantFree(&top);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(ResumeTest, keepsSectionsThatVerify)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    tor->setFilePriority(0, TR_PRI_HIGH);
+    tr_torrentSetLabels(tor, { "foo"s });
+    tr_resume::save(tor);
+
+    // damage the meta section's data
+    auto const filename = tor->resumeFile();
+    auto const buf = readFile(filename);
+    auto const meta_entry = newestTable(buf) + 16;
+    auto const meta_offset = getUint(buf, meta_entry + 16, 8) +
+        getUint(buf, meta_entry + 12, 4) * getUint(buf, meta_entry + 8, 4);
+    corrupt(filename, buf, meta_offset);
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_resume::parseFile(filename, &top));
+    tr_variant* labels = nullptr;
+    EXPECT_FALSE(tr_variantDictFindList(&top, TR_KEY_labels, &labels));
+    EXPECT_EQ((std::vector<int64_t>{ TR_PRI_HIGH, TR_PRI_NORMAL, TR_PRI_NORMAL }), priorities(&top));
+    tr_variant* progress = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&top, TR_KEY_progress, &progress));
+    tr_variantFree(&top);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(ResumeTest, migratesBencFormat)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    auto const filename = tor->resumeFile();
+
+    auto const benc = "d6:labelsl3:bare8:priorityli1ei0ei-1eee"sv;
+    createFileWithContents(filename, std::data(benc), std::size(benc));
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_resume::parseFile(filename, &top));
+    EXPECT_EQ((std::vector<int64_t>{ TR_PRI_HIGH, TR_PRI_NORMAL, TR_PRI_LOW }), priorities(&top));
+    tr_variantFree(&top);
+
+    auto* const ctor = tr_ctorNew(session_);
+    auto const loaded = tr_resume::load(tor, tr_resume::All, ctor, nullptr);
+    EXPECT_NE(0U, loaded & tr_resume::Labels);
+    EXPECT_EQ(1U, tor->labels.count("bar"s));
+    tr_ctorFree(ctor);
+
+    // the next save writes the new format
+    tr_resume::save(tor);
+    EXPECT_TRUE(tr_strvStartsWith(readFile(filename), "TRresume"sv));
+    top = {};
+    EXPECT_TRUE(tr_resume::parseFile(filename, &top));
+    tr_variant* labels = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(&top, TR_KEY_labels, &labels));
+    tr_variantFree(&top);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
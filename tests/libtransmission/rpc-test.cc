@@ -10,9 +10,12 @@
 
 #include "test-fixtures.h"
 
+#include <event2/buffer.h>
+
 #include <algorithm>
 #include <array>
 #include <set>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -187,6 +190,193 @@ TEST_F(RpcTest, sessionGet)
     tr_torrentRemove(tor, false, nullptr);
 }
 
+/***
+****
+***/
+
+TEST_F(RpcTest, torrentGetJsonMatchesVariant)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<std::string*>(setme) = tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN);
+    };
+
+    auto const rpc_response_json_func = [](tr_session* /*session*/, struct evbuffer* response, void* setme) noexcept
+    {
+        auto const len = evbuffer_get_length(response);
+        *static_cast<std::string*>(setme) = std::string{ reinterpret_cast<char const*>(evbuffer_pullup(response, -1)), len };
+    };
+
+    auto* tor = zeroTorrentInit();
+    EXPECT_NE(nullptr, tor);
+
+    auto const requests = std::array<std::string_view, 5>{
+        R"({"method":"torrent-get","tag":7,"arguments":{"fields":["name","id","files","fileStats","hashString",)"
+        R"("isPrivate","labels","magnetLink","peersFrom","percentDone","pieces","priorities","totalSize",)"
+        R"("trackers","uploadRatio","wanted","webseeds","name","alt-speed-up","no-such-field"]}})"sv,
+        R"({"method":"torrent-get","arguments":{"format":"table","fields":["pieceCount","name","id","percentDone"]}})"sv,
+        R"({"method":"torrent-get","arguments":{"ids":"recently-active","fields":["id"]}})"sv,
+        R"({"method":"torrent-get","arguments":{"fields":[]}})"sv,
+        R"({"method":"torrent-get","tag":3})"sv,
+    };
+
+    for (auto const& json : requests)
+    {
+        auto request = tr_variant{};
+        EXPECT_TRUE(tr_variantFromBuf(&request, TR_VARIANT_PARSE_JSON, json));
+
+        auto expected = std::string{};
+        tr_rpc_request_exec_json(session_, &request, rpc_response_func, &expected);
+        auto actual = std::string{};
+        tr_rpc_request_exec_json_to_buf(session_, &request, rpc_response_json_func, &actual);
+        EXPECT_EQ(expected, actual) << json;
+
+        tr_variantFree(&request);
+    }
+
+    // other methods, and errors, get serialized from the tr_variant response
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "no-such-method");
+    auto expected = std::string{};
+    tr_rpc_request_exec_json(session_, &request, rpc_response_func, &expected);
+    auto actual = std::string{};
+    tr_rpc_request_exec_json_to_buf(session_, &request, rpc_response_json_func, &actual);
+    EXPECT_EQ(expected, actual);
+    tr_variantFree(&request);
+
+    // cleanup
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(RpcTest, torrentGetSince)
+{
+    auto* tor = zeroTorrentInit();
+    EXPECT_NE(nullptr, tor);
+    auto const id = tr_torrentId(tor);
+
+    struct Changes
+    {
+        int64_t cursor = 0;
+        std::vector<int64_t> torrents;
+        std::vector<int64_t> removed;
+    };
+
+    auto const torrent_get_since = [this](int64_t since)
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantListAddStrView(tr_variantDictAddList(args, TR_KEY_fields, 1), "id");
+        tr_variantDictAddInt(args, TR_KEY_since, since);
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* got, void* setme) noexcept
+            {
+                *static_cast<tr_variant*>(setme) = *got;
+                tr_variantInitBool(got, false);
+            },
+            &response);
+        tr_variantFree(&request);
+
+        auto changes = Changes{};
+        tr_variant* args_out = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args_out));
+        EXPECT_TRUE(tr_variantDictFindInt(args_out, TR_KEY_cursor, &changes.cursor));
+
+        tr_variant* list = nullptr;
+        EXPECT_TRUE(tr_variantDictFindList(args_out, TR_KEY_torrents, &list));
+        for (size_t i = 0, n = tr_variantListSize(list); i < n; ++i)
+        {
+            auto torrent_id = int64_t{};
+            EXPECT_TRUE(tr_variantDictFindInt(tr_variantListChild(list, i), TR_KEY_id, &torrent_id));
+            changes.torrents.push_back(torrent_id);
+        }
+
+        EXPECT_TRUE(tr_variantDictFindList(args_out, TR_KEY_removed, &list));
+        for (size_t i = 0, n = tr_variantListSize(list); i < n; ++i)
+        {
+            auto torrent_id = int64_t{};
+            EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(list, i), &torrent_id));
+            changes.removed.push_back(torrent_id);
+        }
+
+        tr_variantFree(&response);
+        return changes;
+    };
+
+    // a zero cursor gets everything
+    auto changes = torrent_get_since(0);
+    EXPECT_EQ(std::vector<int64_t>{ id }, changes.torrents);
+    EXPECT_TRUE(std::empty(changes.removed));
+    EXPECT_LT(0, changes.cursor);
+
+    // once the torrent is idle, nothing has changed
+    EXPECT_TRUE(waitFor(
+        [&]()
+        {
+            changes = torrent_get_since(changes.cursor);
+            return std::empty(changes.torrents);
+        },
+        5000));
+    auto cursor = changes.cursor;
+    changes = torrent_get_since(cursor);
+    EXPECT_TRUE(std::empty(changes.torrents));
+    EXPECT_EQ(cursor, changes.cursor);
+
+    // editing the torrent marks it as changed
+    tr_torrentSetDownloadDir(tor, tr_strvPath(sandboxDir(), "elsewhere").c_str());
+    changes = torrent_get_since(cursor);
+    EXPECT_EQ(std::vector<int64_t>{ id }, changes.torrents);
+    EXPECT_LT(cursor, changes.cursor);
+
+    // so does changing its settings with torrent-set
+    auto const settings = std::array<std::string_view, 12>{
+        R"("downloadLimit":100)"sv,
+        R"("downloadLimited":true)"sv,
+        R"("honorsSessionLimits":false)"sv,
+        R"("seedRatioMode":1)"sv,
+        R"("seedRatioLimit":2.5)"sv,
+        R"("seedIdleMode":1)"sv,
+        R"("seedIdleLimit":45)"sv,
+        R"("bandwidthPriority":1)"sv,
+        R"("peer-limit":12)"sv,
+        R"("labels":["foo"])"sv,
+        R"("priority-high":[0])"sv,
+        R"("files-unwanted":[1])"sv,
+    };
+    for (auto const& setting : settings)
+    {
+        cursor = changes.cursor;
+        auto const json = R"({"method":"torrent-set","arguments":{"ids":[)" + std::to_string(id) + "]," +
+            std::string{ setting } + "}}";
+        auto request = tr_variant{};
+        EXPECT_TRUE(tr_variantFromBuf(&request, TR_VARIANT_PARSE_JSON, json));
+        tr_rpc_request_exec_json(
+            session_,
+            &request,
+            [](tr_session* /*session*/, tr_variant* /*response*/, void* /*user_data*/) noexcept {},
+            nullptr);
+        tr_variantFree(&request);
+
+        changes = torrent_get_since(cursor);
+        EXPECT_EQ(std::vector<int64_t>{ id }, changes.torrents) << setting;
+        EXPECT_LT(cursor, changes.cursor) << setting;
+    }
+
+    // removing it shows up in `removed`
+    cursor = changes.cursor;
+    tr_torrentRemove(tor, false, nullptr);
+    EXPECT_TRUE(waitFor([&]() { return !std::empty(torrent_get_since(cursor).removed); }, 5000));
+    changes = torrent_get_since(cursor);
+    EXPECT_TRUE(std::empty(changes.torrents));
+    EXPECT_EQ(std::vector<int64_t>{ id }, changes.removed);
+}
+
 } // namespace test
 
 } // namespace libtransmission
@@ -6,6 +6,8 @@
 #include "transmission.h"
 #include "session.h"
 #include "session-id.h"
+#include "torrent-metainfo.h"
+#include "torrent.h"
 #include "utils.h"
 #include "version.h"
 
@@ -289,6 +291,56 @@ TEST_F(SessionTest, sessionId)
     tr_free(const_cast<char*>(session_id_str_1));
 }
 
+TEST_F(SessionTest, loadTorrents)
+{
+    static auto constexpr NumTorrents = 20;
+
+    // a small, valid single-file torrent for each name
+    auto const make_torrent = [](std::string const& name)
+    {
+        return "d4:infod6:lengthi1e4:name"s + std::to_string(std::size(name)) + ":"s + name +
+            "12:piece lengthi16384e6:pieces20:"s + std::string(20, 'x') + "ee"s;
+    };
+
+    for (int i = 0; i < NumTorrents; ++i)
+    {
+        auto const name = "file-"s + std::to_string(i);
+        auto const benc = make_torrent(name);
+        createFileWithContents(tr_strvPath(session_->torrent_dir, name + ".torrent"), std::data(benc), std::size(benc));
+    }
+
+    // this should be skipped
+    createFileWithContents(tr_strvPath(session_->torrent_dir, "garbage.torrent"), "this is not a torrent");
+
+    // give one of them a resume file
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parseBenc(make_torrent("file-7")));
+    auto const resume = "d6:labelsl5:helloee"sv;
+    createFileWithContents(metainfo.resumeFile(session_->resume_dir), std::data(resume), std::size(resume));
+
+    auto* const ctor = tr_ctorNew(session_);
+    tr_ctorSetPaused(ctor, TR_FORCE, true);
+    auto n = int{};
+    auto** const torrents = tr_sessionLoadTorrents(session_, ctor, &n);
+    tr_ctorFree(ctor);
+
+    EXPECT_EQ(NumTorrents, n);
+    EXPECT_EQ(size_t{ NumTorrents }, std::size(session_->torrents));
+
+    auto n_labeled = int{};
+    for (int i = 0; i < n; ++i)
+    {
+        if (torrents[i]->labels.count("hello") != 0)
+        {
+            ++n_labeled;
+            EXPECT_EQ("file-7"sv, tr_torrentName(torrents[i]));
+        }
+    }
+    EXPECT_EQ(1, n_labeled);
+
+    tr_free(torrents);
+}
+
 } // namespace test
 
 } // namespace libtransmission
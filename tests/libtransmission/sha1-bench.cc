@@ -0,0 +1,127 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h"
+#include "crypto-utils.h"
+#include "sha1.h"
+
+#include "gtest/gtest.h"
+
+class Sha1Bench : public ::testing::Test
+{
+protected:
+    static auto constexpr PieceSize = size_t{ 1024 * 1024 };
+    static auto constexpr PieceCount = size_t{ 64 };
+
+    void SetUp() override
+    {
+        default_impl_ = tr_sha1_get_impl();
+
+        pieces_.resize(PieceCount);
+        for (auto& piece : pieces_)
+        {
+            piece.resize(PieceSize);
+            tr_rand_buffer(std::data(piece), std::size(piece));
+        }
+    }
+
+    void TearDown() override
+    {
+        tr_sha1_set_impl(default_impl_);
+    }
+
+    template<typename Func>
+    static std::chrono::nanoseconds time(Func&& func)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::steady_clock::now() - begin;
+    }
+
+    static void report(char const* name, std::chrono::nanoseconds elapsed, uint64_t n_bytes)
+    {
+        auto const seconds = std::chrono::duration<double>(elapsed).count();
+        std::cout << "    " << name << ": " << double(n_bytes) / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+    }
+
+    std::vector<std::string> pieces_;
+    tr_sha1_impl default_impl_ = tr_sha1_impl::Generic;
+};
+
+TEST_F(Sha1Bench, throughput)
+{
+    static auto constexpr NumPasses = size_t{ 4 };
+    auto const n_bytes = uint64_t{ PieceSize } * PieceCount * NumPasses;
+
+    // the crypto library, one piece at a time
+    auto elapsed = time(
+        [this]()
+        {
+            for (size_t pass = 0; pass < NumPasses; ++pass)
+            {
+                for (auto const& piece : pieces_)
+                {
+                    auto* const ctx = tr_sha1_lib_init();
+                    tr_sha1_lib_update(ctx, std::data(piece), std::size(piece));
+                    tr_sha1_lib_final(ctx);
+                    tr_sha1_lib_free(ctx);
+                }
+            }
+        });
+    report("crypto library", elapsed, n_bytes);
+
+    auto const views = std::vector<std::string_view>(std::begin(pieces_), std::end(pieces_));
+    auto digests = std::vector<tr_sha1_digest_t>(std::size(views));
+
+    for (auto const impl : { tr_sha1_impl::Generic, tr_sha1_impl::Avx2, tr_sha1_impl::ShaNi })
+    {
+        if (!tr_sha1_set_impl(impl))
+        {
+            std::cout << "    " << tr_sha1_impl_name(impl) << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+
+        auto const name = std::string{ tr_sha1_impl_name(impl) };
+
+        // tr_sha1_state directly, one piece at a time
+        elapsed = time(
+            [this]()
+            {
+                for (size_t pass = 0; pass < NumPasses; ++pass)
+                {
+                    for (auto const& piece : pieces_)
+                    {
+                        auto state = tr_sha1_state{};
+                        tr_sha1_state_init(state);
+                        tr_sha1_state_update(state, std::data(piece), std::size(piece));
+                        (void)tr_sha1_state_final(state);
+                    }
+                }
+            });
+        report((name + ", tr_sha1_state").c_str(), elapsed, n_bytes);
+
+        elapsed = time(
+            [&views, &digests]()
+            {
+                for (size_t pass = 0; pass < NumPasses; ++pass)
+                {
+                    tr_sha1_many(std::data(views), std::size(views), std::data(digests));
+                }
+            });
+        report((name + ", tr_sha1_many").c_str(), elapsed, n_bytes);
+
+        for (size_t i = 0; i < std::size(views); ++i)
+        {
+            EXPECT_EQ(*tr_sha1(views[i]), digests[i]);
+        }
+    }
+}
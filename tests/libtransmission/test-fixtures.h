@@ -8,10 +8,14 @@
 #include <chrono>
 #include <cstdlib> // getenv()
 #include <cstring> // strlen()
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex> // std::once_flag()
 #include <string>
+#include <string_view>
 #include <thread>
+#include <utility>
 
 #include "crypto-utils.h" // tr_base64_decode()
 #include "error.h"
@@ -446,6 +450,37 @@ protected:
             4000));
     }
 
+    // a single-file torrent whose piece hashes are all zeroes,
+    // for tests that never check its pieces
+    tr_torrent* syntheticTorrentInit(std::string_view name, uint64_t piece_size, uint64_t piece_count) const
+    {
+        auto benc = std::string{ "d4:infod6:lengthi" } + std::to_string(piece_size * piece_count) + "e4:name" +
+            std::to_string(std::size(name)) + ':' + std::string{ name } + "12:piece lengthi" + std::to_string(piece_size) +
+            "e6:pieces" + std::to_string(piece_count * 20) + ':' + std::string(piece_count * 20, '\0') + "ee";
+
+        auto* ctor = tr_ctorNew(session_);
+        tr_error* error = nullptr;
+        EXPECT_TRUE(tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), &error));
+        EXPECT_EQ(nullptr, error);
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        auto* const tor = tr_torrentNew(ctor, nullptr);
+        EXPECT_NE(nullptr, tor);
+        tr_ctorFree(ctor);
+        return tor;
+    }
+
+    // run `func` in the libtransmission thread and wait for it to finish
+    void runInEventThread(std::function<void()> func)
+    {
+        auto task = std::packaged_task<void()>{ std::move(func) };
+        auto future = task.get_future();
+        tr_runInEventThread(
+            session_,
+            [](void* vtask) { (*static_cast<std::packaged_task<void()>*>(vtask))(); },
+            &task);
+        future.get();
+    }
+
     tr_session* session_ = nullptr;
 
     tr_variant* settings()
@@ -0,0 +1,141 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "transmission.h"
+
+#include "net.h"
+#include "tr-udp.h"
+#include "utils.h" // tr_net_init()
+
+#include "gtest/gtest.h"
+
+class UdpTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ::testing::Test::SetUp();
+
+        tr_net_init();
+
+        // two UDP sockets on loopback, one to send and one to receive
+        for (auto* sock : { &sender_, &receiver_ })
+        {
+            *sock = socket(AF_INET, SOCK_DGRAM, 0);
+            ASSERT_NE(TR_BAD_SOCKET, *sock);
+
+            auto sin = sockaddr_in{};
+            sin.sin_family = AF_INET;
+            sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            ASSERT_EQ(0, bind(*sock, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)));
+        }
+
+        auto len = socklen_t{ sizeof(receiver_addr_) };
+        ASSERT_EQ(0, getsockname(receiver_, reinterpret_cast<sockaddr*>(&receiver_addr_), &len));
+    }
+
+    void TearDown() override
+    {
+        tr_netCloseSocket(sender_);
+        tr_netCloseSocket(receiver_);
+
+        ::testing::Test::TearDown();
+    }
+
+    bool push(tr_udp_send_queue& queue, std::string const& payload) const
+    {
+        return queue.push(
+            sender_,
+            std::data(payload),
+            std::size(payload),
+            reinterpret_cast<sockaddr const*>(&receiver_addr_),
+            sizeof(receiver_addr_));
+    }
+
+    tr_socket_t sender_ = TR_BAD_SOCKET;
+    tr_socket_t receiver_ = TR_BAD_SOCKET;
+    sockaddr_in receiver_addr_ = {};
+};
+
+TEST_F(UdpTest, sendsAndReceivesInBatches)
+{
+    static auto constexpr NumPackets = size_t{ 10 };
+
+    auto sent = std::vector<std::string>{};
+    auto queue = tr_udp_send_queue{};
+    for (size_t i = 0; i < NumPackets; ++i)
+    {
+        EXPECT_TRUE(push(queue, sent.emplace_back("packet " + std::to_string(i))));
+    }
+    EXPECT_EQ(NumPackets, std::size(queue));
+
+    auto stats = tr_udp_stats{};
+    queue.flush(stats);
+    EXPECT_TRUE(std::empty(queue));
+    EXPECT_EQ(NumPackets, stats.packets_sent);
+#ifdef HAVE_SENDMMSG
+    EXPECT_EQ(1U, stats.send_calls);
+#else
+    EXPECT_EQ(NumPackets, stats.send_calls);
+#endif
+
+    auto received = std::vector<std::string>{};
+    auto batch = tr_udp_recv_batch{};
+    while (std::size(received) < NumPackets)
+    {
+        auto const n_read = batch.read(receiver_, stats);
+        ASSERT_NE(0U, n_read);
+
+        for (size_t i = 0; i < n_read; ++i)
+        {
+            auto const& packet = batch[i];
+            EXPECT_EQ('\0', packet.buf[packet.len]);
+            EXPECT_EQ(AF_INET, packet.from.ss_family);
+            received.emplace_back(reinterpret_cast<char const*>(packet.buf), packet.len);
+        }
+    }
+
+    EXPECT_EQ(sent, received);
+    EXPECT_EQ(NumPackets, stats.packets_received);
+#ifdef HAVE_RECVMMSG
+    EXPECT_EQ(1U, stats.receive_calls);
+#else
+    EXPECT_EQ(NumPackets, stats.receive_calls);
+#endif
+}
+
+TEST_F(UdpTest, sendQueueRefusesWhatItCantHold)
+{
+    auto queue = tr_udp_send_queue{};
+
+    // too big
+    EXPECT_FALSE(push(queue, std::string(tr_udp_send_queue::MaxPacketSize + 1, 'x')));
+    EXPECT_TRUE(std::empty(queue));
+
+    // too many
+    while (!queue.full())
+    {
+        EXPECT_TRUE(push(queue, "packet"));
+    }
+    EXPECT_EQ(tr_udp_send_queue::MaxPackets, std::size(queue));
+    EXPECT_FALSE(push(queue, "packet"));
+
+    // flushing makes room again
+    auto stats = tr_udp_stats{};
+    queue.flush(stats);
+    EXPECT_EQ(tr_udp_send_queue::MaxPackets, stats.packets_sent);
+    EXPECT_TRUE(push(queue, "packet"));
+}
@@ -0,0 +1,112 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "transmission.h"
+#include "quark.h"
+#include "variant.h"
+
+#include "gtest/gtest.h"
+
+class VariantBench : public ::testing::Test
+{
+protected:
+    static std::vector<tr_quark> makeKeys(size_t n)
+    {
+        auto keys = std::vector<tr_quark>{};
+        keys.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            keys.push_back(tr_quark_new("variant-bench-key-" + std::to_string(i)));
+        }
+
+        std::shuffle(std::begin(keys), std::end(keys), std::mt19937{ 0 });
+        return keys;
+    }
+
+    // how tr_variantDictFind() looked up keys before dicts had an index
+    static tr_variant* linearFind(tr_variant* dict, tr_quark key)
+    {
+        auto child_key = tr_quark{};
+        tr_variant* child = nullptr;
+        for (size_t i = 0; tr_variantDictChild(dict, i, &child_key, &child); ++i)
+        {
+            if (child_key == key)
+            {
+                return child;
+            }
+        }
+
+        return nullptr;
+    }
+
+    template<typename Func>
+    static std::chrono::nanoseconds time(Func&& func)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::steady_clock::now() - begin;
+    }
+
+    static void report(char const* name, size_t n_keys, std::chrono::nanoseconds elapsed, size_t n_ops)
+    {
+        std::cout << "    " << name << " (" << n_keys << " keys): " << double(elapsed.count()) / double(n_ops) << " ns/op"
+                  << std::endl;
+    }
+};
+
+TEST_F(VariantBench, dictFind)
+{
+    static auto constexpr NumLookups = size_t{ 1000000 };
+
+    for (size_t const n_keys : { 4, 8, 16, 32, 64, 256, 1024, 4096 })
+    {
+        auto const keys = makeKeys(n_keys);
+
+        // building a dict with tr_variantDictAddInt() searches it once per key
+        auto dict = tr_variant{};
+        auto elapsed = time(
+            [&]()
+            {
+                tr_variantInitDict(&dict, 0);
+                for (size_t i = 0; i < n_keys; ++i)
+                {
+                    tr_variantDictAddInt(&dict, keys[i], i);
+                }
+            });
+        report("build", n_keys, elapsed, n_keys);
+
+        auto n_found = size_t{};
+        elapsed = time(
+            [&]()
+            {
+                for (size_t i = 0; i < NumLookups; ++i)
+                {
+                    n_found += linearFind(&dict, keys[i % n_keys]) != nullptr ? 1 : 0;
+                }
+            });
+        report("find, linear scan", n_keys, elapsed, NumLookups);
+
+        elapsed = time(
+            [&]()
+            {
+                for (size_t i = 0; i < NumLookups; ++i)
+                {
+                    n_found += tr_variantDictFind(&dict, keys[i % n_keys]) != nullptr ? 1 : 0;
+                }
+            });
+        report("find, tr_variantDictFind", n_keys, elapsed, NumLookups);
+
+        EXPECT_EQ(NumLookups * 2, n_found);
+        tr_variantFree(&dict);
+    }
+}
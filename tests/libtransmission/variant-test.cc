@@ -17,6 +17,8 @@
 #include <array>
 #include <cmath> // lrint()
 #include <cctype> // isspace()
+#include <map>
+#include <random>
 #include <string>
 #include <string_view>
 
@@ -536,3 +538,78 @@ TEST_F(VariantTest, dictFindType)
 
     tr_variantFree(&top);
 }
+
+TEST_F(VariantTest, bigDictFindAddRemove)
+{
+    // enough keys for the dict to get a hash index
+    static auto constexpr NumKeys = tr_quark{ 300 };
+
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 0);
+    auto expected = std::map<tr_quark, int64_t>{};
+
+    auto rng = std::mt19937{ 0 };
+    auto pick = std::uniform_int_distribution<tr_quark>{ 1, NumKeys };
+
+    for (int64_t i = 0; i < 5000; ++i)
+    {
+        auto const key = pick(rng);
+
+        if (i % 3 == 0)
+        {
+            EXPECT_EQ(expected.erase(key) != 0, tr_variantDictRemove(&top, key));
+        }
+        else
+        {
+            tr_variantDictAddInt(&top, key, i);
+            expected[key] = i;
+        }
+
+        if (i % 100 == 0)
+        {
+            for (tr_quark k = 1; k <= NumKeys; ++k)
+            {
+                auto val = int64_t{};
+                auto const it = expected.find(k);
+                EXPECT_EQ(it != std::end(expected), tr_variantDictFindInt(&top, k, &val));
+                if (it != std::end(expected))
+                {
+                    EXPECT_EQ(it->second, val);
+                }
+            }
+        }
+    }
+
+    EXPECT_EQ(std::size(expected), top.val.l.count);
+    tr_variantFree(&top);
+}
+
+TEST_F(VariantTest, bigDictWithDuplicateKeys)
+{
+    // parsers append keys without checking for duplicates,
+    // so make sure lookups still find the first one
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 0);
+    for (tr_quark key = 1; key <= 64; ++key)
+    {
+        tr_variantInitInt(tr_variantDictAdd(&top, key), key);
+    }
+
+    tr_variantInitInt(tr_variantDictAdd(&top, 7), 1000);
+
+    auto val = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(&top, 7, &val));
+    EXPECT_EQ(7, val);
+
+    // removing the first one exposes the second
+    EXPECT_TRUE(tr_variantDictRemove(&top, 7));
+    EXPECT_TRUE(tr_variantDictFindInt(&top, 7, &val));
+    EXPECT_EQ(1000, val);
+    EXPECT_TRUE(tr_variantDictFindInt(&top, 64, &val));
+    EXPECT_EQ(64, val);
+
+    EXPECT_TRUE(tr_variantDictRemove(&top, 7));
+    EXPECT_FALSE(tr_variantDictFindInt(&top, 7, &val));
+
+    tr_variantFree(&top);
+}
@@ -0,0 +1,143 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0), GPLv3 (SPDX: GPL-3.0),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "transmission.h"
+
+#include "file.h"
+#include "session.h"
+#include "torrent.h"
+#include "utils.h"
+#include "verify.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class VerifyTest : public SessionTest
+{
+protected:
+    static std::vector<bool> havePieces(tr_torrent const* tor)
+    {
+        auto ret = std::vector<bool>{};
+        for (tr_piece_index_t piece = 0, n = tor->pieceCount(); piece < n; ++piece)
+        {
+            ret.push_back(tor->hasPiece(piece));
+        }
+        return ret;
+    }
+
+    // overwrite the first byte of `piece` so that it fails its checksum
+    static void corruptPiece(tr_torrent const* tor, tr_piece_index_t piece)
+    {
+        auto const path = makeString(tr_torrentFindFile(tor, 0));
+        auto const fd = tr_sys_file_open(path.c_str(), TR_SYS_FILE_WRITE, 0, nullptr);
+        ASSERT_NE(TR_BAD_SYS_FILE, fd);
+        EXPECT_TRUE(tr_sys_file_write_at(fd, "\1", 1, uint64_t{ piece } * tor->pieceSize(), nullptr, nullptr));
+        tr_sys_file_close(fd, nullptr);
+    }
+};
+
+TEST_F(VerifyTest, threadsGiveSameResultAsOneThread)
+{
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, false);
+    corruptPiece(tor, 5);
+    corruptPiece(tor, 17);
+
+    session_->verifyThreads = 1;
+    blockingTorrentVerify(tor);
+    auto const expected = havePieces(tor);
+    EXPECT_FALSE(expected[0]);
+    EXPECT_FALSE(expected[5]);
+    EXPECT_FALSE(expected[17]);
+    EXPECT_EQ(ptrdiff_t(tor->pieceCount()) - 3, std::count(std::begin(expected), std::end(expected), true));
+
+    for (auto const n_threads : { 2, 4, 8 })
+    {
+        session_->verifyThreads = n_threads;
+        blockingTorrentVerify(tor);
+        EXPECT_EQ(expected, havePieces(tor)) << n_threads;
+        EXPECT_TRUE(tor->checked_pieces_.hasAll()) << n_threads;
+    }
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST(VerifyThrottleTest, pacesReadsToTheLimit)
+{
+    // 1000 bytes per second, starting at t=5000
+    auto throttle = tr_verify_throttle{ 1000, 5000 };
+
+    // reading 500 bytes instantly means waiting out the rest of 500 msec
+    EXPECT_EQ(500U, throttle.add(500, 5000));
+
+    // a read that took as long as the limit allows needs no wait
+    EXPECT_EQ(0U, throttle.add(500, 6000));
+
+    // a slow read earns no credit beyond what was read
+    EXPECT_EQ(0U, throttle.add(1000, 9000));
+    EXPECT_EQ(0U, throttle.add(1000, 9000));
+    EXPECT_EQ(1000U, throttle.add(2000, 9000));
+    EXPECT_EQ(5000U, throttle.bytesRead());
+
+    // no limit, no waiting
+    auto unlimited = tr_verify_throttle{ 0, 5000 };
+    EXPECT_EQ(0U, unlimited.add(1000000, 5000));
+    EXPECT_EQ(1000000U, unlimited.bytesRead());
+}
+
+// asks for far more verify threads than there are cores
+class VerifyThreadsTest : public VerifyTest
+{
+protected:
+    static auto constexpr TooManyThreads = int{ 100000 };
+
+    void SetUp() override
+    {
+        tr_variantDictAddInt(settings(), TR_KEY_verify_threads, TooManyThreads);
+        VerifyTest::SetUp();
+    }
+};
+
+TEST_F(VerifyThreadsTest, clampedToCoresWhenUsed)
+{
+    // the setting is kept as given...
+    EXPECT_EQ(TooManyThreads, session_->verifyThreads);
+
+    // ...but no more threads than cores are used
+    auto const n_cores = size_t{ std::max(std::thread::hardware_concurrency(), 1U) };
+    EXPECT_LE(1U, tr_verifyThreadCount(session_));
+    EXPECT_GE(n_cores, tr_verifyThreadCount(session_));
+
+    // and verifying with the clamped count still finds the bad pieces
+    auto* const tor = zeroTorrentInit();
+    ASSERT_NE(nullptr, tor);
+    zeroTorrentPopulate(tor, false);
+    corruptPiece(tor, 9);
+    blockingTorrentVerify(tor);
+
+    auto const have = havePieces(tor);
+    EXPECT_FALSE(have[0]);
+    EXPECT_FALSE(have[9]);
+    EXPECT_EQ(ptrdiff_t(tor->pieceCount()) - 2, std::count(std::begin(have), std::end(have), true));
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
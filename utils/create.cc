@@ -3,6 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <array>
 #include <cinttypes>
 #include <cstdio>
@@ -31,7 +32,7 @@ char constexpr Usage[] = "Usage: transmission-create [options] <file|directory>"
 
 uint32_t constexpr KiB = 1024;
 
-auto constexpr Options = std::array<tr_option, 9>{
+auto constexpr Options = std::array<tr_option, 10>{
     { { 'p', "private", "Allow this torrent to only be used with the specified tracker(s)", "p", false, nullptr },
       { 'r', "source", "Set the source for private trackers", "r", true, "<source>" },
       { 'o', "outfile", "Save the generated .torrent to this filename", "o", true, "<file>" },
@@ -39,6 +40,7 @@ auto constexpr Options = std::array<tr_option, 9>{
       { 'c', "comment", "Add a comment", "c", true, "<comment>" },
       { 't', "tracker", "Add a tracker's announce URL", "t", true, "<url>" },
       { 'w', "webseed", "Add a webseed URL", "w", true, "<url>" },
+      { 'T', "threads", "Set how many threads hash the pieces, overriding the default of one per CPU core", "T", true, "<n>" },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
 };
@@ -52,6 +54,7 @@ struct app_options
     char const* infile = nullptr;
     char const* source = nullptr;
     uint32_t piecesize_kib = 0;
+    uint32_t threads = 0;
     bool is_private = false;
     bool show_version = false;
 };
@@ -107,6 +110,17 @@ int parseCommandLine(app_options& options, int argc, char const* const* argv)
             options.source = optarg;
             break;
 
+        case 'T':
+            options.threads = strtoul(optarg, nullptr, 10);
+
+            if (options.threads == 0)
+            {
+                fprintf(stderr, "ERROR: --threads needs a number greater than zero\n");
+                return 1;
+            }
+
+            break;
+
         case TR_OPT_UNK:
             options.infile = optarg;
             break;
@@ -213,6 +227,8 @@ int tr_main(int argc, char* argv[])
         tr_metaInfoBuilderSetPieceSize(b, options.piecesize_kib * KiB);
     }
 
+    b->hashThreads = options.threads;
+
     printf(
         b->fileCount > 1 ? " %" PRIu32 " files, %s\n" : " %" PRIu32 " file, %s\n",
         b->fileCount,
@@ -234,6 +250,7 @@ int tr_main(int argc, char* argv[])
         options.source);
 
     uint32_t last = UINT32_MAX;
+    auto last_msec = tr_time_msec();
     while (!b->isDone)
     {
         tr_wait_msec(500);
@@ -241,10 +258,19 @@ int tr_main(int argc, char* argv[])
         uint32_t current = b->pieceIndex;
         if (current != last)
         {
-            printf("\rPiece %" PRIu32 "/%" PRIu32 " ...", current, b->pieceCount);
+            auto const now_msec = tr_time_msec();
+            auto const n_pieces = last == UINT32_MAX ? current : current - last;
+            auto const bytes_per_second = double(n_pieces) * b->pieceSize * 1000 / std::max(now_msec - last_msec, uint64_t{ 1 });
+
+            printf(
+                "\rPiece %" PRIu32 "/%" PRIu32 " (%s) ...   ",
+                current,
+                b->pieceCount,
+                tr_formatter_speed_KBps(bytes_per_second / SpeedK).c_str());
             fflush(stdout);
 
             last = current;
+            last_msec = now_msec;
         }
     }
 